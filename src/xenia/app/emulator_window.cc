@@ -307,8 +307,9 @@ void EmulatorWindow::FileOpen() {
   file_picker->set_multi_selection(false);
   file_picker->set_title("Select Content Package");
   file_picker->set_extensions({
-      {"Supported Files", "*.iso;*.xex;*.xcp;*.*"},
+      {"Supported Files", "*.iso;*.xcdi;*.xex;*.xcp;*.*"},
       {"Disc Image (*.iso)", "*.iso"},
+      {"Compressed Disc Image (*.xcdi)", "*.xcdi"},
       {"Xbox Executable (*.xex)", "*.xex"},
       //{"Content Package (*.xcp)", "*.xcp" },
       {"All Files (*.*)", "*.*"},
@@ -23,6 +23,17 @@ class AudioDriver {
 
   virtual void SubmitFrame(uint32_t samples_ptr) = 0;
 
+  struct PlaybackPosition {
+    // Frames played by the device since the driver was created.
+    uint64_t played_frames;
+    // Queue depth the driver wants the client to keep, 0 if it doesn't care.
+    uint32_t target_queued_frames;
+  };
+  // Returns false if the driver can't tell how far the playback is.
+  virtual bool GetPlaybackPosition(PlaybackPosition& position_out) const {
+    return false;
+  }
+
  protected:
   inline uint8_t* TranslatePhysical(uint32_t guest_address) const {
     return memory_->TranslatePhysical(guest_address);
@@ -13,6 +13,7 @@
 #include "xenia/apu/audio_driver.h"
 #include "xenia/apu/xma_decoder.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -33,6 +34,12 @@
 // and let the normal AudioSystem handling take it, to prevent duplicate
 // implementations. They can be found in xboxkrnl_audio_xma.cc
 
+DEFINE_int32(audio_client_lead_frames, 2,
+             "Number of 256-sample frames the audio clients are scheduled "
+             "ahead of the audio device, if the audio backend has no "
+             "preference.",
+             "APU");
+
 namespace xe {
 namespace apu {
 
@@ -45,10 +52,10 @@ AudioSystem::AudioSystem(cpu::Processor* processor)
   for (size_t i = 0; i < kMaximumClientCount; ++i) {
     client_semaphores_[i] =
         xe::threading::Semaphore::Create(0, kMaximumQueuedFrames);
-    wait_handles_[i] = client_semaphores_[i].get();
   }
   shutdown_event_ = xe::threading::Event::CreateAutoResetEvent(false);
-  wait_handles_[kMaximumClientCount] = shutdown_event_.get();
+  frame_ticks_ = Clock::QueryHostTickFrequency() * kFrameSampleCount /
+                 kFrameSampleRate;
 
   xma_decoder_ = std::make_unique<xe::apu::XmaDecoder>(processor_);
 
@@ -77,6 +84,7 @@ X_STATUS AudioSystem::Setup(kernel::KernelState* kernel_state) {
   worker_thread_->set_can_debugger_suspend(true);
   worker_thread_->set_name("Audio Worker");
   worker_thread_->Create();
+  worker_thread_->Isolate(kernel::XHostThread::IsolatedWork::kAudio);
 
   return X_STATUS_SUCCESS;
 }
@@ -85,61 +93,174 @@ void AudioSystem::WorkerThreadMain() {
   // Initialize driver and ringbuffer.
   Initialize();
 
+  const uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+
   // Main run loop.
   while (worker_running_) {
-    // These handles signify the number of submitted samples. Once we reach
-    // 64 samples, we wait until our audio backend releases a semaphore
-    // (signaling a sample has finished playing)
-    auto result =
-        xe::threading::WaitAny(wait_handles_, xe::countof(wait_handles_), true);
-    if (result.first == xe::threading::WaitResult::kFailed) {
-      // TODO: Assert?
+    if (paused_) {
+      pause_fence_.Signal();
+      threading::Wait(resume_event_.get(), false);
+
+      // Don't count the pause as lateness.
+      auto global_lock = global_critical_region_.Acquire();
+      uint64_t resume_ticks = Clock::QueryHostTickCount();
+      for (size_t i = 0; i < kMaximumClientCount; ++i) {
+        clients_[i].next_callback_ticks = resume_ticks;
+      }
+    }
+
+    bool pumped;
+    uint64_t next_callback_ticks = PumpClients(pumped);
+
+    if (!worker_running_) {
+      break;
+    }
+
+    if (pumped) {
+      // The callbacks take time, check the schedule again right away.
       continue;
     }
 
-    if (result.first == threading::WaitResult::kSuccess &&
-        result.second == kMaximumClientCount) {
-      // Shutdown event signaled.
-      if (paused_) {
-        pause_fence_.Signal();
-        threading::Wait(resume_event_.get(), false);
-      }
+    // Sleep until the next callback is due. Waits have millisecond precision,
+    // so yield for the remainder.
+    uint64_t now = Clock::QueryHostTickCount();
+    if (next_callback_ticks <= now) {
+      continue;
+    }
+    uint64_t wait_ms = (next_callback_ticks - now) * 1000 / tick_frequency;
+    if (!wait_ms) {
+      xe::threading::MaybeYield();
+      continue;
+    }
+    // Woken up early for shutdown, pausing or a new client.
+    SCOPE_profile_cpu_i("apu", "Sleep");
+    xe::threading::Wait(shutdown_event_.get(), true,
+                        std::chrono::milliseconds(wait_ms));
+  }
+  worker_running_ = false;
 
+  // TODO(benvanik): call module API to kill?
+}
+
+uint64_t AudioSystem::PumpClients(bool& pumped_out) {
+  pumped_out = false;
+  // Nothing to do - check again later.
+  uint64_t next_callback_ticks =
+      Clock::QueryHostTickCount() + Clock::QueryHostTickFrequency() / 2;
+
+  for (size_t i = 0; i < kMaximumClientCount; ++i) {
+    // Callbacks of the other clients take time.
+    uint64_t now = Clock::QueryHostTickCount();
+    auto global_lock = global_critical_region_.Acquire();
+    auto& client = clients_[i];
+    if (!client.in_use || !client.callback || !client.driver) {
       continue;
     }
 
-    // Number of clients pumped
-    bool pumped = false;
-    if (result.first == xe::threading::WaitResult::kSuccess) {
-      auto index = result.second;
+    auto reschedule = [&](uint64_t ticks) {
+      if (ticks + kMaximumLateFrames * frame_ticks_ < now) {
+        ticks = now;
+        ++client.resync_count;
+      }
+      client.next_callback_ticks = ticks;
+      next_callback_ticks = std::min(next_callback_ticks, ticks);
+    };
 
-      auto global_lock = global_critical_region_.Acquire();
-      uint32_t client_callback = clients_[index].callback;
-      uint32_t client_callback_arg = clients_[index].wrapped_callback_arg;
-      global_lock.unlock();
-
-      if (client_callback) {
-        SCOPE_profile_cpu_i("apu", "xe::apu::AudioSystem->client_callback");
-        uint64_t args[] = {client_callback_arg};
-        processor_->Execute(worker_thread_->thread_state(), client_callback,
-                            args, xe::countof(args));
+    uint64_t scheduled_ticks = client.next_callback_ticks;
+    if (now < scheduled_ticks) {
+      next_callback_ticks = std::min(next_callback_ticks, scheduled_ticks);
+      continue;
+    }
+
+    // Follow the playback position of the device - it may drift from the
+    // host clock, and the client may also fall behind when the emulator is
+    // slow. Drivers that can't report it are driven by their back-pressure
+    // alone.
+    bool behind = true;
+    AudioDriver::PlaybackPosition position;
+    if (client.driver->GetPlaybackPosition(position)) {
+      uint64_t lead_frames = position.target_queued_frames;
+      if (!lead_frames) {
+        lead_frames = uint64_t(std::max(cvars::audio_client_lead_frames, 1));
       }
+      uint64_t queued_frames =
+          client.submitted_frames - std::min(client.submitted_frames,
+                                             position.played_frames);
+      if (queued_frames > lead_frames) {
+        // Ahead of the device, let it play a frame first.
+        reschedule(scheduled_ticks + frame_ticks_);
+        continue;
+      }
+      behind = queued_frames < lead_frames;
+    }
 
-      pumped = true;
+    // Drivers limit the number of frames in flight.
+    if (xe::threading::Wait(client_semaphores_[i].get(), false,
+                            std::chrono::milliseconds(0)) !=
+        xe::threading::WaitResult::kSuccess) {
+      reschedule(now + frame_ticks_ / 4);
+      continue;
     }
 
-    if (!worker_running_) {
-      break;
+    uint32_t client_callback = client.callback;
+    uint32_t client_callback_arg = client.wrapped_callback_arg;
+    global_lock.unlock();
+
+    {
+      SCOPE_profile_cpu_i("apu", "xe::apu::AudioSystem->client_callback");
+      uint64_t args[] = {client_callback_arg};
+      processor_->Execute(worker_thread_->thread_state(), client_callback,
+                          args, xe::countof(args));
     }
+    pumped_out = true;
 
-    if (!pumped) {
-      SCOPE_profile_cpu_i("apu", "Sleep");
-      xe::threading::Sleep(std::chrono::milliseconds(500));
+    global_lock.lock();
+    if (!client.in_use || client.callback != client_callback) {
+      // Unregistered by the callback.
+      continue;
     }
+    uint64_t jitter_ticks = now - scheduled_ticks;
+    ++client.callback_count;
+    client.jitter_ticks_sum += jitter_ticks;
+    client.jitter_ticks_max = std::max(client.jitter_ticks_max, jitter_ticks);
+    // Catch up with the device right away if behind, otherwise keep the
+    // schedule.
+    reschedule(behind ? now : scheduled_ticks + frame_ticks_);
   }
-  worker_running_ = false;
 
-  // TODO(benvanik): call module API to kill?
+  return next_callback_ticks;
+}
+
+bool AudioSystem::GetClientTimingStatistics(
+    size_t index, ClientTimingStatistics& statistics_out) const {
+  auto global_lock = global_critical_region::AcquireDirect();
+  if (index >= kMaximumClientCount || !clients_[index].in_use) {
+    return false;
+  }
+  auto& client = clients_[index];
+  uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+  statistics_out.callback_count = client.callback_count;
+  statistics_out.mean_jitter_us =
+      client.callback_count ? client.jitter_ticks_sum * 1000000 /
+                                  tick_frequency / client.callback_count
+                            : 0;
+  statistics_out.max_jitter_us =
+      client.jitter_ticks_max * 1000000 / tick_frequency;
+  statistics_out.resync_count = client.resync_count;
+  return true;
+}
+
+void AudioSystem::LogClientTimingStatistics(size_t index) const {
+  ClientTimingStatistics statistics;
+  if (!GetClientTimingStatistics(index, statistics) ||
+      !statistics.callback_count) {
+    return;
+  }
+  XELOGI(
+      "AudioSystem: Client {} - {} callbacks, jitter {} us mean, {} us max, "
+      "{} resyncs",
+      index, statistics.callback_count, statistics.mean_jitter_us,
+      statistics.max_jitter_us, statistics.resync_count);
 }
 
 int AudioSystem::FindFreeClient() {
@@ -162,6 +283,9 @@ void AudioSystem::Shutdown() {
     worker_thread_->Wait(0, 0, 0, nullptr);
     worker_thread_.reset();
   }
+  for (size_t i = 0; i < kMaximumClientCount; ++i) {
+    LogClientTimingStatistics(i);
+  }
 }
 
 X_STATUS AudioSystem::RegisterClient(uint32_t callback, uint32_t callback_arg,
@@ -186,6 +310,8 @@ X_STATUS AudioSystem::RegisterClient(uint32_t callback, uint32_t callback_arg,
   xe::store_and_swap<uint32_t>(memory()->TranslateVirtual(ptr), callback_arg);
 
   clients_[index] = {driver, callback, callback_arg, ptr, true};
+  clients_[index].next_callback_ticks = Clock::QueryHostTickCount();
+  shutdown_event_->Set();
 
   if (out_index) {
     *out_index = index;
@@ -201,6 +327,7 @@ void AudioSystem::SubmitFrame(size_t index, uint32_t samples_ptr) {
   assert_true(index < kMaximumClientCount);
   assert_true(clients_[index].driver != NULL);
   (clients_[index].driver)->SubmitFrame(samples_ptr);
+  ++clients_[index].submitted_frames;
 }
 
 void AudioSystem::UnregisterClient(size_t index) {
@@ -208,6 +335,7 @@ void AudioSystem::UnregisterClient(size_t index) {
 
   auto global_lock = global_critical_region_.Acquire();
   assert_true(index < kMaximumClientCount);
+  LogClientTimingStatistics(index);
   DestroyDriver(clients_[index].driver);
   memory()->SystemHeapFree(clients_[index].wrapped_callback_arg);
   clients_[index] = {0};
@@ -289,6 +417,7 @@ bool AudioSystem::Restore(ByteStream* stream) {
     }
 
     assert_not_null(driver);
+    client.next_callback_ticks = Clock::QueryHostTickCount();
     client.driver = driver;
   }
 
@@ -45,6 +45,17 @@ class AudioSystem {
   bool Save(ByteStream* stream);
   bool Restore(ByteStream* stream);
 
+  struct ClientTimingStatistics {
+    uint64_t callback_count;
+    // Lateness of the callbacks relative to their scheduled time.
+    uint64_t mean_jitter_us;
+    uint64_t max_jitter_us;
+    // Times the client fell too far behind and was rescheduled.
+    uint64_t resync_count;
+  };
+  bool GetClientTimingStatistics(size_t index,
+                                 ClientTimingStatistics& statistics_out) const;
+
   bool is_paused() const { return paused_; }
   void Pause();
   void Resume();
@@ -55,6 +66,10 @@ class AudioSystem {
   virtual void Initialize();
 
   void WorkerThreadMain();
+  // Runs the callbacks of the clients that are due, returns the host tick
+  // count of the next scheduled callback.
+  uint64_t PumpClients(bool& pumped_out);
+  void LogClientTimingStatistics(size_t index) const;
 
   virtual X_STATUS CreateDriver(size_t index,
                                 xe::threading::Semaphore* semaphore,
@@ -64,6 +79,13 @@ class AudioSystem {
   // TODO(gibbed): respect XAUDIO2_MAX_QUEUED_BUFFERS somehow (ie min(64,
   // XAUDIO2_MAX_QUEUED_BUFFERS))
   static const size_t kMaximumQueuedFrames = 64;
+  // Guest audio frames are 256 samples at 48 kHz, the clients are scheduled
+  // with this period.
+  static const uint32_t kFrameSampleCount = 256;
+  static const uint32_t kFrameSampleRate = 48000;
+  // Clients more than this many frames behind their schedule are rescheduled
+  // from the current time rather than catching up with a burst of callbacks.
+  static const uint32_t kMaximumLateFrames = 4;
 
   Memory* memory_ = nullptr;
   cpu::Processor* processor_ = nullptr;
@@ -80,15 +102,25 @@ class AudioSystem {
     uint32_t callback_arg;
     uint32_t wrapped_callback_arg;
     bool in_use;
+    // Host tick count of the next callback.
+    uint64_t next_callback_ticks;
+    uint64_t submitted_frames;
+    uint64_t callback_count;
+    uint64_t jitter_ticks_sum;
+    uint64_t jitter_ticks_max;
+    uint64_t resync_count;
   } clients_[kMaximumClientCount];
 
   int FindFreeClient();
 
+  // Released by the drivers for each frame the client may submit. The
+  // callbacks are scheduled on the host clock, these only limit how far ahead
+  // the clients can get.
   std::unique_ptr<xe::threading::Semaphore>
       client_semaphores_[kMaximumClientCount];
-  // Event is always there in case we have no clients.
+  // Wakes the worker up for shutdown, pausing and new clients.
   std::unique_ptr<xe::threading::Event> shutdown_event_;
-  xe::threading::WaitHandle* wait_handles_[kMaximumClientCount + 1];
+  uint64_t frame_ticks_ = 0;
 
   bool paused_ = false;
   threading::Fence pause_fence_;
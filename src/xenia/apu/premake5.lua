@@ -17,3 +17,30 @@ project("xenia-apu")
     project_root.."/third_party/libav/",
   })
   local_platform_files()
+
+include("testing")
+
+group("src")
+project("xenia-apu-xma-bench")
+  uuid("c671e84b-d207-4624-acda-f5805b45b13e")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "libavcodec",
+    "libavutil",
+    "xenia-apu",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xxhash",
+  })
+  defines({
+  })
+  includedirs({
+    project_root.."/third_party/libav/",
+  })
+  files({
+    "xma_bench_main.cc",
+    "../base/main_"..platform_suffix..".cc",
+  })
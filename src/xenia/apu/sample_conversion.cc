@@ -0,0 +1,417 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/sample_conversion.h"
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64
+#include "third_party/xbyak/xbyak/xbyak_util.h"
+
+// The whole emulator is built for AVX, so only wider instruction sets need to
+// be enabled per function and selected at runtime.
+#if XE_COMPILER_MSVC
+#define XE_APU_TARGET_AVX2
+#else
+#define XE_APU_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif  // XE_ARCH_AMD64
+
+namespace xe {
+namespace apu {
+namespace sample_conversion {
+
+namespace {
+
+constexpr float kS16Scale = float((1 << 15) - 1);
+// -3 dB for the center and the surround channels, like ITU-R BS.775.
+constexpr float kDownmixScale = 0.70710678f;
+
+// Scalar implementations, also used for the tails of the SIMD loops.
+
+inline uint16_t FloatToS16BE(float sample) {
+  int value = static_cast<int>(xe::saturate(sample) * kS16Scale);
+  return xe::byte_swap(uint16_t(value));
+}
+
+void PlanarFloatToInterleavedS16BERange(const float* const* channels,
+                                        uint32_t channel_count,
+                                        uint32_t sample_first,
+                                        uint32_t sample_count,
+                                        uint16_t* output) {
+  output += sample_first * channel_count;
+  for (uint32_t i = sample_first; i < sample_count; ++i) {
+    for (uint32_t j = 0; j < channel_count; ++j) {
+      *(output++) = FloatToS16BE(channels[j][i]);
+    }
+  }
+}
+
+void PlanarFloatBEToInterleavedFloatRange(const float* input,
+                                          uint32_t channel_count,
+                                          uint32_t sample_first,
+                                          uint32_t sample_count,
+                                          float* output) {
+  output += sample_first * channel_count;
+  for (uint32_t i = sample_first; i < sample_count; ++i) {
+    for (uint32_t j = 0; j < channel_count; ++j) {
+      *(output++) = xe::byte_swap(input[j * sample_count + i]);
+    }
+  }
+}
+
+void Downmix51ToStereoRange(const float* input, uint32_t sample_first,
+                            uint32_t sample_count, float* output) {
+  for (uint32_t i = sample_first; i < sample_count; ++i) {
+    const float* source = input + i * 6;
+    float center = source[2] * kDownmixScale;
+    output[i * 2] =
+        xe::saturate(source[0] + center + source[4] * kDownmixScale);
+    output[i * 2 + 1] =
+        xe::saturate(source[1] + center + source[5] * kDownmixScale);
+  }
+}
+
+void PlanarFloatToInterleavedS16BEScalar(const float* const* channels,
+                                         uint32_t channel_count,
+                                         uint32_t sample_count,
+                                         uint16_t* output) {
+  PlanarFloatToInterleavedS16BERange(channels, channel_count, 0, sample_count,
+                                     output);
+}
+
+void PlanarFloatBEToInterleavedFloatScalar(const float* input,
+                                           uint32_t channel_count,
+                                           uint32_t sample_count,
+                                           float* output) {
+  PlanarFloatBEToInterleavedFloatRange(input, channel_count, 0, sample_count,
+                                       output);
+}
+
+void Downmix51ToStereoScalar(const float* input, uint32_t sample_count,
+                             float* output) {
+  Downmix51ToStereoRange(input, 0, sample_count, output);
+}
+
+const Functions kScalarFunctions = {
+    Implementation::kScalar,
+    PlanarFloatToInterleavedS16BEScalar,
+    PlanarFloatBEToInterleavedFloatScalar,
+    Downmix51ToStereoScalar,
+};
+
+#if XE_ARCH_AMD64
+
+// SSE (SSSE3) implementations. Clamping uses min before max with the constant
+// as the second operand so NaN is handled like xe::saturate (becomes 1).
+
+inline __m128 SaturateSSE(__m128 value) {
+  return _mm_max_ps(_mm_min_ps(value, _mm_set1_ps(1.0f)),
+                    _mm_set1_ps(-1.0f));
+}
+
+// Converts 8 samples to host-endian int16.
+inline __m128i LoadS16SSE(const float* source) {
+  const __m128 scale = _mm_set1_ps(kS16Scale);
+  __m128i low = _mm_cvttps_epi32(
+      _mm_mul_ps(SaturateSSE(_mm_loadu_ps(source)), scale));
+  __m128i high = _mm_cvttps_epi32(
+      _mm_mul_ps(SaturateSSE(_mm_loadu_ps(source + 4)), scale));
+  // In range after clamping, so the saturation of packs doesn't matter.
+  return _mm_packs_epi32(low, high);
+}
+
+inline __m128 LoadFloatBESSE(const float* source, __m128i swap_mask) {
+  return _mm_castsi128_ps(_mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)), swap_mask));
+}
+
+void PlanarFloatToInterleavedS16BESSE(const float* const* channels,
+                                      uint32_t channel_count,
+                                      uint32_t sample_count,
+                                      uint16_t* output) {
+  const __m128i swap_mask =
+      _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  uint32_t i = 0;
+  if (channel_count == 1) {
+    for (; i + 8 <= sample_count; i += 8) {
+      __m128i samples = LoadS16SSE(channels[0] + i);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i),
+                       _mm_shuffle_epi8(samples, swap_mask));
+    }
+  } else if (channel_count == 2) {
+    for (; i + 8 <= sample_count; i += 8) {
+      __m128i left = LoadS16SSE(channels[0] + i);
+      __m128i right = LoadS16SSE(channels[1] + i);
+      __m128i* dest = reinterpret_cast<__m128i*>(output + i * 2);
+      _mm_storeu_si128(
+          dest, _mm_shuffle_epi8(_mm_unpacklo_epi16(left, right), swap_mask));
+      _mm_storeu_si128(
+          dest + 1,
+          _mm_shuffle_epi8(_mm_unpackhi_epi16(left, right), swap_mask));
+    }
+  }
+  PlanarFloatToInterleavedS16BERange(channels, channel_count, i, sample_count,
+                                     output);
+}
+
+void PlanarFloatBEToInterleavedFloatSSE(const float* input,
+                                        uint32_t channel_count,
+                                        uint32_t sample_count, float* output) {
+  const __m128i swap_mask =
+      _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  uint32_t i = 0;
+  if (channel_count == 6) {
+    for (; i + 4 <= sample_count; i += 4) {
+      __m128 c0 = LoadFloatBESSE(input + i, swap_mask);
+      __m128 c1 = LoadFloatBESSE(input + sample_count + i, swap_mask);
+      __m128 c2 = LoadFloatBESSE(input + sample_count * 2 + i, swap_mask);
+      __m128 c3 = LoadFloatBESSE(input + sample_count * 3 + i, swap_mask);
+      __m128 c4 = LoadFloatBESSE(input + sample_count * 4 + i, swap_mask);
+      __m128 c5 = LoadFloatBESSE(input + sample_count * 5 + i, swap_mask);
+      // c0...c3 become channels 0-3 of samples 0...3.
+      _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+      // Channels 4-5 of samples 0-1 and 2-3.
+      __m128 c45_01 = _mm_unpacklo_ps(c4, c5);
+      __m128 c45_23 = _mm_unpackhi_ps(c4, c5);
+      float* dest = output + i * 6;
+      _mm_storeu_ps(dest, c0);
+      _mm_storeu_ps(dest + 4, _mm_movelh_ps(c45_01, c1));
+      _mm_storeu_ps(dest + 8,
+                    _mm_shuffle_ps(c1, c45_01, _MM_SHUFFLE(3, 2, 3, 2)));
+      _mm_storeu_ps(dest + 12, c2);
+      _mm_storeu_ps(dest + 16, _mm_movelh_ps(c45_23, c3));
+      _mm_storeu_ps(dest + 20,
+                    _mm_shuffle_ps(c3, c45_23, _MM_SHUFFLE(3, 2, 3, 2)));
+    }
+  } else if (channel_count == 2) {
+    for (; i + 4 <= sample_count; i += 4) {
+      __m128 left = LoadFloatBESSE(input + i, swap_mask);
+      __m128 right = LoadFloatBESSE(input + sample_count + i, swap_mask);
+      _mm_storeu_ps(output + i * 2, _mm_unpacklo_ps(left, right));
+      _mm_storeu_ps(output + i * 2 + 4, _mm_unpackhi_ps(left, right));
+    }
+  }
+  PlanarFloatBEToInterleavedFloatRange(input, channel_count, i, sample_count,
+                                       output);
+}
+
+void Downmix51ToStereoSSE(const float* input, uint32_t sample_count,
+                          float* output) {
+  const __m128 scale = _mm_set1_ps(kDownmixScale);
+  uint32_t i = 0;
+  for (; i + 2 <= sample_count; i += 2) {
+    const float* source = input + i * 6;
+    // FL0 FR0 C0 LFE0 | SL0 SR0 FL1 FR1 | C1 LFE1 SL1 SR1.
+    __m128 v0 = _mm_loadu_ps(source);
+    __m128 v1 = _mm_loadu_ps(source + 4);
+    __m128 v2 = _mm_loadu_ps(source + 8);
+    __m128 front = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 2, 1, 0));
+    __m128 center = _mm_shuffle_ps(v0, v2, _MM_SHUFFLE(0, 0, 2, 2));
+    __m128 surround = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(3, 2, 1, 0));
+    // Same order of operations as the scalar path.
+    __m128 mixed = _mm_add_ps(_mm_add_ps(front, _mm_mul_ps(center, scale)),
+                              _mm_mul_ps(surround, scale));
+    _mm_storeu_ps(output + i * 2, SaturateSSE(mixed));
+  }
+  Downmix51ToStereoRange(input, i, sample_count, output);
+}
+
+const Functions kSSEFunctions = {
+    Implementation::kSSE,
+    PlanarFloatToInterleavedS16BESSE,
+    PlanarFloatBEToInterleavedFloatSSE,
+    Downmix51ToStereoSSE,
+};
+
+// AVX2 implementations. Most 256-bit shuffles work within 128-bit lanes, so
+// the results are regrouped before storing.
+
+XE_APU_TARGET_AVX2 inline __m256 SaturateAVX2(__m256 value) {
+  return _mm256_max_ps(_mm256_min_ps(value, _mm256_set1_ps(1.0f)),
+                       _mm256_set1_ps(-1.0f));
+}
+
+// Converts 16 samples to host-endian int16.
+XE_APU_TARGET_AVX2 inline __m256i LoadS16AVX2(const float* source) {
+  const __m256 scale = _mm256_set1_ps(kS16Scale);
+  __m256i low = _mm256_cvttps_epi32(
+      _mm256_mul_ps(SaturateAVX2(_mm256_loadu_ps(source)), scale));
+  __m256i high = _mm256_cvttps_epi32(
+      _mm256_mul_ps(SaturateAVX2(_mm256_loadu_ps(source + 8)), scale));
+  // 0-3 8-11 | 4-7 12-15 to 0-7 | 8-15.
+  return _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high),
+                                  _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+XE_APU_TARGET_AVX2 inline __m256 LoadFloatBEAVX2(const float* source,
+                                                 __m256i swap_mask) {
+  return _mm256_castsi256_ps(_mm256_shuffle_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)),
+      swap_mask));
+}
+
+XE_APU_TARGET_AVX2 void PlanarFloatToInterleavedS16BEAVX2(
+    const float* const* channels, uint32_t channel_count,
+    uint32_t sample_count, uint16_t* output) {
+  const __m256i swap_mask = _mm256_setr_epi8(
+      1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4,
+      7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  uint32_t i = 0;
+  if (channel_count == 1) {
+    for (; i + 16 <= sample_count; i += 16) {
+      __m256i samples = LoadS16AVX2(channels[0] + i);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i),
+                          _mm256_shuffle_epi8(samples, swap_mask));
+    }
+  } else if (channel_count == 2) {
+    for (; i + 16 <= sample_count; i += 16) {
+      __m256i left = LoadS16AVX2(channels[0] + i);
+      __m256i right = LoadS16AVX2(channels[1] + i);
+      // 0-3 8-11 and 4-7 12-15.
+      __m256i low = _mm256_unpacklo_epi16(left, right);
+      __m256i high = _mm256_unpackhi_epi16(left, right);
+      __m256i* dest = reinterpret_cast<__m256i*>(output + i * 2);
+      _mm256_storeu_si256(
+          dest, _mm256_shuffle_epi8(_mm256_permute2x128_si256(low, high, 0x20),
+                                    swap_mask));
+      _mm256_storeu_si256(
+          dest + 1, _mm256_shuffle_epi8(
+                        _mm256_permute2x128_si256(low, high, 0x31), swap_mask));
+    }
+  }
+  PlanarFloatToInterleavedS16BERange(channels, channel_count, i, sample_count,
+                                     output);
+}
+
+XE_APU_TARGET_AVX2 void PlanarFloatBEToInterleavedFloatAVX2(
+    const float* input, uint32_t channel_count, uint32_t sample_count,
+    float* output) {
+  const __m256i swap_mask = _mm256_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6,
+      5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  uint32_t i = 0;
+  if (channel_count == 6) {
+    for (; i + 8 <= sample_count; i += 8) {
+      __m256 c0 = LoadFloatBEAVX2(input + i, swap_mask);
+      __m256 c1 = LoadFloatBEAVX2(input + sample_count + i, swap_mask);
+      __m256 c2 = LoadFloatBEAVX2(input + sample_count * 2 + i, swap_mask);
+      __m256 c3 = LoadFloatBEAVX2(input + sample_count * 3 + i, swap_mask);
+      __m256 c4 = LoadFloatBEAVX2(input + sample_count * 4 + i, swap_mask);
+      __m256 c5 = LoadFloatBEAVX2(input + sample_count * 5 + i, swap_mask);
+      // Same as the SSE path, samples 0-3 in the lower lane and 4-7 in the
+      // upper one.
+      __m256 t0 = _mm256_shuffle_ps(c0, c1, _MM_SHUFFLE(1, 0, 1, 0));
+      __m256 t1 = _mm256_shuffle_ps(c2, c3, _MM_SHUFFLE(1, 0, 1, 0));
+      __m256 t2 = _mm256_shuffle_ps(c0, c1, _MM_SHUFFLE(3, 2, 3, 2));
+      __m256 t3 = _mm256_shuffle_ps(c2, c3, _MM_SHUFFLE(3, 2, 3, 2));
+      __m256 s0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0));
+      __m256 s1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 1, 3, 1));
+      __m256 s2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(2, 0, 2, 0));
+      __m256 s3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 1, 3, 1));
+      __m256 c45_01 = _mm256_unpacklo_ps(c4, c5);
+      __m256 c45_23 = _mm256_unpackhi_ps(c4, c5);
+      __m256 o1 = _mm256_shuffle_ps(c45_01, s1, _MM_SHUFFLE(1, 0, 1, 0));
+      __m256 o2 = _mm256_shuffle_ps(s1, c45_01, _MM_SHUFFLE(3, 2, 3, 2));
+      __m256 o4 = _mm256_shuffle_ps(c45_23, s3, _MM_SHUFFLE(1, 0, 1, 0));
+      __m256 o5 = _mm256_shuffle_ps(s3, c45_23, _MM_SHUFFLE(3, 2, 3, 2));
+      float* dest = output + i * 6;
+      _mm256_storeu_ps(dest, _mm256_permute2f128_ps(s0, o1, 0x20));
+      _mm256_storeu_ps(dest + 8, _mm256_permute2f128_ps(o2, s2, 0x20));
+      _mm256_storeu_ps(dest + 16, _mm256_permute2f128_ps(o4, o5, 0x20));
+      _mm256_storeu_ps(dest + 24, _mm256_permute2f128_ps(s0, o1, 0x31));
+      _mm256_storeu_ps(dest + 32, _mm256_permute2f128_ps(o2, s2, 0x31));
+      _mm256_storeu_ps(dest + 40, _mm256_permute2f128_ps(o4, o5, 0x31));
+    }
+  } else if (channel_count == 2) {
+    for (; i + 8 <= sample_count; i += 8) {
+      __m256 left = LoadFloatBEAVX2(input + i, swap_mask);
+      __m256 right = LoadFloatBEAVX2(input + sample_count + i, swap_mask);
+      __m256 low = _mm256_unpacklo_ps(left, right);
+      __m256 high = _mm256_unpackhi_ps(left, right);
+      _mm256_storeu_ps(output + i * 2, _mm256_permute2f128_ps(low, high, 0x20));
+      _mm256_storeu_ps(output + i * 2 + 8,
+                       _mm256_permute2f128_ps(low, high, 0x31));
+    }
+  }
+  PlanarFloatBEToInterleavedFloatRange(input, channel_count, i, sample_count,
+                                       output);
+}
+
+// The downmix is bound by the 6-float stride shuffles, so it reuses SSE.
+const Functions kAVX2Functions = {
+    Implementation::kAVX2,
+    PlanarFloatToInterleavedS16BEAVX2,
+    PlanarFloatBEToInterleavedFloatAVX2,
+    Downmix51ToStereoSSE,
+};
+
+#endif  // XE_ARCH_AMD64
+
+}  // namespace
+
+const Functions* GetFunctions(Implementation implementation) {
+  switch (implementation) {
+    case Implementation::kScalar:
+      return &kScalarFunctions;
+#if XE_ARCH_AMD64
+    case Implementation::kSSE:
+      // SSSE3 is implied by AVX, which is required.
+      return &kSSEFunctions;
+    case Implementation::kAVX2: {
+      static const bool avx2_supported =
+          Xbyak::util::Cpu().has(Xbyak::util::Cpu::tAVX2);
+      return avx2_supported ? &kAVX2Functions : nullptr;
+    }
+#endif  // XE_ARCH_AMD64
+    default:
+      return nullptr;
+  }
+}
+
+const Functions& GetBestFunctions() {
+  static const Functions* best_functions = []() {
+    const Implementation implementations[] = {
+        Implementation::kAVX2,
+        Implementation::kSSE,
+    };
+    for (Implementation implementation : implementations) {
+      const Functions* functions = GetFunctions(implementation);
+      if (functions) {
+        return functions;
+      }
+    }
+    return &kScalarFunctions;
+  }();
+  return *best_functions;
+}
+
+void PlanarFloatToInterleavedS16BE(const float* const* channels,
+                                   uint32_t channel_count,
+                                   uint32_t sample_count, uint16_t* output) {
+  GetBestFunctions().planar_float_to_interleaved_s16be(
+      channels, channel_count, sample_count, output);
+}
+
+void PlanarFloatBEToInterleavedFloat(const float* input, uint32_t channel_count,
+                                     uint32_t sample_count, float* output) {
+  GetBestFunctions().planar_float_be_to_interleaved_float(
+      input, channel_count, sample_count, output);
+}
+
+void Downmix51ToStereo(const float* input, uint32_t sample_count,
+                       float* output) {
+  GetBestFunctions().downmix_51_to_stereo(input, sample_count, output);
+}
+
+}  // namespace sample_conversion
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_SAMPLE_CONVERSION_H_
+#define XENIA_APU_SAMPLE_CONVERSION_H_
+
+#include <cstdint>
+
+namespace xe {
+namespace apu {
+namespace sample_conversion {
+
+// Converts planar host-endian float samples to interleaved big-endian signed
+// 16-bit samples. Samples are clamped to [-1, 1], scaled by 32767 and
+// truncated towards zero.
+void PlanarFloatToInterleavedS16BE(const float* const* channels,
+                                   uint32_t channel_count,
+                                   uint32_t sample_count, uint16_t* output);
+
+// Converts planar big-endian float samples (channel_count consecutive arrays
+// of sample_count samples, like guest audio frames) to interleaved host-endian
+// float samples.
+void PlanarFloatBEToInterleavedFloat(const float* input, uint32_t channel_count,
+                                     uint32_t sample_count, float* output);
+
+// Downmixes interleaved 5.1 float samples (front left, front right, center,
+// LFE, surround left, surround right) to interleaved stereo. The LFE channel
+// is dropped and the result is clamped to [-1, 1].
+void Downmix51ToStereo(const float* input, uint32_t sample_count,
+                       float* output);
+
+enum class Implementation {
+  kScalar,
+  kSSE,
+  kAVX2,
+};
+
+struct Functions {
+  Implementation implementation;
+  void (*planar_float_to_interleaved_s16be)(const float* const* channels,
+                                            uint32_t channel_count,
+                                            uint32_t sample_count,
+                                            uint16_t* output);
+  void (*planar_float_be_to_interleaved_float)(const float* input,
+                                               uint32_t channel_count,
+                                               uint32_t sample_count,
+                                               float* output);
+  void (*downmix_51_to_stereo)(const float* input, uint32_t sample_count,
+                               float* output);
+};
+
+// Returns the functions of a specific implementation, or nullptr if it's not
+// available on the host. Mainly for testing and benchmarking - the free
+// functions above use the fastest supported implementation, selected once.
+const Functions* GetFunctions(Implementation implementation);
+const Functions& GetBestFunctions();
+
+}  // namespace sample_conversion
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_SAMPLE_CONVERSION_H_
@@ -9,24 +9,45 @@
 
 #include "xenia/apu/sdl/sdl_audio_driver.h"
 
-#include <array>
+#include <algorithm>
+#include <cstring>
 
 #include "xenia/apu/apu_flags.h"
+#include "xenia/apu/sample_conversion.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
 #include "xenia/helper/sdl/sdl_helper.h"
 
+DEFINE_int32(sdl_audio_min_queued_frames, 4,
+             "Minimum number of 256-sample frames (5.3 ms each) queued for "
+             "the SDL audio device. Lower values reduce the latency, the "
+             "depth is raised automatically when the device runs out of "
+             "frames.",
+             "APU");
+
 namespace xe {
 namespace apu {
 namespace sdl {
 
+// Lower the target depth by one frame after this many frames (5 seconds)
+// played without an underrun.
+constexpr uint32_t kFramesPerTargetDecrease = 5 * 48000 / 256;
+
 SDLAudioDriver::SDLAudioDriver(Memory* memory,
-                               xe::threading::Semaphore* semaphore)
-    : AudioDriver(memory), semaphore_(semaphore) {}
+                               xe::threading::Semaphore* semaphore,
+                               uint32_t max_queued_frames)
+    : AudioDriver(memory),
+      semaphore_(semaphore),
+      ring_frame_count_(max_queued_frames),
+      client_credits_(max_queued_frames) {
+  assert_not_zero(max_queued_frames);
+  ring_frames_ = std::make_unique<float[]>(size_t(ring_frame_count_) *
+                                           frame_samples_);
+  target_queued_frames_ = uint32_t(xe::clamp(
+      cvars::sdl_audio_min_queued_frames, 1, int32_t(max_queued_frames)));
+}
 
-SDLAudioDriver::~SDLAudioDriver() {
-  assert_true(frames_queued_.empty());
-  assert_true(frames_unused_.empty());
-};
+SDLAudioDriver::~SDLAudioDriver() = default;
 
 bool SDLAudioDriver::Initialize() {
   SDL_version ver = {};
@@ -48,25 +69,7 @@ bool SDLAudioDriver::Initialize() {
 
   SDL_AudioCallback audio_callback = [](void* userdata, Uint8* stream,
                                         int len) -> void {
-    assert_true(len == frame_size_);
-    const auto driver = static_cast<SDLAudioDriver*>(userdata);
-
-    std::unique_lock<std::mutex> guard(driver->frames_mutex_);
-    if (driver->frames_queued_.empty()) {
-      memset(stream, 0, len);
-    } else {
-      auto buffer = driver->frames_queued_.front();
-      driver->frames_queued_.pop();
-      if (cvars::mute) {
-        memset(stream, 0, len);
-      } else {
-        memcpy(stream, buffer, len);
-      }
-      driver->frames_unused_.push(buffer);
-
-      auto ret = driver->semaphore_->Release(1, nullptr);
-      assert_true(ret);
-    }
+    static_cast<SDLAudioDriver*>(userdata)->PlayFrame(stream, len);
   };
 
   SDL_AudioSpec wanted_spec = {};
@@ -76,41 +79,145 @@ bool SDLAudioDriver::Initialize() {
   wanted_spec.samples = channel_samples_;
   wanted_spec.callback = audio_callback;
   wanted_spec.userdata = this;
-  sdl_device_id_ = SDL_OpenAudioDevice(nullptr, 0, &wanted_spec, nullptr, 0);
+  // Downmix to stereo on our side rather than letting SDL do it.
+  SDL_AudioSpec obtained_spec;
+  sdl_device_id_ =
+      SDL_OpenAudioDevice(nullptr, 0, &wanted_spec, &obtained_spec,
+                          SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+  if (sdl_device_id_ > 0 && obtained_spec.channels != frame_channels_ &&
+      obtained_spec.channels != 2) {
+    // Some other layout - let SDL convert the 5.1 frames.
+    SDL_CloseAudioDevice(sdl_device_id_);
+    sdl_device_id_ =
+        SDL_OpenAudioDevice(nullptr, 0, &wanted_spec, &obtained_spec, 0);
+  }
   if (sdl_device_id_ <= 0) {
     XELOGE("SDL_OpenAudioDevice() failed.");
     return false;
   }
+  device_channels_ = obtained_spec.channels;
+  if (device_channels_ != frame_channels_) {
+    XELOGI("SDLAudioDriver: Downmixing to {} channels", device_channels_);
+  }
   SDL_PauseAudioDevice(sdl_device_id_, 0);
 
   return true;
 }
 
-void SDLAudioDriver::SubmitFrame(uint32_t frame_ptr) {
-  const auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
-  float* output_frame;
-  {
-    std::unique_lock<std::mutex> guard(frames_mutex_);
-    if (frames_unused_.empty()) {
-      output_frame = new float[frame_samples_];
+void SDLAudioDriver::PlayFrame(uint8_t* stream, int len) {
+  assert_true(size_t(len) ==
+              sizeof(float) * channel_samples_ * device_channels_);
+
+  uint32_t read_index = ring_read_index_.load(std::memory_order_relaxed);
+  uint32_t write_index = ring_write_index_.load(std::memory_order_acquire);
+  uint32_t target = target_queued_frames_.load(std::memory_order_relaxed);
+  if (read_index == write_index) {
+    std::memset(stream, 0, len);
+    // Not an underrun if the client hasn't started yet.
+    if (!played_frames_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    frames_since_underrun_ = 0;
+    // A stall makes the device call back many times in a row, count it and
+    // let the client queue deeper to ride out the next hiccup only once.
+    if (!underrun_in_progress_) {
+      underrun_in_progress_ = true;
+      underruns_.fetch_add(1, std::memory_order_relaxed);
+      if (target < ring_frame_count_) {
+        ++target;
+        target_queued_frames_.store(target, std::memory_order_relaxed);
+      }
+    }
+  } else {
+    underrun_in_progress_ = false;
+    const float* frame = RingFrame(read_index);
+    if (cvars::mute) {
+      std::memset(stream, 0, len);
     } else {
-      output_frame = frames_unused_.top();
-      frames_unused_.pop();
+      std::memcpy(stream, frame, len);
+    }
+    ring_read_index_.store(RingNextIndex(read_index),
+                           std::memory_order_release);
+    played_frames_.fetch_add(1, std::memory_order_relaxed);
+    --client_credits_;
+    if (++frames_since_underrun_ >= kFramesPerTargetDecrease) {
+      frames_since_underrun_ = 0;
+      uint32_t min_target = uint32_t(xe::clamp(
+          cvars::sdl_audio_min_queued_frames, 1, int32_t(ring_frame_count_)));
+      if (target > min_target) {
+        --target;
+        target_queued_frames_.store(target, std::memory_order_relaxed);
+      }
     }
   }
 
-  // interleave the data
-  for (size_t index = 0, o = 0; index < channel_samples_; ++index) {
-    for (size_t channel = 0, table = 0; channel < frame_channels_;
-         ++channel, table += channel_samples_) {
-      output_frame[o++] = xe::byte_swap(input_frame[table + index]);
-    }
+  // Request more frames if below the target, the surplus drains naturally.
+  if (client_credits_ < target) {
+    auto ret = semaphore_->Release(target - client_credits_, nullptr);
+    assert_true(ret);
+    client_credits_ = target;
   }
+}
 
-  {
-    std::unique_lock<std::mutex> guard(frames_mutex_);
-    frames_queued_.push(output_frame);
+void SDLAudioDriver::SubmitFrame(uint32_t frame_ptr) {
+  const auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
+
+  uint32_t write_index = ring_write_index_.load(std::memory_order_relaxed);
+  if (RingQueuedFrames(ring_read_index_.load(std::memory_order_acquire),
+                       write_index) >= ring_frame_count_) {
+    // Only possible if the client submits more frames than it was allowed to.
+    dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  float* output_frame = RingFrame(write_index);
+
+  if (device_channels_ == frame_channels_) {
+    sample_conversion::PlanarFloatBEToInterleavedFloat(
+        input_frame, frame_channels_, channel_samples_, output_frame);
+  } else {
+    float interleaved_frame[frame_samples_];
+    sample_conversion::PlanarFloatBEToInterleavedFloat(
+        input_frame, frame_channels_, channel_samples_, interleaved_frame);
+    sample_conversion::Downmix51ToStereo(interleaved_frame, channel_samples_,
+                                         output_frame);
   }
+
+  ring_write_index_.store(RingNextIndex(write_index),
+                          std::memory_order_release);
+
+  Statistics statistics = GetStatistics();
+  COUNT_profile_set("apu/sdl/queued_frames", statistics.queued_frames);
+  COUNT_profile_set("apu/sdl/target_queued_frames",
+                    statistics.target_queued_frames);
+  COUNT_profile_set("apu/sdl/underruns", statistics.underruns);
+  COUNT_profile_set("apu/sdl/dropped_frames", statistics.dropped_frames);
+  COUNT_profile_set("apu/sdl/latency_us", statistics.latency_us);
+}
+
+bool SDLAudioDriver::GetPlaybackPosition(
+    PlaybackPosition& position_out) const {
+  // Frames dropped by SubmitFrame will never be played.
+  position_out.played_frames = played_frames_.load(std::memory_order_relaxed) +
+                               dropped_frames_.load(std::memory_order_relaxed);
+  position_out.target_queued_frames =
+      target_queued_frames_.load(std::memory_order_relaxed);
+  return true;
+}
+
+SDLAudioDriver::Statistics SDLAudioDriver::GetStatistics() const {
+  Statistics statistics;
+  statistics.queued_frames =
+      RingQueuedFrames(ring_read_index_.load(std::memory_order_relaxed),
+                       ring_write_index_.load(std::memory_order_relaxed));
+  statistics.target_queued_frames =
+      target_queued_frames_.load(std::memory_order_relaxed);
+  statistics.played_frames = played_frames_.load(std::memory_order_relaxed);
+  statistics.underruns = underruns_.load(std::memory_order_relaxed);
+  statistics.dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+  statistics.latency_us = uint32_t(uint64_t(statistics.queued_frames + 1) *
+                                   channel_samples_ * 1000000 /
+                                   frame_frequency_);
+  return statistics;
 }
 
 void SDLAudioDriver::Shutdown() {
@@ -122,15 +229,14 @@ void SDLAudioDriver::Shutdown() {
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
     sdl_initialized_ = false;
   }
-  std::unique_lock<std::mutex> guard(frames_mutex_);
-  while (!frames_unused_.empty()) {
-    delete[] frames_unused_.top();
-    frames_unused_.pop();
-  };
-  while (!frames_queued_.empty()) {
-    delete[] frames_queued_.front();
-    frames_queued_.pop();
-  };
+  Statistics statistics = GetStatistics();
+  if (statistics.played_frames) {
+    XELOGI(
+        "SDLAudioDriver: {} frames played, {} underruns, {} dropped frames, "
+        "final queue depth target {} frames",
+        statistics.played_frames, statistics.underruns,
+        statistics.dropped_frames, statistics.target_queued_frames);
+  }
 }
 
 }  // namespace sdl
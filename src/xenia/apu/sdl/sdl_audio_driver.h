@@ -10,9 +10,8 @@
 #ifndef XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 #define XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 
-#include <mutex>
-#include <queue>
-#include <stack>
+#include <atomic>
+#include <memory>
 
 #include "SDL.h"
 #include "xenia/apu/audio_driver.h"
@@ -24,27 +23,88 @@ namespace sdl {
 
 class SDLAudioDriver : public AudioDriver {
  public:
-  SDLAudioDriver(Memory* memory, xe::threading::Semaphore* semaphore);
+  struct Statistics {
+    // Frames waiting to be played.
+    uint32_t queued_frames;
+    // Depth the client is throttled to, adjusted on underruns.
+    uint32_t target_queued_frames;
+    uint64_t played_frames;
+    // Times playback ran out of frames, each counted once however many device
+    // callbacks the stall lasted.
+    uint64_t underruns;
+    // Frames submitted while the queue was full.
+    uint64_t dropped_frames;
+    // Of the queued frames and the frame being played by the device.
+    uint32_t latency_us;
+  };
+
+  // The semaphore must have been released max_queued_frames times - that's
+  // how many frames the client may have in flight at most.
+  SDLAudioDriver(Memory* memory, xe::threading::Semaphore* semaphore,
+                 uint32_t max_queued_frames);
   ~SDLAudioDriver() override;
 
   bool Initialize();
   void SubmitFrame(uint32_t frame_ptr) override;
+  bool GetPlaybackPosition(PlaybackPosition& position_out) const override;
   void Shutdown();
 
+  Statistics GetStatistics() const;
+
  protected:
+  void PlayFrame(uint8_t* stream, int len);
+
+  uint32_t RingNextIndex(uint32_t index) const {
+    return index + 1 < ring_frame_count_ * 2 ? index + 1 : 0;
+  }
+  uint32_t RingQueuedFrames(uint32_t read_index, uint32_t write_index) const {
+    return write_index >= read_index
+               ? write_index - read_index
+               : write_index + ring_frame_count_ * 2 - read_index;
+  }
+  float* RingFrame(uint32_t index) const {
+    if (index >= ring_frame_count_) {
+      index -= ring_frame_count_;
+    }
+    return &ring_frames_[size_t(index) * frame_samples_];
+  }
+
   xe::threading::Semaphore* semaphore_ = nullptr;
 
   SDL_AudioDeviceID sdl_device_id_ = -1;
   bool sdl_initialized_ = false;
+  // frame_channels_, or 2 if the frames are downmixed to stereo.
+  uint32_t device_channels_ = frame_channels_;
 
   static const uint32_t frame_frequency_ = 48000;
   static const uint32_t frame_channels_ = 6;
   static const uint32_t channel_samples_ = 256;
   static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
   static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
-  std::queue<float*> frames_queued_ = {};
-  std::stack<float*> frames_unused_ = {};
-  std::mutex frames_mutex_ = {};
+
+  // Single producer (SubmitFrame, serialized by the audio system) single
+  // consumer (the SDL callback) ring of preallocated frames. The indices wrap
+  // at twice the frame count, so a full ring can be told from an empty one
+  // whatever the frame count is.
+  uint32_t ring_frame_count_;
+  std::unique_ptr<float[]> ring_frames_;
+  std::atomic<uint32_t> ring_write_index_ = {0};
+  std::atomic<uint32_t> ring_read_index_ = {0};
+
+  // Owned by the SDL callback. Client credits are the semaphore count plus
+  // the frames being rendered by the client or queued - releasing the
+  // semaphore only while they're below the target keeps the queue around the
+  // target depth.
+  uint32_t client_credits_;
+  uint32_t frames_since_underrun_ = 0;
+  // Whether the device has been running out of frames since the previous
+  // played frame.
+  bool underrun_in_progress_ = false;
+  std::atomic<uint32_t> target_queued_frames_;
+
+  std::atomic<uint64_t> played_frames_ = {0};
+  std::atomic<uint64_t> underruns_ = {0};
+  std::atomic<uint64_t> dropped_frames_ = {0};
 };
 
 }  // namespace sdl
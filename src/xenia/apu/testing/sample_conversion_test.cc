@@ -0,0 +1,213 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/sample_conversion.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/math.h"
+#include "xenia/base/testing/util.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace apu {
+namespace test {
+using namespace xe::apu::sample_conversion;
+
+const Implementation kImplementations[] = {
+    Implementation::kScalar,
+    Implementation::kSSE,
+    Implementation::kAVX2,
+};
+
+// Out of range values and special values to cover clamping.
+std::vector<float> MakeSamples(size_t count, uint32_t seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> distribution(-1.5f, 1.5f);
+  std::vector<float> samples(count);
+  for (float& sample : samples) {
+    sample = distribution(random);
+  }
+  const float special[] = {
+      0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1e-6f,
+      std::numeric_limits<float>::infinity(),
+      -std::numeric_limits<float>::infinity(),
+      std::numeric_limits<float>::quiet_NaN(),
+  };
+  for (size_t i = 0; i < count && i < xe::countof(special); ++i) {
+    samples[i * 7 % count] = special[i];
+  }
+  return samples;
+}
+
+bool BitwiseEqual(const std::vector<float>& a, const std::vector<float>& b) {
+  return a.size() == b.size() &&
+         !std::memcmp(a.data(), b.data(), a.size() * sizeof(float));
+}
+
+TEST_CASE("SAMPLE_CONVERSION_S16BE", "[sample_conversion]") {
+  // Known values.
+  {
+    const float left[] = {1.0f, -1.0f, 0.5f, 2.0f};
+    const float right[] = {0.0f, -2.0f, -0.5f, 0.99999f};
+    const float* channels[] = {left, right};
+    uint16_t output[8];
+    GetFunctions(Implementation::kScalar)
+        ->planar_float_to_interleaved_s16be(channels, 2, 4, output);
+    const int16_t expected[] = {32767, 0,     -32767, -32767,
+                                16383, -16383, 32767, 32766};
+    for (size_t i = 0; i < xe::countof(expected); ++i) {
+      REQUIRE(xe::byte_swap(output[i]) == uint16_t(expected[i]));
+    }
+  }
+
+  // Odd sample counts to cover both the SIMD and the scalar paths.
+  const uint32_t sample_count = 512 + 13;
+  auto left = MakeSamples(sample_count, 1);
+  auto right = MakeSamples(sample_count, 2);
+  auto third = MakeSamples(sample_count, 3);
+  const float* channels[] = {left.data(), right.data(), third.data()};
+  for (uint32_t channel_count = 1; channel_count <= 3; ++channel_count) {
+    std::vector<uint16_t> expected(sample_count * channel_count);
+    GetFunctions(Implementation::kScalar)
+        ->planar_float_to_interleaved_s16be(channels, channel_count,
+                                            sample_count, expected.data());
+    for (Implementation implementation : kImplementations) {
+      const Functions* functions = GetFunctions(implementation);
+      if (!functions) {
+        continue;
+      }
+      std::vector<uint16_t> output(expected.size() + 1, 0xABCD);
+      functions->planar_float_to_interleaved_s16be(
+          channels, channel_count, sample_count, output.data());
+      REQUIRE(output.back() == 0xABCD);
+      output.pop_back();
+      REQUIRE(output == expected);
+    }
+  }
+}
+
+TEST_CASE("SAMPLE_CONVERSION_INTERLEAVE_BE", "[sample_conversion]") {
+  for (uint32_t sample_count : {256u, 256u + 7u}) {
+    for (uint32_t channel_count : {2u, 3u, 6u}) {
+      auto input = MakeSamples(sample_count * channel_count, channel_count);
+      for (float& sample : input) {
+        sample = xe::byte_swap(sample);
+      }
+      std::vector<float> expected(input.size());
+      for (uint32_t i = 0; i < sample_count; ++i) {
+        for (uint32_t j = 0; j < channel_count; ++j) {
+          expected[i * channel_count + j] =
+              xe::byte_swap(input[j * sample_count + i]);
+        }
+      }
+      for (Implementation implementation : kImplementations) {
+        const Functions* functions = GetFunctions(implementation);
+        if (!functions) {
+          continue;
+        }
+        std::vector<float> output(input.size());
+        functions->planar_float_be_to_interleaved_float(
+            input.data(), channel_count, sample_count, output.data());
+        REQUIRE(BitwiseEqual(output, expected));
+      }
+    }
+  }
+}
+
+TEST_CASE("SAMPLE_CONVERSION_DOWNMIX", "[sample_conversion]") {
+  {
+    const float input[] = {0.25f, -0.25f, 0.5f, 1.0f, 0.0f, 0.5f,
+                           1.0f,  -1.0f,  1.0f, 0.0f, 1.0f, -1.0f};
+    float output[4];
+    GetFunctions(Implementation::kScalar)
+        ->downmix_51_to_stereo(input, 2, output);
+    REQUIRE(std::abs(output[0] - (0.25f + 0.5f * 0.70710678f)) < 1e-6f);
+    REQUIRE(std::abs(output[1] - (-0.25f + 1.0f * 0.70710678f)) < 1e-6f);
+    REQUIRE(output[2] == 1.0f);
+    REQUIRE(output[3] == -1.0f);
+  }
+
+  const uint32_t sample_count = 256 + 3;
+  auto input = MakeSamples(sample_count * 6, 4);
+  std::vector<float> expected(sample_count * 2);
+  GetFunctions(Implementation::kScalar)
+      ->downmix_51_to_stereo(input.data(), sample_count, expected.data());
+  for (Implementation implementation : kImplementations) {
+    const Functions* functions = GetFunctions(implementation);
+    if (!functions) {
+      continue;
+    }
+    std::vector<float> output(expected.size());
+    functions->downmix_51_to_stereo(input.data(), sample_count, output.data());
+    REQUIRE(BitwiseEqual(output, expected));
+  }
+}
+
+TEST_CASE("SAMPLE_CONVERSION_BENCHMARK", "[.benchmark]") {
+  constexpr uint32_t kIterations = 100000;
+  // An XMA frame pair and an audio driver frame.
+  constexpr uint32_t kXmaSamples = 512;
+  constexpr uint32_t kFrameSamples = 256;
+  auto left = MakeSamples(kXmaSamples, 1);
+  auto right = MakeSamples(kXmaSamples, 2);
+  const float* channels[] = {left.data(), right.data()};
+  std::vector<uint16_t> xma_output(kXmaSamples * 2);
+  auto frame = MakeSamples(kFrameSamples * 6, 3);
+  std::vector<float> interleaved(kFrameSamples * 6);
+  std::vector<float> stereo(kFrameSamples * 2);
+
+  for (Implementation implementation : kImplementations) {
+    const Functions* functions = GetFunctions(implementation);
+    if (!functions) {
+      continue;
+    }
+    double seconds[3];
+    for (uint32_t test = 0; test < 3; ++test) {
+      testing::BenchmarkTimer timer;
+      for (uint32_t i = 0; i < kIterations; ++i) {
+        switch (test) {
+          case 0:
+            functions->planar_float_to_interleaved_s16be(
+                channels, 2, kXmaSamples, xma_output.data());
+            break;
+          case 1:
+            functions->planar_float_be_to_interleaved_float(
+                frame.data(), 6, kFrameSamples, interleaved.data());
+            break;
+          case 2:
+            functions->downmix_51_to_stereo(frame.data(), kFrameSamples,
+                                            stereo.data());
+            break;
+        }
+      }
+      seconds[test] = timer.seconds();
+    }
+    WARN("Implementation " << uint32_t(implementation) << ": "
+                           << kXmaSamples * 2 * double(kIterations) /
+                                  seconds[0] / 1e6
+                           << " million XMA samples per second, "
+                           << kFrameSamples * 6 * double(kIterations) /
+                                  seconds[1] / 1e6
+                           << " million frame samples per second, "
+                           << kFrameSamples * 6 * double(kIterations) /
+                                  seconds[2] / 1e6
+                           << " million downmixed samples per second");
+  }
+}
+
+}  // namespace test
+}  // namespace apu
+}  // namespace xe
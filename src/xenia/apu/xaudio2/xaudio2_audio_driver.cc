@@ -248,6 +248,19 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
   }
 }
 
+bool XAudio2AudioDriver::GetPlaybackPosition(
+    PlaybackPosition& position_out) const {
+  api::XAUDIO2_VOICE_STATE state;
+  if (api_minor_version_ >= 8) {
+    objects_.api_2_8.pcm_voice->GetState(&state);
+  } else {
+    objects_.api_2_7.pcm_voice->GetState(&state);
+  }
+  position_out.played_frames = state.SamplesPlayed / channel_samples_;
+  position_out.target_queued_frames = 0;
+  return true;
+}
+
 void XAudio2AudioDriver::Shutdown() {
   if (api_minor_version_ >= 8) {
     ShutdownObjects(objects_.api_2_8);
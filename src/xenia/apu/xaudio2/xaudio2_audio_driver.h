@@ -29,6 +29,7 @@ class XAudio2AudioDriver : public AudioDriver {
 
   bool Initialize();
   void SubmitFrame(uint32_t frame_ptr) override;
+  bool GetPlaybackPosition(PlaybackPosition& position_out) const override;
   void Shutdown();
 
  private:
@@ -0,0 +1,386 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/apu/xma_context.h"
+#include "xenia/apu/xma_decoder_state.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/utf8.h"
+#include "xenia/memory.h"
+
+DEFINE_path(xma_bench_input, "",
+            "Captured XMA packet stream (raw 2048-byte packets), or a "
+            "manifest text file with one stream per line: "
+            "<path> <sample rate in Hz> <channel count>. Relative paths are "
+            "resolved against the manifest directory.",
+            "APU");
+DEFINE_int32(xma_bench_sample_rate, 48000,
+             "Sample rate of a single input stream: [24000, 32000, 44100, "
+             "48000].",
+             "APU");
+DEFINE_int32(xma_bench_channels, 2,
+             "Channel count of a single input stream: [1, 2].", "APU");
+DEFINE_int32(xma_bench_block_packets, 32,
+             "Number of packets in each of the two input buffers, like a "
+             "title submitting the stream in blocks.",
+             "APU");
+DEFINE_int32(xma_bench_iterations, 1,
+             "Number of times to decode every stream when measuring the "
+             "realtime factor.",
+             "APU");
+DEFINE_bool(xma_bench_update_golden, false,
+            "Write the PCM output hashes to the golden files instead of "
+            "comparing against them.",
+            "APU");
+
+namespace xe {
+namespace apu {
+
+// The golden file for a stream is <stream path>.golden, containing the XXH64
+// of the big-endian PCM output in hexadecimal.
+static std::filesystem::path GetGoldenPath(const std::filesystem::path& path) {
+  std::filesystem::path golden_path = path;
+  golden_path += ".golden";
+  return golden_path;
+}
+
+struct BenchStream {
+  std::filesystem::path path;
+  uint32_t sample_rate;
+  uint32_t channels;
+  std::vector<uint8_t> packets;
+};
+
+static int GetSampleRateIndex(uint32_t sample_rate) {
+  switch (sample_rate) {
+    case 24000:
+      return 0;
+    case 32000:
+      return 1;
+    case 44100:
+      return 2;
+    case 48000:
+      return 3;
+    default:
+      return -1;
+  }
+}
+
+static bool ReadFile(const std::filesystem::path& path,
+                     std::vector<uint8_t>& data_out) {
+  auto file = filesystem::OpenFile(path, "rb");
+  if (!file) {
+    return false;
+  }
+  filesystem::Seek(file, 0, SEEK_END);
+  int64_t file_size = filesystem::Tell(file);
+  filesystem::Seek(file, 0, SEEK_SET);
+  data_out.resize(size_t(std::max(file_size, int64_t(0))));
+  bool read = data_out.empty() || fread(data_out.data(), 1, data_out.size(),
+                                        file) == data_out.size();
+  fclose(file);
+  return read;
+}
+
+static bool AddStream(const std::filesystem::path& path, uint32_t sample_rate,
+                      uint32_t channels, std::vector<BenchStream>& streams) {
+  if (GetSampleRateIndex(sample_rate) < 0) {
+    XELOGE("{}: Unsupported sample rate {}", xe::path_to_utf8(path),
+           sample_rate);
+    return false;
+  }
+  if (channels != 1 && channels != 2) {
+    XELOGE("{}: Unsupported channel count {}", xe::path_to_utf8(path),
+           channels);
+    return false;
+  }
+  BenchStream stream;
+  stream.path = path;
+  stream.sample_rate = sample_rate;
+  stream.channels = channels;
+  if (!ReadFile(path, stream.packets)) {
+    XELOGE("Unable to read the XMA stream {}", xe::path_to_utf8(path));
+    return false;
+  }
+  if (stream.packets.size() % XmaContext::kBytesPerPacket) {
+    XELOGW("{}: Dropping an incomplete packet at the end",
+           xe::path_to_utf8(path));
+    stream.packets.resize(stream.packets.size() -
+                          stream.packets.size() % XmaContext::kBytesPerPacket);
+  }
+  streams.push_back(std::move(stream));
+  return true;
+}
+
+static bool LoadStreams(std::vector<BenchStream>& streams_out) {
+  std::filesystem::path input = cvars::xma_bench_input;
+  if (input.extension() != ".txt") {
+    return AddStream(input, uint32_t(cvars::xma_bench_sample_rate),
+                     uint32_t(cvars::xma_bench_channels), streams_out);
+  }
+  std::vector<uint8_t> manifest_data;
+  if (!ReadFile(input, manifest_data)) {
+    XELOGE("Unable to read the manifest {}", xe::path_to_utf8(input));
+    return false;
+  }
+  std::string manifest(manifest_data.begin(), manifest_data.end());
+  for (std::string_view line : xe::utf8::split(manifest, "\r\n", true)) {
+    std::vector<std::string_view> fields = xe::utf8::split(line, " \t", true);
+    if (fields.empty() || fields[0][0] == '#') {
+      continue;
+    }
+    if (fields.size() != 3) {
+      XELOGE("Invalid manifest line: {}", line);
+      return false;
+    }
+    std::filesystem::path path = xe::to_path(fields[0]);
+    if (path.is_relative()) {
+      path = input.parent_path() / path;
+    }
+    uint32_t sample_rate =
+        uint32_t(std::strtoul(std::string(fields[1]).c_str(), nullptr, 10));
+    uint32_t channels =
+        uint32_t(std::strtoul(std::string(fields[2]).c_str(), nullptr, 10));
+    if (!AddStream(path, sample_rate, channels, streams_out)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Guest memory used for decoding, like a title would set it up.
+struct BenchGuestBuffers {
+  uint32_t context_ptr;
+  uint32_t input_ptrs[2];
+  uint32_t output_ptr;
+};
+
+// Feeds the whole stream through the context as a title streaming it in
+// blocks would, consuming all the output after every kick.
+static void DecodeStream(Memory* memory, XmaContext& context,
+                         const BenchGuestBuffers& buffers,
+                         const BenchStream& stream, uint64_t& hash_out,
+                         uint64_t& sample_count_out) {
+  uint8_t* context_host_ptr = memory->TranslateVirtual(buffers.context_ptr);
+  std::memset(context_host_ptr, 0, sizeof(XMA_CONTEXT_DATA));
+  XMA_CONTEXT_DATA data(context_host_ptr);
+  data.sample_rate = uint32_t(GetSampleRateIndex(stream.sample_rate));
+  data.is_stereo = stream.channels == 2 ? 1 : 0;
+  data.input_buffer_0_ptr = memory->GetPhysicalAddress(buffers.input_ptrs[0]);
+  data.input_buffer_1_ptr = memory->GetPhysicalAddress(buffers.input_ptrs[1]);
+  data.output_buffer_ptr = memory->GetPhysicalAddress(buffers.output_ptr);
+  data.output_buffer_block_count =
+      XmaContext::kOutputMaxSizeBytes / XmaContext::kOutputBytesPerBlock;
+  const uint8_t* output_host_ptr = memory->TranslateVirtual(buffers.output_ptr);
+
+  XXH64_state_t hash_state;
+  XXH64_reset(&hash_state, 0);
+  uint64_t output_bytes = 0;
+
+  uint32_t packet_count =
+      uint32_t(stream.packets.size() / XmaContext::kBytesPerPacket);
+  uint32_t block_packets = uint32_t(cvars::xma_bench_block_packets);
+  uint32_t next_packet = 0;
+  uint32_t stall_count = 0;
+  while (true) {
+    // Submit more input to the free buffers.
+    bool input_submitted = false;
+    for (uint32_t i = 0; i < 2 && next_packet < packet_count; ++i) {
+      if (i ? data.input_buffer_1_valid : data.input_buffer_0_valid) {
+        continue;
+      }
+      uint32_t submit_packets =
+          std::min(block_packets, packet_count - next_packet);
+      std::memcpy(memory->TranslateVirtual(buffers.input_ptrs[i]),
+                  stream.packets.data() +
+                      size_t(next_packet) * XmaContext::kBytesPerPacket,
+                  size_t(submit_packets) * XmaContext::kBytesPerPacket);
+      next_packet += submit_packets;
+      if (i) {
+        data.input_buffer_1_packet_count = submit_packets;
+        data.input_buffer_1_valid = 1;
+      } else {
+        data.input_buffer_0_packet_count = submit_packets;
+        data.input_buffer_0_valid = 1;
+      }
+      input_submitted = true;
+    }
+    if (!data.input_buffer_0_valid && !data.input_buffer_1_valid) {
+      break;
+    }
+
+    data.output_buffer_valid = 1;
+    data.Store(context_host_ptr);
+    context.Enable();
+    context.Work();
+    data = XMA_CONTEXT_DATA(context_host_ptr);
+
+    // Consume everything written to the output ring buffer.
+    uint32_t capacity =
+        data.output_buffer_block_count * XmaContext::kOutputBytesPerBlock;
+    uint32_t read_offset =
+        data.output_buffer_read_offset * XmaContext::kOutputBytesPerBlock;
+    uint32_t write_offset =
+        data.output_buffer_write_offset * XmaContext::kOutputBytesPerBlock;
+    uint32_t written = (write_offset + capacity - read_offset) % capacity;
+    if (written) {
+      uint32_t first_length = std::min(written, capacity - read_offset);
+      XXH64_update(&hash_state, output_host_ptr + read_offset, first_length);
+      if (written > first_length) {
+        XXH64_update(&hash_state, output_host_ptr, written - first_length);
+      }
+      output_bytes += written;
+      data.output_buffer_read_offset = data.output_buffer_write_offset;
+    }
+
+    // Decoding may legitimately consume a buffer without output (such as when
+    // saving a partial frame), but the decoder must not get stuck.
+    if (written || input_submitted) {
+      stall_count = 0;
+    } else if (++stall_count >= 16) {
+      XELOGW("{}: Decoder stalled at packet {} of {}",
+             xe::path_to_utf8(stream.path), next_packet, packet_count);
+      break;
+    }
+  }
+
+  hash_out = XXH64_digest(&hash_state);
+  sample_count_out =
+      output_bytes / (XmaContext::kBytesPerSample * stream.channels);
+}
+
+int xma_bench_main(const std::vector<std::string>& args) {
+  if (cvars::xma_bench_input.empty()) {
+    XELOGE("No input stream or manifest specified with --xma_bench_input.");
+    return 1;
+  }
+  if (cvars::xma_bench_block_packets < 1 ||
+      cvars::xma_bench_block_packets > 4095) {
+    XELOGE("--xma_bench_block_packets must be between 1 and 4095.");
+    return 1;
+  }
+  std::vector<BenchStream> streams;
+  if (!LoadStreams(streams)) {
+    return 1;
+  }
+
+  // No processor is needed - the context only accesses guest memory.
+  auto memory = std::make_unique<Memory>();
+  if (!memory->Initialize()) {
+    XELOGE("Failed to initialize the guest memory");
+    return 1;
+  }
+  BenchGuestBuffers buffers;
+  buffers.context_ptr = memory->SystemHeapAlloc(sizeof(XMA_CONTEXT_DATA), 256,
+                                                kSystemHeapPhysical);
+  uint32_t input_buffer_size =
+      uint32_t(cvars::xma_bench_block_packets) * XmaContext::kBytesPerPacket;
+  for (uint32_t i = 0; i < 2; ++i) {
+    buffers.input_ptrs[i] = memory->SystemHeapAlloc(
+        input_buffer_size, XmaContext::kBytesPerPacket, kSystemHeapPhysical);
+  }
+  buffers.output_ptr = memory->SystemHeapAlloc(XmaContext::kOutputMaxSizeBytes,
+                                               256, kSystemHeapPhysical);
+
+  XmaDecoderStatePool decoder_state_pool;
+  uint32_t iterations = uint32_t(std::max(cvars::xma_bench_iterations, 1));
+  // Audio and host time per channel configuration.
+  std::map<std::pair<uint32_t, uint32_t>, std::pair<double, double>>
+      configuration_times;
+  uint32_t mismatch_count = 0;
+  {
+    // Released before the pool is destroyed.
+    XmaContext context;
+    context.Setup(0, memory.get(), buffers.context_ptr, &decoder_state_pool);
+
+    for (const BenchStream& stream : streams) {
+      uint64_t hash = 0, sample_count = 0;
+      uint64_t start_ticks = Clock::QueryHostTickCount();
+      for (uint32_t i = 0; i < iterations; ++i) {
+        // Start from a fresh decoder state every time, like a title
+        // allocating a context for a new stream.
+        context.set_is_allocated(true);
+        DecodeStream(memory.get(), context, buffers, stream, hash,
+                     sample_count);
+        context.Release();
+      }
+      double host_seconds =
+          double(Clock::QueryHostTickCount() - start_ticks) /
+          double(Clock::QueryHostTickFrequency()) / double(iterations);
+      double audio_seconds = double(sample_count) / double(stream.sample_rate);
+      auto& times = configuration_times[std::make_pair(stream.sample_rate,
+                                                       stream.channels)];
+      times.first += audio_seconds;
+      times.second += host_seconds;
+      XELOGI("{}: {} samples, {:.2f}x realtime, hash {:016X}",
+             xe::path_to_utf8(stream.path), sample_count,
+             host_seconds > 0.0 ? audio_seconds / host_seconds : 0.0, hash);
+
+      std::filesystem::path golden_path = GetGoldenPath(stream.path);
+      if (cvars::xma_bench_update_golden) {
+        auto golden_file = filesystem::OpenFile(golden_path, "wb");
+        if (!golden_file) {
+          XELOGE("Unable to write {}", xe::path_to_utf8(golden_path));
+          ++mismatch_count;
+          continue;
+        }
+        fprintf(golden_file, "%016" PRIX64 "\n", hash);
+        fclose(golden_file);
+        continue;
+      }
+      std::vector<uint8_t> golden_data;
+      if (!ReadFile(golden_path, golden_data)) {
+        XELOGW("{}: No golden file", xe::path_to_utf8(stream.path));
+        continue;
+      }
+      std::string golden(golden_data.begin(), golden_data.end());
+      uint64_t golden_hash = std::strtoull(golden.c_str(), nullptr, 16);
+      if (golden_hash != hash) {
+        XELOGE("{}: PCM output hash mismatch, expected {:016X}",
+               xe::path_to_utf8(stream.path), golden_hash);
+        ++mismatch_count;
+      }
+    }
+  }
+
+  for (const auto& configuration : configuration_times) {
+    double host_seconds = configuration.second.second;
+    XELOGI("{} Hz, {} channel(s): {:.2f}x realtime", configuration.first.first,
+           configuration.first.second,
+           host_seconds > 0.0 ? configuration.second.first / host_seconds
+                              : 0.0);
+  }
+  if (mismatch_count) {
+    XELOGE("{} of {} streams did not match the golden output", mismatch_count,
+           streams.size());
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace apu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-apu-xma-bench", xe::apu::xma_bench_main,
+                   "[stream or manifest]", "xma_bench_input");
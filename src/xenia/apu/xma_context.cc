@@ -12,7 +12,9 @@
 #include <algorithm>
 #include <cstring>
 
+#include "xenia/apu/sample_conversion.h"
 #include "xenia/apu/xma_decoder.h"
+#include "xenia/apu/xma_decoder_state.h"
 #include "xenia/apu/xma_helpers.h"
 #include "xenia/base/bit_stream.h"
 #include "xenia/base/logging.h"
@@ -35,67 +37,48 @@ namespace apu {
 
 XmaContext::XmaContext() = default;
 
-XmaContext::~XmaContext() {
-  if (context_) {
-    if (avcodec_is_open(context_)) {
-      avcodec_close(context_);
-    }
-    av_free(context_);
-  }
-  if (decoded_frame_) {
-    av_frame_free(&decoded_frame_);
-  }
-  if (current_frame_) {
-    delete[] current_frame_;
-  }
-}
+XmaContext::~XmaContext() { ReleaseDecoderState(); }
 
-int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr) {
+int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr,
+                      XmaDecoderStatePool* decoder_state_pool) {
   id_ = id;
   memory_ = memory;
   guest_ptr_ = guest_ptr;
+  decoder_state_pool_ = decoder_state_pool;
 
-  // Allocate important stuff.
-  codec_ = &ff_xma2_decoder;
-  if (!codec_) {
-    return 1;
-  }
+  // The libav state is only acquired when the context is actually used.
+  return 0;
+}
 
-  context_ = avcodec_alloc_context3(codec_);
-  if (!context_) {
-    return 1;
+bool XmaContext::AcquireDecoderState() {
+  if (decoder_state_) {
+    return true;
   }
-
-  decoded_frame_ = av_frame_alloc();
-  if (!decoded_frame_) {
-    return 1;
+  decoder_state_ = decoder_state_pool_->Acquire();
+  if (!decoder_state_) {
+    XELOGE("XmaContext {}: Failed to acquire a decoder state", id());
+    return false;
   }
+  // New stream for the decoder.
+  ResetPartialFrame();
+  return true;
+}
 
-  packet_ = new AVPacket();
-  av_init_packet(packet_);
-
-  // Initialize these to 0. They'll actually be set later.
-  context_->channels = 0;
-  context_->sample_rate = 0;
-  context_->block_align = kBytesPerPacket;
-
-  // Extra data passed to the decoder.
-  std::memset(&extra_data_, 0, sizeof(extra_data_));
-  extra_data_.bits_per_sample = 16;
-  extra_data_.channel_mask = AV_CH_FRONT_RIGHT;
-  extra_data_.decode_flags = 0x10D6;
-
-  context_->extradata_size = sizeof(extra_data_);
-  context_->extradata = reinterpret_cast<uint8_t*>(&extra_data_);
-
-  partial_frame_buffer_.resize(2048);
-
-  // Current frame stuff whatever
-  // samples per frame * 2 max channels * output bytes
-  current_frame_ = new uint8_t[kSamplesPerFrame * kBytesPerSample * 2];
+void XmaContext::ReleaseDecoderState() {
+  if (!decoder_state_) {
+    return;
+  }
+  decoder_state_pool_->Release(decoder_state_);
+  decoder_state_ = nullptr;
+  ResetPartialFrame();
+}
 
-  // FYI: We're purposely not opening the context here. That is done later.
-  return 0;
+void XmaContext::ResetPartialFrame() {
+  partial_frame_saved_ = false;
+  partial_frame_size_known_ = false;
+  partial_frame_total_size_bits_ = 0;
+  partial_frame_start_offset_bits_ = 0;
+  partial_frame_offset_bits_ = 0;
 }
 
 bool XmaContext::Work() {
@@ -106,6 +89,10 @@ bool XmaContext::Work() {
 
   set_is_enabled(false);
 
+  if (!AcquireDecoderState()) {
+    return false;
+  }
+
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   XMA_CONTEXT_DATA data(context_ptr);
   DecodePackets(&data);
@@ -127,6 +114,7 @@ void XmaContext::Enable() {
 
   data.Store(context_ptr);
 
+  AcquireDecoderState();
   set_is_enabled(true);
 }
 
@@ -156,6 +144,9 @@ void XmaContext::Clear() {
   data.output_buffer_write_offset = 0;
 
   data.Store(context_ptr);
+
+  // The input buffers are gone, don't splice a saved frame into the next ones.
+  ResetPartialFrame();
 }
 
 void XmaContext::Disable() {
@@ -170,6 +161,8 @@ void XmaContext::Release() {
   assert_true(is_allocated_ == true);
 
   set_is_allocated(false);
+  set_is_enabled(false);
+  ReleaseDecoderState();
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   std::memset(context_ptr, 0, sizeof(XMA_CONTEXT_DATA));  // Zero it.
 }
@@ -191,7 +184,7 @@ int XmaContext::GetSampleRate(int id) {
 
 size_t XmaContext::SavePartial(uint8_t* packet, uint32_t frame_offset_bits,
                                size_t frame_size_bits, bool append) {
-  uint8_t* buff = partial_frame_buffer_.data();
+  uint8_t* buff = decoder_state_->partial_frame_buffer.data();
 
   BitStream stream(packet, 2048 * 8);
   stream.SetOffset(frame_offset_bits);
@@ -199,7 +192,7 @@ size_t XmaContext::SavePartial(uint8_t* packet, uint32_t frame_offset_bits,
   if (!append) {
     // Reset the buffer.
     // TODO: Probably not necessary.
-    std::memset(buff, 0, partial_frame_buffer_.size());
+    std::memset(buff, 0, decoder_state_->partial_frame_buffer.size());
 
     size_t copy_bits = (2048 * 8) - frame_offset_bits;
     size_t copy_offset = stream.Copy(buff, copy_bits);
@@ -323,6 +316,10 @@ void XmaContext::DecodePackets(XMA_CONTEXT_DATA* data) {
                      : nullptr;
   uint8_t* current_input_buffer = data->current_buffer ? in1 : in0;
 
+  AVCodecContext* context = decoder_state_->context;
+  AVFrame* decoded_frame = decoder_state_->decoded_frame;
+  AVPacket* packet = decoder_state_->packet;
+
   XELOGAPU("Processing context {} (offset {}, buffer {}, ptr {:p})", id(),
            data->input_buffer_read_offset, data->current_buffer,
            current_input_buffer);
@@ -462,7 +459,7 @@ void XmaContext::DecodePackets(XMA_CONTEXT_DATA* data) {
       size_t offset = SavePartial(current_input_buffer, 32, 15, true);
 
       // Read the frame size.
-      BitStream stream(partial_frame_buffer_.data(),
+      BitStream stream(decoder_state_->partial_frame_buffer.data(),
                        15 + partial_frame_start_offset_bits_);
       stream.SetOffset(partial_frame_start_offset_bits_);
 
@@ -486,22 +483,22 @@ void XmaContext::DecodePackets(XMA_CONTEXT_DATA* data) {
     size_t bit_offset = data->input_buffer_read_offset;
     if (partial_frame_saved_) {
       XELOGAPU("XmaContext {}: processing saved partial frame", id());
-      packet_->data = partial_frame_buffer_.data();
-      packet_->size = (int)partial_frame_buffer_.size();
+      packet->data = decoder_state_->partial_frame_buffer.data();
+      packet->size = (int)decoder_state_->partial_frame_buffer.size();
 
       bit_offset = partial_frame_start_offset_bits_;
       partial = true;
       partial_frame_saved_ = false;
     } else {
-      packet_->data = current_input_buffer;
-      packet_->size = (int)current_input_size;
+      packet->data = current_input_buffer;
+      packet->size = (int)current_input_size;
     }
 
     int invalid_frame = 0;  // invalid frame?
     int got_frame = 0;      // successfully decoded a frame?
     int frame_size = 0;
     int len =
-        xma2_decode_frame(context_, packet_, decoded_frame_, &got_frame,
+        xma2_decode_frame(context, packet, decoded_frame, &got_frame,
                           &invalid_frame, &frame_size, !partial, bit_offset);
     if (!partial && len == 0) {
       // Got the last frame of a packet. Advance the read offset to the next
@@ -574,21 +571,22 @@ void XmaContext::DecodePackets(XMA_CONTEXT_DATA* data) {
       size_t written_bytes = 0;
 
       // Validity checks.
-      assert(decoded_frame_->nb_samples <= kSamplesPerFrame);
-      assert(context_->sample_fmt == AV_SAMPLE_FMT_FLTP);
+      assert(decoded_frame->nb_samples <= kSamplesPerFrame);
+      assert(context->sample_fmt == AV_SAMPLE_FMT_FLTP);
 
       // Check the returned buffer size.
-      assert(av_samples_get_buffer_size(NULL, context_->channels,
-                                        decoded_frame_->nb_samples,
-                                        context_->sample_fmt, 1) ==
-             context_->channels * decoded_frame_->nb_samples * sizeof(float));
+      assert(av_samples_get_buffer_size(NULL, context->channels,
+                                        decoded_frame->nb_samples,
+                                        context->sample_fmt, 1) ==
+             context->channels * decoded_frame->nb_samples * sizeof(float));
 
       // Convert the frame.
-      ConvertFrame((const uint8_t**)decoded_frame_->data, context_->channels,
-                   decoded_frame_->nb_samples, current_frame_);
+      uint8_t* current_frame = decoder_state_->current_frame.get();
+      ConvertFrame((const uint8_t**)decoded_frame->data, context->channels,
+                   decoded_frame->nb_samples, current_frame);
 
       assert_true(output_remaining_bytes >= kBytesPerFrame * num_channels);
-      output_rb.Write(current_frame_, kBytesPerFrame * num_channels);
+      output_rb.Write(current_frame, kBytesPerFrame * num_channels);
       written_bytes = kBytesPerFrame * num_channels;
 
       output_remaining_bytes -= written_bytes;
@@ -626,50 +624,35 @@ int XmaContext::PrepareDecoder(uint8_t* block, size_t size, int sample_rate,
   sample_rate = GetSampleRate(sample_rate);
 
   // Re-initialize the context with new sample rate and channels.
-  if (context_->sample_rate != sample_rate || context_->channels != channels) {
+  AVCodecContext* context = decoder_state_->context;
+  if (context->sample_rate != sample_rate || context->channels != channels) {
     // We have to reopen the codec so it'll realloc whatever data it needs.
     // TODO(DrChat): Find a better way.
-    avcodec_close(context_);
+    avcodec_close(context);
 
-    context_->sample_rate = sample_rate;
-    context_->channels = channels;
-    extra_data_.channel_mask =
+    context->sample_rate = sample_rate;
+    context->channels = channels;
+    decoder_state_->extra_data.channel_mask =
         channels == 2 ? AV_CH_LAYOUT_STEREO : AV_CH_LAYOUT_MONO;
 
-    if (avcodec_open2(context_, codec_, NULL) < 0) {
+    if (avcodec_open2(context, &ff_xma2_decoder, NULL) < 0) {
       XELOGE("XmaContext: Failed to reopen libav context");
       return 1;
     }
   }
 
-  av_frame_unref(decoded_frame_);
+  av_frame_unref(decoder_state_->decoded_frame);
 
   return 0;
 }
 
 bool XmaContext::ConvertFrame(const uint8_t** samples, int num_channels,
                               int num_samples, uint8_t* output_buffer) {
-  // Loop through every sample, convert and drop it into the output array.
-  // If more than one channel, we need to interleave the samples from each
-  // channel next to each other.
-  // TODO: This can definitely be optimized with AVX/SSE intrinsics!
-  uint32_t o = 0;
-  for (int i = 0; i < num_samples; i++) {
-    for (int j = 0; j < num_channels; j++) {
-      // Select the appropriate array based on the current channel.
-      auto sample_array = reinterpret_cast<const float*>(samples[j]);
-
-      // Raw sample should be within [-1, 1].
-      // Clamp it, just in case.
-      float raw_sample = xe::saturate(sample_array[i]);
-
-      // Convert the sample and output it in big endian.
-      float scaled_sample = raw_sample * ((1 << 15) - 1);
-      int sample = static_cast<int>(scaled_sample);
-      xe::store_and_swap<uint16_t>(&output_buffer[o++ * 2], sample & 0xFFFF);
-    }
-  }
-
+  // Clamp the samples (which should be within [-1, 1], but just in case),
+  // convert them to big endian 16-bit and interleave the channels.
+  sample_conversion::PlanarFloatToInterleavedS16BE(
+      reinterpret_cast<const float* const*>(samples), uint32_t(num_channels),
+      uint32_t(num_samples), reinterpret_cast<uint16_t*>(output_buffer));
   return true;
 }
 
@@ -29,7 +29,6 @@
 // https://github.com/hrydgard/minidx9/blob/master/Include/xma2defs.h
 
 // Forward declarations
-struct AVCodec;
 struct AVCodecContext;
 struct AVFrame;
 struct AVPacket;
@@ -131,6 +130,9 @@ struct WmaProExtraData {
 static_assert_size(WmaProExtraData, 18);
 #pragma pack(pop)
 
+struct XmaDecoderState;
+class XmaDecoderStatePool;
+
 class XmaContext {
  public:
   static const uint32_t kBytesPerPacket = 2048;
@@ -148,7 +150,8 @@ class XmaContext {
   explicit XmaContext();
   ~XmaContext();
 
-  int Setup(uint32_t id, Memory* memory, uint32_t guest_ptr);
+  int Setup(uint32_t id, Memory* memory, uint32_t guest_ptr,
+            XmaDecoderStatePool* decoder_state_pool);
   bool Work();
 
   void Enable();
@@ -191,6 +194,11 @@ class XmaContext {
   int DecodePacket(uint8_t* output, size_t offset, size_t size,
                    size_t* read_bytes);
 
+  // Must be called with the lock held.
+  bool AcquireDecoderState();
+  void ReleaseDecoderState();
+  void ResetPartialFrame();
+
   Memory* memory_ = nullptr;
 
   uint32_t id_ = 0;
@@ -199,21 +207,16 @@ class XmaContext {
   bool is_allocated_ = false;
   bool is_enabled_ = false;
 
-  // libav structures
-  AVCodec* codec_ = nullptr;
-  AVCodecContext* context_ = nullptr;
-  AVFrame* decoded_frame_ = nullptr;
-  AVPacket* packet_ = nullptr;
-  WmaProExtraData extra_data_;
+  XmaDecoderStatePool* decoder_state_pool_ = nullptr;
+  // Acquired when the context is first kicked, returned to the pool when the
+  // context is released.
+  XmaDecoderState* decoder_state_ = nullptr;
 
   bool partial_frame_saved_ = false;
   bool partial_frame_size_known_ = false;
   size_t partial_frame_total_size_bits_ = 0;
   size_t partial_frame_start_offset_bits_ = 0;
   size_t partial_frame_offset_bits_ = 0;  // blah internal don't use this
-  std::vector<uint8_t> partial_frame_buffer_;
-
-  uint8_t* current_frame_ = nullptr;
 };
 
 }  // namespace apu
@@ -16,6 +16,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/base/ring_buffer.h"
 #include "xenia/base/string_buffer.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/thread_state.h"
 #include "xenia/kernel/xthread.h"
@@ -50,6 +51,10 @@ extern "C" {
 
 DEFINE_bool(libav_verbose, false, "Verbose libav output (debug and above)",
             "APU");
+DEFINE_int32(xma_decoder_threads, 0,
+             "Number of XMA decoder worker threads, 0 to use half of the "
+             "logical processors (up to 4).",
+             "APU");
 
 namespace xe {
 namespace apu {
@@ -130,79 +135,155 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
   for (int i = 0; i < kContextCount; ++i) {
     uint32_t guest_ptr = context_data_first_ptr_ + i * sizeof(XMA_CONTEXT_DATA);
     XmaContext& context = contexts_[i];
-    if (context.Setup(i, memory(), guest_ptr)) {
+    if (context.Setup(i, memory(), guest_ptr, &decoder_state_pool_)) {
       assert_always();
     }
   }
   register_file_[XE_XMA_REG_NEXT_CONTEXT_INDEX].u32 = 1;
   context_bitmap_.Resize(kContextCount);
 
+  for (uint32_t i = 0; i < kContextCount; ++i) {
+    context_queued_[i].store(false, std::memory_order_relaxed);
+  }
+  for (uint32_t i = 0; i < kReadyQueueSize; ++i) {
+    ready_queue_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  ready_queue_push_position_.store(0, std::memory_order_relaxed);
+  ready_queue_pop_position_.store(0, std::memory_order_relaxed);
+
+  uint32_t worker_count;
+  if (cvars::xma_decoder_threads > 0) {
+    worker_count = uint32_t(cvars::xma_decoder_threads);
+  } else {
+    worker_count = xe::clamp(xe::threading::logical_processor_count() / 2,
+                             uint32_t(1), uint32_t(4));
+  }
+
+  worker_count_ = worker_count;
   worker_running_ = true;
-  work_event_ = xe::threading::Event::CreateAutoResetEvent(false);
-  worker_thread_ = kernel::object_ref<kernel::XHostThread>(
-      new kernel::XHostThread(kernel_state, 128 * 1024, 0, [this]() {
-        WorkerThreadMain();
-        return 0;
-      }));
-  worker_thread_->set_name("XMA Decoder Worker");
-  worker_thread_->set_can_debugger_suspend(true);
-  worker_thread_->Create();
+  paused_worker_count_ = 0;
+  work_semaphore_ = xe::threading::Semaphore::Create(0, INT32_MAX);
+  resume_event_ = xe::threading::Event::CreateManualResetEvent(true);
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    auto worker_thread = kernel::object_ref<kernel::XHostThread>(
+        new kernel::XHostThread(kernel_state, 128 * 1024, 0, [this]() {
+          WorkerThreadMain();
+          return 0;
+        }));
+    worker_thread->set_name(fmt::format("XMA Decoder Worker {}", i));
+    worker_thread->set_can_debugger_suspend(true);
+    worker_thread->Create();
+    worker_threads_.push_back(std::move(worker_thread));
+  }
 
   return X_STATUS_SUCCESS;
 }
 
 void XmaDecoder::WorkerThreadMain() {
-  uint32_t idle_loop_count = 0;
-  while (worker_running_) {
-    // Okay, let's loop through XMA contexts to find ones we need to decode!
-    bool did_work = false;
-    for (uint32_t n = 0; n < kContextCount; n++) {
-      XmaContext& context = contexts_[n];
-      did_work = context.Work() || did_work;
-
-      // TODO: Need thread safety to do this.
-      // Probably not too important though.
-      // registers_.current_context = n;
-      // registers_.next_context = (n + 1) % kContextCount;
+  while (true) {
+    // Sleep until a context is kicked, or the worker needs to pause or to exit.
+    xe::threading::Wait(work_semaphore_.get(), false);
+    if (!worker_running_) {
+      break;
     }
 
     if (paused_) {
-      pause_fence_.Signal();
-      resume_fence_.Wait();
+      if (paused_worker_count_.fetch_add(1) + 1 == worker_count_) {
+        pause_fence_.Signal();
+      }
+      xe::threading::Wait(resume_event_.get(), false);
+      paused_worker_count_.fetch_sub(1);
+      continue;
     }
 
-    if (!did_work) {
-      idle_loop_count++;
-    } else {
-      idle_loop_count = 0;
+    // Drain the queue rather than claiming one context per wakeup, so contexts
+    // left in the queue when pausing are picked up by the wakeups on resume.
+    uint32_t context_id;
+    while (!paused_ && PopReadyContext(context_id)) {
+      // Kicks from now on must queue the context again - the context lock
+      // prevents it from being decoded by two workers at once.
+      context_queued_[context_id].store(false, std::memory_order_release);
+      contexts_[context_id].Work();
     }
+  }
+}
 
-    if (idle_loop_count > 500) {
-      // Idle for an extended period. Introduce a 20ms wait.
-      xe::threading::Wait(work_event_.get(), false,
-                          std::chrono::milliseconds(20));
+void XmaDecoder::ScheduleContext(uint32_t context_id) {
+  if (context_queued_[context_id].exchange(true, std::memory_order_acq_rel)) {
+    // Already waiting for a worker.
+    return;
+  }
+  if (!PushReadyContext(context_id)) {
+    // Can't happen - the queue has space for every context.
+    assert_always();
+    return;
+  }
+  work_semaphore_->Release(1, nullptr);
+}
+
+bool XmaDecoder::PushReadyContext(uint32_t context_id) {
+  uint32_t position =
+      ready_queue_push_position_.load(std::memory_order_relaxed);
+  while (true) {
+    ReadyQueueCell& cell = ready_queue_[position & (kReadyQueueSize - 1)];
+    uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+    int32_t difference = int32_t(sequence - position);
+    if (difference == 0) {
+      if (ready_queue_push_position_.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed)) {
+        cell.context_id = context_id;
+        cell.sequence.store(position + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (difference < 0) {
+      // Full.
+      return false;
+    } else {
+      position = ready_queue_push_position_.load(std::memory_order_relaxed);
     }
+  }
+}
 
-    xe::threading::MaybeYield();
+bool XmaDecoder::PopReadyContext(uint32_t& context_id_out) {
+  uint32_t position = ready_queue_pop_position_.load(std::memory_order_relaxed);
+  while (true) {
+    ReadyQueueCell& cell = ready_queue_[position & (kReadyQueueSize - 1)];
+    uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+    int32_t difference = int32_t(sequence - (position + 1));
+    if (difference == 0) {
+      if (ready_queue_pop_position_.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed)) {
+        context_id_out = cell.context_id;
+        cell.sequence.store(position + kReadyQueueSize,
+                            std::memory_order_release);
+        return true;
+      }
+    } else if (difference < 0) {
+      // Empty.
+      return false;
+    } else {
+      position = ready_queue_pop_position_.load(std::memory_order_relaxed);
+    }
   }
 }
 
 void XmaDecoder::Shutdown() {
   worker_running_ = false;
 
-  if (work_event_) {
-    work_event_->Set();
-  }
-
   if (paused_) {
     Resume();
   }
 
-  if (worker_thread_) {
-    // Wait for work thread.
-    xe::threading::Wait(worker_thread_->thread(), false);
-    worker_thread_.reset();
+  if (work_semaphore_) {
+    // Wake up all the workers so they can see that they need to exit.
+    work_semaphore_->Release(int(worker_count_), nullptr);
+  }
+
+  // Wait for work threads.
+  for (auto& worker_thread : worker_threads_) {
+    xe::threading::Wait(worker_thread->thread(), false);
   }
+  worker_threads_.clear();
 
   if (context_data_first_ptr_) {
     memory()->SystemHeapFree(context_data_first_ptr_);
@@ -311,10 +392,9 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         uint32_t context_id = base_context_id + i;
         auto& context = contexts_[context_id];
         context.Enable();
+        ScheduleContext(context_id);
       }
     }
-    // Signal the decoder thread to start processing.
-    work_event_->Set();
   } else if (r >= XE_XMA_REG_CONTEXT_LOCK_0 && r <= XE_XMA_REG_CONTEXT_LOCK_9) {
     // Context lock command.
     // This requests a lock by flagging the context.
@@ -327,8 +407,6 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         context.Disable();
       }
     }
-    // Signal the decoder thread to start processing.
-    work_event_->Set();
   } else if (r >= XE_XMA_REG_CONTEXT_CLEAR_0 &&
              r <= XE_XMA_REG_CONTEXT_CLEAR_9) {
     // Context clear command.
@@ -364,8 +442,11 @@ void XmaDecoder::Pause() {
   if (paused_) {
     return;
   }
+  resume_event_->Reset();
   paused_ = true;
 
+  // Wake up all the workers so they park.
+  work_semaphore_->Release(int(worker_count_), nullptr);
   pause_fence_.Wait();
 }
 
@@ -375,7 +456,9 @@ void XmaDecoder::Resume() {
   }
   paused_ = false;
 
-  resume_fence_.Signal();
+  resume_event_->Set();
+  // Let the workers pick up the contexts kicked while paused.
+  work_semaphore_->Release(int(worker_count_), nullptr);
 }
 
 }  // namespace apu
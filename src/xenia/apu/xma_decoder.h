@@ -11,10 +11,13 @@
 #define XENIA_APU_XMA_DECODER_H_
 
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include "xenia/apu/xma_context.h"
+#include "xenia/apu/xma_decoder_state.h"
 #include "xenia/apu/xma_register_file.h"
 #include "xenia/base/bit_map.h"
 #include "xenia/kernel/xthread.h"
@@ -57,6 +60,15 @@ class XmaDecoder {
  private:
   void WorkerThreadMain();
 
+  // Queues a kicked context for decoding unless it's already queued. A context
+  // is in the ready queue at most once, and XmaContext::Work is serialized by
+  // the context lock, so per-context ordering is preserved when it's kicked
+  // again while being decoded by another worker.
+  void ScheduleContext(uint32_t context_id);
+  // Lock-free bounded multi-producer multi-consumer queue of context IDs.
+  bool PushReadyContext(uint32_t context_id);
+  bool PopReadyContext(uint32_t& context_id_out);
+
   static uint32_t MMIOReadRegisterThunk(void* ppc_context, XmaDecoder* as,
                                         uint32_t addr) {
     return as->ReadRegister(addr);
@@ -71,19 +83,39 @@ class XmaDecoder {
   cpu::Processor* processor_ = nullptr;
 
   std::atomic<bool> worker_running_ = {false};
-  kernel::object_ref<kernel::XHostThread> worker_thread_;
-  std::unique_ptr<xe::threading::Event> work_event_ = nullptr;
-
-  bool paused_ = false;
-  xe::threading::Fence pause_fence_;   // Signaled when worker paused.
-  xe::threading::Fence resume_fence_;  // Signaled when resume requested.
+  uint32_t worker_count_ = 0;
+  std::vector<kernel::object_ref<kernel::XHostThread>> worker_threads_;
+  // Count of queued contexts not yet claimed by a worker (plus wakeups for
+  // pausing and shutting down) - workers sleep on it while idle.
+  std::unique_ptr<xe::threading::Semaphore> work_semaphore_ = nullptr;
+
+  std::atomic<bool> paused_ = {false};
+  std::atomic<uint32_t> paused_worker_count_ = {0};
+  xe::threading::Fence pause_fence_;  // Signaled when all workers paused.
+  // Manual-reset, set when resume requested.
+  std::unique_ptr<xe::threading::Event> resume_event_ = nullptr;
 
   XmaRegisterFile register_file_;
 
   static const uint32_t kContextCount = 320;
+  // Declared before the contexts, which return their states when destroyed.
+  XmaDecoderStatePool decoder_state_pool_;
   XmaContext contexts_[kContextCount];
   BitMap context_bitmap_;
 
+  // Whether each context is in the ready queue.
+  std::atomic<bool> context_queued_[kContextCount] = {};
+  // Power of two not smaller than kContextCount since every context is queued
+  // at most once.
+  static const uint32_t kReadyQueueSize = 512;
+  struct ReadyQueueCell {
+    std::atomic<uint32_t> sequence;
+    uint32_t context_id;
+  };
+  ReadyQueueCell ready_queue_[kReadyQueueSize];
+  std::atomic<uint32_t> ready_queue_push_position_ = {0};
+  std::atomic<uint32_t> ready_queue_pop_position_ = {0};
+
   uint32_t context_data_first_ptr_ = 0;
   uint32_t context_data_last_ptr_ = 0;
 };
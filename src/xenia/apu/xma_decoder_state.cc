@@ -0,0 +1,126 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_decoder_state.h"
+
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+
+extern "C" {
+#include "third_party/libav/libavcodec/avcodec.h"
+#include "third_party/libav/libavutil/channel_layout.h"
+
+extern AVCodec ff_xma2_decoder;
+}  // extern "C"
+
+namespace xe {
+namespace apu {
+
+XmaDecoderStatePool::~XmaDecoderStatePool() {
+  // All the states must have been returned by the contexts by now.
+  assert_true(free_states_.size() == created_state_count_);
+  for (XmaDecoderState* state : free_states_) {
+    DestroyState(state);
+  }
+}
+
+XmaDecoderState* XmaDecoderStatePool::Acquire() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_states_.empty()) {
+      XmaDecoderState* state = free_states_.back();
+      free_states_.pop_back();
+      return state;
+    }
+    // Count the state now, it's created outside the lock.
+    ++created_state_count_;
+  }
+  XmaDecoderState* state = CreateState();
+  if (!state) {
+    XELOGE("XmaDecoderStatePool: Failed to create a decoder state");
+    std::lock_guard<std::mutex> lock(mutex_);
+    --created_state_count_;
+  }
+  return state;
+}
+
+void XmaDecoderStatePool::Release(XmaDecoderState* state) {
+  if (!state) {
+    return;
+  }
+  // Reset the decoder for the next stream - the codec will be reopened with
+  // the new stream's parameters.
+  if (avcodec_is_open(state->context)) {
+    avcodec_close(state->context);
+  }
+  state->context->channels = 0;
+  state->context->sample_rate = 0;
+  av_frame_unref(state->decoded_frame);
+  std::memset(state->partial_frame_buffer.data(), 0,
+              state->partial_frame_buffer.size());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_states_.push_back(state);
+}
+
+XmaDecoderState* XmaDecoderStatePool::CreateState() {
+  auto state = new XmaDecoderState();
+
+  state->context = avcodec_alloc_context3(&ff_xma2_decoder);
+  state->decoded_frame = av_frame_alloc();
+  if (!state->context || !state->decoded_frame) {
+    DestroyState(state);
+    return nullptr;
+  }
+
+  state->packet = new AVPacket();
+  av_init_packet(state->packet);
+
+  // Initialize these to 0. They'll actually be set later.
+  state->context->channels = 0;
+  state->context->sample_rate = 0;
+  state->context->block_align = XmaContext::kBytesPerPacket;
+
+  // Extra data passed to the decoder.
+  std::memset(&state->extra_data, 0, sizeof(state->extra_data));
+  state->extra_data.bits_per_sample = 16;
+  state->extra_data.channel_mask = AV_CH_FRONT_RIGHT;
+  state->extra_data.decode_flags = 0x10D6;
+
+  state->context->extradata_size = sizeof(state->extra_data);
+  state->context->extradata = reinterpret_cast<uint8_t*>(&state->extra_data);
+
+  state->partial_frame_buffer.resize(XmaContext::kBytesPerPacket);
+  state->current_frame = std::make_unique<uint8_t[]>(
+      XmaContext::kSamplesPerFrame * XmaContext::kBytesPerSample * 2);
+
+  // FYI: We're purposely not opening the context here. That is done later.
+  return state;
+}
+
+void XmaDecoderStatePool::DestroyState(XmaDecoderState* state) {
+  if (state->context) {
+    if (avcodec_is_open(state->context)) {
+      avcodec_close(state->context);
+    }
+    // Not owned by libav.
+    state->context->extradata = nullptr;
+    av_free(state->context);
+  }
+  if (state->decoded_frame) {
+    av_frame_free(&state->decoded_frame);
+  }
+  delete state->packet;
+  delete state;
+}
+
+}  // namespace apu
+}  // namespace xe
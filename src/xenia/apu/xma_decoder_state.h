@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_XMA_DECODER_STATE_H_
+#define XENIA_APU_XMA_DECODER_STATE_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/apu/xma_context.h"
+
+namespace xe {
+namespace apu {
+
+// Host-side state needed to decode one XMA stream. Only contexts that are
+// actually used by the title hold one.
+struct XmaDecoderState {
+  // libav structures
+  AVCodecContext* context = nullptr;
+  AVFrame* decoded_frame = nullptr;
+  AVPacket* packet = nullptr;
+  // Referenced by context->extradata.
+  WmaProExtraData extra_data;
+
+  std::vector<uint8_t> partial_frame_buffer;
+
+  // Current frame stuff whatever
+  // samples per frame * 2 max channels * output bytes
+  std::unique_ptr<uint8_t[]> current_frame;
+};
+
+// Pool of decoder states, lazily created and reused across contexts so the
+// resident memory depends on the number of contexts in use at once rather than
+// on the number of hardware contexts. A context holds at most one state, so
+// the pool never holds more states than there are contexts.
+class XmaDecoderStatePool {
+ public:
+  XmaDecoderStatePool() = default;
+  ~XmaDecoderStatePool();
+
+  // Returns a state with the codec closed (it's opened when the stream
+  // parameters are known) and an empty partial frame, or nullptr if creation
+  // failed.
+  XmaDecoderState* Acquire();
+  void Release(XmaDecoderState* state);
+
+  uint32_t created_state_count() const { return created_state_count_; }
+
+ private:
+  static XmaDecoderState* CreateState();
+  static void DestroyState(XmaDecoderState* state);
+
+  std::mutex mutex_;
+  uint32_t created_state_count_ = 0;
+  std::vector<XmaDecoderState*> free_states_;
+};
+
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_XMA_DECODER_STATE_H_
@@ -215,11 +215,8 @@ int64_t Clock::ScaleGuestDurationFileTime(int64_t guest_file_time) {
         static_cast<int64_t>(relative_time * guest_time_scalar_);
     return static_cast<int64_t>(guest_time) + scaled_time;
   } else {
-    // Relative time.
-    uint64_t scaled_file_time = static_cast<uint64_t>(
-        (static_cast<uint64_t>(guest_file_time) * guest_time_scalar_));
-    // TODO(benvanik): check for overflow?
-    return scaled_file_time;
+    // Relative time, negative.
+    return static_cast<int64_t>(guest_file_time * guest_time_scalar_);
   }
 }
 
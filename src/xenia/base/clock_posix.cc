@@ -9,38 +9,34 @@
 
 #include "xenia/base/clock.h"
 
-#include <sys/time.h>
 #include <time.h>
 
 namespace xe {
 
 uint64_t Clock::host_tick_frequency_platform() {
-  timespec res;
-  clock_getres(CLOCK_MONOTONIC_RAW, &res);
-
-  return uint64_t(res.tv_sec) + uint64_t(res.tv_nsec) * 1000000000ull;
+  // Ticks are nanoseconds, clock_getres is the precision, not the frequency.
+  return 1000000000ull;
 }
 
 uint64_t Clock::host_tick_count_platform() {
   timespec res;
   clock_gettime(CLOCK_MONOTONIC_RAW, &res);
 
-  return uint64_t(res.tv_sec) + uint64_t(res.tv_nsec) * 1000000000ull;
+  return uint64_t(res.tv_sec) * 1000000000ull + uint64_t(res.tv_nsec);
 }
 
 uint64_t Clock::QueryHostSystemTime() {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-
-  uint64_t ret = tv.tv_usec;
-  ret /= 1000;  // usec -> msec
+  // 100-nanosecond intervals since January 1, 1601, like a FILETIME.
+  constexpr uint64_t kUnixEpochFileTime = 116444736000000000ull;
+  timespec res;
+  clock_gettime(CLOCK_REALTIME, &res);
 
-  ret += (tv.tv_sec * 1000);  // sec -> msec
-  return ret;
+  return kUnixEpochFileTime + uint64_t(res.tv_sec) * 10000000ull +
+         uint64_t(res.tv_nsec) / 100;
 }
 
 uint64_t Clock::QueryHostUptimeMillis() {
-  return host_tick_count_platform() * 1000 / host_tick_frequency_platform();
+  return host_tick_count_platform() / 1000000ull;
 }
 
 }  // namespace xe
\ No newline at end of file
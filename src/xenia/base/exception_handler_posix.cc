@@ -2,17 +2,209 @@
  ******************************************************************************
  * Xenia : Xbox 360 Emulator Research Project                                 *
  ******************************************************************************
- * Copyright 2017 Ben Vanik. All rights reserved.                             *
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
  * Released under the BSD license - see LICENSE in the root for more details. *
  ******************************************************************************
  */
 
 #include "xenia/base/exception_handler.h"
 
+#include <signal.h>
+#include <ucontext.h>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/math.h"
+
 namespace xe {
 
-// TODO(DrChat): Exception handling on linux.
-void ExceptionHandler::Install(Handler fn, void* data) {}
-void ExceptionHandler::Uninstall(Handler fn, void* data) {}
+// Whether the signal handlers are installed.
+bool signal_handlers_installed_ = false;
+// Actions that were set before ours, restored when uninstalling and used for
+// signals that aren't handled.
+struct sigaction original_sigill_handler_;
+struct sigaction original_sigsegv_handler_;
+
+// This can be as large as needed, but isn't often needed.
+// As we will be sometimes firing many exceptions we want to avoid having to
+// scan the table too much or invoke many custom handlers.
+constexpr size_t kMaxHandlerCount = 8;
+
+// All custom handlers, executed in order, with empty slots where handlers were
+// uninstalled. Read by the signal handler on any thread while being modified,
+// so the data is written before the function is published with release
+// ordering, and a slot is only reused once no signal handler is running.
+struct HandlerSlot {
+  std::atomic<ExceptionHandler::Handler> fn;
+  std::atomic<void*> data;
+};
+HandlerSlot handlers_[kMaxHandlerCount];
+// Signal handlers currently reading handlers_.
+std::atomic<uint32_t> active_signal_handler_count_(0);
+
+#if XE_ARCH_AMD64
+// Order of the general-purpose registers in X64Context, indices in gregs.
+constexpr int kIntRegisterMapping[] = {
+    REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+    REG_R8,  REG_R9,  REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+};
+static_assert(sizeof(kIntRegisterMapping) / sizeof(*kIntRegisterMapping) ==
+                  sizeof(X64Context::int_registers) / sizeof(uint64_t),
+              "All registers must be mapped");
+// Bit 1 of the page fault error code is set for writes.
+constexpr greg_t kPageFaultErrorWrite = 1 << 1;
+#endif  // XE_ARCH_AMD64
+
+void ForwardSignal(int signal_number, siginfo_t* signal_info,
+                   void* signal_context) {
+  const struct sigaction& original_action = signal_number == SIGILL
+                                                ? original_sigill_handler_
+                                                : original_sigsegv_handler_;
+  if ((original_action.sa_flags & SA_SIGINFO) &&
+      original_action.sa_sigaction) {
+    original_action.sa_sigaction(signal_number, signal_info, signal_context);
+    return;
+  }
+  if (original_action.sa_handler == SIG_IGN) {
+    return;
+  }
+  if (original_action.sa_handler != SIG_DFL) {
+    original_action.sa_handler(signal_number);
+    return;
+  }
+  // Restore the default action, the faulting instruction will be executed
+  // again and will terminate the process as usual.
+  struct sigaction default_action = {};
+  default_action.sa_handler = SIG_DFL;
+  sigaction(signal_number, &default_action, nullptr);
+}
+
+void ExceptionHandlerCallback(int signal_number, siginfo_t* signal_info,
+                              void* signal_context) {
+#if XE_ARCH_AMD64
+  mcontext_t& mcontext =
+      reinterpret_cast<ucontext_t*>(signal_context)->uc_mcontext;
+
+  // TODO(benvanik): avoid this by mapping X64Context virtual?
+  X64Context thread_context;
+  thread_context.rip = uint64_t(mcontext.gregs[REG_RIP]);
+  thread_context.eflags = uint32_t(mcontext.gregs[REG_EFL]);
+  for (size_t i = 0; i < xe::countof(kIntRegisterMapping); ++i) {
+    thread_context.int_registers[i] =
+        uint64_t(mcontext.gregs[kIntRegisterMapping[i]]);
+  }
+  // fpregs points to the XSAVE area on the signal stack, normally present on
+  // x86-64, but not guaranteed to be.
+  if (mcontext.fpregs) {
+    std::memcpy(thread_context.xmm_registers, mcontext.fpregs->_xmm,
+                sizeof(thread_context.xmm_registers));
+  } else {
+    std::memset(thread_context.xmm_registers, 0,
+                sizeof(thread_context.xmm_registers));
+  }
+
+  Exception ex;
+  switch (signal_number) {
+    case SIGILL:
+      ex.InitializeIllegalInstruction(&thread_context);
+      break;
+    case SIGSEGV: {
+      Exception::AccessViolationOperation access_violation_operation =
+          (mcontext.gregs[REG_ERR] & kPageFaultErrorWrite)
+              ? Exception::AccessViolationOperation::kWrite
+              : Exception::AccessViolationOperation::kRead;
+      ex.InitializeAccessViolation(
+          &thread_context, reinterpret_cast<uint64_t>(signal_info->si_addr),
+          access_violation_operation);
+    } break;
+    default:
+      assert_unhandled_case(signal_number);
+      return;
+  }
+
+  active_signal_handler_count_.fetch_add(1);
+  bool handled = false;
+  for (size_t i = 0; i < xe::countof(handlers_) && !handled; ++i) {
+    // Sequentially consistent with the count, see Uninstall.
+    ExceptionHandler::Handler fn = handlers_[i].fn.load();
+    if (fn) {
+      handled = fn(&ex, handlers_[i].data.load(std::memory_order_relaxed));
+    }
+  }
+  active_signal_handler_count_.fetch_sub(1);
+  if (handled) {
+    // Exception handled. Unlike on Windows, handlers may update registers
+    // other than the program counter, such as the result of an emulated
+    // MMIO load, so write back the whole context.
+    mcontext.gregs[REG_RIP] = greg_t(thread_context.rip);
+    mcontext.gregs[REG_EFL] = greg_t(thread_context.eflags);
+    for (size_t j = 0; j < xe::countof(kIntRegisterMapping); ++j) {
+      mcontext.gregs[kIntRegisterMapping[j]] =
+          greg_t(thread_context.int_registers[j]);
+    }
+    if (mcontext.fpregs) {
+      std::memcpy(mcontext.fpregs->_xmm, thread_context.xmm_registers,
+                  sizeof(thread_context.xmm_registers));
+    }
+    return;
+  }
+#endif  // XE_ARCH_AMD64
+
+  ForwardSignal(signal_number, signal_info, signal_context);
+}
+
+void ExceptionHandler::Install(Handler fn, void* data) {
+  if (!signal_handlers_installed_) {
+    struct sigaction signal_handler = {};
+    signal_handler.sa_sigaction = ExceptionHandlerCallback;
+    signal_handler.sa_flags = SA_SIGINFO;
+    sigemptyset(&signal_handler.sa_mask);
+    if (sigaction(SIGILL, &signal_handler, &original_sigill_handler_) != 0) {
+      assert_always("Failed to install the SIGILL handler");
+    }
+    if (sigaction(SIGSEGV, &signal_handler, &original_sigsegv_handler_) !=
+        0) {
+      assert_always("Failed to install the SIGSEGV handler");
+    }
+    signal_handlers_installed_ = true;
+  }
+
+  for (size_t i = 0; i < xe::countof(handlers_); ++i) {
+    if (!handlers_[i].fn.load(std::memory_order_relaxed)) {
+      handlers_[i].data.store(data, std::memory_order_relaxed);
+      handlers_[i].fn.store(fn, std::memory_order_release);
+      return;
+    }
+  }
+  assert_always("Too many exception handlers installed");
+}
+
+void ExceptionHandler::Uninstall(Handler fn, void* data) {
+  bool removed = false;
+  bool has_any = false;
+  for (size_t i = 0; i < xe::countof(handlers_); ++i) {
+    Handler slot_fn = handlers_[i].fn.load(std::memory_order_relaxed);
+    if (!removed && slot_fn == fn &&
+        handlers_[i].data.load(std::memory_order_relaxed) == data) {
+      handlers_[i].fn.store(nullptr);
+      // Signal handlers that have read the function may still use the data,
+      // and the slot may be reused with other data after returning.
+      while (active_signal_handler_count_.load()) {
+        std::this_thread::yield();
+      }
+      handlers_[i].data.store(nullptr, std::memory_order_relaxed);
+      removed = true;
+    } else if (slot_fn) {
+      has_any = true;
+    }
+  }
+  if (!has_any && signal_handlers_installed_) {
+    sigaction(SIGILL, &original_sigill_handler_, nullptr);
+    sigaction(SIGSEGV, &original_sigsegv_handler_, nullptr);
+    signal_handlers_installed_ = false;
+  }
+}
 
-}  // namespace xe
\ No newline at end of file
+}  // namespace xe
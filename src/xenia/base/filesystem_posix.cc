@@ -162,25 +162,17 @@ class PosixFileHandle : public FileHandle {
 
 std::unique_ptr<FileHandle> FileHandle::OpenExisting(
     const std::filesystem::path& path, uint32_t desired_access) {
-  int open_access = 0;
-  if (desired_access & FileAccess::kGenericRead) {
-    open_access |= O_RDONLY;
-  }
-  if (desired_access & FileAccess::kGenericWrite) {
-    open_access |= O_WRONLY;
-  }
-  if (desired_access & FileAccess::kGenericExecute) {
-    open_access |= O_RDONLY;
-  }
-  if (desired_access & FileAccess::kGenericAll) {
-    open_access |= O_RDWR;
-  }
-  if (desired_access & FileAccess::kFileReadData) {
-    open_access |= O_RDONLY;
-  }
-  if (desired_access & FileAccess::kFileWriteData) {
-    open_access |= O_WRONLY;
-  }
+  // O_RDONLY is 0, so reading and writing must be combined explicitly. Opens
+  // without data access (attributes, synchronization) are read-only so that
+  // they work for read-only files and directories.
+  bool read = (desired_access &
+               (FileAccess::kGenericRead | FileAccess::kGenericExecute |
+                FileAccess::kGenericAll | FileAccess::kFileReadData)) != 0;
+  bool write =
+      (desired_access &
+       (FileAccess::kGenericWrite | FileAccess::kGenericAll |
+        FileAccess::kFileWriteData | FileAccess::kFileAppendData)) != 0;
+  int open_access = write ? (read ? O_RDWR : O_WRONLY) : O_RDONLY;
   if (desired_access & FileAccess::kFileAppendData) {
     open_access |= O_APPEND;
   }
@@ -217,6 +209,10 @@ std::vector<FileInfo> ListFiles(const std::filesystem::path& path) {
   }
 
   while (auto ent = readdir(dir)) {
+    if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+      continue;
+    }
+
     FileInfo info;
 
     info.name = ent->d_name;
@@ -234,6 +230,7 @@ std::vector<FileInfo> ListFiles(const std::filesystem::path& path) {
     }
     result.push_back(info);
   }
+  closedir(dir);
 
   return result;
 }
@@ -9,10 +9,21 @@
 
 #include "xenia/base/mapped_memory.h"
 
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/string.h"
 
 namespace xe {
@@ -69,18 +80,206 @@ std::unique_ptr<MappedMemory> MappedMemory::Open(
 
   mm->data_ =
       mmap(0, map_length, prot, MAP_SHARED, fileno(mm->file_handle), offset);
-  if (!mm->data_) {
+  if (mm->data_ == MAP_FAILED) {
+    mm->data_ = nullptr;
     return nullptr;
   }
 
   return std::move(mm);
 }
 
+class PosixChunkedMappedMemoryWriter : public ChunkedMappedMemoryWriter {
+ public:
+  PosixChunkedMappedMemoryWriter(const std::filesystem::path& path,
+                                 size_t chunk_size, bool low_address_space)
+      : ChunkedMappedMemoryWriter(path, chunk_size, low_address_space) {
+    flush_thread_ = std::thread([this]() { FlushThreadMain(); });
+  }
+
+  ~PosixChunkedMappedMemoryWriter() override {
+    {
+      std::lock_guard<std::mutex> lock(flush_mutex_);
+      flush_thread_running_ = false;
+    }
+    flush_cond_.notify_all();
+    flush_thread_.join();
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunks_.clear();
+  }
+
+  uint8_t* Allocate(size_t length) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!chunks_.empty()) {
+      uint8_t* result = chunks_.back()->Allocate(length);
+      if (result != nullptr) {
+        return result;
+      }
+    }
+    auto chunk = std::make_unique<Chunk>(chunk_size_);
+    auto chunk_path = std::filesystem::path(path_).replace_extension(
+        fmt::format(".{}", chunks_.size()));
+    if (!chunk->Open(chunk_path, low_address_space_)) {
+      return nullptr;
+    }
+    uint8_t* result = chunk->Allocate(length);
+    if (!chunks_.empty()) {
+      // Nothing new will be allocated in the previous chunk, write it back in
+      // the background so that little is left to flush on exit.
+      {
+        std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+        flush_queue_.push_back(chunks_.back().get());
+      }
+      flush_cond_.notify_one();
+    }
+    chunks_.push_back(std::move(chunk));
+    return result;
+  }
+
+  void Flush() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& chunk : chunks_) {
+      chunk->Flush();
+    }
+  }
+
+  void FlushNew() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& chunk : chunks_) {
+      chunk->FlushNew();
+    }
+  }
+
+ private:
+  class Chunk {
+   public:
+    explicit Chunk(size_t capacity)
+        : fd_(-1),
+          data_(nullptr),
+          offset_(0),
+          capacity_(capacity),
+          last_flush_offset_(0) {}
+
+    ~Chunk() {
+      if (data_) {
+        munmap(data_, capacity_);
+      }
+      if (fd_ != -1) {
+        // Drop the unused tail, the data is only written through the mapping.
+        if (ftruncate(fd_, off_t(offset_))) {
+          XELOGW("Unable to truncate a chunk to {} bytes", offset_);
+        }
+        close(fd_);
+      }
+    }
+
+    bool Open(const std::filesystem::path& path, bool low_address_space) {
+      fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (fd_ == -1) {
+        XELOGE("Unable to create {}", xe::path_to_utf8(path));
+        return false;
+      }
+      if (ftruncate(fd_, off_t(capacity_))) {
+        return false;
+      }
+
+      int prot = PROT_READ | PROT_WRITE;
+      void* data;
+      if (low_address_space) {
+        // Code referencing the data may only use 32-bit displacements, find
+        // free space below 2 GB. A hint is only used if the range is free.
+        data = MAP_FAILED;
+        for (uintptr_t address = 0x10000000;
+             address + capacity_ <= 0x80000000; address += capacity_) {
+          void* hint = reinterpret_cast<void*>(address);
+          void* mapping = mmap(hint, capacity_, prot, MAP_SHARED, fd_, 0);
+          if (mapping == hint) {
+            data = mapping;
+            break;
+          }
+          if (mapping != MAP_FAILED) {
+            munmap(mapping, capacity_);
+          }
+        }
+        if (data == MAP_FAILED) {
+          XELOGE("Unable to find space for mapping");
+        }
+      } else {
+        data = mmap(nullptr, capacity_, prot, MAP_SHARED, fd_, 0);
+      }
+      if (data == MAP_FAILED) {
+        return false;
+      }
+      data_ = reinterpret_cast<uint8_t*>(data);
+
+      return true;
+    }
+
+    uint8_t* Allocate(size_t length) {
+      if (capacity_ - offset_ < length) {
+        return nullptr;
+      }
+      uint8_t* result = data_ + offset_;
+      offset_ += length;
+      return result;
+    }
+
+    void Flush() { msync(data_, capacity_, MS_SYNC); }
+
+    void FlushNew() {
+      // msync requires a page-aligned start.
+      size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+      size_t start = last_flush_offset_ - last_flush_offset_ % page_size;
+      if (offset_ > start) {
+        msync(data_ + start, offset_ - start, MS_ASYNC);
+      }
+      last_flush_offset_ = offset_;
+    }
+
+   private:
+    int fd_;
+    uint8_t* data_;
+    size_t offset_;
+    size_t capacity_;
+    size_t last_flush_offset_;
+  };
+
+  void FlushThreadMain() {
+    std::unique_lock<std::mutex> lock(flush_mutex_);
+    while (true) {
+      flush_cond_.wait(lock, [this]() {
+        return !flush_thread_running_ || !flush_queue_.empty();
+      });
+      if (flush_queue_.empty()) {
+        // Stopping, anything remaining is written back on unmapping.
+        break;
+      }
+      Chunk* chunk = flush_queue_.front();
+      flush_queue_.pop_front();
+      lock.unlock();
+      // Chunks are only destroyed after this thread has exited.
+      chunk->Flush();
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Chunk>> chunks_;
+
+  // Completed chunks to write back.
+  std::mutex flush_mutex_;
+  std::condition_variable flush_cond_;
+  std::deque<Chunk*> flush_queue_;
+  bool flush_thread_running_ = true;
+  std::thread flush_thread_;
+};
+
 std::unique_ptr<ChunkedMappedMemoryWriter> ChunkedMappedMemoryWriter::Open(
     const std::filesystem::path& path, size_t chunk_size,
     bool low_address_space) {
-  // TODO(DrChat)
-  return nullptr;
+  size_t aligned_chunk_size =
+      xe::round_up(chunk_size, size_t(sysconf(_SC_PAGESIZE)));
+  return std::make_unique<PosixChunkedMappedMemoryWriter>(
+      path, aligned_chunk_size, low_address_space);
 }
 
 }  // namespace xe
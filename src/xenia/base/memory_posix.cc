@@ -13,6 +13,8 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <cstdlib>
+#include <cstring>
 
 namespace xe {
 namespace memory {
@@ -58,7 +60,68 @@ bool Protect(void* base_address, size_t length, PageAccess access,
 }
 
 bool QueryProtect(void* base_address, size_t& length, PageAccess& access_out) {
-  return false;
+  access_out = PageAccess::kNoAccess;
+
+  // There's no system call for this, so look up the mapping in
+  // /proc/self/maps. This may be called from signal handlers, so no memory is
+  // allocated.
+  int file = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+  if (file < 0) {
+    return false;
+  }
+  uintptr_t address = reinterpret_cast<uintptr_t>(base_address);
+  uintptr_t page_address = address & ~uintptr_t(page_size() - 1);
+  bool found = false;
+  char buffer[4096];
+  size_t buffer_used = 0;
+  while (!found) {
+    ssize_t read_size =
+        read(file, buffer + buffer_used, sizeof(buffer) - 1 - buffer_used);
+    if (read_size <= 0) {
+      break;
+    }
+    buffer_used += size_t(read_size);
+    buffer[buffer_used] = '\0';
+    // Parse the complete lines, in the "start-end perms ..." format.
+    char* line = buffer;
+    char* line_end;
+    while ((line_end = std::strchr(line, '\n')) != nullptr) {
+      char* parse_end;
+      uintptr_t start = uintptr_t(std::strtoull(line, &parse_end, 16));
+      uintptr_t end = uintptr_t(std::strtoull(parse_end + 1, &parse_end, 16));
+      if (address >= start && address < end) {
+        const char* permissions = parse_end + 1;
+        if (permissions[0] == 'r') {
+          if (permissions[1] == 'w') {
+            access_out = permissions[2] == 'x' ? PageAccess::kExecuteReadWrite
+                                               : PageAccess::kReadWrite;
+          } else {
+            access_out = PageAccess::kReadOnly;
+          }
+        }
+        length = end - page_address;
+        found = true;
+        break;
+      }
+      if (start > address) {
+        // Mappings are sorted, the address isn't mapped.
+        break;
+      }
+      line = line_end + 1;
+    }
+    if (line == buffer && !found && buffer_used == sizeof(buffer) - 1) {
+      // A line longer than the buffer, can't be parsed.
+      break;
+    }
+    if (!found && line_end == nullptr) {
+      buffer_used -= size_t(line - buffer);
+      std::memmove(buffer, line, buffer_used);
+    } else {
+      break;
+    }
+  }
+  close(file);
+  return found;
 }
 
 FileMappingHandle CreateFileMappingHandle(const std::filesystem::path& path,
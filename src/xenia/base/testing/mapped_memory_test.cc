@@ -0,0 +1,56 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/mapped_memory.h"
+
+#include <cstring>
+#include <filesystem>
+
+#include "xenia/base/testing/util.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace base {
+namespace test {
+
+TEST_CASE("CHUNKED_MAPPED_MEMORY_WRITER", "[mapped_memory]") {
+  testing::TempDirectory directory("xenia-mapped-memory-test");
+  auto path = directory.path() / "chunked.bin";
+  // Larger than half of a chunk, so each allocation gets its own chunk.
+  const size_t kAllocationSize = 40000;
+  {
+    auto writer = ChunkedMappedMemoryWriter::Open(path, 65536, true);
+    REQUIRE(writer != nullptr);
+    for (uint8_t i = 0; i < 2; ++i) {
+      uint8_t* data = writer->Allocate(kAllocationSize);
+      REQUIRE(data != nullptr);
+      // Addressable with 32-bit displacements.
+      REQUIRE(uintptr_t(data) + kAllocationSize <= 0x80000000);
+      std::memset(data, 0xA0 + i, kAllocationSize);
+      writer->FlushNew();
+    }
+    writer->Flush();
+  }
+
+  for (uint8_t i = 0; i < 2; ++i) {
+    auto chunk_path = std::filesystem::path(path).replace_extension(
+        i ? ".1" : ".0");
+    auto chunk = MappedMemory::Open(chunk_path, MappedMemory::Mode::kRead);
+    REQUIRE(chunk != nullptr);
+    REQUIRE(chunk->size() >= kAllocationSize);
+    for (size_t j = 0; j < kAllocationSize; ++j) {
+      REQUIRE(chunk->data()[j] == 0xA0 + i);
+    }
+  }
+}
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
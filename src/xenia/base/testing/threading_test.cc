@@ -0,0 +1,404 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/threading.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "xenia/base/testing/util.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace base {
+namespace test {
+using namespace xe::threading;
+using namespace std::chrono_literals;
+
+std::unique_ptr<Thread> CreateThread(std::function<void()> start_routine) {
+  auto thread = Thread::Create({}, std::move(start_routine));
+  REQUIRE(thread != nullptr);
+  return thread;
+}
+
+TEST_CASE("THREADING_EVENT", "[threading]") {
+  auto manual_event = Event::CreateManualResetEvent(false);
+  REQUIRE(Wait(manual_event.get(), false, 0ms) == WaitResult::kTimeout);
+  manual_event->Set();
+  REQUIRE(Wait(manual_event.get(), false, 0ms) == WaitResult::kSuccess);
+  REQUIRE(Wait(manual_event.get(), false, 0ms) == WaitResult::kSuccess);
+  manual_event->Reset();
+  REQUIRE(Wait(manual_event.get(), false, 10ms) == WaitResult::kTimeout);
+
+  auto auto_event = Event::CreateAutoResetEvent(true);
+  REQUIRE(Wait(auto_event.get(), false, 0ms) == WaitResult::kSuccess);
+  REQUIRE(Wait(auto_event.get(), false, 0ms) == WaitResult::kTimeout);
+
+  // Set from another thread while waiting.
+  auto thread = CreateThread([&auto_event]() {
+    Sleep(10ms);
+    auto_event->Set();
+  });
+  REQUIRE(Wait(auto_event.get(), false, 5s) == WaitResult::kSuccess);
+  REQUIRE(Wait(thread.get(), false, 5s) == WaitResult::kSuccess);
+}
+
+TEST_CASE("THREADING_SEMAPHORE", "[threading]") {
+  auto semaphore = Semaphore::Create(2, 3);
+  REQUIRE(Wait(semaphore.get(), false, 0ms) == WaitResult::kSuccess);
+  REQUIRE(Wait(semaphore.get(), false, 0ms) == WaitResult::kSuccess);
+  REQUIRE(Wait(semaphore.get(), false, 0ms) == WaitResult::kTimeout);
+  int previous_count = -1;
+  REQUIRE(semaphore->Release(2, &previous_count));
+  REQUIRE(previous_count == 0);
+  REQUIRE(!semaphore->Release(2, &previous_count));
+  REQUIRE(semaphore->Release(1, &previous_count));
+  REQUIRE(previous_count == 2);
+}
+
+TEST_CASE("THREADING_MUTANT", "[threading]") {
+  auto mutant = Mutant::Create(true);
+  // Recursive acquisition by the owner.
+  REQUIRE(Wait(mutant.get(), false, 0ms) == WaitResult::kSuccess);
+
+  // Catch assertions are only made on the main thread.
+  std::atomic<bool> released_unowned(true);
+  std::atomic<bool> acquired(false);
+  std::atomic<bool> released(false);
+  auto thread = CreateThread([&]() {
+    released_unowned = mutant->Release();
+    acquired = Wait(mutant.get(), false, 5s) == WaitResult::kSuccess;
+    released = mutant->Release();
+  });
+  REQUIRE(mutant->Release());
+  Sleep(10ms);
+  REQUIRE(!acquired);
+  REQUIRE(mutant->Release());
+  REQUIRE(!mutant->Release());
+  REQUIRE(Wait(thread.get(), false, 5s) == WaitResult::kSuccess);
+  REQUIRE(!released_unowned);
+  REQUIRE(acquired);
+  REQUIRE(released);
+}
+
+TEST_CASE("THREADING_WAIT_MULTIPLE", "[threading]") {
+  auto event_0 = Event::CreateManualResetEvent(false);
+  auto event_1 = Event::CreateAutoResetEvent(false);
+  WaitHandle* handles[] = {event_0.get(), event_1.get()};
+
+  REQUIRE(WaitAny(handles, 2, false, 0ms).first == WaitResult::kTimeout);
+  event_1->Set();
+  auto result = WaitAny(handles, 2, false, 0ms);
+  REQUIRE(result.first == WaitResult::kSuccess);
+  REQUIRE(result.second == 1);
+
+  // Nothing is acquired unless all are signaled.
+  event_1->Set();
+  REQUIRE(WaitAll(handles, 2, false, 0ms) == WaitResult::kTimeout);
+  event_0->Set();
+  REQUIRE(WaitAll(handles, 2, false, 0ms) == WaitResult::kSuccess);
+  REQUIRE(Wait(event_0.get(), false, 0ms) == WaitResult::kSuccess);
+  REQUIRE(Wait(event_1.get(), false, 0ms) == WaitResult::kTimeout);
+
+  event_0->Reset();
+  auto thread = CreateThread([&event_0, &event_1]() {
+    event_1->Set();
+    Sleep(10ms);
+    event_0->Set();
+  });
+  REQUIRE(WaitAll(handles, 2, false, 5s) == WaitResult::kSuccess);
+  REQUIRE(Wait(thread.get(), false, 5s) == WaitResult::kSuccess);
+}
+
+TEST_CASE("THREADING_ALERTABLE_WAIT", "[threading]") {
+  auto event = Event::CreateManualResetEvent(false);
+  auto ready_event = Event::CreateManualResetEvent(false);
+  std::atomic<uint32_t> callback_thread_id(0);
+  std::atomic<uint32_t> thread_id(0);
+  WaitResult non_alertable_wait_result = WaitResult::kFailed;
+  uint32_t non_alertable_callback_thread_id = 1;
+  WaitResult wait_result = WaitResult::kFailed;
+  SleepResult sleep_result = SleepResult::kSuccess;
+  auto thread = CreateThread([&]() {
+    thread_id = current_thread_system_id();
+    ready_event->Set();
+    // Not alertable, the callback must not be called yet.
+    non_alertable_wait_result = Wait(event.get(), false, 20ms);
+    non_alertable_callback_thread_id = callback_thread_id;
+    wait_result = Wait(event.get(), true);
+    sleep_result = AlertableSleep(10s);
+  });
+  REQUIRE(Wait(ready_event.get(), false, 5s) == WaitResult::kSuccess);
+  thread->QueueUserCallback(
+      [&]() { callback_thread_id = current_thread_system_id(); });
+  Sleep(30ms);
+  thread->QueueUserCallback([]() {});
+  REQUIRE(Wait(thread.get(), false, 5s) == WaitResult::kSuccess);
+  REQUIRE(non_alertable_wait_result == WaitResult::kTimeout);
+  REQUIRE(!non_alertable_callback_thread_id);
+  REQUIRE(wait_result == WaitResult::kUserCallback);
+  REQUIRE(sleep_result == SleepResult::kAlerted);
+  REQUIRE(callback_thread_id == thread_id);
+}
+
+TEST_CASE("THREADING_TIMER", "[threading]") {
+  auto timer = Timer::CreateSynchronizationTimer();
+  REQUIRE(timer->SetOnce(-std::chrono::nanoseconds(10ms)));
+  REQUIRE(Wait(timer.get(), false, 0ms) == WaitResult::kTimeout);
+  REQUIRE(Wait(timer.get(), false, 5s) == WaitResult::kSuccess);
+  REQUIRE(Wait(timer.get(), false, 20ms) == WaitResult::kTimeout);
+
+  // Callbacks are called on the thread that set the timer, when alertable.
+  uint32_t fire_count = 0;
+  auto manual_timer = Timer::CreateManualResetTimer();
+  REQUIRE(manual_timer->SetRepeating(-std::chrono::nanoseconds(1ms),
+                                     std::chrono::milliseconds(1),
+                                     [&fire_count]() { ++fire_count; }));
+  while (fire_count < 3) {
+    REQUIRE(AlertableSleep(5s) == SleepResult::kAlerted);
+  }
+  REQUIRE(Wait(manual_timer.get(), false, 0ms) == WaitResult::kSuccess);
+  REQUIRE(Wait(manual_timer.get(), false, 0ms) == WaitResult::kSuccess);
+  REQUIRE(manual_timer->Cancel());
+  // Drain the callbacks queued before canceling.
+  AlertableSleep(10ms);
+  uint32_t canceled_fire_count = fire_count;
+  REQUIRE(AlertableSleep(20ms) == SleepResult::kSuccess);
+  REQUIRE(fire_count == canceled_fire_count);
+
+  std::atomic<uint32_t> tick_count(0);
+  auto high_resolution_timer = HighResolutionTimer::CreateRepeating(
+      1ms, [&tick_count]() { ++tick_count; });
+  REQUIRE(high_resolution_timer != nullptr);
+  Sleep(100ms);
+  high_resolution_timer.reset();
+  REQUIRE(tick_count >= 10);
+
+  // Timers can be set while a slow callback is running, and destroying a timer
+  // waits for its callback to return.
+  std::atomic<bool> in_callback(false);
+  auto slow_timer =
+      HighResolutionTimer::CreateRepeating(1ms, [&in_callback]() {
+        in_callback = true;
+        Sleep(200ms);
+        in_callback = false;
+      });
+  while (!in_callback) {
+    Sleep(1ms);
+  }
+  auto set_start = std::chrono::steady_clock::now();
+  REQUIRE(timer->SetOnce(-std::chrono::nanoseconds(1ms)));
+  REQUIRE(timer->Cancel());
+  REQUIRE(std::chrono::steady_clock::now() - set_start < 100ms);
+  REQUIRE(in_callback);
+  slow_timer.reset();
+  REQUIRE(!in_callback);
+}
+
+TEST_CASE("THREADING_HIGH_RESOLUTION_SLEEP", "[threading]") {
+  // Never shorter than requested, including below the host sleep slack.
+  for (auto duration : {50us, 500us, 2000us}) {
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(HighResolutionSleep(duration, false) == SleepResult::kSuccess);
+    REQUIRE(std::chrono::steady_clock::now() - start >= duration);
+  }
+
+  auto ready_event = Event::CreateManualResetEvent(false);
+  SleepResult sleep_result = SleepResult::kSuccess;
+  auto thread = CreateThread([&]() {
+    ready_event->Set();
+    sleep_result = HighResolutionSleep(10s, true);
+  });
+  REQUIRE(Wait(ready_event.get(), false, 5s) == WaitResult::kSuccess);
+  thread->QueueUserCallback([]() {});
+  REQUIRE(Wait(thread.get(), false, 5s) == WaitResult::kSuccess);
+  REQUIRE(sleep_result == SleepResult::kAlerted);
+}
+
+TEST_CASE("THREADING_AFFINITY", "[threading]") {
+  // Each logical processor belongs to at most one physical core.
+  uint64_t all_cores_mask = 0;
+  for (uint64_t core_mask : physical_core_processor_masks()) {
+    REQUIRE(core_mask != 0);
+    REQUIRE((all_cores_mask & core_mask) == 0);
+    all_cores_mask |= core_mask;
+  }
+
+  auto ready_event = Event::CreateManualResetEvent(false);
+  auto exit_event = Event::CreateManualResetEvent(false);
+  auto thread = CreateThread([&]() {
+    ready_event->Set();
+    Wait(exit_event.get(), false, 5s);
+  });
+  REQUIRE(Wait(ready_event.get(), false, 5s) == WaitResult::kSuccess);
+  uint64_t original_mask = thread->affinity_mask();
+  REQUIRE(original_mask != 0);
+  uint64_t first_processor_mask = original_mask & ~(original_mask - 1);
+  thread->set_affinity_mask(first_processor_mask);
+  REQUIRE(thread->affinity_mask() == first_processor_mask);
+  exit_event->Set();
+  REQUIRE(Wait(thread.get(), false, 5s) == WaitResult::kSuccess);
+}
+
+TEST_CASE("THREADING_WAIT_ON_ADDRESS", "[threading]") {
+  volatile uint32_t value = 0;
+  // Returns immediately if the value is different, or after the timeout.
+  WaitOnAddress(&value, 1, std::chrono::nanoseconds(5s));
+  WaitOnAddress(&value, 0, std::chrono::nanoseconds(1ms));
+
+  std::atomic<bool> woken(false);
+  auto thread = CreateThread([&]() {
+    while (value == 0) {
+      WaitOnAddress(&value, 0, std::chrono::nanoseconds::max());
+    }
+    woken = true;
+  });
+  Sleep(10ms);
+  REQUIRE(!woken);
+  value = 1;
+  WakeByAddressAll(&value);
+  REQUIRE(Wait(thread.get(), false, 5s) == WaitResult::kSuccess);
+  REQUIRE(woken);
+}
+
+TEST_CASE("THREADING_BENCHMARK", "[.benchmark]") {
+  // Uncontended signal and wait on the same thread.
+  {
+    constexpr uint32_t kIterationCount = 10000000;
+    auto event = Event::CreateAutoResetEvent(false);
+    testing::BenchmarkTimer timer;
+    for (uint32_t i = 0; i < kIterationCount; ++i) {
+      event->Set();
+      Wait(event.get(), false);
+    }
+    WARN("Uncontended Set + Wait: "
+         << timer.seconds() * 1e9 / kIterationCount << " ns");
+  }
+
+  // Latency of waking another thread, round trips between two threads.
+  {
+    constexpr uint32_t kRoundTripCount = 200000;
+    auto ping = Event::CreateAutoResetEvent(false);
+    auto pong = Event::CreateAutoResetEvent(false);
+    auto thread = CreateThread([&]() {
+      for (uint32_t i = 0; i < kRoundTripCount; ++i) {
+        Wait(ping.get(), false);
+        pong->Set();
+      }
+    });
+    testing::BenchmarkTimer timer;
+    for (uint32_t i = 0; i < kRoundTripCount; ++i) {
+      ping->Set();
+      Wait(pong.get(), false);
+    }
+    WARN("Round trip between threads: "
+         << timer.seconds() * 1e6 / kRoundTripCount << " us");
+    Wait(thread.get(), false);
+  }
+
+  // The same round trips, waiting on the address of a shared value, as done
+  // for guest dispatcher objects.
+  {
+    constexpr uint32_t kRoundTripCount = 200000;
+    std::atomic<uint32_t> turn(0);
+    auto turn_address = reinterpret_cast<volatile uint32_t*>(&turn);
+    auto thread = CreateThread([&]() {
+      for (uint32_t i = 0; i < kRoundTripCount; ++i) {
+        while (turn.load() != i * 2 + 1) {
+          WaitOnAddress(turn_address, i * 2, std::chrono::nanoseconds::max());
+        }
+        turn.store(i * 2 + 2);
+        WakeByAddressAll(turn_address);
+      }
+    });
+    testing::BenchmarkTimer timer;
+    for (uint32_t i = 0; i < kRoundTripCount; ++i) {
+      turn.store(i * 2 + 1);
+      WakeByAddressAll(turn_address);
+      while (turn.load() != i * 2 + 2) {
+        WaitOnAddress(turn_address, i * 2 + 1,
+                      std::chrono::nanoseconds::max());
+      }
+    }
+    WARN("Round trip between threads on an address: "
+         << timer.seconds() * 1e6 / kRoundTripCount << " us");
+    Wait(thread.get(), false);
+  }
+
+  // Throughput of a semaphore between a producer and consumers.
+  {
+    constexpr uint32_t kConsumerCount = 4;
+    constexpr uint32_t kItemCount = 1000000;
+    auto semaphore = Semaphore::Create(0, INT_MAX);
+    auto stop_event = Event::CreateManualResetEvent(false);
+    std::atomic<uint32_t> consumed_count(0);
+    std::vector<std::unique_ptr<Thread>> threads;
+    for (uint32_t i = 0; i < kConsumerCount; ++i) {
+      threads.push_back(CreateThread([&]() {
+        WaitHandle* handles[] = {semaphore.get(), stop_event.get()};
+        while (!WaitAny(handles, 2, false).second) {
+          ++consumed_count;
+        }
+      }));
+    }
+    testing::BenchmarkTimer timer;
+    for (uint32_t i = 0; i < kItemCount; ++i) {
+      semaphore->Release(1, nullptr);
+    }
+    while (consumed_count < kItemCount) {
+      MaybeYield();
+    }
+    WARN("Semaphore throughput with " << kConsumerCount << " consumers: "
+                                      << kItemCount / timer.seconds() / 1e6
+                                      << " million per second");
+    stop_event->Set();
+    for (auto& thread : threads) {
+      Wait(thread.get(), false);
+    }
+  }
+
+  // Lateness of short sleeps and timers, as used for frame pacing.
+  for (auto duration : {100us, 500us, 1000us, 4000us}) {
+    constexpr uint32_t kSleepCount = 100;
+    double sleep_late[3] = {}, sleep_max_late[3] = {};
+    auto timer = Timer::CreateSynchronizationTimer();
+    for (uint32_t i = 0; i < kSleepCount; ++i) {
+      for (uint32_t j = 0; j < 3; ++j) {
+        testing::BenchmarkTimer sleep_timer;
+        switch (j) {
+          case 0:
+            Sleep(duration);
+            break;
+          case 1:
+            HighResolutionSleep(duration, false);
+            break;
+          case 2:
+            timer->SetOnce(-std::chrono::nanoseconds(duration));
+            Wait(timer.get(), false);
+            break;
+        }
+        double late = sleep_timer.seconds() * 1e6 - double(duration.count());
+        sleep_late[j] += late;
+        sleep_max_late[j] = std::max(sleep_max_late[j], late);
+      }
+    }
+    WARN(duration.count()
+         << " us late by (mean/max us): Sleep " << sleep_late[0] / kSleepCount
+         << "/" << sleep_max_late[0] << ", HighResolutionSleep "
+         << sleep_late[1] / kSleepCount << "/" << sleep_max_late[1]
+         << ", Timer " << sleep_late[2] / kSleepCount << "/"
+         << sleep_max_late[2]);
+  }
+}
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
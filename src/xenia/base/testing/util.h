@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_TESTING_UTIL_H_
+#define XENIA_BASE_TESTING_UTIL_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/clock.h"
+
+namespace xe {
+namespace testing {
+
+// A directory in the host temporary directory, removed with its contents on
+// destruction. The name gets a random suffix, so test binaries running at the
+// same time and leftovers of crashed runs don't collide.
+class TempDirectory {
+ public:
+  explicit TempDirectory(const std::string_view name) {
+    std::random_device random;
+    path_ = std::filesystem::temp_directory_path() /
+            fmt::format("{}-{:08x}{:08x}", name, random(), random());
+    std::filesystem::create_directories(path_);
+  }
+  ~TempDirectory() {
+    std::error_code error;
+    std::filesystem::remove_all(path_, error);
+  }
+  TempDirectory(const TempDirectory&) = delete;
+  TempDirectory& operator=(const TempDirectory&) = delete;
+
+  const std::filesystem::path& path() const { return path_; }
+
+ private:
+  std::filesystem::path path_;
+};
+
+// Measures the host time taken by [.benchmark] tests.
+class BenchmarkTimer {
+ public:
+  BenchmarkTimer() { Restart(); }
+
+  void Restart() { start_ = Clock::QueryHostTickCount(); }
+  double seconds() const {
+    return double(Clock::QueryHostTickCount() - start_) /
+           double(Clock::QueryHostTickFrequency());
+  }
+
+ private:
+  uint64_t start_;
+};
+
+}  // namespace testing
+}  // namespace xe
+
+#endif  // XENIA_BASE_TESTING_UTIL_H_
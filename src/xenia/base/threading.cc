@@ -9,6 +9,8 @@
 
 #include "xenia/base/threading.h"
 
+#include <algorithm>
+
 namespace xe {
 namespace threading {
 
@@ -29,5 +31,61 @@ uint32_t current_thread_id() {
 
 void set_current_thread_id(uint32_t id) { current_thread_id_ = id; }
 
+namespace {
+
+// How much later than requested the host sleeps of the thread end. Tracks the
+// 90th percentile of the overshoots rather than the largest one, so a single
+// late wakeup, like after preemption, doesn't make later sleeps spin longer,
+// and is capped so that only a short tail of a sleep is spent spinning.
+thread_local int64_t sleep_slack_ns_ = 500000;
+constexpr int64_t kMinSleepSlackNs = 20000;
+constexpr int64_t kMaxSleepSlackNs = 2000000;
+
+void UpdateSleepSlack(std::chrono::nanoseconds overshoot) {
+  // Stochastic percentile estimate, rising by 9 steps for each overshoot above
+  // the estimate and falling by 1 for each one below.
+  constexpr int64_t kSleepSlackStepNs = 10000;
+  if (overshoot.count() > sleep_slack_ns_) {
+    sleep_slack_ns_ += kSleepSlackStepNs * 9;
+  } else {
+    sleep_slack_ns_ -= kSleepSlackStepNs;
+  }
+  sleep_slack_ns_ =
+      std::min(std::max(sleep_slack_ns_, kMinSleepSlackNs), kMaxSleepSlackNs);
+}
+
+}  // namespace
+
+SleepResult HighResolutionSleep(std::chrono::nanoseconds duration,
+                                bool alertable) {
+  using WaitClock = std::chrono::steady_clock;
+  auto deadline = WaitClock::now() + duration;
+  auto slack = std::chrono::nanoseconds(sleep_slack_ns_);
+  if (duration > slack) {
+    auto sleep_duration =
+        std::chrono::duration_cast<std::chrono::microseconds>(duration - slack);
+    auto sleep_start = WaitClock::now();
+    if (alertable) {
+      if (AlertableSleep(sleep_duration) == SleepResult::kAlerted) {
+        return SleepResult::kAlerted;
+      }
+    } else {
+      Sleep(sleep_duration);
+    }
+    UpdateSleepSlack(WaitClock::now() - sleep_start - sleep_duration);
+  }
+  while (WaitClock::now() < deadline) {
+    if (alertable) {
+      if (AlertableSleep(std::chrono::microseconds(0)) ==
+          SleepResult::kAlerted) {
+        return SleepResult::kAlerted;
+      }
+    } else {
+      MaybeYield();
+    }
+  }
+  return SleepResult::kSuccess;
+}
+
 }  // namespace threading
 }  // namespace xe
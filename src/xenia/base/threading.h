@@ -52,6 +52,12 @@ class Fence {
 // Returns the total number of logical processors in the host system.
 uint32_t logical_processor_count();
 
+// Returns the affinity masks of the logical processors of each physical core
+// of the host, in the order of the cores, for keeping threads that share
+// caches on the same core or apart. Only the first 64 logical processors are
+// included. Empty if the topology can't be queried.
+const std::vector<uint64_t>& physical_core_processor_masks();
+
 // Enables the current process to set thread affinity.
 // Must be called at startup before attempting to set thread affinity.
 void EnableAffinityConfiguration();
@@ -100,6 +106,24 @@ SleepResult AlertableSleep(std::chrono::duration<Rep, Period> duration) {
       std::chrono::duration_cast<std::chrono::microseconds>(duration));
 }
 
+// Sleeps the current thread for the given duration with sub-millisecond
+// precision. The host sleep ends early by the slack observed in previous
+// sleeps of the thread (at most 2 ms), and the thread yields until the end of
+// the duration. Alertable sleeps return early with SleepResult::kAlerted like
+// AlertableSleep.
+SleepResult HighResolutionSleep(std::chrono::nanoseconds duration,
+                                bool alertable);
+
+// Blocks while the 32-bit value at address equals compare_value, until
+// WakeByAddressAll is called for the address or the timeout (max() for none)
+// elapses. May return spuriously, the value must be checked again.
+// Unlike waits for WaitHandles, this doesn't require any host object, so it
+// can be used for state stored in guest memory.
+void WaitOnAddress(volatile void* address, uint32_t compare_value,
+                   std::chrono::nanoseconds timeout);
+// Wakes all threads blocked in WaitOnAddress for the address.
+void WakeByAddressAll(volatile void* address);
+
 typedef uint32_t TlsHandle;
 constexpr TlsHandle kInvalidTlsHandle = UINT_MAX;
 
@@ -12,20 +12,71 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 
+#include <linux/futex.h>
 #include <pthread.h>
-#include <sys/eventfd.h>
+#include <sys/prctl.h>
 #include <sys/syscall.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <cstdio>
+#include <deque>
+#include <map>
+
 namespace xe {
 namespace threading {
 
+using WaitClock = std::chrono::steady_clock;
+
 // TODO(dougvj)
 void EnableAffinityConfiguration() {}
 
+const std::vector<uint64_t>& physical_core_processor_masks() {
+  static const std::vector<uint64_t> masks = []() {
+    auto read_topology_value = [](uint32_t cpu, const char* name,
+                                  int& value_out) {
+      char path[128];
+      std::snprintf(path, sizeof(path),
+                    "/sys/devices/system/cpu/cpu%u/topology/%s", cpu, name);
+      FILE* file = std::fopen(path, "r");
+      if (!file) {
+        return false;
+      }
+      bool read = std::fscanf(file, "%d", &value_out) == 1;
+      std::fclose(file);
+      return read;
+    };
+    // (package, core) in the order the cores are first encountered.
+    std::vector<std::pair<std::pair<int, int>, uint64_t>> cores;
+    uint32_t cpu_count = std::min(logical_processor_count(), uint32_t(64));
+    for (uint32_t cpu = 0; cpu < cpu_count; ++cpu) {
+      int package_id, core_id;
+      if (!read_topology_value(cpu, "physical_package_id", package_id) ||
+          !read_topology_value(cpu, "core_id", core_id)) {
+        return std::vector<uint64_t>();
+      }
+      auto core_key = std::make_pair(package_id, core_id);
+      auto it = std::find_if(cores.begin(), cores.end(),
+                             [&](const auto& core) {
+                               return core.first == core_key;
+                             });
+      if (it == cores.end()) {
+        cores.emplace_back(core_key, uint64_t(0));
+        it = cores.end() - 1;
+      }
+      it->second |= uint64_t(1) << cpu;
+    }
+    std::vector<uint64_t> core_masks;
+    core_masks.reserve(cores.size());
+    for (const auto& core : cores) {
+      core_masks.push_back(core.second);
+    }
+    return core_masks;
+  }();
+  return masks;
+}
+
 // uint64_t ticks() { return mach_absolute_time(); }
 
 uint32_t current_thread_system_id() {
@@ -34,7 +85,8 @@ uint32_t current_thread_system_id() {
 
 void set_name(std::thread::native_handle_type handle,
               const std::string_view name) {
-  pthread_setname_np(handle, std::string(name).c_str());
+  // Linux limits thread names to 15 characters.
+  pthread_setname_np(handle, std::string(name.substr(0, 15)).c_str());
 }
 
 void set_name(const std::string_view name) { set_name(pthread_self(), name); }
@@ -48,307 +100,746 @@ void SyncMemory() { __sync_synchronize(); }
 
 void Sleep(std::chrono::microseconds duration) {
   timespec rqtp = {time_t(duration.count() / 1000000),
-                   time_t(duration.count() % 1000)};
-  nanosleep(&rqtp, nullptr);
-  // TODO(benvanik): spin while rmtp >0?
-}
-
-// TODO(dougvj) Not sure how to implement the equivalent of this on POSIX.
-SleepResult AlertableSleep(std::chrono::microseconds duration) {
-  sleep(duration.count() / 1000);
-  return SleepResult::kSuccess;
+                   long(duration.count() % 1000000 * 1000)};
+  while (nanosleep(&rqtp, &rqtp) == -1 && errno == EINTR) {
+  }
 }
 
-// TODO(dougvj) We can probably wrap this with pthread_key_t but the type of
-// TlsHandle probably needs to be refactored
 TlsHandle AllocateTlsHandle() {
-  assert_always();
-  return 0;
+  pthread_key_t key;
+  if (pthread_key_create(&key, nullptr)) {
+    return kInvalidTlsHandle;
+  }
+  return TlsHandle(key);
 }
 
-bool FreeTlsHandle(TlsHandle handle) { return true; }
+bool FreeTlsHandle(TlsHandle handle) {
+  return !pthread_key_delete(pthread_key_t(handle));
+}
 
 uintptr_t GetTlsValue(TlsHandle handle) {
-  assert_always();
-  return 0;
+  return reinterpret_cast<uintptr_t>(
+      pthread_getspecific(pthread_key_t(handle)));
 }
 
 bool SetTlsValue(TlsHandle handle, uintptr_t value) {
-  assert_always();
-  return false;
+  return !pthread_setspecific(pthread_key_t(handle),
+                              reinterpret_cast<void*>(value));
 }
 
-// TODO(dougvj)
-class PosixHighResolutionTimer : public HighResolutionTimer {
- public:
-  PosixHighResolutionTimer(std::function<void()> callback)
-      : callback_(callback) {}
-  ~PosixHighResolutionTimer() override {}
-
-  bool Initialize(std::chrono::milliseconds period) {
-    assert_always();
-    return false;
-  }
+// Blocks while *word == expected, until woken or the timeout (if not null)
+// elapses. May return spuriously.
+static void FutexWait(std::atomic<uint32_t>* word, uint32_t expected,
+                      const timespec* timeout) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE,
+          expected, timeout, nullptr, 0);
+}
 
- private:
-  std::function<void()> callback_;
-};
+static void FutexWakeAll(std::atomic<uint32_t>* word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE,
+          INT_MAX, nullptr, nullptr, 0);
+}
 
-std::unique_ptr<HighResolutionTimer> HighResolutionTimer::CreateRepeating(
-    std::chrono::milliseconds period, std::function<void()> callback) {
-  auto timer = std::make_unique<PosixHighResolutionTimer>(std::move(callback));
-  if (!timer->Initialize(period)) {
-    return nullptr;
+// Not private, as guest memory is shared between multiple mappings.
+void WaitOnAddress(volatile void* address, uint32_t compare_value,
+                   std::chrono::nanoseconds timeout) {
+  timespec timeout_timespec;
+  if (timeout != std::chrono::nanoseconds::max()) {
+    if (timeout.count() <= 0) {
+      return;
+    }
+    timeout_timespec = {time_t(timeout.count() / 1000000000),
+                        long(timeout.count() % 1000000000)};
   }
-  return std::unique_ptr<HighResolutionTimer>(timer.release());
+  syscall(SYS_futex, const_cast<void*>(address), FUTEX_WAIT, compare_value,
+          timeout != std::chrono::nanoseconds::max() ? &timeout_timespec
+                                                     : nullptr,
+          nullptr, 0);
+}
+
+void WakeByAddressAll(volatile void* address) {
+  syscall(SYS_futex, const_cast<void*>(address), FUTEX_WAKE, INT_MAX, nullptr,
+          nullptr, 0);
 }
 
-// TODO(dougvj) There really is no native POSIX handle for a single wait/signal
-// construct pthreads is at a lower level with more handles for such a mechanism
-// This simple wrapper class could function as our handle, but probably needs
-// some more functionality
-class PosixCondition {
+class ThreadWaitState;
+
+// Base of all objects that can be waited on. The state of the object is
+// protected by mutex_, and threads blocked waiting for it are registered in
+// waiters_ so that changes to the state can wake them to check it again.
+class PosixWaitObject {
  public:
-  PosixCondition() : signal_(false) {
-    pthread_mutex_init(&mutex_, NULL);
-    pthread_cond_init(&cond_, NULL);
+  virtual ~PosixWaitObject() = default;
+
+  // Whether a wait by the given thread would be satisfied. mutex_ is held.
+  virtual bool IsSignaled(ThreadWaitState* waiter) const = 0;
+  // Updates the state after a wait by the given thread was satisfied, such as
+  // resetting an auto-reset event. mutex_ is held.
+  virtual void Acquire(ThreadWaitState* waiter) {}
+  // Signals the object for SignalAndWait.
+  virtual bool Signal() { return false; }
+
+  std::mutex& mutex() { return mutex_; }
+  void AddWaiter(ThreadWaitState* waiter) { waiters_.push_back(waiter); }
+  void RemoveWaiter(ThreadWaitState* waiter) {
+    auto it = std::find(waiters_.begin(), waiters_.end(), waiter);
+    if (it != waiters_.end()) {
+      *it = waiters_.back();
+      waiters_.pop_back();
+    }
   }
 
-  ~PosixCondition() {
-    pthread_mutex_destroy(&mutex_);
-    pthread_cond_destroy(&cond_);
-  }
+ protected:
+  // Wakes all threads waiting for the object so that they check its state
+  // again. mutex_ must be held.
+  void WakeWaiters();
 
-  void Signal() {
-    pthread_mutex_lock(&mutex_);
-    signal_ = true;
-    pthread_cond_broadcast(&cond_);
-    pthread_mutex_unlock(&mutex_);
-  }
+  std::mutex mutex_;
+  std::vector<ThreadWaitState*> waiters_;
+};
 
-  void Reset() {
-    pthread_mutex_lock(&mutex_);
-    signal_ = false;
-    pthread_mutex_unlock(&mutex_);
-  }
+// State of a host thread used to block it in waits and to deliver user
+// callbacks (APCs) to it. It's also the waitable object for the thread,
+// signaled when the thread exits.
+class ThreadWaitState : public PosixWaitObject {
+ public:
+  bool IsSignaled(ThreadWaitState* waiter) const override { return exited_; }
 
-  bool Wait(unsigned int timeout_ms) {
-    // Assume 0 means no timeout, not instant timeout
-    if (timeout_ms == 0) {
-      Wait();
+  uint32_t wake_sequence() const {
+    return wake_sequence_.load(std::memory_order_acquire);
+  }
+  // Blocks until Wake is called after wake_sequence returned sequence, or
+  // until the deadline.
+  void Sleep(uint32_t sequence, const WaitClock::time_point* deadline) {
+    timespec timeout;
+    if (deadline) {
+      auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          *deadline - WaitClock::now());
+      if (remaining.count() <= 0) {
+        return;
+      }
+      timeout = {time_t(remaining.count() / 1000000000),
+                 long(remaining.count() % 1000000000)};
     }
-    struct timespec time_to_wait;
-    struct timeval now;
-    gettimeofday(&now, NULL);
-
-    // Add the number of seconds we want to wait to the current time
-    time_to_wait.tv_sec = now.tv_sec + (timeout_ms / 1000);
-    // Add the number of nanoseconds we want to wait to the current nanosecond
-    // stride
-    long nsec = (now.tv_usec + (timeout_ms % 1000)) * 1000;
-    // If we overflowed the nanosecond count then we add a second
-    time_to_wait.tv_sec += nsec / 1000000000UL;
-    // We only add nanoseconds within the 1 second stride
-    time_to_wait.tv_nsec = nsec % 1000000000UL;
-    pthread_mutex_lock(&mutex_);
-    while (!signal_) {
-      int status = pthread_cond_timedwait(&cond_, &mutex_, &time_to_wait);
-      if (status == ETIMEDOUT) return false;  // We timed out
+    // Either Wake sees sleeping_ set and makes the system call, or the futex
+    // sees the new sequence and returns immediately.
+    sleeping_.store(true, std::memory_order_seq_cst);
+    FutexWait(&wake_sequence_, sequence, deadline ? &timeout : nullptr);
+    sleeping_.store(false, std::memory_order_relaxed);
+  }
+  void Wake() {
+    wake_sequence_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_seq_cst)) {
+      FutexWakeAll(&wake_sequence_);
     }
-    pthread_mutex_unlock(&mutex_);
-    return true;  // We didn't time out
   }
 
-  bool Wait() {
-    pthread_mutex_lock(&mutex_);
-    while (!signal_) {
-      pthread_cond_wait(&cond_, &mutex_);
+  void QueueCallback(std::function<void()> callback) {
+    {
+      std::lock_guard<std::mutex> lock(callback_mutex_);
+      callbacks_.push_back(std::move(callback));
+      has_callbacks_.store(true, std::memory_order_release);
     }
-    pthread_mutex_unlock(&mutex_);
-    return true;  // Did not time out;
+    Wake();
+  }
+  // Calls all queued callbacks, returning whether there were any. Must be
+  // called on the thread itself.
+  bool DispatchCallbacks() {
+    if (!has_callbacks_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    std::deque<std::function<void()>> callbacks;
+    {
+      std::lock_guard<std::mutex> lock(callback_mutex_);
+      callbacks.swap(callbacks_);
+      has_callbacks_.store(false, std::memory_order_relaxed);
+    }
+    for (auto& callback : callbacks) {
+      callback();
+    }
+    return !callbacks.empty();
   }
 
- private:
-  bool signal_;
-  pthread_cond_t cond_;
-  pthread_mutex_t mutex_;
-};
-
-// Native posix thread handle
-template <typename T>
-class PosixThreadHandle : public T {
- public:
-  explicit PosixThreadHandle(pthread_t handle) : handle_(handle) {}
-  ~PosixThreadHandle() override {}
-
- protected:
-  void* native_handle() const override {
-    return reinterpret_cast<void*>(handle_);
+  void SetExited() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exited_ = true;
+    WakeWaiters();
   }
 
-  pthread_t handle_;
-};
+  pthread_t handle() const { return handle_; }
+  void set_handle(pthread_t handle) { handle_ = handle; }
+  uint32_t system_id() const { return system_id_; }
+  // Called on the thread itself once it starts.
+  void Attach() {
+    handle_ = pthread_self();
+    system_id_ = current_thread_system_id();
+  }
 
-// This is wraps a condition object as our handle because posix has no single
-// native handle for higher level concurrency constructs such as semaphores
-template <typename T>
-class PosixConditionHandle : public T {
- public:
-  ~PosixConditionHandle() override {}
+ private:
+  std::atomic<uint32_t> wake_sequence_{0};
+  std::atomic<bool> sleeping_{false};
 
- protected:
-  void* native_handle() const override {
-    return reinterpret_cast<void*>(const_cast<PosixCondition*>(&handle_));
-  }
+  std::mutex callback_mutex_;
+  std::deque<std::function<void()>> callbacks_;
+  std::atomic<bool> has_callbacks_{false};
 
-  PosixCondition handle_;
+  bool exited_ = false;
+  // Set both by the thread and its creator, whichever comes first.
+  std::atomic<pthread_t> handle_{0};
+  std::atomic<uint32_t> system_id_{0};
 };
 
-template <typename T>
-class PosixFdHandle : public T {
- public:
-  explicit PosixFdHandle(intptr_t handle) : handle_(handle) {}
-  ~PosixFdHandle() override {
-    close(handle_);
-    handle_ = 0;
+void PosixWaitObject::WakeWaiters() {
+  for (ThreadWaitState* waiter : waiters_) {
+    waiter->Wake();
   }
+}
 
- protected:
-  void* native_handle() const override {
-    return reinterpret_cast<void*>(handle_);
+thread_local std::shared_ptr<ThreadWaitState> current_wait_state_;
+
+static ThreadWaitState* GetCurrentWaitState() {
+  if (!current_wait_state_) {
+    current_wait_state_ = std::make_shared<ThreadWaitState>();
+    current_wait_state_->Attach();
   }
+  return current_wait_state_.get();
+}
 
-  intptr_t handle_;
-};
+static PosixWaitObject* GetWaitObject(WaitHandle* wait_handle) {
+  return reinterpret_cast<PosixWaitObject*>(wait_handle->native_handle());
+}
 
-// TODO(dougvj)
-WaitResult Wait(WaitHandle* wait_handle, bool is_alertable,
-                std::chrono::milliseconds timeout) {
-  intptr_t handle = reinterpret_cast<intptr_t>(wait_handle->native_handle());
+// Like MAXIMUM_WAIT_OBJECTS on Windows.
+constexpr size_t kMaxWaitObjects = 64;
+
+// Satisfies the wait if possible, returning the index of the object that
+// satisfied a wait for any of them.
+static bool TryAcquire(PosixWaitObject* objects[], size_t count,
+                       bool wait_all, ThreadWaitState* waiter,
+                       size_t* out_index) {
+  if (!wait_all) {
+    for (size_t i = 0; i < count; ++i) {
+      std::lock_guard<std::mutex> lock(objects[i]->mutex());
+      if (objects[i]->IsSignaled(waiter)) {
+        objects[i]->Acquire(waiter);
+        *out_index = i;
+        return true;
+      }
+    }
+    return false;
+  }
 
-  fd_set set;
-  struct timeval time_val;
-  int ret;
+  // All objects must be acquired at once, lock them in a consistent order to
+  // avoid deadlocking with other waits for all.
+  PosixWaitObject* sorted[kMaxWaitObjects];
+  std::copy(objects, objects + count, sorted);
+  std::sort(sorted, sorted + count);
+  count = std::unique(sorted, sorted + count) - sorted;
+  for (size_t i = 0; i < count; ++i) {
+    sorted[i]->mutex().lock();
+  }
+  bool signaled = true;
+  for (size_t i = 0; i < count && signaled; ++i) {
+    signaled = sorted[i]->IsSignaled(waiter);
+  }
+  if (signaled) {
+    for (size_t i = 0; i < count; ++i) {
+      sorted[i]->Acquire(waiter);
+    }
+  }
+  for (size_t i = count; i > 0; --i) {
+    sorted[i - 1]->mutex().unlock();
+  }
+  *out_index = 0;
+  return signaled;
+}
 
-  FD_ZERO(&set);
-  FD_SET(handle, &set);
+// Common implementation of the waits. A timeout of max() never times out.
+// Waiters first try to acquire the objects, and if they can't, register
+// themselves with the objects and sleep until one of them changes state.
+static std::pair<WaitResult, size_t> WaitInternal(
+    PosixWaitObject* objects[], size_t count, bool wait_all,
+    bool is_alertable, std::chrono::nanoseconds timeout) {
+  ThreadWaitState* waiter = GetCurrentWaitState();
+  bool has_deadline = timeout != std::chrono::nanoseconds::max();
+  WaitClock::time_point deadline;
+  if (has_deadline && timeout.count() > 0) {
+    deadline = WaitClock::now() +
+               std::chrono::duration_cast<WaitClock::duration>(timeout);
+  }
 
-  time_val.tv_sec = timeout.count() / 1000;
-  time_val.tv_usec = timeout.count() * 1000;
-  ret = select(handle + 1, &set, NULL, NULL, &time_val);
-  if (ret == -1) {
-    return WaitResult::kFailed;
-  } else if (ret == 0) {
-    return WaitResult::kTimeout;
-  } else {
-    uint64_t buf = 0;
-    ret = read(handle, &buf, sizeof(buf));
-    if (ret < 8) {
-      return WaitResult::kTimeout;
+  std::pair<WaitResult, size_t> result(WaitResult::kTimeout, 0);
+  bool registered = false;
+  while (true) {
+    // Read before checking the state, so that any change to it after the
+    // check prevents the sleep.
+    uint32_t sequence = waiter->wake_sequence();
+    if (is_alertable && waiter->DispatchCallbacks()) {
+      result.first = WaitResult::kUserCallback;
+      break;
+    }
+    if (TryAcquire(objects, count, wait_all, waiter, &result.second)) {
+      result.first = WaitResult::kSuccess;
+      break;
     }
+    if (has_deadline &&
+        (timeout.count() <= 0 || WaitClock::now() >= deadline)) {
+      break;
+    }
+    if (!registered) {
+      // Check again after registering, as a state change before that
+      // wouldn't have woken this thread.
+      for (size_t i = 0; i < count; ++i) {
+        std::lock_guard<std::mutex> lock(objects[i]->mutex());
+        objects[i]->AddWaiter(waiter);
+      }
+      registered = true;
+      continue;
+    }
+    waiter->Sleep(sequence, has_deadline ? &deadline : nullptr);
+  }
+
+  if (registered) {
+    for (size_t i = 0; i < count; ++i) {
+      std::lock_guard<std::mutex> lock(objects[i]->mutex());
+      objects[i]->RemoveWaiter(waiter);
+    }
+  }
+  return result;
+}
 
-    return WaitResult::kSuccess;
+static std::chrono::nanoseconds ToWaitTimeout(
+    std::chrono::milliseconds timeout) {
+  if (timeout == std::chrono::milliseconds::max()) {
+    return std::chrono::nanoseconds::max();
   }
+  return timeout;
+}
+
+SleepResult AlertableSleep(std::chrono::microseconds duration) {
+  auto result = WaitInternal(nullptr, 0, false, true, duration);
+  return result.first == WaitResult::kUserCallback ? SleepResult::kAlerted
+                                                   : SleepResult::kSuccess;
+}
+
+WaitResult Wait(WaitHandle* wait_handle, bool is_alertable,
+                std::chrono::milliseconds timeout) {
+  PosixWaitObject* object = GetWaitObject(wait_handle);
+  return WaitInternal(&object, 1, false, is_alertable, ToWaitTimeout(timeout))
+      .first;
 }
 
-// TODO(dougvj)
 WaitResult SignalAndWait(WaitHandle* wait_handle_to_signal,
                          WaitHandle* wait_handle_to_wait_on, bool is_alertable,
                          std::chrono::milliseconds timeout) {
-  assert_always();
-  return WaitResult::kFailed;
+  if (!GetWaitObject(wait_handle_to_signal)->Signal()) {
+    return WaitResult::kFailed;
+  }
+  return Wait(wait_handle_to_wait_on, is_alertable, timeout);
 }
 
-// TODO(dougvj)
 std::pair<WaitResult, size_t> WaitMultiple(WaitHandle* wait_handles[],
                                            size_t wait_handle_count,
                                            bool wait_all, bool is_alertable,
                                            std::chrono::milliseconds timeout) {
-  assert_always();
-  return std::pair<WaitResult, size_t>(WaitResult::kFailed, 0);
+  PosixWaitObject* objects[kMaxWaitObjects];
+  if (wait_handle_count > kMaxWaitObjects) {
+    assert_always();
+    return std::pair<WaitResult, size_t>(WaitResult::kFailed, 0);
+  }
+  for (size_t i = 0; i < wait_handle_count; ++i) {
+    objects[i] = GetWaitObject(wait_handles[i]);
+  }
+  return WaitInternal(objects, wait_handle_count, wait_all, is_alertable,
+                      ToWaitTimeout(timeout));
 }
 
-// TODO(dougvj)
-class PosixEvent : public PosixFdHandle<Event> {
+// Wait handle backed by a PosixWaitObject.
+template <typename T>
+class PosixWaitHandle : public T, public PosixWaitObject {
  public:
-  PosixEvent(intptr_t fd) : PosixFdHandle(fd) {}
+  ~PosixWaitHandle() override = default;
+
+ protected:
+  void* native_handle() const override {
+    return static_cast<PosixWaitObject*>(const_cast<PosixWaitHandle*>(this));
+  }
+};
+
+class PosixEvent : public PosixWaitHandle<Event> {
+ public:
+  PosixEvent(bool manual_reset, bool initial_state)
+      : manual_reset_(manual_reset), signaled_(initial_state) {}
   ~PosixEvent() override = default;
+
+  bool IsSignaled(ThreadWaitState* waiter) const override {
+    return signaled_;
+  }
+  void Acquire(ThreadWaitState* waiter) override {
+    if (pulse_count_) {
+      // Only the threads waiting during the pulse are released.
+      if (!--pulse_count_) {
+        signaled_ = false;
+      }
+    } else if (!manual_reset_) {
+      signaled_ = false;
+    }
+  }
+  bool Signal() override {
+    Set();
+    return true;
+  }
+
   void Set() override {
-    uint64_t buf = 1;
-    write(handle_, &buf, sizeof(buf));
+    std::lock_guard<std::mutex> lock(mutex_);
+    pulse_count_ = 0;
+    signaled_ = true;
+    WakeWaiters();
+  }
+  void Reset() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pulse_count_ = 0;
+    signaled_ = false;
+  }
+  void Pulse() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (signaled_ || waiters_.empty()) {
+      // Nothing waiting, or already signaled - ends up nonsignaled.
+      pulse_count_ = 0;
+      signaled_ = false;
+      return;
+    }
+    pulse_count_ = manual_reset_ ? uint32_t(waiters_.size()) : 1;
+    signaled_ = true;
+    WakeWaiters();
   }
-  void Reset() override { assert_always(); }
-  void Pulse() override { assert_always(); }
 
  private:
-  PosixCondition condition_;
+  bool manual_reset_;
+  bool signaled_;
+  // Number of waits still to be satisfied by the current pulse.
+  uint32_t pulse_count_ = 0;
 };
 
 std::unique_ptr<Event> Event::CreateManualResetEvent(bool initial_state) {
-  // Linux's eventfd doesn't appear to support manual reset natively.
-  return nullptr;
+  return std::make_unique<PosixEvent>(true, initial_state);
 }
 
 std::unique_ptr<Event> Event::CreateAutoResetEvent(bool initial_state) {
-  int fd = eventfd(initial_state ? 1 : 0, EFD_CLOEXEC);
-  if (fd == -1) {
-    return nullptr;
-  }
-
-  return std::make_unique<PosixEvent>(PosixEvent(fd));
+  return std::make_unique<PosixEvent>(false, initial_state);
 }
 
-// TODO(dougvj)
-class PosixSemaphore : public PosixConditionHandle<Semaphore> {
+class PosixSemaphore : public PosixWaitHandle<Semaphore> {
  public:
-  PosixSemaphore(int initial_count, int maximum_count) { assert_always(); }
+  PosixSemaphore(int initial_count, int maximum_count)
+      : count_(initial_count), maximum_count_(maximum_count) {}
   ~PosixSemaphore() override = default;
+
+  bool IsSignaled(ThreadWaitState* waiter) const override {
+    return count_ > 0;
+  }
+  void Acquire(ThreadWaitState* waiter) override { --count_; }
+  bool Signal() override { return Release(1, nullptr); }
+
   bool Release(int release_count, int* out_previous_count) override {
-    assert_always();
-    return false;
+    if (release_count <= 0) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (release_count > maximum_count_ - count_) {
+      return false;
+    }
+    if (out_previous_count) {
+      *out_previous_count = count_;
+    }
+    count_ += release_count;
+    WakeWaiters();
+    return true;
   }
+
+ private:
+  int count_;
+  int maximum_count_;
 };
 
 std::unique_ptr<Semaphore> Semaphore::Create(int initial_count,
                                              int maximum_count) {
+  if (initial_count < 0 || initial_count > maximum_count ||
+      maximum_count <= 0) {
+    return nullptr;
+  }
   return std::make_unique<PosixSemaphore>(initial_count, maximum_count);
 }
 
-// TODO(dougvj)
-class PosixMutant : public PosixConditionHandle<Mutant> {
+class PosixMutant : public PosixWaitHandle<Mutant> {
  public:
-  PosixMutant(bool initial_owner) { assert_always(); }
-  ~PosixMutant() = default;
+  explicit PosixMutant(bool initial_owner) {
+    if (initial_owner) {
+      owner_ = GetCurrentWaitState();
+      recursion_count_ = 1;
+    }
+  }
+  ~PosixMutant() override = default;
+
+  bool IsSignaled(ThreadWaitState* waiter) const override {
+    return !owner_ || owner_ == waiter;
+  }
+  void Acquire(ThreadWaitState* waiter) override {
+    owner_ = waiter;
+    ++recursion_count_;
+  }
+  bool Signal() override { return Release(); }
+
   bool Release() override {
-    assert_always();
-    return false;
+    ThreadWaitState* current = GetCurrentWaitState();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (owner_ != current) {
+      return false;
+    }
+    if (!--recursion_count_) {
+      owner_ = nullptr;
+      WakeWaiters();
+    }
+    return true;
   }
+
+ private:
+  ThreadWaitState* owner_ = nullptr;
+  uint32_t recursion_count_ = 0;
 };
 
 std::unique_ptr<Mutant> Mutant::Create(bool initial_owner) {
   return std::make_unique<PosixMutant>(initial_owner);
 }
 
-// TODO(dougvj)
-class PosixTimer : public PosixConditionHandle<Timer> {
+// Single host thread servicing all Timer and HighResolutionTimer objects,
+// sleeping until the earliest due time.
+class TimerQueue {
+ public:
+  class Entry {
+   public:
+    virtual ~Entry() = default;
+    // Called on the timer thread without the queue mutex held, so that it may
+    // schedule timers.
+    virtual void Fire() = 0;
+
+   private:
+    friend class TimerQueue;
+    bool scheduled_ = false;
+    std::multimap<WaitClock::time_point, Entry*>::iterator iterator_;
+    WaitClock::duration period_;
+  };
+
+  static TimerQueue& Get() {
+    // Never destroyed, so that timers may outlive static destruction.
+    static TimerQueue* timer_queue = new TimerQueue();
+    return *timer_queue;
+  }
+
+  // Must be held for Schedule and Cancel.
+  std::mutex& mutex() { return mutex_; }
+
+  // Replaces the previous schedule of the entry. A zero period fires only
+  // once.
+  void Schedule(Entry* entry, WaitClock::time_point due_time,
+                WaitClock::duration period) {
+    Cancel(entry);
+    entry->iterator_ = entries_.emplace(due_time, entry);
+    entry->scheduled_ = true;
+    entry->period_ = period;
+    if (entry->iterator_ == entries_.begin()) {
+      cond_.notify_one();
+    }
+  }
+
+  void Cancel(Entry* entry) {
+    if (entry->scheduled_) {
+      entries_.erase(entry->iterator_);
+      entry->scheduled_ = false;
+    }
+  }
+
+  // Cancels the entry and waits until it's not firing anymore, so that it can
+  // be destroyed, unless called from its own Fire.
+  void CancelForDestruction(Entry* entry) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Cancel(entry);
+    while (firing_entry_ == entry &&
+           std::this_thread::get_id() != thread_id_) {
+      fired_cond_.wait(lock);
+    }
+  }
+
+ private:
+  TimerQueue() { std::thread([this]() { ThreadMain(); }).detach(); }
+  void ThreadMain() {
+    set_name("Timer Queue");
+    // Wake up for timers as precisely as possible rather than the default
+    // 50 us late.
+    prctl(PR_SET_TIMERSLACK, 1);
+    std::unique_lock<std::mutex> lock(mutex_);
+    thread_id_ = std::this_thread::get_id();
+    while (true) {
+      if (entries_.empty()) {
+        cond_.wait(lock);
+        continue;
+      }
+      auto it = entries_.begin();
+      WaitClock::time_point due_time = it->first;
+      if (WaitClock::now() < due_time) {
+        cond_.wait_until(lock, due_time);
+        continue;
+      }
+      Entry* entry = it->second;
+      entries_.erase(it);
+      entry->scheduled_ = false;
+      if (entry->period_.count()) {
+        // Periods missed while the host was busy are skipped rather than
+        // fired in a burst.
+        WaitClock::time_point next_due_time = due_time + entry->period_;
+        if (next_due_time < WaitClock::now()) {
+          next_due_time = WaitClock::now() + entry->period_;
+        }
+        entry->iterator_ = entries_.emplace(next_due_time, entry);
+        entry->scheduled_ = true;
+      }
+      firing_entry_ = entry;
+      lock.unlock();
+      entry->Fire();
+      lock.lock();
+      firing_entry_ = nullptr;
+      fired_cond_.notify_all();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::multimap<WaitClock::time_point, Entry*> entries_;
+  std::thread::id thread_id_;
+  // Entry in Fire, and signaled when it returns, for CancelForDestruction.
+  Entry* firing_entry_ = nullptr;
+  std::condition_variable fired_cond_;
+};
+
+class PosixHighResolutionTimer : public HighResolutionTimer,
+                                 public TimerQueue::Entry {
+ public:
+  explicit PosixHighResolutionTimer(std::function<void()> callback)
+      : callback_(std::move(callback)) {}
+  ~PosixHighResolutionTimer() override {
+    TimerQueue::Get().CancelForDestruction(this);
+  }
+
+  bool Initialize(std::chrono::milliseconds period) {
+    if (period.count() <= 0) {
+      return false;
+    }
+    auto& timer_queue = TimerQueue::Get();
+    std::lock_guard<std::mutex> lock(timer_queue.mutex());
+    timer_queue.Schedule(this, WaitClock::now() + period, period);
+    return true;
+  }
+
+  void Fire() override { callback_(); }
+
+ private:
+  std::function<void()> callback_;
+};
+
+std::unique_ptr<HighResolutionTimer> HighResolutionTimer::CreateRepeating(
+    std::chrono::milliseconds period, std::function<void()> callback) {
+  auto timer = std::make_unique<PosixHighResolutionTimer>(std::move(callback));
+  if (!timer->Initialize(period)) {
+    return nullptr;
+  }
+  return std::unique_ptr<HighResolutionTimer>(timer.release());
+}
+
+class PosixTimer : public PosixWaitHandle<Timer>, public TimerQueue::Entry {
  public:
-  PosixTimer(bool manual_reset) { assert_always(); }
-  ~PosixTimer() = default;
+  explicit PosixTimer(bool manual_reset) : manual_reset_(manual_reset) {}
+  ~PosixTimer() override { TimerQueue::Get().CancelForDestruction(this); }
+
+  bool IsSignaled(ThreadWaitState* waiter) const override {
+    return signaled_;
+  }
+  void Acquire(ThreadWaitState* waiter) override {
+    if (!manual_reset_) {
+      signaled_ = false;
+    }
+  }
+
   bool SetOnce(std::chrono::nanoseconds due_time,
                std::function<void()> opt_callback) override {
-    assert_always();
-    return false;
+    return SetRepeating(due_time, std::chrono::milliseconds(0),
+                        std::move(opt_callback));
   }
   bool SetRepeating(std::chrono::nanoseconds due_time,
                     std::chrono::milliseconds period,
                     std::function<void()> opt_callback) override {
-    assert_always();
-    return false;
+    auto& timer_queue = TimerQueue::Get();
+    std::lock_guard<std::mutex> lock(timer_queue.mutex());
+    GetCurrentWaitState();
+    {
+      std::lock_guard<std::mutex> object_lock(mutex_);
+      signaled_ = false;
+      callback_ = std::move(opt_callback);
+      callback_thread_ = current_wait_state_;
+    }
+    timer_queue.Schedule(this, ToWaitClock(due_time), period);
+    return true;
   }
   bool Cancel() override {
-    assert_always();
-    return false;
+    auto& timer_queue = TimerQueue::Get();
+    std::lock_guard<std::mutex> lock(timer_queue.mutex());
+    timer_queue.Cancel(this);
+    std::lock_guard<std::mutex> object_lock(mutex_);
+    callback_ = nullptr;
+    callback_thread_.reset();
+    return true;
+  }
+
+  void Fire() override {
+    std::function<void()> callback;
+    std::shared_ptr<ThreadWaitState> callback_thread;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      signaled_ = true;
+      WakeWaiters();
+      callback = callback_;
+      callback_thread = callback_thread_;
+    }
+    // Like a completion routine, called on the thread that set the timer when
+    // it's in an alertable wait.
+    if (callback) {
+      callback_thread->QueueCallback(std::move(callback));
+    }
   }
+
+ private:
+  // Negative due times are relative, positive ones are absolute FILETIMEs.
+  static WaitClock::time_point ToWaitClock(std::chrono::nanoseconds due_time) {
+    auto now = WaitClock::now();
+    if (due_time.count() <= 0) {
+      return now - std::chrono::duration_cast<WaitClock::duration>(due_time);
+    }
+    // 100-nanosecond intervals between 1601 and 1970.
+    constexpr int64_t kUnixEpochFileTime = 116444736000000000ll;
+    timespec system_time;
+    clock_gettime(CLOCK_REALTIME, &system_time);
+    auto system_now = std::chrono::nanoseconds(
+        (kUnixEpochFileTime + int64_t(system_time.tv_sec) * 10000000) * 100 +
+        system_time.tv_nsec);
+    return now +
+           std::chrono::duration_cast<WaitClock::duration>(
+               std::max(due_time - system_now, std::chrono::nanoseconds(0)));
+  }
+
+  bool manual_reset_;
+  bool signaled_ = false;
+  // Protected by the timer queue mutex.
+  std::function<void()> callback_;
+  std::shared_ptr<ThreadWaitState> callback_thread_;
 };
 
 std::unique_ptr<Timer> Timer::CreateManualResetTimer() {
@@ -359,25 +850,50 @@ std::unique_ptr<Timer> Timer::CreateSynchronizationTimer() {
   return std::make_unique<PosixTimer>(false);
 }
 
-class PosixThread : public PosixThreadHandle<Thread> {
+class PosixThread : public Thread {
  public:
-  explicit PosixThread(pthread_t handle) : PosixThreadHandle(handle) {}
+  explicit PosixThread(std::shared_ptr<ThreadWaitState> state)
+      : state_(std::move(state)) {}
   ~PosixThread() = default;
 
   void set_name(std::string name) override {
-    pthread_setname_np(handle_, name.c_str());
+    xe::threading::set_name(state_->handle(), name);
+    Thread::set_name(name);
   }
 
-  uint32_t system_id() const override { return 0; }
+  uint32_t system_id() const override { return state_->system_id(); }
 
-  // TODO(DrChat)
-  uint64_t affinity_mask() override { return 0; }
-  void set_affinity_mask(uint64_t mask) override { assert_always(); }
+  uint64_t affinity_mask() override {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (pthread_getaffinity_np(state_->handle(), sizeof(cpu_set), &cpu_set)) {
+      return 0;
+    }
+    uint64_t mask = 0;
+    for (uint32_t cpu = 0; cpu < 64; ++cpu) {
+      if (CPU_ISSET(cpu, &cpu_set)) {
+        mask |= uint64_t(1) << cpu;
+      }
+    }
+    return mask;
+  }
+  void set_affinity_mask(uint64_t mask) override {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (uint32_t cpu = 0; cpu < 64; ++cpu) {
+      if (mask & (uint64_t(1) << cpu)) {
+        CPU_SET(cpu, &cpu_set);
+      }
+    }
+    if (pthread_setaffinity_np(state_->handle(), sizeof(cpu_set), &cpu_set)) {
+      XELOGW("Failed to set the affinity mask of a thread to {:016X}", mask);
+    }
+  }
 
   int priority() override {
     int policy;
     struct sched_param param;
-    int ret = pthread_getschedparam(handle_, &policy, &param);
+    int ret = pthread_getschedparam(state_->handle(), &policy, &param);
     if (ret != 0) {
       return -1;
     }
@@ -388,12 +904,11 @@ class PosixThread : public PosixThreadHandle<Thread> {
   void set_priority(int new_priority) override {
     struct sched_param param;
     param.sched_priority = new_priority;
-    int ret = pthread_setschedparam(handle_, SCHED_FIFO, &param);
+    int ret = pthread_setschedparam(state_->handle(), SCHED_FIFO, &param);
   }
 
-  // TODO(DrChat)
   void QueueUserCallback(std::function<void()> callback) override {
-    assert_always();
+    state_->QueueCallback(std::move(callback));
   }
 
   bool Resume(uint32_t* out_new_suspend_count = nullptr) override {
@@ -407,32 +922,54 @@ class PosixThread : public PosixThreadHandle<Thread> {
   }
 
   void Terminate(int exit_code) override {}
+
+ protected:
+  void* native_handle() const override {
+    return static_cast<PosixWaitObject*>(state_.get());
+  }
+
+ private:
+  std::shared_ptr<ThreadWaitState> state_;
 };
 
 thread_local std::unique_ptr<PosixThread> current_thread_ = nullptr;
 
 struct ThreadStartData {
   std::function<void()> start_routine;
+  std::shared_ptr<ThreadWaitState> state;
 };
 void* ThreadStartRoutine(void* parameter) {
+  // Freed before running the start routine, as Thread::Exit doesn't return.
+  std::function<void()> start_routine;
+  {
+    auto start_data = std::unique_ptr<ThreadStartData>(
+        reinterpret_cast<ThreadStartData*>(parameter));
+    current_wait_state_ = std::move(start_data->state);
+    start_routine = std::move(start_data->start_routine);
+  }
+  current_wait_state_->Attach();
   current_thread_ =
-      std::unique_ptr<PosixThread>(new PosixThread(::pthread_self()));
+      std::unique_ptr<PosixThread>(new PosixThread(current_wait_state_));
 
-  auto start_data = reinterpret_cast<ThreadStartData*>(parameter);
-  start_data->start_routine();
-  delete start_data;
+  start_routine();
+  current_wait_state_->SetExited();
   return 0;
 }
 
 std::unique_ptr<Thread> Thread::Create(CreationParameters params,
                                        std::function<void()> start_routine) {
-  auto start_data = new ThreadStartData({std::move(start_routine)});
+  auto state = std::make_shared<ThreadWaitState>();
+  auto start_data = new ThreadStartData({std::move(start_routine), state});
 
   assert_false(params.create_suspended);
   pthread_t handle;
   pthread_attr_t attr;
   pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, params.stack_size);
+  // Waits for the thread use its exit state rather than joining it.
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
   int ret = pthread_create(&handle, &attr, ThreadStartRoutine, start_data);
+  pthread_attr_destroy(&attr);
   if (ret != 0) {
     // TODO(benvanik): pass back?
     auto last_error = errno;
@@ -441,7 +978,8 @@ std::unique_ptr<Thread> Thread::Create(CreationParameters params,
     return nullptr;
   }
 
-  return std::unique_ptr<PosixThread>(new PosixThread(handle));
+  state->set_handle(handle);
+  return std::unique_ptr<PosixThread>(new PosixThread(std::move(state)));
 }
 
 Thread* Thread::GetCurrentThread() {
@@ -449,13 +987,15 @@ Thread* Thread::GetCurrentThread() {
     return current_thread_.get();
   }
 
-  pthread_t handle = pthread_self();
-
-  current_thread_ = std::make_unique<PosixThread>(handle);
+  GetCurrentWaitState();
+  current_thread_ = std::make_unique<PosixThread>(current_wait_state_);
   return current_thread_.get();
 }
 
 void Thread::Exit(int exit_code) {
+  if (current_wait_state_) {
+    current_wait_state_->SetExited();
+  }
   pthread_exit(reinterpret_cast<void*>(exit_code));
 }
 
@@ -12,12 +12,36 @@
 #include "xenia/base/platform_win.h"
 #include "xenia/base/threading.h"
 
+// For WaitOnAddress.
+#pragma comment(lib, "Synchronization.lib")
+
 typedef HANDLE (*SetThreadDescriptionFn)(HANDLE hThread,
                                          PCWSTR lpThreadDescription);
 
 namespace xe {
 namespace threading {
 
+const std::vector<uint64_t>& physical_core_processor_masks() {
+  static const std::vector<uint64_t> masks = []() {
+    std::vector<uint64_t> core_masks;
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(
+        length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (infos.empty() ||
+        !GetLogicalProcessorInformation(infos.data(), &length)) {
+      return core_masks;
+    }
+    for (const auto& info : infos) {
+      if (info.Relationship == RelationProcessorCore) {
+        core_masks.push_back(uint64_t(info.ProcessorMask));
+      }
+    }
+    return core_masks;
+  }();
+  return masks;
+}
+
 void EnableAffinityConfiguration() {
   HANDLE process_handle = GetCurrentProcess();
   DWORD_PTR process_affinity_mask;
@@ -96,6 +120,24 @@ SleepResult AlertableSleep(std::chrono::microseconds duration) {
   return SleepResult::kSuccess;
 }
 
+void WaitOnAddress(volatile void* address, uint32_t compare_value,
+                   std::chrono::nanoseconds timeout) {
+  DWORD timeout_ms = INFINITE;
+  if (timeout != std::chrono::nanoseconds::max()) {
+    if (timeout.count() <= 0) {
+      return;
+    }
+    // Round up so that short timeouts don't become spins.
+    timeout_ms = DWORD(std::min(int64_t((timeout.count() + 999999) / 1000000),
+                                int64_t(INFINITE - 1)));
+  }
+  ::WaitOnAddress(address, &compare_value, sizeof(compare_value), timeout_ms);
+}
+
+void WakeByAddressAll(volatile void* address) {
+  ::WakeByAddressAll(const_cast<void*>(address));
+}
+
 TlsHandle AllocateTlsHandle() { return TlsAlloc(); }
 
 bool FreeTlsHandle(TlsHandle handle) { return TlsFree(handle) ? true : false; }
@@ -70,6 +70,23 @@ X64Backend::~X64Backend() {
 
   X64Emitter::FreeConstData(emitter_data_);
   ExceptionHandler::Uninstall(&ExceptionCallbackThunk, this);
+
+  // Report how well the inline fast paths of kernel exports worked.
+  if (processor() && processor()->export_resolver()) {
+    for (auto export_data :
+         processor()->export_resolver()->all_exports_by_name()) {
+      if (export_data->type != Export::Type::kFunction) {
+        continue;
+      }
+      const auto& function_data = export_data->function_data;
+      if (function_data.intrinsic_hit_count ||
+          function_data.intrinsic_miss_count) {
+        XELOGI("Export {}: {} calls inline, {} calls to the kernel",
+               export_data->name, function_data.intrinsic_hit_count,
+               function_data.intrinsic_miss_count);
+      }
+    }
+  }
 }
 
 bool X64Backend::Initialize(Processor* processor) {
@@ -25,6 +25,7 @@
 #include "xenia/base/vec128.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_export_intrinsics.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
@@ -42,6 +43,11 @@ DEFINE_bool(ignore_undefined_externs, true,
 DEFINE_bool(emit_source_annotations, false,
             "Add extra movs and nops to make disassembly easier to read.",
             "CPU");
+DEFINE_bool(inline_kernel_exports, false,
+            "Emit inline fast paths for frequently called kernel exports, "
+            "such as uncontended critical sections, calling the kernel only "
+            "when needed. Experimental.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -508,6 +514,24 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     auto extern_function = static_cast<const GuestFunction*>(function);
     if (extern_function->extern_handler()) {
       undefined = false;
+      Export* export_data = extern_function->export_data();
+      Xbyak::Label intrinsic_done;
+      if (cvars::inline_kernel_exports && HasExportIntrinsic(export_data)) {
+        Xbyak::Label intrinsic_slow_path;
+        EmitExportIntrinsic(*this, export_data, intrinsic_slow_path);
+        mov(rax,
+            reinterpret_cast<uint64_t>(
+                &export_data->function_data.intrinsic_hit_count));
+        lock();
+        inc(qword[rax]);
+        jmp(intrinsic_done, T_NEAR);
+        L(intrinsic_slow_path);
+        mov(rax,
+            reinterpret_cast<uint64_t>(
+                &export_data->function_data.intrinsic_miss_count));
+        lock();
+        inc(qword[rax]);
+      }
       // rcx = target function
       // rdx = arg0
       // r8  = arg1
@@ -519,6 +543,7 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
       call(rax);
       // rax = host return
+      L(intrinsic_done);
     }
   }
   if (undefined) {
@@ -0,0 +1,204 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_export_intrinsics.h"
+
+#include <cstddef>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+#include "xenia/cpu/export_resolver.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+using namespace Xbyak;
+
+// Guest structures accessed by the fast paths, must match the kernel.
+// X_KPCR (pointed to by r13) current_thread, the X_KTHREAD guest address.
+constexpr uint32_t kKPCRCurrentThreadOffset = 0x100;
+// X_RTL_CRITICAL_SECTION (xboxkrnl_rtl.h) fields. The lock count is in host
+// byte order, as it's only accessed with host atomic operations.
+constexpr uint32_t kCriticalSectionLockCountOffset = 0x10;
+constexpr uint32_t kCriticalSectionRecursionCountOffset = 0x14;
+constexpr uint32_t kCriticalSectionOwningThreadOffset = 0x18;
+// Big-endian 1, for storing to the recursion count.
+constexpr uint32_t kBigEndianOne = 0x01000000;
+
+size_t GuestRegisterOffset(uint32_t index) {
+  return offsetof(ppc::PPCContext, r) + sizeof(uint64_t) * index;
+}
+
+// Loads the host address of the guest address in a guest register.
+void EmitGuestRegisterToHostAddress(X64Emitter& e, const Reg64& dest,
+                                    uint32_t index) {
+  e.mov(dest.cvt32(), e.dword[e.GetContextReg() + GuestRegisterOffset(index)]);
+  if (xe::memory::allocation_granularity() > 0x1000) {
+    // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
+    // it via memory mapping.
+    Label below_offset;
+    e.cmp(dest.cvt32(), 0xE0000000);
+    e.jb(below_offset);
+    e.add(dest.cvt32(), 0x1000);
+    e.L(below_offset);
+  }
+  e.add(dest, e.GetMembaseReg());
+}
+
+// Loads the guest address of the current X_KTHREAD, big-endian as stored in
+// guest structures.
+void EmitLoadCurrentThread(X64Emitter& e, const Reg32& dest) {
+  EmitGuestRegisterToHostAddress(e, e.r8, 13);
+  e.mov(dest, e.dword[e.r8 + kKPCRCurrentThreadOffset]);
+}
+
+void EmitStoreResult(X64Emitter& e, const Reg64& value) {
+  e.mov(e.qword[e.GetContextReg() + GuestRegisterOffset(3)], value);
+}
+
+// Tries to acquire the critical section in rdx for the thread in ecx, either
+// when it's free or recursively. Jumps to acquired on success, falls through
+// otherwise.
+void EmitTryEnterCriticalSection(X64Emitter& e, Label& acquired) {
+  Label not_free;
+  e.mov(e.eax, 0xFFFFFFFF);
+  e.xor_(e.r9d, e.r9d);
+  e.lock();
+  e.cmpxchg(e.dword[e.rdx + kCriticalSectionLockCountOffset], e.r9d);
+  e.jne(not_free);
+  e.mov(e.dword[e.rdx + kCriticalSectionOwningThreadOffset], e.ecx);
+  e.mov(e.dword[e.rdx + kCriticalSectionRecursionCountOffset], kBigEndianOne);
+  e.jmp(acquired, CodeGenerator::T_NEAR);
+
+  e.L(not_free);
+  Label not_owned;
+  e.cmp(e.dword[e.rdx + kCriticalSectionOwningThreadOffset], e.ecx);
+  e.jne(not_owned);
+  e.lock();
+  e.inc(e.dword[e.rdx + kCriticalSectionLockCountOffset]);
+  e.mov(e.eax, e.dword[e.rdx + kCriticalSectionRecursionCountOffset]);
+  e.bswap(e.eax);
+  e.inc(e.eax);
+  e.bswap(e.eax);
+  e.mov(e.dword[e.rdx + kCriticalSectionRecursionCountOffset], e.eax);
+  e.jmp(acquired, CodeGenerator::T_NEAR);
+  e.L(not_owned);
+}
+
+void EmitRtlEnterCriticalSection(X64Emitter& e, Label& slow_path) {
+  // Contended entering spins and waits in the kernel.
+  Label done;
+  EmitGuestRegisterToHostAddress(e, e.rdx, 3);
+  EmitLoadCurrentThread(e, e.ecx);
+  EmitTryEnterCriticalSection(e, done);
+  e.jmp(slow_path, CodeGenerator::T_NEAR);
+  e.L(done);
+}
+
+void EmitRtlTryEnterCriticalSection(X64Emitter& e, Label& slow_path) {
+  Label acquired, done;
+  EmitGuestRegisterToHostAddress(e, e.rdx, 3);
+  EmitLoadCurrentThread(e, e.ecx);
+  EmitTryEnterCriticalSection(e, acquired);
+  e.xor_(e.eax, e.eax);
+  EmitStoreResult(e, e.rax);
+  e.jmp(done);
+  e.L(acquired);
+  e.mov(e.eax, 1);
+  EmitStoreResult(e, e.rax);
+  e.L(done);
+}
+
+void EmitRtlLeaveCriticalSection(X64Emitter& e, Label& slow_path) {
+  Label recursive, done;
+  EmitGuestRegisterToHostAddress(e, e.rdx, 3);
+  e.mov(e.eax, e.dword[e.rdx + kCriticalSectionRecursionCountOffset]);
+  e.bswap(e.eax);
+  e.cmp(e.eax, 1);
+  // Not entered, let the kernel report it.
+  e.jl(slow_path, CodeGenerator::T_NEAR);
+  e.jne(recursive, CodeGenerator::T_NEAR);
+
+  // Last leave, release unless there are waiters to wake.
+  e.xor_(e.eax, e.eax);
+  e.mov(e.dword[e.rdx + kCriticalSectionRecursionCountOffset], e.eax);
+  e.mov(e.dword[e.rdx + kCriticalSectionOwningThreadOffset], e.eax);
+  e.mov(e.r9d, 0xFFFFFFFF);
+  e.lock();
+  e.cmpxchg(e.dword[e.rdx + kCriticalSectionLockCountOffset], e.r9d);
+  e.je(done, CodeGenerator::T_NEAR);
+  // There are waiters, which can't take the lock meanwhile as the lock count
+  // isn't -1. Restore the ownership and let the kernel release it.
+  e.mov(e.dword[e.rdx + kCriticalSectionRecursionCountOffset], kBigEndianOne);
+  EmitLoadCurrentThread(e, e.ecx);
+  e.mov(e.dword[e.rdx + kCriticalSectionOwningThreadOffset], e.ecx);
+  e.jmp(slow_path, CodeGenerator::T_NEAR);
+
+  e.L(recursive);
+  e.dec(e.eax);
+  e.bswap(e.eax);
+  e.mov(e.dword[e.rdx + kCriticalSectionRecursionCountOffset], e.eax);
+  e.lock();
+  e.dec(e.dword[e.rdx + kCriticalSectionLockCountOffset]);
+  e.L(done);
+}
+
+void EmitKeQueryPerformanceFrequency(X64Emitter& e, Label& slow_path) {
+  // Set once on startup, before any guest code is translated.
+  e.mov(e.eax, uint32_t(Clock::guest_tick_frequency()));
+  EmitStoreResult(e, e.rax);
+}
+
+struct ExportIntrinsic {
+  const char* name;
+  void (*emit)(X64Emitter& e, Label& slow_path);
+};
+
+const ExportIntrinsic kExportIntrinsics[] = {
+    {"RtlEnterCriticalSection", EmitRtlEnterCriticalSection},
+    {"RtlTryEnterCriticalSection", EmitRtlTryEnterCriticalSection},
+    {"RtlLeaveCriticalSection", EmitRtlLeaveCriticalSection},
+    {"KeQueryPerformanceFrequency", EmitKeQueryPerformanceFrequency},
+};
+
+const ExportIntrinsic* FindExportIntrinsic(const Export* export_data) {
+  if (!export_data || export_data->type != Export::Type::kFunction ||
+      !(export_data->tags & ExportTag::kHighFrequency)) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < xe::countof(kExportIntrinsics); ++i) {
+    if (!std::strcmp(export_data->name, kExportIntrinsics[i].name)) {
+      return &kExportIntrinsics[i];
+    }
+  }
+  return nullptr;
+}
+
+bool HasExportIntrinsic(const Export* export_data) {
+  return FindExportIntrinsic(export_data) != nullptr;
+}
+
+void EmitExportIntrinsic(X64Emitter& e, const Export* export_data,
+                         Label& slow_path) {
+  auto intrinsic = FindExportIntrinsic(export_data);
+  assert_not_null(intrinsic);
+  intrinsic->emit(e, slow_path);
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,37 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKEND_X64_X64_EXPORT_INTRINSICS_H_
+#define XENIA_CPU_BACKEND_X64_X64_EXPORT_INTRINSICS_H_
+
+#include "third_party/xbyak/xbyak/xbyak.h"
+
+namespace xe {
+namespace cpu {
+class Export;
+namespace backend {
+namespace x64 {
+class X64Emitter;
+
+// Whether an inline fast path can be emitted for calls to the export.
+bool HasExportIntrinsic(const Export* export_data);
+
+// Emits the inline fast path for a call to the export, with the arguments and
+// the result in the guest registers in the context. Jumps to slow_path when
+// the export must be called instead, and falls through when done. Only the
+// registers clobbered by native calls (rax, rcx, rdx, r8 and r9) are used.
+void EmitExportIntrinsic(X64Emitter& e, const Export* export_data,
+                         Xbyak::Label& slow_path);
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_X64_X64_EXPORT_INTRINSICS_H_
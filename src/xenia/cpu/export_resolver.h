@@ -82,7 +82,7 @@ class Export {
       : ordinal(ordinal),
         type(type),
         tags(tags),
-        function_data({nullptr, nullptr, 0}) {
+        function_data({nullptr, nullptr, 0, 0, 0}) {
     std::strncpy(this->name, name, xe::countof(this->name));
   }
 
@@ -109,6 +109,11 @@ class Export {
       // Expects only PPC context as first arg.
       ExportTrampoline trampoline;
       uint64_t call_count;
+
+      // Calls completed by the fast path inlined by the backend, and calls
+      // that needed the trampoline after entering the fast path.
+      uint64_t intrinsic_hit_count;
+      uint64_t intrinsic_miss_count;
     } function_data;
   };
 };
@@ -0,0 +1,256 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/math.h"
+#include "xenia/cpu/function_trace_data.h"
+
+DEFINE_path(function_trace_input, "",
+            "Function trace data path, as passed to --trace_function_data_path "
+            "when recording. The chunks written to it with the .0, .1, ... "
+            "extensions are read.",
+            "CPU");
+DEFINE_int32(function_trace_hot_count, 40,
+             "Number of most called functions to list.", "CPU");
+DEFINE_path(function_trace_report, "",
+            "CSV file to write the aggregated data of every traced function "
+            "to, for sorting and diffing between runs.",
+            "CPU");
+
+namespace xe {
+namespace cpu {
+
+// Data of a guest function aggregated over all its translations.
+struct FunctionReport {
+  uint32_t start_address = 0;
+  uint32_t end_address = 0;
+  uint64_t call_count = 0;
+  uint64_t thread_use = 0;
+  // Most recent callers, in no particular order.
+  std::vector<uint32_t> callers;
+  // Empty if not traced with --trace_function_coverage.
+  std::vector<uint64_t> instruction_execute_counts;
+
+  uint32_t instruction_count() const {
+    return (end_address - start_address) / 4 + 1;
+  }
+  uint64_t executed_instruction_count() const {
+    uint64_t count = 0;
+    for (uint64_t execute_count : instruction_execute_counts) {
+      count += execute_count;
+    }
+    return count;
+  }
+  uint32_t covered_instruction_count() const {
+    return uint32_t(std::count_if(instruction_execute_counts.begin(),
+                                  instruction_execute_counts.end(),
+                                  [](uint64_t count) { return count != 0; }));
+  }
+};
+
+// Adds the records of a chunk, returns false if it's malformed.
+bool ReadChunk(const MappedMemory& chunk,
+               std::map<uint32_t, FunctionReport>& functions) {
+  using Header = FunctionTraceData::Header;
+  size_t offset = 0;
+  while (chunk.size() - offset >= sizeof(Header)) {
+    Header header;
+    std::memcpy(&header, chunk.data() + offset, sizeof(Header));
+    if (!header.data_size) {
+      // Unused space at the end of an untruncated chunk.
+      break;
+    }
+    if (header.data_size < sizeof(Header) ||
+        header.data_size > chunk.size() - offset ||
+        header.end_address < header.start_address) {
+      XELOGE("Malformed trace record at offset {}", offset);
+      return false;
+    }
+    FunctionReport& function = functions[header.start_address];
+    function.start_address = header.start_address;
+    function.end_address = header.end_address;
+    function.call_count += header.function_call_count;
+    function.thread_use |= header.function_thread_use;
+    for (uint32_t caller : header.function_caller_history) {
+      if (caller && std::find(function.callers.begin(), function.callers.end(),
+                              caller) == function.callers.end()) {
+        function.callers.push_back(caller);
+      }
+    }
+    size_t counts_size = header.data_size - sizeof(Header);
+    if (counts_size ==
+        FunctionTraceData::SizeOfInstructionCounts(header.start_address,
+                                                   header.end_address)) {
+      function.instruction_execute_counts.resize(function.instruction_count());
+      const uint8_t* counts = chunk.data() + offset + sizeof(Header);
+      for (size_t i = 0; i < function.instruction_execute_counts.size();
+           ++i) {
+        uint64_t count;
+        std::memcpy(&count, counts + i * sizeof(uint64_t), sizeof(count));
+        function.instruction_execute_counts[i] += count;
+      }
+    }
+    offset += header.data_size;
+  }
+  return true;
+}
+
+bool WriteCsvReport(const std::filesystem::path& path,
+                    const std::vector<const FunctionReport*>& functions) {
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Unable to create {}", xe::path_to_utf8(path));
+    return false;
+  }
+  std::fputs(
+      "start_address,end_address,call_count,thread_use,instruction_count,"
+      "covered_instruction_count,executed_instruction_count,callers\n",
+      file);
+  for (const FunctionReport* function : functions) {
+    std::string callers;
+    for (uint32_t caller : function->callers) {
+      callers += fmt::format("{}{:08X}", callers.empty() ? "" : " ", caller);
+    }
+    std::fputs(fmt::format("{:08X},{:08X},{},{:016X},{},{},{},{}\n",
+                           function->start_address, function->end_address,
+                           function->call_count, function->thread_use,
+                           function->instruction_count(),
+                           function->covered_instruction_count(),
+                           function->executed_instruction_count(), callers)
+                   .c_str(),
+               file);
+  }
+  std::fclose(file);
+  return true;
+}
+
+int function_trace_report_main(const std::vector<std::string>& args) {
+  if (cvars::function_trace_input.empty()) {
+    XELOGE("No trace data specified with --function_trace_input.");
+    return 1;
+  }
+
+  std::map<uint32_t, FunctionReport> functions;
+  uint32_t chunk_count = 0;
+  while (true) {
+    auto chunk_path = std::filesystem::path(cvars::function_trace_input)
+                          .replace_extension(fmt::format(".{}", chunk_count));
+    if (!std::filesystem::exists(chunk_path)) {
+      break;
+    }
+    auto chunk = MappedMemory::Open(chunk_path, MappedMemory::Mode::kRead);
+    if (!chunk) {
+      XELOGE("Unable to open {}", xe::path_to_utf8(chunk_path));
+      return 1;
+    }
+    if (!ReadChunk(*chunk, functions)) {
+      XELOGE("Unable to read {}", xe::path_to_utf8(chunk_path));
+      return 1;
+    }
+    ++chunk_count;
+  }
+  if (!chunk_count) {
+    XELOGE("No trace data chunks found for {}",
+           xe::path_to_utf8(cvars::function_trace_input));
+    return 1;
+  }
+
+  std::vector<const FunctionReport*> sorted_functions;
+  uint64_t total_call_count = 0;
+  uint32_t called_function_count = 0;
+  uint32_t coverage_function_count = 0;
+  uint64_t instruction_count = 0, covered_instruction_count = 0;
+  uint32_t fully_covered_function_count = 0;
+  for (const auto& function_pair : functions) {
+    const FunctionReport& function = function_pair.second;
+    sorted_functions.push_back(&function);
+    total_call_count += function.call_count;
+    if (function.call_count) {
+      ++called_function_count;
+    }
+    if (!function.instruction_execute_counts.empty()) {
+      ++coverage_function_count;
+      instruction_count += function.instruction_count();
+      uint32_t covered = function.covered_instruction_count();
+      covered_instruction_count += covered;
+      if (covered == function.instruction_count()) {
+        ++fully_covered_function_count;
+      }
+    }
+  }
+  std::stable_sort(sorted_functions.begin(), sorted_functions.end(),
+                   [](const FunctionReport* a, const FunctionReport* b) {
+                     return a->call_count > b->call_count;
+                   });
+
+  XELOGI("{} functions traced in {} chunk(s), {} called, {} calls",
+         functions.size(), chunk_count, called_function_count,
+         total_call_count);
+
+  size_t hot_count =
+      std::min(size_t(std::max(cvars::function_trace_hot_count, 0)),
+               size_t(called_function_count));
+  if (hot_count) {
+    XELOGI("Hot functions:");
+    XELOGI("  {:>8}-{:8} {:>14} {:>7} {:>7} {:>16}  recent callers", "start",
+           "end", "calls", "% calls", "threads", "instructions");
+  }
+  for (size_t i = 0; i < hot_count; ++i) {
+    const FunctionReport& function = *sorted_functions[i];
+    std::string callers;
+    for (uint32_t caller : function.callers) {
+      callers += fmt::format(" {:08X}", caller);
+    }
+    XELOGI("  {:08X}-{:08X} {:>14} {:>6.2f}% {:>7} {:>16} {}",
+           function.start_address, function.end_address, function.call_count,
+           100.0 * double(function.call_count) / double(total_call_count),
+           xe::bit_count(function.thread_use),
+           function.instruction_execute_counts.empty()
+               ? std::string("-")
+               : std::to_string(function.executed_instruction_count()),
+           callers);
+  }
+
+  if (coverage_function_count) {
+    XELOGI(
+        "Coverage: {} of {} instructions ({:.2f}%) in {} functions, {} fully "
+        "covered",
+        covered_instruction_count, instruction_count,
+        100.0 * double(covered_instruction_count) / double(instruction_count),
+        coverage_function_count, fully_covered_function_count);
+  } else {
+    XELOGI("No coverage data - record with --trace_function_coverage.");
+  }
+
+  if (!cvars::function_trace_report.empty() &&
+      !WriteCsvReport(cvars::function_trace_report, sorted_functions)) {
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace cpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-cpu-function-trace-report",
+                   xe::cpu::function_trace_report_main, "[trace data path]",
+                   "function_trace_input");
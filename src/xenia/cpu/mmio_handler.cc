@@ -114,32 +114,11 @@ bool MMIOHandler::CheckStore(uint32_t virtual_address, uint32_t value) {
   return false;
 }
 
-struct DecodedMov {
-  size_t length;
-  // Inidicates this is a load (or conversely a store).
-  bool is_load;
-  // Indicates the memory must be swapped.
-  bool byte_swap;
-  // Source (for store) or target (for load) register.
-  // AX  CX  DX  BX  SP  BP  SI  DI   // REX.R=0
-  // R8  R9  R10 R11 R12 R13 R14 R15  // REX.R=1
-  uint32_t value_reg;
-  // [base + (index * scale) + displacement]
-  bool mem_has_base;
-  uint8_t mem_base_reg;
-  bool mem_has_index;
-  uint8_t mem_index_reg;
-  uint8_t mem_scale;
-  int32_t mem_displacement;
-  bool is_constant;
-  int32_t constant;
-};
-
 bool TryDecodeMov(const uint8_t* p, DecodedMov* mov) {
   uint8_t i = 0;  // Current byte decode index.
   uint8_t rex = 0;
   if ((p[i] & 0xF0) == 0x40) {
-    rex = p[0];
+    rex = p[i];
     ++i;
   }
   if (p[i] == 0x0F && p[i + 1] == 0x38 && p[i + 2] == 0xF1) {
@@ -231,17 +210,13 @@ bool TryDecodeMov(const uint8_t* p, DecodedMov* mov) {
   }
   if (has_sib) {
     uint8_t sib = p[i++];
-    mov->mem_scale = 1 << ((sib & 0b11000000) >> 8);
+    mov->mem_scale = 1 << ((sib & 0b11000000) >> 6);
     uint8_t sib_index = (sib & 0b00111000) >> 3;
     uint8_t sib_base = (sib & 0b00000111);
-    switch (sib_index) {
-      case 0b100:
-        // No index.
-        break;
-      default:
-        mov->mem_has_index = true;
-        mov->mem_index_reg = sib_index + (rex_x ? 8 : 0);
-        break;
+    // No index unless REX.X is set (r12).
+    if (sib_index != 0b100 || rex_x) {
+      mov->mem_has_index = true;
+      mov->mem_index_reg = sib_index + (rex_x ? 8 : 0);
     }
     switch (sib_base) {
       case 0b101:
@@ -312,25 +287,31 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
     }
   }
   if (!range) {
-    // Recheck if the pages are still protected (race condition - another thread
-    // clears the watch we just hit).
+    // The address is not found within any range, so either a write watch or an
+    // actual access violation.
     // Do this under the lock so we don't introduce another race condition.
     auto lock = global_critical_region_.Acquire();
+    if (access_violation_callback_ &&
+        access_violation_callback_(std::move(lock),
+                                   access_violation_callback_context_,
+                                   fault_host_address, is_write)) {
+      return true;
+    }
+    // Recheck if the pages are still protected (race condition - another thread
+    // clears the watch we just hit). Querying the protection is slow on some
+    // hosts, so this is only done when the callback didn't handle the access,
+    // as write watches are hit many times per frame.
+    lock = global_critical_region_.Acquire();
     memory::PageAccess cur_access;
     size_t page_length = memory::page_size();
-    memory::QueryProtect(fault_host_address, page_length, cur_access);
+    if (!memory::QueryProtect(fault_host_address, page_length, cur_access)) {
+      return false;
+    }
     if (cur_access != memory::PageAccess::kNoAccess &&
         (!is_write || cur_access != memory::PageAccess::kReadOnly)) {
       // Another thread has cleared this watch. Abort.
       return true;
     }
-    // The address is not found within any range, so either a write watch or an
-    // actual access violation.
-    if (access_violation_callback_) {
-      return access_violation_callback_(std::move(lock),
-                                        access_violation_callback_context_,
-                                        fault_host_address, is_write);
-    }
     return false;
   }
 
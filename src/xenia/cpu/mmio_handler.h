@@ -29,6 +29,31 @@ typedef uint32_t (*MMIOReadCallback)(void* ppc_context, void* callback_context,
 typedef void (*MMIOWriteCallback)(void* ppc_context, void* callback_context,
                                   uint32_t addr, uint32_t value);
 
+// A 32-bit guest memory access instruction emitted by the x64 backend.
+struct DecodedMov {
+  size_t length;
+  // Inidicates this is a load (or conversely a store).
+  bool is_load;
+  // Indicates the memory must be swapped.
+  bool byte_swap;
+  // Source (for store) or target (for load) register.
+  // AX  CX  DX  BX  SP  BP  SI  DI   // REX.R=0
+  // R8  R9  R10 R11 R12 R13 R14 R15  // REX.R=1
+  uint32_t value_reg;
+  // [base + (index * scale) + displacement]
+  bool mem_has_base;
+  uint8_t mem_base_reg;
+  bool mem_has_index;
+  uint8_t mem_index_reg;
+  uint8_t mem_scale;
+  int32_t mem_displacement;
+  bool is_constant;
+  int32_t constant;
+};
+
+// Decodes the mov or movbe at p, returns false if it's not a supported form.
+bool TryDecodeMov(const uint8_t* p, DecodedMov* mov);
+
 struct MMIORange {
   uint32_t address;
   uint32_t mask;
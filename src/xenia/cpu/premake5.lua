@@ -20,5 +20,20 @@ project("xenia-cpu")
   local_platform_files("hir")
   local_platform_files("ppc")
 
+project("xenia-cpu-function-trace-report")
+  uuid("a05efd27-eeb4-4029-9b03-d2acc4814187")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "xenia-base",
+  })
+  defines({
+  })
+  files({
+    "function_trace_report_main.cc",
+    "../base/main_"..platform_suffix..".cc",
+  })
+
 include("testing")
 include("ppc/testing")
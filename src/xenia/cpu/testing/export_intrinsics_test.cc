@@ -0,0 +1,307 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <array>
+#include <cstring>
+#include <memory>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/cvar.h"
+#include "xenia/cpu/export_resolver.h"
+#include "xenia/cpu/testing/util.h"
+#include "xenia/cpu/thread_state.h"
+#include "xenia/kernel/xboxkrnl/xboxkrnl_rtl.h"
+
+DECLARE_bool(inline_kernel_exports);
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+using kernel::xboxkrnl::X_RTL_CRITICAL_SECTION;
+using xe::cpu::ppc::PPCContext;
+
+// Guest addresses of the X_KTHREADs entering the critical section, only
+// compared, never dereferenced.
+constexpr uint32_t kThread = 0x80A01000;
+constexpr uint32_t kOtherThread = 0x80A02000;
+// X_KPCR current_thread, as read by the intrinsics through r13.
+constexpr uint32_t kKPCRCurrentThreadOffset = 0x100;
+
+constexpr uint32_t kCallerAddress = 0x80000000;
+constexpr uint32_t kExternAddress = 0x80001000;
+
+enum class CriticalSectionExport {
+  kEnter,
+  kTryEnter,
+  kLeave,
+  kCount,
+};
+
+// Calls of the critical section exports from guest code, through the fast
+// paths inlined by the x64 backend, with the kernel state transitions as the
+// slow paths. The same operations are done with the kernel functions on a
+// reference critical section in host memory, and both must stay identical.
+//
+// The slow paths can't wait or wake waiters, so they only record whether the
+// kernel would have done that.
+class CriticalSectionTest {
+ public:
+  CriticalSectionTest()
+      : inline_kernel_exports_(cvars::inline_kernel_exports) {
+    // Off by default, the callers are translated with the fast paths.
+    cvars::inline_kernel_exports = true;
+    memory_ = std::make_unique<Memory>();
+    REQUIRE(memory_->Initialize());
+    processor_ = std::make_unique<Processor>(memory_.get(), nullptr);
+    REQUIRE(processor_->Setup(std::make_unique<backend::x64::X64Backend>()));
+    processor_->AddModule(std::make_unique<TestModule>(
+        processor_.get(), "Test",
+        [](uint32_t address) {
+          return address >= kCallerAddress &&
+                 address < kCallerAddress +
+                               4 * uint32_t(CriticalSectionExport::kCount);
+        },
+        [this](hir::HIRBuilder& b) {
+          b.CallExtern(generated_extern_);
+          b.Return();
+          return true;
+        }));
+    processor_->backend()->CommitExecutableRange(0x80000000, 0x80010000);
+
+    static const char* const kExportNames[] = {
+        "RtlEnterCriticalSection",
+        "RtlTryEnterCriticalSection",
+        "RtlLeaveCriticalSection",
+    };
+    static const GuestFunction::ExternHandler kSlowPaths[] = {
+        EnterSlowPath,
+        TryEnterSlowPath,
+        LeaveSlowPath,
+    };
+    for (uint32_t i = 0; i < uint32_t(CriticalSectionExport::kCount); ++i) {
+      exports_[i] = std::make_unique<Export>(
+          uint16_t(i), Export::Type::kFunction, kExportNames[i],
+          ExportTag::kImplemented | ExportTag::kHighFrequency);
+      externs_[i] = processor_->backend()->CreateGuestFunction(
+          nullptr, kExternAddress + 4 * i);
+      externs_[i]->SetupExtern(kSlowPaths[i], exports_[i].get());
+      generated_extern_ = externs_[i].get();
+      callers_[i] = processor_->ResolveFunction(kCallerAddress + 4 * i);
+      REQUIRE(callers_[i] != nullptr);
+    }
+
+    kpcr_address_ = memory_->SystemHeapAlloc(0x1000);
+    cs_address_ = memory_->SystemHeapAlloc(sizeof(X_RTL_CRITICAL_SECTION));
+    REQUIRE(kpcr_address_ != 0);
+    REQUIRE(cs_address_ != 0);
+    kernel::xboxkrnl::xeRtlInitializeCriticalSection(guest_cs(), cs_address_);
+    kernel::xboxkrnl::xeRtlInitializeCriticalSection(&reference_cs_, 0);
+  }
+
+  ~CriticalSectionTest() {
+    memory_->SystemHeapFree(cs_address_);
+    memory_->SystemHeapFree(kpcr_address_);
+    callers_ = {};
+    processor_.reset();
+    externs_ = {};
+    memory_.reset();
+    cvars::inline_kernel_exports = inline_kernel_exports_;
+  }
+
+  X_RTL_CRITICAL_SECTION* guest_cs() const {
+    return memory_->TranslateVirtual<X_RTL_CRITICAL_SECTION*>(cs_address_);
+  }
+
+  // Returns r3 after calling the export from guest code on the thread.
+  uint32_t Call(CriticalSectionExport export_index, uint32_t thread) {
+    xe::store_and_swap<uint32_t>(
+        memory_->TranslateVirtual(kpcr_address_ + kKPCRCurrentThreadOffset),
+        thread);
+    ThreadState thread_state(processor_.get(), 0x100, 0, kpcr_address_);
+    PPCContext* ctx = thread_state.context();
+    ctx->lr = 0xBCBCBCBC;
+    ctx->r[3] = cs_address_;
+    callers_[size_t(export_index)]->Call(&thread_state, uint32_t(ctx->lr));
+    return uint32_t(ctx->r[3]);
+  }
+
+  // Both the inline fast path and the slow path must leave the critical
+  // section in the same state as the kernel does.
+  void RequireSameState() const {
+    const X_RTL_CRITICAL_SECTION& cs = *guest_cs();
+    REQUIRE(cs.lock_count == reference_cs_.lock_count);
+    REQUIRE(cs.recursion_count == reference_cs_.recursion_count);
+    REQUIRE(cs.owning_thread == reference_cs_.owning_thread);
+    REQUIRE(std::memcmp(&cs.header, &reference_cs_.header,
+                        sizeof(cs.header)) == 0);
+  }
+
+  void Enter(uint32_t thread) {
+    Call(CriticalSectionExport::kEnter, thread);
+    REQUIRE(kernel::xboxkrnl::xeRtlTryEnterCriticalSection(&reference_cs_,
+                                                           thread));
+    RequireSameState();
+  }
+  bool TryEnter(uint32_t thread) {
+    uint32_t result = Call(CriticalSectionExport::kTryEnter, thread);
+    bool reference_result =
+        kernel::xboxkrnl::xeRtlTryEnterCriticalSection(&reference_cs_, thread);
+    REQUIRE(result == uint32_t(reference_result));
+    RequireSameState();
+    return reference_result;
+  }
+  void Leave(uint32_t thread) {
+    Call(CriticalSectionExport::kLeave, thread);
+    bool wake = kernel::xboxkrnl::xeRtlLeaveCriticalSection(&reference_cs_);
+    REQUIRE(wake_count_ == uint32_t(wake) + reference_wake_count_);
+    reference_wake_count_ += uint32_t(wake);
+    RequireSameState();
+  }
+  // Another thread starting to wait, as RtlEnterCriticalSection does when the
+  // lock count is already 0 or more.
+  void AddWaiter() {
+    ++guest_cs()->lock_count;
+    ++reference_cs_.lock_count;
+  }
+
+  const Export& export_data(CriticalSectionExport export_index) const {
+    return *exports_[size_t(export_index)];
+  }
+  uint32_t slow_path_count(CriticalSectionExport export_index) const {
+    return slow_path_counts_[size_t(export_index)];
+  }
+  // Slow paths taken in unexpected states, counted as the handlers are called
+  // from guest code and can't report failures themselves.
+  uint32_t slow_path_failure_count() const { return slow_path_failure_count_; }
+
+ private:
+  static CriticalSectionTest* current() { return current_; }
+
+  static X_RTL_CRITICAL_SECTION* SlowPathCriticalSection(
+      PPCContext* ppc_context, uint32_t& thread) {
+    Memory* memory = ppc_context->thread_state->memory();
+    thread = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(
+        uint32_t(ppc_context->r[13]) + kKPCRCurrentThreadOffset));
+    return memory->TranslateVirtual<X_RTL_CRITICAL_SECTION*>(
+        uint32_t(ppc_context->r[3]));
+  }
+  static void EnterSlowPath(PPCContext* ppc_context,
+                            kernel::KernelState* kernel_state) {
+    ++current()->slow_path_counts_[size_t(CriticalSectionExport::kEnter)];
+    uint32_t thread;
+    X_RTL_CRITICAL_SECTION* cs = SlowPathCriticalSection(ppc_context, thread);
+    // Contended entering would wait, which isn't done in the tests.
+    if (!kernel::xboxkrnl::xeRtlTryEnterCriticalSection(cs, thread)) {
+      ++current()->slow_path_failure_count_;
+    }
+  }
+  static void TryEnterSlowPath(PPCContext* ppc_context,
+                               kernel::KernelState* kernel_state) {
+    ++current()->slow_path_counts_[size_t(CriticalSectionExport::kTryEnter)];
+    uint32_t thread;
+    X_RTL_CRITICAL_SECTION* cs = SlowPathCriticalSection(ppc_context, thread);
+    ppc_context->r[3] =
+        kernel::xboxkrnl::xeRtlTryEnterCriticalSection(cs, thread) ? 1 : 0;
+  }
+  static void LeaveSlowPath(PPCContext* ppc_context,
+                            kernel::KernelState* kernel_state) {
+    ++current()->slow_path_counts_[size_t(CriticalSectionExport::kLeave)];
+    uint32_t thread;
+    X_RTL_CRITICAL_SECTION* cs = SlowPathCriticalSection(ppc_context, thread);
+    if (cs->owning_thread != thread) {
+      ++current()->slow_path_failure_count_;
+    }
+    if (kernel::xboxkrnl::xeRtlLeaveCriticalSection(cs)) {
+      ++current()->wake_count_;
+    }
+  }
+
+  // Restored when the test is done.
+  bool inline_kernel_exports_;
+
+  static CriticalSectionTest* current_;
+  struct CurrentScope {
+    explicit CurrentScope(CriticalSectionTest* test) { current_ = test; }
+    ~CurrentScope() { current_ = nullptr; }
+  } current_scope_{this};
+
+  std::unique_ptr<Memory> memory_;
+  std::unique_ptr<Processor> processor_;
+  std::array<std::unique_ptr<Export>, size_t(CriticalSectionExport::kCount)>
+      exports_;
+  std::array<std::unique_ptr<GuestFunction>,
+             size_t(CriticalSectionExport::kCount)>
+      externs_;
+  std::array<Function*, size_t(CriticalSectionExport::kCount)> callers_ = {};
+  Function* generated_extern_ = nullptr;
+  uint32_t kpcr_address_ = 0;
+  uint32_t cs_address_ = 0;
+  X_RTL_CRITICAL_SECTION reference_cs_ = {};
+  std::array<uint32_t, size_t(CriticalSectionExport::kCount)>
+      slow_path_counts_ = {};
+  uint32_t slow_path_failure_count_ = 0;
+  uint32_t wake_count_ = 0;
+  uint32_t reference_wake_count_ = 0;
+};
+
+CriticalSectionTest* CriticalSectionTest::current_ = nullptr;
+
+TEST_CASE("EXPORT_INTRINSICS_CRITICAL_SECTION", "[export_intrinsics]") {
+  CriticalSectionTest test;
+
+  // Uncontended and recursive entering and leaving stay inline.
+  test.Enter(kThread);
+  test.Enter(kThread);
+  REQUIRE(test.TryEnter(kThread));
+  test.Leave(kThread);
+  test.Leave(kThread);
+  test.Leave(kThread);
+  REQUIRE(test.guest_cs()->lock_count == -1);
+  REQUIRE(test.guest_cs()->owning_thread == 0u);
+
+  // Failing to enter a critical section owned by another thread returns 0
+  // inline, without changing it.
+  test.Enter(kOtherThread);
+  REQUIRE(!test.TryEnter(kThread));
+  test.Leave(kOtherThread);
+  REQUIRE(test.TryEnter(kThread));
+  test.Leave(kThread);
+  REQUIRE(test.slow_path_count(CriticalSectionExport::kEnter) == 0);
+  REQUIRE(test.slow_path_count(CriticalSectionExport::kTryEnter) == 0);
+  REQUIRE(test.slow_path_count(CriticalSectionExport::kLeave) == 0);
+
+  // The final leave with waiters needs the kernel to wake one, but recursive
+  // leaving doesn't.
+  test.Enter(kThread);
+  test.Enter(kThread);
+  test.AddWaiter();
+  test.Leave(kThread);
+  REQUIRE(test.slow_path_count(CriticalSectionExport::kLeave) == 0);
+  test.Leave(kThread);
+  REQUIRE(test.slow_path_count(CriticalSectionExport::kLeave) == 1);
+  REQUIRE(test.guest_cs()->owning_thread == 0u);
+
+  // Calls completed inline and in the kernel are counted separately.
+  const auto& enter_data = test.export_data(CriticalSectionExport::kEnter);
+  REQUIRE(enter_data.function_data.intrinsic_hit_count == 5);
+  REQUIRE(enter_data.function_data.intrinsic_miss_count == 0);
+  const auto& try_enter_data =
+      test.export_data(CriticalSectionExport::kTryEnter);
+  REQUIRE(try_enter_data.function_data.intrinsic_hit_count == 3);
+  REQUIRE(try_enter_data.function_data.intrinsic_miss_count == 0);
+  const auto& leave_data = test.export_data(CriticalSectionExport::kLeave);
+  REQUIRE(leave_data.function_data.intrinsic_hit_count == 6);
+  REQUIRE(leave_data.function_data.intrinsic_miss_count == 1);
+  REQUIRE(test.slow_path_failure_count() == 0);
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
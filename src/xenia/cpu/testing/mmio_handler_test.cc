@@ -0,0 +1,244 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/mmio_handler.h"
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/testing/util.h"
+
+#include "third_party/catch/single_include/catch.hpp"
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+constexpr uint32_t kRangeAddress = 0x7FC80000;
+constexpr uint32_t kRangeMask = 0xFFFF0000;
+constexpr size_t kRangeSize = 0x10000;
+
+// An MMIO range backed by registers in memory, and a page for write watches,
+// both inaccessible to the host so accesses go through the exception handler.
+class TestMMIO {
+ public:
+  TestMMIO() {
+    page_size_ = memory::page_size();
+    membase_ = reinterpret_cast<uint8_t*>(memory::AllocFixed(
+        nullptr, kRangeSize + page_size_,
+        memory::AllocationType::kReserveCommit, memory::PageAccess::kNoAccess));
+    REQUIRE(membase_ != nullptr);
+    watch_page_ = membase_ + kRangeSize;
+    handler_ = MMIOHandler::Install(
+        membase_, membase_ + kRangeSize + page_size_,
+        membase_ + kRangeSize + page_size_, HostToGuestVirtual, this,
+        AccessViolationCallback, this);
+    REQUIRE(handler_ != nullptr);
+    REQUIRE(handler_->RegisterRange(kRangeAddress, kRangeMask,
+                                    uint32_t(kRangeSize), this, Read, Write));
+  }
+  ~TestMMIO() {
+    handler_.reset();
+    memory::DeallocFixed(membase_, 0, memory::DeallocationType::kRelease);
+  }
+
+  MMIOHandler* handler() const { return handler_.get(); }
+  uint8_t* range_host_address(uint32_t offset) const {
+    return membase_ + offset;
+  }
+  uint8_t* watch_page() const { return watch_page_; }
+  uint32_t registers[4] = {};
+  uint32_t read_count = 0;
+  uint32_t write_count = 0;
+  uint32_t watch_count = 0;
+
+  void Watch() {
+    REQUIRE(memory::Protect(watch_page_, page_size_,
+                            memory::PageAccess::kReadOnly));
+  }
+
+ private:
+  static uint32_t HostToGuestVirtual(const void* context,
+                                     const void* host_address) {
+    auto mmio = reinterpret_cast<const TestMMIO*>(context);
+    return kRangeAddress +
+           uint32_t(reinterpret_cast<const uint8_t*>(host_address) -
+                    mmio->membase_);
+  }
+  static uint32_t Read(void* ppc_context, void* callback_context,
+                       uint32_t addr) {
+    auto mmio = reinterpret_cast<TestMMIO*>(callback_context);
+    ++mmio->read_count;
+    return mmio->registers[(addr - kRangeAddress) / 4 % 4];
+  }
+  static void Write(void* ppc_context, void* callback_context, uint32_t addr,
+                    uint32_t value) {
+    auto mmio = reinterpret_cast<TestMMIO*>(callback_context);
+    ++mmio->write_count;
+    mmio->registers[(addr - kRangeAddress) / 4 % 4] = value;
+  }
+  static bool AccessViolationCallback(
+      std::unique_lock<std::recursive_mutex> global_lock_locked_once,
+      void* context, void* host_address, bool is_write) {
+    auto mmio = reinterpret_cast<TestMMIO*>(context);
+    if (!is_write || host_address < mmio->watch_page_ ||
+        host_address >= mmio->watch_page_ + mmio->page_size_) {
+      return false;
+    }
+    ++mmio->watch_count;
+    return memory::Protect(mmio->watch_page_, mmio->page_size_,
+                           memory::PageAccess::kReadWrite);
+  }
+
+  size_t page_size_;
+  uint8_t* membase_ = nullptr;
+  uint8_t* watch_page_ = nullptr;
+  std::unique_ptr<MMIOHandler> handler_;
+};
+
+TEST_CASE("MMIO_CHECK_LOAD_STORE", "[mmio]") {
+  TestMMIO mmio;
+  REQUIRE(mmio.handler()->LookupRange(kRangeAddress + 4) != nullptr);
+  REQUIRE(mmio.handler()->LookupRange(0x40000000) == nullptr);
+
+  REQUIRE(mmio.handler()->CheckStore(kRangeAddress + 4, 0x12345678));
+  REQUIRE(mmio.registers[1] == 0x12345678);
+  uint32_t value = 0;
+  REQUIRE(mmio.handler()->CheckLoad(kRangeAddress + 4, &value));
+  REQUIRE(value == 0x12345678);
+  REQUIRE(!mmio.handler()->CheckLoad(0x40000000, &value));
+  REQUIRE(!mmio.handler()->CheckStore(0x40000000, value));
+}
+
+TEST_CASE("MMIO_DECODE_MOV", "[mmio]") {
+  DecodedMov mov = {};
+  // movbe r12d, dword ptr [rdi+rax*4+0x10]
+  const uint8_t movbe_load[] = {0x44, 0x0F, 0x38, 0xF0, 0x64, 0x87, 0x10};
+  REQUIRE(TryDecodeMov(movbe_load, &mov));
+  REQUIRE(mov.length == sizeof(movbe_load));
+  REQUIRE(mov.is_load);
+  REQUIRE(mov.byte_swap);
+  REQUIRE(!mov.is_constant);
+  REQUIRE(mov.value_reg == 12);
+  REQUIRE(mov.mem_base_reg == 7);
+  REQUIRE(mov.mem_has_index);
+  REQUIRE(mov.mem_index_reg == 0);
+  REQUIRE(mov.mem_scale == 4);
+  REQUIRE(mov.mem_displacement == 0x10);
+
+  // mov dword ptr [rdi+r12], 0x11223344
+  const uint8_t mov_store_constant[] = {0x42, 0xC7, 0x04, 0x27,
+                                        0x44, 0x33, 0x22, 0x11};
+  mov = {};
+  REQUIRE(TryDecodeMov(mov_store_constant, &mov));
+  REQUIRE(mov.length == sizeof(mov_store_constant));
+  REQUIRE(!mov.is_load);
+  REQUIRE(!mov.byte_swap);
+  REQUIRE(mov.is_constant);
+  REQUIRE(mov.constant == 0x11223344);
+  REQUIRE(mov.mem_base_reg == 7);
+  REQUIRE(mov.mem_index_reg == 12);
+  REQUIRE(mov.mem_scale == 1);
+}
+
+// The MMIO access emulation decodes the faulting instruction, so the accesses
+// must use the forms emitted by the x64 backend.
+#if XE_ARCH_AMD64 && !XE_COMPILER_MSVC
+uint32_t LoadMov(const void* base, uint64_t offset) {
+  uint32_t value;
+  // mov ecx, dword ptr [rdx+rax]
+  asm volatile("movl (%%rdx,%%rax,1), %%ecx"
+               : "=c"(value)
+               : "d"(base), "a"(offset)
+               : "memory");
+  return value;
+}
+
+void StoreMov(void* base, uint64_t offset, uint32_t value) {
+  // mov dword ptr [rdx+rax], ecx
+  asm volatile("movl %%ecx, (%%rdx,%%rax,1)"
+               :
+               : "d"(base), "a"(offset), "c"(value)
+               : "memory");
+}
+
+void StoreMovConstant(void* base, uint64_t offset) {
+  // mov dword ptr [rdx+rax], 0x11223344
+  asm volatile("movl $0x11223344, (%%rdx,%%rax,1)"
+               :
+               : "d"(base), "a"(offset)
+               : "memory");
+}
+
+TEST_CASE("MMIO_EXCEPTION_LOAD_STORE", "[mmio]") {
+  TestMMIO mmio;
+  // Guest memory is big-endian, the handler swaps the values.
+  mmio.registers[2] = 0xAABBCCDD;
+  REQUIRE(LoadMov(mmio.range_host_address(0), 8) == 0xDDCCBBAA);
+  REQUIRE(mmio.read_count == 1);
+
+  StoreMov(mmio.range_host_address(0), 4, 0x78563412);
+  REQUIRE(mmio.write_count == 1);
+  REQUIRE(mmio.registers[1] == 0x12345678);
+  REQUIRE(LoadMov(mmio.range_host_address(4), 0) == 0x78563412);
+
+  StoreMovConstant(mmio.range_host_address(12), 0);
+  REQUIRE(mmio.write_count == 2);
+  REQUIRE(mmio.registers[3] == 0x11223344);
+}
+
+TEST_CASE("MMIO_EXCEPTION_WRITE_WATCH", "[mmio]") {
+  TestMMIO mmio;
+  auto page = reinterpret_cast<uint32_t*>(mmio.watch_page());
+  // Watched pages can still be read.
+  mmio.Watch();
+  REQUIRE(page[1] == 0);
+  REQUIRE(mmio.watch_count == 0);
+  StoreMov(page, 4, 0x12345678);
+  REQUIRE(mmio.watch_count == 1);
+  REQUIRE(page[1] == 0x12345678);
+  // Unwatched by the callback.
+  StoreMov(page, 8, 1);
+  REQUIRE(mmio.watch_count == 1);
+  mmio.Watch();
+  StoreMov(page, 8, 2);
+  REQUIRE(mmio.watch_count == 2);
+  REQUIRE(page[2] == 2);
+}
+
+TEST_CASE("MMIO_EXCEPTION_BENCHMARK", "[.benchmark]") {
+  TestMMIO mmio;
+  constexpr uint32_t kIterationCount = 200000;
+
+  xe::testing::BenchmarkTimer timer;
+  for (uint32_t i = 0; i < kIterationCount; ++i) {
+    LoadMov(mmio.range_host_address(0), 4);
+  }
+  double seconds = timer.seconds();
+  REQUIRE(mmio.read_count == kIterationCount);
+  WARN("MMIO loads: " << kIterationCount / seconds / 1e6
+                      << " million faults per second");
+
+  // Includes protecting the page again, as done when watching ranges.
+  auto page = mmio.watch_page();
+  timer.Restart();
+  for (uint32_t i = 0; i < kIterationCount; ++i) {
+    mmio.Watch();
+    StoreMov(page, 0, i);
+  }
+  seconds = timer.seconds();
+  REQUIRE(mmio.watch_count == kIterationCount);
+  WARN("Write watches: " << kIterationCount / seconds / 1e6
+                         << " million faults per second");
+}
+#endif  // XE_ARCH_AMD64 && !XE_COMPILER_MSVC
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
@@ -195,6 +195,9 @@ void DebugWindow::DrawFrame() {
   ImGui::SameLine();
   ImGui::RadioButton("Memory", &state_.right_pane_tab,
                      ImState::kRightPaneMemory);
+  ImGui::SameLine();
+  ImGui::RadioButton("Kernel Calls", &state_.right_pane_tab,
+                     ImState::kRightPaneKernelCalls);
   ImGui::EndGroup();
   ImGui::Separator();
   switch (state_.right_pane_tab) {
@@ -208,6 +211,11 @@ void DebugWindow::DrawFrame() {
       DrawMemoryPane();
       ImGui::EndChild();
       break;
+    case ImState::kRightPaneKernelCalls:
+      ImGui::BeginChild("##kernel_calls_pane");
+      DrawKernelCallsPane();
+      ImGui::EndChild();
+      break;
   }
   ImGui::EndChild();
   ImGui::InvisibleButton("##hsplitter0", ImVec2(-1, kSplitterWidth));
@@ -1096,6 +1104,94 @@ void DebugWindow::DrawMemoryPane() {
   // https://github.com/ocornut/imgui/wiki/memory_editor_example
 }
 
+void DebugWindow::DrawKernelCallsPane() {
+  using xe::kernel::util::KernelCallProfiler;
+  ImGui::Checkbox("Profile", &cvars::profile_kernel_calls);
+  ImGui::SameLine();
+  if (ImGui::Button("Reset")) {
+    KernelCallProfiler::Reset();
+    cache_.kernel_calls_update_millis = 0;
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Dump JSON")) {
+    auto path = cvars::kernel_call_profile_path;
+    if (path.empty()) {
+      path = "kernel_calls.json";
+    }
+    KernelCallProfiler::DumpJson(path);
+  }
+  ImGui::Separator();
+
+  // Summing up the counters of all threads takes a lock, only do it sometimes.
+  uint64_t now_millis = Clock::QueryHostUptimeMillis();
+  if (!cache_.kernel_calls_update_millis ||
+      now_millis - cache_.kernel_calls_update_millis >= 500) {
+    cache_.kernel_calls = KernelCallProfiler::TakeSnapshot();
+    cache_.kernel_calls_update_millis = now_millis;
+  }
+
+  ImGui::BeginChild("##kernel_calls_listing");
+  ImGui::Columns(6);
+  ImGui::Text("Export");
+  ImGui::NextColumn();
+  ImGui::Text("Calls");
+  ImGui::NextColumn();
+  ImGui::Text("Inline calls");
+  ImGui::NextColumn();
+  ImGui::Text("Total ms");
+  ImGui::NextColumn();
+  ImGui::Text("Avg us");
+  ImGui::NextColumn();
+  ImGui::Text("Max us");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  for (auto& stats : cache_.kernel_calls.exports) {
+    bool is_blocking =
+        (stats.export_entry->tags & cpu::ExportTag::kBlocking) != 0;
+    if (is_blocking) {
+      ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.7f, 0.7f, 0.7f, 0.6f));
+    }
+    ImGui::Text("%s", stats.export_entry->name);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, stats.call_count);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, stats.inline_call_count);
+    ImGui::NextColumn();
+    ImGui::Text("%.3f", stats.total_ns / 1000000.0);
+    ImGui::NextColumn();
+    ImGui::Text("%.2f", stats.call_count
+                            ? stats.total_ns / 1000.0 / stats.call_count
+                            : 0.0);
+    ImGui::NextColumn();
+    ImGui::Text("%.2f", stats.max_ns / 1000.0);
+    ImGui::NextColumn();
+    if (is_blocking) {
+      ImGui::PopStyleColor();
+    }
+  }
+  ImGui::Columns(1);
+  ImGui::Separator();
+  for (auto& thread_stats : cache_.kernel_calls.threads) {
+    ImGui::PushID(&thread_stats);
+    char thread_label[256];
+    std::snprintf(thread_label, xe::countof(thread_label),
+                  "id=%.4X %s: %" PRIu64 " calls, %.3f ms, %.3f ms blocked",
+                  thread_stats.thread_id, thread_stats.name.c_str(),
+                  thread_stats.call_count, thread_stats.total_ns / 1000000.0,
+                  thread_stats.blocked_ns / 1000000.0);
+    if (ImGui::CollapsingHeader(thread_label)) {
+      ImGui::Indent();
+      for (auto& stats : thread_stats.exports) {
+        ImGui::Text("%-40s %10" PRIu64 " %12.3f ms", stats.export_entry->name,
+                    stats.call_count, stats.total_ns / 1000000.0);
+      }
+      ImGui::Unindent();
+    }
+    ImGui::PopID();
+  }
+  ImGui::EndChild();
+}
+
 void DebugWindow::DrawBreakpointsPane() {
   auto& state = state_.breakpoints;
 
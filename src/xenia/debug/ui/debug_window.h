@@ -18,6 +18,7 @@
 #include "xenia/cpu/debug_listener.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/emulator.h"
+#include "xenia/kernel/util/kernel_call_profiler.h"
 #include "xenia/ui/loop.h"
 #include "xenia/ui/menu_item.h"
 #include "xenia/ui/window.h"
@@ -68,6 +69,7 @@ class DebugWindow : public cpu::DebugListener {
   bool DrawRegisterTextBoxes(int id, float* value);
   void DrawThreadsPane();
   void DrawMemoryPane();
+  void DrawKernelCallsPane();
   void DrawBreakpointsPane();
   void DrawLogPane();
 
@@ -101,6 +103,8 @@ class DebugWindow : public cpu::DebugListener {
     bool is_running = false;
     std::vector<kernel::object_ref<kernel::XModule>> modules;
     std::vector<cpu::ThreadDebugInfo*> thread_debug_infos;
+    kernel::util::KernelCallProfiler::Snapshot kernel_calls;
+    uint64_t kernel_calls_update_millis = 0;
   } cache_;
 
   enum class RegisterGroup {
@@ -116,6 +120,7 @@ class DebugWindow : public cpu::DebugListener {
   struct ImState {
     static const int kRightPaneThreads = 0;
     static const int kRightPaneMemory = 1;
+    static const int kRightPaneKernelCalls = 2;
     int right_pane_tab = kRightPaneThreads;
 
     cpu::ThreadDebugInfo* thread_info = nullptr;
@@ -9,6 +9,7 @@
 
 #include "xenia/emulator.h"
 
+#include <algorithm>
 #include <cinttypes>
 
 #include "config.h"
@@ -40,6 +41,7 @@
 #include "xenia/kernel/xboxkrnl/xboxkrnl_module.h"
 #include "xenia/memory.h"
 #include "xenia/ui/imgui_dialog.h"
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
 #include "xenia/vfs/devices/disc_image_device.h"
 #include "xenia/vfs/devices/host_path_device.h"
 #include "xenia/vfs/devices/stfs_container_device.h"
@@ -54,6 +56,14 @@ DEFINE_string(
     "or the module specified by the game. Leave blank to launch the default "
     "module.",
     "General");
+DEFINE_int32(compressed_disc_image_cache_mb, 64,
+             "Size of the cache of decompressed blocks of .xcdi disc images, "
+             "in megabytes.",
+             "General");
+DEFINE_int32(compressed_disc_image_read_ahead_blocks, 8,
+             "Number of blocks of .xcdi disc images loaded ahead of sequential "
+             "reads.",
+             "General");
 
 namespace xe {
 
@@ -303,7 +313,16 @@ X_STATUS Emulator::LaunchDiscImage(const std::filesystem::path& path) {
   auto mount_path = "\\Device\\Cdrom0";
 
   // Register the disc image in the virtual filesystem.
-  auto device = std::make_unique<vfs::DiscImageDevice>(mount_path, path);
+  std::unique_ptr<vfs::Device> device;
+  auto extension = xe::utf8::lower_ascii(xe::path_to_utf8(path.extension()));
+  if (extension == ".xcdi") {
+    device = std::make_unique<vfs::CompressedDiscImageDevice>(
+        mount_path, path,
+        size_t(std::max(cvars::compressed_disc_image_cache_mb, 0)) << 20,
+        uint32_t(std::max(cvars::compressed_disc_image_read_ahead_blocks, 0)));
+  } else {
+    device = std::make_unique<vfs::DiscImageDevice>(mount_path, path);
+  }
   if (!device->Initialize()) {
     xe::FatalError("Unable to mount disc image; file not found or corrupt.");
     return X_STATUS_NO_SUCH_FILE;
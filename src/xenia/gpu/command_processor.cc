@@ -15,6 +15,7 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -75,6 +76,8 @@ bool CommandProcessor::Initialize(
       }));
   worker_thread_->set_name("GraphicsSystem Command Processor");
   worker_thread_->Create();
+  worker_thread_->Isolate(
+      kernel::XHostThread::IsolatedWork::kGpuCommandProcessor);
 
   return true;
 }
@@ -187,6 +190,12 @@ void CommandProcessor::WorkerThreadMain() {
     // Execute. Note that we handle wraparound transparently.
     read_ptr_index_ = ExecutePrimaryBuffer(read_ptr_index_, write_ptr_index);
 
+    if (packet_rate_counter_.Update(xe::Clock::QueryHostTickCount(),
+                                    xe::Clock::QueryHostTickFrequency())) {
+      COUNT_profile_set("gpu/command_processor/packets_per_second",
+                        packet_rate_counter_.packets_per_second());
+    }
+
     // TODO(benvanik): use reader->Read_update_freq_ and only issue after moving
     //     that many indices.
     if (read_ptr_writeback_ptr_) {
@@ -419,6 +428,8 @@ void CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
     }
   }
 
+  UpdateFrameTimeStats();
+
   PerformSwap(frontbuffer_ptr, frontbuffer_width, frontbuffer_height);
 
   {
@@ -432,6 +443,38 @@ void CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
   swap_request_handler_();
 }
 
+void CommandProcessor::UpdateFrameTimeStats() {
+  if (cvars::frame_time_stats_interval <= 0) {
+    return;
+  }
+  uint64_t ticks = Clock::QueryHostTickCount();
+  uint64_t last_ticks = frame_time_last_swap_ticks_;
+  frame_time_last_swap_ticks_ = ticks;
+  if (!last_ticks) {
+    return;
+  }
+  double frame_time_ms = double(ticks - last_ticks) * 1000.0 /
+                         double(Clock::QueryHostTickFrequency());
+  ++frame_time_count_;
+  frame_time_sum_ += frame_time_ms;
+  frame_time_square_sum_ += frame_time_ms * frame_time_ms;
+  frame_time_max_ = std::max(frame_time_max_, frame_time_ms);
+  if (frame_time_count_ < uint32_t(cvars::frame_time_stats_interval)) {
+    return;
+  }
+  double mean = frame_time_sum_ / frame_time_count_;
+  double variance =
+      std::max(frame_time_square_sum_ / frame_time_count_ - mean * mean, 0.0);
+  XELOGI(
+      "Frame time over {} frames: mean {:.3f} ms, standard deviation {:.3f} "
+      "ms, max {:.3f} ms",
+      frame_time_count_, mean, std::sqrt(variance), frame_time_max_);
+  frame_time_count_ = 0;
+  frame_time_sum_ = 0.0;
+  frame_time_square_sum_ = 0.0;
+  frame_time_max_ = 0.0;
+}
+
 uint32_t CommandProcessor::ExecutePrimaryBuffer(uint32_t read_index,
                                                 uint32_t write_index) {
   SCOPE_profile_cpu_f("gpu");
@@ -512,6 +555,7 @@ void CommandProcessor::ExecutePacket(uint32_t ptr, uint32_t count) {
 
 bool CommandProcessor::ExecutePacket(RingBuffer* reader) {
   const uint32_t packet = reader->ReadAndSwap<uint32_t>();
+  packet_rate_counter_.Increment();
   const uint32_t packet_type = packet >> 30;
   if (packet == 0) {
     trace_writer_.WritePacketStart(uint32_t(reader->read_ptr() - 4), 1);
@@ -549,13 +593,19 @@ bool CommandProcessor::ExecutePacketType0(RingBuffer* reader, uint32_t packet) {
 
   trace_writer_.WritePacketStart(uint32_t(reader->read_ptr() - 4), 1 + count);
 
+  RingBuffer::ReadRange payload_range =
+      reader->BeginRead(count * sizeof(uint32_t));
+  PacketDataReader payload(payload_range);
   uint32_t base_index = (packet & 0x7FFF);
   uint32_t write_one_reg = (packet >> 15) & 0x1;
-  for (uint32_t m = 0; m < count; m++) {
-    uint32_t reg_data = reader->ReadAndSwap<uint32_t>();
-    uint32_t target_index = write_one_reg ? base_index : base_index + m;
-    WriteRegister(target_index, reg_data);
+  if (write_one_reg) {
+    for (uint32_t m = 0; m < count; m++) {
+      WriteRegister(base_index, payload.ReadAndSwap());
+    }
+  } else {
+    WriteRegistersFromPacket(&payload, base_index, count);
   }
+  reader->EndRead(payload_range);
 
   trace_writer_.WritePacketEnd();
   return true;
@@ -583,11 +633,25 @@ bool CommandProcessor::ExecutePacketType2(RingBuffer* reader, uint32_t packet) {
   return true;
 }
 
+void CommandProcessor::WriteRegistersFromPacket(PacketDataReader* reader,
+                                                uint32_t index,
+                                                uint32_t count) {
+  // Swap the payload in batches rather than one dword at a time.
+  uint32_t values[64];
+  while (count) {
+    uint32_t batch_count = std::min(count, uint32_t(xe::countof(values)));
+    reader->ReadAndSwap(values, batch_count);
+    for (uint32_t i = 0; i < batch_count; ++i) {
+      WriteRegister(index++, values[i]);
+    }
+    count -= batch_count;
+  }
+}
+
 bool CommandProcessor::ExecutePacketType3(RingBuffer* reader, uint32_t packet) {
   // Type-3 packet.
   uint32_t opcode = (packet >> 8) & 0x7F;
   uint32_t count = ((packet >> 16) & 0x3FFF) + 1;
-  auto data_start_offset = reader->read_offset();
 
   if (reader->read_count() < count * sizeof(uint32_t)) {
     XELOGE(
@@ -615,121 +679,128 @@ bool CommandProcessor::ExecutePacketType3(RingBuffer* reader, uint32_t packet) {
     }
   }
 
+  // Resolve the payload into at most two contiguous spans once, the handlers
+  // read from them directly, and the ring buffer is advanced past the whole
+  // packet afterwards.
+  RingBuffer::ReadRange payload_range =
+      reader->BeginRead(count * sizeof(uint32_t));
+  PacketDataReader payload(payload_range);
+
   bool result = false;
   switch (opcode) {
     case PM4_ME_INIT:
-      result = ExecutePacketType3_ME_INIT(reader, packet, count);
+      result = ExecutePacketType3_ME_INIT(&payload, packet, count);
       break;
     case PM4_NOP:
-      result = ExecutePacketType3_NOP(reader, packet, count);
+      result = ExecutePacketType3_NOP(&payload, packet, count);
       break;
     case PM4_INTERRUPT:
-      result = ExecutePacketType3_INTERRUPT(reader, packet, count);
+      result = ExecutePacketType3_INTERRUPT(&payload, packet, count);
       break;
     case PM4_XE_SWAP:
-      result = ExecutePacketType3_XE_SWAP(reader, packet, count);
+      result = ExecutePacketType3_XE_SWAP(&payload, packet, count);
       break;
     case PM4_INDIRECT_BUFFER:
     case PM4_INDIRECT_BUFFER_PFD:
-      result = ExecutePacketType3_INDIRECT_BUFFER(reader, packet, count);
+      result = ExecutePacketType3_INDIRECT_BUFFER(&payload, packet, count);
       break;
     case PM4_WAIT_REG_MEM:
-      result = ExecutePacketType3_WAIT_REG_MEM(reader, packet, count);
+      result = ExecutePacketType3_WAIT_REG_MEM(&payload, packet, count);
       break;
     case PM4_REG_RMW:
-      result = ExecutePacketType3_REG_RMW(reader, packet, count);
+      result = ExecutePacketType3_REG_RMW(&payload, packet, count);
       break;
     case PM4_REG_TO_MEM:
-      result = ExecutePacketType3_REG_TO_MEM(reader, packet, count);
+      result = ExecutePacketType3_REG_TO_MEM(&payload, packet, count);
       break;
     case PM4_MEM_WRITE:
-      result = ExecutePacketType3_MEM_WRITE(reader, packet, count);
+      result = ExecutePacketType3_MEM_WRITE(&payload, packet, count);
       break;
     case PM4_COND_WRITE:
-      result = ExecutePacketType3_COND_WRITE(reader, packet, count);
+      result = ExecutePacketType3_COND_WRITE(&payload, packet, count);
       break;
     case PM4_EVENT_WRITE:
-      result = ExecutePacketType3_EVENT_WRITE(reader, packet, count);
+      result = ExecutePacketType3_EVENT_WRITE(&payload, packet, count);
       break;
     case PM4_EVENT_WRITE_SHD:
-      result = ExecutePacketType3_EVENT_WRITE_SHD(reader, packet, count);
+      result = ExecutePacketType3_EVENT_WRITE_SHD(&payload, packet, count);
       break;
     case PM4_EVENT_WRITE_EXT:
-      result = ExecutePacketType3_EVENT_WRITE_EXT(reader, packet, count);
+      result = ExecutePacketType3_EVENT_WRITE_EXT(&payload, packet, count);
       break;
     case PM4_EVENT_WRITE_ZPD:
-      result = ExecutePacketType3_EVENT_WRITE_ZPD(reader, packet, count);
+      result = ExecutePacketType3_EVENT_WRITE_ZPD(&payload, packet, count);
       break;
     case PM4_DRAW_INDX:
-      result = ExecutePacketType3_DRAW_INDX(reader, packet, count);
+      result = ExecutePacketType3_DRAW_INDX(&payload, packet, count);
       break;
     case PM4_DRAW_INDX_2:
-      result = ExecutePacketType3_DRAW_INDX_2(reader, packet, count);
+      result = ExecutePacketType3_DRAW_INDX_2(&payload, packet, count);
       break;
     case PM4_SET_CONSTANT:
-      result = ExecutePacketType3_SET_CONSTANT(reader, packet, count);
+      result = ExecutePacketType3_SET_CONSTANT(&payload, packet, count);
       break;
     case PM4_SET_CONSTANT2:
-      result = ExecutePacketType3_SET_CONSTANT2(reader, packet, count);
+      result = ExecutePacketType3_SET_CONSTANT2(&payload, packet, count);
       break;
     case PM4_LOAD_ALU_CONSTANT:
-      result = ExecutePacketType3_LOAD_ALU_CONSTANT(reader, packet, count);
+      result = ExecutePacketType3_LOAD_ALU_CONSTANT(&payload, packet, count);
       break;
     case PM4_SET_SHADER_CONSTANTS:
-      result = ExecutePacketType3_SET_SHADER_CONSTANTS(reader, packet, count);
+      result = ExecutePacketType3_SET_SHADER_CONSTANTS(&payload, packet, count);
       break;
     case PM4_IM_LOAD:
-      result = ExecutePacketType3_IM_LOAD(reader, packet, count);
+      result = ExecutePacketType3_IM_LOAD(&payload, packet, count);
       break;
     case PM4_IM_LOAD_IMMEDIATE:
-      result = ExecutePacketType3_IM_LOAD_IMMEDIATE(reader, packet, count);
+      result = ExecutePacketType3_IM_LOAD_IMMEDIATE(&payload, packet, count);
       break;
     case PM4_INVALIDATE_STATE:
-      result = ExecutePacketType3_INVALIDATE_STATE(reader, packet, count);
+      result = ExecutePacketType3_INVALIDATE_STATE(&payload, packet, count);
       break;
     case PM4_VIZ_QUERY:
-      result = ExecutePacketType3_VIZ_QUERY(reader, packet, count);
+      result = ExecutePacketType3_VIZ_QUERY(&payload, packet, count);
       break;
 
     case PM4_SET_BIN_MASK_LO: {
-      uint32_t value = reader->ReadAndSwap<uint32_t>();
+      uint32_t value = payload.ReadAndSwap();
       bin_mask_ = (bin_mask_ & 0xFFFFFFFF00000000ull) | value;
       result = true;
     } break;
     case PM4_SET_BIN_MASK_HI: {
-      uint32_t value = reader->ReadAndSwap<uint32_t>();
+      uint32_t value = payload.ReadAndSwap();
       bin_mask_ =
           (bin_mask_ & 0xFFFFFFFFull) | (static_cast<uint64_t>(value) << 32);
       result = true;
     } break;
     case PM4_SET_BIN_SELECT_LO: {
-      uint32_t value = reader->ReadAndSwap<uint32_t>();
+      uint32_t value = payload.ReadAndSwap();
       bin_select_ = (bin_select_ & 0xFFFFFFFF00000000ull) | value;
       result = true;
     } break;
     case PM4_SET_BIN_SELECT_HI: {
-      uint32_t value = reader->ReadAndSwap<uint32_t>();
+      uint32_t value = payload.ReadAndSwap();
       bin_select_ =
           (bin_select_ & 0xFFFFFFFFull) | (static_cast<uint64_t>(value) << 32);
       result = true;
     } break;
     case PM4_SET_BIN_MASK: {
       assert_true(count == 2);
-      uint64_t val_hi = reader->ReadAndSwap<uint32_t>();
-      uint64_t val_lo = reader->ReadAndSwap<uint32_t>();
+      uint64_t val_hi = payload.ReadAndSwap();
+      uint64_t val_lo = payload.ReadAndSwap();
       bin_mask_ = (val_hi << 32) | val_lo;
       result = true;
     } break;
     case PM4_SET_BIN_SELECT: {
       assert_true(count == 2);
-      uint64_t val_hi = reader->ReadAndSwap<uint32_t>();
-      uint64_t val_lo = reader->ReadAndSwap<uint32_t>();
+      uint64_t val_hi = payload.ReadAndSwap();
+      uint64_t val_lo = payload.ReadAndSwap();
       bin_select_ = (val_hi << 32) | val_lo;
       result = true;
     } break;
     case PM4_CONTEXT_UPDATE: {
       assert_true(count == 1);
-      uint64_t value = reader->ReadAndSwap<uint32_t>();
+      uint64_t value = payload.ReadAndSwap();
       XELOGGPU("GPU context update = {:08X}", value);
       assert_true(value == 0);
       result = true;
@@ -740,10 +811,13 @@ bool CommandProcessor::ExecutePacketType3(RingBuffer* reader, uint32_t packet) {
       XELOGGPU("Unimplemented GPU OPCODE: 0x{:02X}\t\tCOUNT: {}\n", opcode,
                count);
       assert_always();
-      reader->AdvanceRead(count * sizeof(uint32_t));
+      payload.Skip(count);
       break;
   }
 
+  assert_zero(payload.remaining());
+  reader->EndRead(payload_range);
+
   trace_writer_.WritePacketEnd();
   if (opcode == PM4_XE_SWAP) {
     // End the trace writer frame.
@@ -765,39 +839,34 @@ bool CommandProcessor::ExecutePacketType3(RingBuffer* reader, uint32_t packet) {
     }
   }
 
-  assert_true(reader->read_offset() ==
-              (data_start_offset + (count * sizeof(uint32_t))) %
-                  reader->capacity());
   return result;
 }
 
-bool CommandProcessor::ExecutePacketType3_ME_INIT(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_ME_INIT(PacketDataReader* reader,
                                                   uint32_t packet,
                                                   uint32_t count) {
   // initialize CP's micro-engine
-  me_bin_.clear();
-  for (uint32_t i = 0; i < count; i++) {
-    me_bin_.push_back(reader->ReadAndSwap<uint32_t>());
-  }
+  me_bin_.resize(count);
+  reader->ReadAndSwap(me_bin_.data(), count);
 
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_NOP(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_NOP(PacketDataReader* reader,
                                               uint32_t packet, uint32_t count) {
   // skip N 32-bit words to get to the next packet
   // No-op, ignore some data.
-  reader->AdvanceRead(count * sizeof(uint32_t));
+  reader->Skip(count);
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_INTERRUPT(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_INTERRUPT(PacketDataReader* reader,
                                                     uint32_t packet,
                                                     uint32_t count) {
   SCOPE_profile_cpu_f("gpu");
 
   // generate interrupt from the command stream
-  uint32_t cpu_mask = reader->ReadAndSwap<uint32_t>();
+  uint32_t cpu_mask = reader->ReadAndSwap();
   for (int n = 0; n < 6; n++) {
     if (cpu_mask & (1 << n)) {
       graphics_system_->DispatchInterruptCallback(1, n);
@@ -806,7 +875,7 @@ bool CommandProcessor::ExecutePacketType3_INTERRUPT(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_XE_SWAP(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_XE_SWAP(PacketDataReader* reader,
                                                   uint32_t packet,
                                                   uint32_t count) {
   SCOPE_profile_cpu_f("gpu");
@@ -819,14 +888,14 @@ bool CommandProcessor::ExecutePacketType3_XE_SWAP(RingBuffer* reader,
   // VdSwap will post this to tell us we need to swap the screen/fire an
   // interrupt.
   // 63 words here, but only the first has any data.
-  uint32_t magic = reader->ReadAndSwap<uint32_t>();
+  uint32_t magic = reader->ReadAndSwap();
   assert_true(magic == 'SWAP');
 
   // TODO(benvanik): only swap frontbuffer ptr.
-  uint32_t frontbuffer_ptr = reader->ReadAndSwap<uint32_t>();
-  uint32_t frontbuffer_width = reader->ReadAndSwap<uint32_t>();
-  uint32_t frontbuffer_height = reader->ReadAndSwap<uint32_t>();
-  reader->AdvanceRead((count - 4) * sizeof(uint32_t));
+  uint32_t frontbuffer_ptr = reader->ReadAndSwap();
+  uint32_t frontbuffer_width = reader->ReadAndSwap();
+  uint32_t frontbuffer_height = reader->ReadAndSwap();
+  reader->Skip(count - 4);
 
   if (swap_mode_ == SwapMode::kNormal) {
     IssueSwap(frontbuffer_ptr, frontbuffer_width, frontbuffer_height);
@@ -836,29 +905,28 @@ bool CommandProcessor::ExecutePacketType3_XE_SWAP(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_INDIRECT_BUFFER(RingBuffer* reader,
-                                                          uint32_t packet,
-                                                          uint32_t count) {
+bool CommandProcessor::ExecutePacketType3_INDIRECT_BUFFER(
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
   // indirect buffer dispatch
-  uint32_t list_ptr = CpuToGpu(reader->ReadAndSwap<uint32_t>());
-  uint32_t list_length = reader->ReadAndSwap<uint32_t>();
+  uint32_t list_ptr = CpuToGpu(reader->ReadAndSwap());
+  uint32_t list_length = reader->ReadAndSwap();
   assert_zero(list_length & ~0xFFFFF);
   list_length &= 0xFFFFF;
   ExecuteIndirectBuffer(GpuToCpu(list_ptr), list_length);
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_WAIT_REG_MEM(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_WAIT_REG_MEM(PacketDataReader* reader,
                                                        uint32_t packet,
                                                        uint32_t count) {
   SCOPE_profile_cpu_f("gpu");
 
   // wait until a register or memory location is a specific value
-  uint32_t wait_info = reader->ReadAndSwap<uint32_t>();
-  uint32_t poll_reg_addr = reader->ReadAndSwap<uint32_t>();
-  uint32_t ref = reader->ReadAndSwap<uint32_t>();
-  uint32_t mask = reader->ReadAndSwap<uint32_t>();
-  uint32_t wait = reader->ReadAndSwap<uint32_t>();
+  uint32_t wait_info = reader->ReadAndSwap();
+  uint32_t poll_reg_addr = reader->ReadAndSwap();
+  uint32_t ref = reader->ReadAndSwap();
+  uint32_t mask = reader->ReadAndSwap();
+  uint32_t wait = reader->ReadAndSwap();
   bool matched = false;
   do {
     uint32_t value;
@@ -930,14 +998,14 @@ bool CommandProcessor::ExecutePacketType3_WAIT_REG_MEM(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_REG_RMW(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_REG_RMW(PacketDataReader* reader,
                                                   uint32_t packet,
                                                   uint32_t count) {
   // register read/modify/write
   // ? (used during shader upload and edram setup)
-  uint32_t rmw_info = reader->ReadAndSwap<uint32_t>();
-  uint32_t and_mask = reader->ReadAndSwap<uint32_t>();
-  uint32_t or_mask = reader->ReadAndSwap<uint32_t>();
+  uint32_t rmw_info = reader->ReadAndSwap();
+  uint32_t and_mask = reader->ReadAndSwap();
+  uint32_t or_mask = reader->ReadAndSwap();
   uint32_t value = register_file_->values[rmw_info & 0x1FFF].u32;
   if ((rmw_info >> 31) & 0x1) {
     // & reg
@@ -957,14 +1025,14 @@ bool CommandProcessor::ExecutePacketType3_REG_RMW(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_REG_TO_MEM(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_REG_TO_MEM(PacketDataReader* reader,
                                                      uint32_t packet,
                                                      uint32_t count) {
   // Copy Register to Memory (?)
   // Count is 2, assuming a Register Addr and a Memory Addr.
 
-  uint32_t reg_addr = reader->ReadAndSwap<uint32_t>();
-  uint32_t mem_addr = reader->ReadAndSwap<uint32_t>();
+  uint32_t reg_addr = reader->ReadAndSwap();
+  uint32_t mem_addr = reader->ReadAndSwap();
 
   uint32_t reg_val;
 
@@ -980,12 +1048,12 @@ bool CommandProcessor::ExecutePacketType3_REG_TO_MEM(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_MEM_WRITE(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_MEM_WRITE(PacketDataReader* reader,
                                                     uint32_t packet,
                                                     uint32_t count) {
-  uint32_t write_addr = reader->ReadAndSwap<uint32_t>();
+  uint32_t write_addr = reader->ReadAndSwap();
   for (uint32_t i = 0; i < count - 1; i++) {
-    uint32_t write_data = reader->ReadAndSwap<uint32_t>();
+    uint32_t write_data = reader->ReadAndSwap();
 
     auto endianness = static_cast<xenos::Endian>(write_addr & 0x3);
     auto addr = write_addr & ~0x3;
@@ -998,16 +1066,16 @@ bool CommandProcessor::ExecutePacketType3_MEM_WRITE(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_COND_WRITE(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_COND_WRITE(PacketDataReader* reader,
                                                      uint32_t packet,
                                                      uint32_t count) {
   // conditional write to memory or register
-  uint32_t wait_info = reader->ReadAndSwap<uint32_t>();
-  uint32_t poll_reg_addr = reader->ReadAndSwap<uint32_t>();
-  uint32_t ref = reader->ReadAndSwap<uint32_t>();
-  uint32_t mask = reader->ReadAndSwap<uint32_t>();
-  uint32_t write_reg_addr = reader->ReadAndSwap<uint32_t>();
-  uint32_t write_data = reader->ReadAndSwap<uint32_t>();
+  uint32_t wait_info = reader->ReadAndSwap();
+  uint32_t poll_reg_addr = reader->ReadAndSwap();
+  uint32_t ref = reader->ReadAndSwap();
+  uint32_t mask = reader->ReadAndSwap();
+  uint32_t write_reg_addr = reader->ReadAndSwap();
+  uint32_t write_data = reader->ReadAndSwap();
   uint32_t value;
   if (wait_info & 0x10) {
     // Memory.
@@ -1065,11 +1133,11 @@ bool CommandProcessor::ExecutePacketType3_COND_WRITE(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_EVENT_WRITE(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_EVENT_WRITE(PacketDataReader* reader,
                                                       uint32_t packet,
                                                       uint32_t count) {
   // generate an event that creates a write to memory when completed
-  uint32_t initiator = reader->ReadAndSwap<uint32_t>();
+  uint32_t initiator = reader->ReadAndSwap();
   // Writeback initiator.
   WriteRegister(XE_GPU_REG_VGT_EVENT_INITIATOR, initiator & 0x3F);
   if (count == 1) {
@@ -1077,18 +1145,17 @@ bool CommandProcessor::ExecutePacketType3_EVENT_WRITE(RingBuffer* reader,
   } else {
     // Write to an address.
     assert_always();
-    reader->AdvanceRead((count - 1) * sizeof(uint32_t));
+    reader->Skip(count - 1);
   }
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_SHD(RingBuffer* reader,
-                                                          uint32_t packet,
-                                                          uint32_t count) {
+bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_SHD(
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
   // generate a VS|PS_done event
-  uint32_t initiator = reader->ReadAndSwap<uint32_t>();
-  uint32_t address = reader->ReadAndSwap<uint32_t>();
-  uint32_t value = reader->ReadAndSwap<uint32_t>();
+  uint32_t initiator = reader->ReadAndSwap();
+  uint32_t address = reader->ReadAndSwap();
+  uint32_t value = reader->ReadAndSwap();
   // Writeback initiator.
   WriteRegister(XE_GPU_REG_VGT_EVENT_INITIATOR, initiator & 0x3F);
   uint32_t data_value;
@@ -1107,12 +1174,11 @@ bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_SHD(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_EXT(RingBuffer* reader,
-                                                          uint32_t packet,
-                                                          uint32_t count) {
+bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_EXT(
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
   // generate a screen extent event
-  uint32_t initiator = reader->ReadAndSwap<uint32_t>();
-  uint32_t address = reader->ReadAndSwap<uint32_t>();
+  uint32_t initiator = reader->ReadAndSwap();
+  uint32_t address = reader->ReadAndSwap();
   // Writeback initiator.
   WriteRegister(XE_GPU_REG_VGT_EVENT_INITIATOR, initiator & 0x3F);
   auto endianness = static_cast<xenos::Endian>(address & 0x3);
@@ -1137,11 +1203,10 @@ bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_EXT(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_ZPD(RingBuffer* reader,
-                                                          uint32_t packet,
-                                                          uint32_t count) {
+bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_ZPD(
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
   assert_true(count == 1);
-  uint32_t initiator = reader->ReadAndSwap<uint32_t>();
+  uint32_t initiator = reader->ReadAndSwap();
   // Writeback initiator.
   WriteRegister(XE_GPU_REG_VGT_EVENT_INITIATOR, initiator & 0x3F);
 
@@ -1167,7 +1232,7 @@ bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_ZPD(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_DRAW_INDX(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_DRAW_INDX(PacketDataReader* reader,
                                                     uint32_t packet,
                                                     uint32_t count) {
   // initiate fetch of index buffer and draw
@@ -1175,9 +1240,9 @@ bool CommandProcessor::ExecutePacketType3_DRAW_INDX(RingBuffer* reader,
   // This ID matches the one issued in PM4_VIZ_QUERY
   // ID = dword0 & 0x3F;
   // use = dword0 & 0x40;
-  uint32_t dword0 = reader->ReadAndSwap<uint32_t>();  // viz query info
+  uint32_t dword0 = reader->ReadAndSwap();  // viz query info
   reg::VGT_DRAW_INITIATOR vgt_draw_initiator;
-  vgt_draw_initiator.value = reader->ReadAndSwap<uint32_t>();
+  vgt_draw_initiator.value = reader->ReadAndSwap();
   WriteRegister(XE_GPU_REG_VGT_DRAW_INITIATOR, vgt_draw_initiator.value);
 
   bool is_indexed = false;
@@ -1186,8 +1251,8 @@ bool CommandProcessor::ExecutePacketType3_DRAW_INDX(RingBuffer* reader,
     case xenos::SourceSelect::kDMA: {
       // Indexed draw.
       is_indexed = true;
-      index_buffer_info.guest_base = reader->ReadAndSwap<uint32_t>();
-      uint32_t index_size = reader->ReadAndSwap<uint32_t>();
+      index_buffer_info.guest_base = reader->ReadAndSwap();
+      uint32_t index_size = reader->ReadAndSwap();
       index_buffer_info.endianness =
           static_cast<xenos::Endian>(index_size >> 30);
       index_size &= 0x00FFFFFF;
@@ -1227,12 +1292,12 @@ bool CommandProcessor::ExecutePacketType3_DRAW_INDX(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_DRAW_INDX_2(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_DRAW_INDX_2(PacketDataReader* reader,
                                                       uint32_t packet,
                                                       uint32_t count) {
   // draw using supplied indices in packet
   reg::VGT_DRAW_INITIATOR vgt_draw_initiator;
-  vgt_draw_initiator.value = reader->ReadAndSwap<uint32_t>();
+  vgt_draw_initiator.value = reader->ReadAndSwap();
   WriteRegister(XE_GPU_REG_VGT_DRAW_INITIATOR, vgt_draw_initiator.value);
   assert_true(vgt_draw_initiator.source_select ==
               xenos::SourceSelect::kAutoIndex);
@@ -1243,7 +1308,7 @@ bool CommandProcessor::ExecutePacketType3_DRAW_INDX_2(RingBuffer* reader,
   //                                                                      : 2);
   // uint32_t index_ptr = reader->ptr();
   // TODO(Triang3l): VGT_IMMED_DATA.
-  reader->AdvanceRead((count - 1) * sizeof(uint32_t));
+  reader->Skip(count - 1);
 
   bool success = IssueDraw(
       vgt_draw_initiator.prim_type, vgt_draw_initiator.num_indices, nullptr,
@@ -1258,13 +1323,13 @@ bool CommandProcessor::ExecutePacketType3_DRAW_INDX_2(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_SET_CONSTANT(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_SET_CONSTANT(PacketDataReader* reader,
                                                        uint32_t packet,
                                                        uint32_t count) {
   // load constant into chip and to memory
   // PM4_REG(reg) ((0x4 << 16) | (GSL_HAL_SUBBLOCK_OFFSET(reg)))
   //                                     reg - 0x2000
-  uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
+  uint32_t offset_type = reader->ReadAndSwap();
   uint32_t index = offset_type & 0x7FF;
   uint32_t type = (offset_type >> 16) & 0xFF;
   switch (type) {
@@ -1285,37 +1350,29 @@ bool CommandProcessor::ExecutePacketType3_SET_CONSTANT(RingBuffer* reader,
       break;
     default:
       assert_always();
-      reader->AdvanceRead((count - 1) * sizeof(uint32_t));
+      reader->Skip(count - 1);
       return true;
   }
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegistersFromPacket(reader, index, count - 1);
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_SET_CONSTANT2(RingBuffer* reader,
-                                                        uint32_t packet,
-                                                        uint32_t count) {
-  uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
+bool CommandProcessor::ExecutePacketType3_SET_CONSTANT2(
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
+  uint32_t offset_type = reader->ReadAndSwap();
   uint32_t index = offset_type & 0xFFFF;
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegistersFromPacket(reader, index, count - 1);
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_LOAD_ALU_CONSTANT(RingBuffer* reader,
-                                                            uint32_t packet,
-                                                            uint32_t count) {
+bool CommandProcessor::ExecutePacketType3_LOAD_ALU_CONSTANT(
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
   // load constants from memory
-  uint32_t address = reader->ReadAndSwap<uint32_t>();
+  uint32_t address = reader->ReadAndSwap();
   address &= 0x3FFFFFFF;
-  uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
+  uint32_t offset_type = reader->ReadAndSwap();
   uint32_t index = offset_type & 0x7FF;
-  uint32_t size_dwords = reader->ReadAndSwap<uint32_t>();
+  uint32_t size_dwords = reader->ReadAndSwap();
   size_dwords &= 0xFFF;
   uint32_t type = (offset_type >> 16) & 0xFF;
   switch (type) {
@@ -1348,26 +1405,23 @@ bool CommandProcessor::ExecutePacketType3_LOAD_ALU_CONSTANT(RingBuffer* reader,
 }
 
 bool CommandProcessor::ExecutePacketType3_SET_SHADER_CONSTANTS(
-    RingBuffer* reader, uint32_t packet, uint32_t count) {
-  uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
+  uint32_t offset_type = reader->ReadAndSwap();
   uint32_t index = offset_type & 0xFFFF;
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegistersFromPacket(reader, index, count - 1);
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_IM_LOAD(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_IM_LOAD(PacketDataReader* reader,
                                                   uint32_t packet,
                                                   uint32_t count) {
   SCOPE_profile_cpu_f("gpu");
 
   // load sequencer instruction memory (pointer-based)
-  uint32_t addr_type = reader->ReadAndSwap<uint32_t>();
+  uint32_t addr_type = reader->ReadAndSwap();
   auto shader_type = static_cast<xenos::ShaderType>(addr_type & 0x3);
   uint32_t addr = addr_type & ~0x3;
-  uint32_t start_size = reader->ReadAndSwap<uint32_t>();
+  uint32_t start_size = reader->ReadAndSwap();
   uint32_t start = start_size >> 16;
   uint32_t size_dwords = start_size & 0xFFFF;  // dwords
   assert_true(start == 0);
@@ -1389,24 +1443,32 @@ bool CommandProcessor::ExecutePacketType3_IM_LOAD(RingBuffer* reader,
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_IM_LOAD_IMMEDIATE(RingBuffer* reader,
-                                                            uint32_t packet,
-                                                            uint32_t count) {
+bool CommandProcessor::ExecutePacketType3_IM_LOAD_IMMEDIATE(
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
   SCOPE_profile_cpu_f("gpu");
 
   // load sequencer instruction memory (code embedded in packet)
-  uint32_t dword0 = reader->ReadAndSwap<uint32_t>();
-  uint32_t dword1 = reader->ReadAndSwap<uint32_t>();
+  uint32_t dword0 = reader->ReadAndSwap();
+  uint32_t dword1 = reader->ReadAndSwap();
   auto shader_type = static_cast<xenos::ShaderType>(dword0);
   uint32_t start_size = dword1;
   uint32_t start = start_size >> 16;
   uint32_t size_dwords = start_size & 0xFFFF;  // dwords
   assert_true(start == 0);
-  assert_true(reader->read_count() >= size_dwords * 4);
   assert_true(count - 2 >= size_dwords);
-  auto shader =
-      LoadShader(shader_type, uint32_t(reader->read_ptr()),
-                 reinterpret_cast<uint32_t*>(reader->read_ptr()), size_dwords);
+  size_dwords = std::min(size_dwords, uint32_t(reader->remaining()));
+  // LoadShader takes the microcode in guest byte order, so it's only copied if
+  // the packet wraps around the end of the ring buffer.
+  const uint32_t* ucode_dwords = reader->contiguous_ptr(size_dwords);
+  if (ucode_dwords) {
+    reader->Skip(size_dwords);
+  } else {
+    im_load_immediate_ucode_.resize(size_dwords);
+    reader->Read(im_load_immediate_ucode_.data(), size_dwords);
+    ucode_dwords = im_load_immediate_ucode_.data();
+  }
+  auto shader = LoadShader(shader_type, uint32_t(uintptr_t(ucode_dwords)),
+                           ucode_dwords, size_dwords);
   switch (shader_type) {
     case xenos::ShaderType::kVertex:
       active_vertex_shader_ = shader;
@@ -1418,27 +1480,26 @@ bool CommandProcessor::ExecutePacketType3_IM_LOAD_IMMEDIATE(RingBuffer* reader,
       assert_unhandled_case(shader_type);
       return false;
   }
-  reader->AdvanceRead(size_dwords * sizeof(uint32_t));
+  reader->Skip(reader->remaining());
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_INVALIDATE_STATE(RingBuffer* reader,
-                                                           uint32_t packet,
-                                                           uint32_t count) {
+bool CommandProcessor::ExecutePacketType3_INVALIDATE_STATE(
+    PacketDataReader* reader, uint32_t packet, uint32_t count) {
   // selective invalidation of state pointers
-  /*uint32_t mask =*/reader->ReadAndSwap<uint32_t>();
+  /*uint32_t mask =*/reader->ReadAndSwap();
   // driver_->InvalidateState(mask);
   return true;
 }
 
-bool CommandProcessor::ExecutePacketType3_VIZ_QUERY(RingBuffer* reader,
+bool CommandProcessor::ExecutePacketType3_VIZ_QUERY(PacketDataReader* reader,
                                                     uint32_t packet,
                                                     uint32_t count) {
   // begin/end initiator for viz query extent processing
   // https://www.google.com/patents/US20050195186
   assert_true(count == 1);
 
-  uint32_t dword0 = reader->ReadAndSwap<uint32_t>();
+  uint32_t dword0 = reader->ReadAndSwap();
 
   uint32_t id = dword0 & 0x3F;
   uint32_t end = dword0 & 0x80;
@@ -21,6 +21,8 @@
 
 #include "xenia/base/ring_buffer.h"
 #include "xenia/base/threading.h"
+#include "xenia/gpu/packet_data_reader.h"
+#include "xenia/gpu/packet_rate_counter.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/trace_writer.h"
 #include "xenia/gpu/xenos.h"
@@ -180,6 +182,9 @@ class CommandProcessor {
   virtual void PrepareForWait();
   virtual void ReturnFromWait();
 
+  // Accumulates and logs the time between swaps if requested.
+  void UpdateFrameTimeStats();
+
   virtual void PerformSwap(uint32_t frontbuffer_ptr, uint32_t frontbuffer_width,
                            uint32_t frontbuffer_height) = 0;
 
@@ -191,54 +196,55 @@ class CommandProcessor {
   bool ExecutePacketType1(RingBuffer* reader, uint32_t packet);
   bool ExecutePacketType2(RingBuffer* reader, uint32_t packet);
   bool ExecutePacketType3(RingBuffer* reader, uint32_t packet);
-  bool ExecutePacketType3_ME_INIT(RingBuffer* reader, uint32_t packet,
+  void WriteRegistersFromPacket(PacketDataReader* reader, uint32_t index,
+                                uint32_t count);
+  bool ExecutePacketType3_ME_INIT(PacketDataReader* reader, uint32_t packet,
                                   uint32_t count);
-  bool ExecutePacketType3_NOP(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_NOP(PacketDataReader* reader, uint32_t packet,
                               uint32_t count);
-  bool ExecutePacketType3_INTERRUPT(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_INTERRUPT(PacketDataReader* reader, uint32_t packet,
                                     uint32_t count);
-  bool ExecutePacketType3_XE_SWAP(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_XE_SWAP(PacketDataReader* reader, uint32_t packet,
                                   uint32_t count);
-  bool ExecutePacketType3_INDIRECT_BUFFER(RingBuffer* reader, uint32_t packet,
-                                          uint32_t count);
-  bool ExecutePacketType3_WAIT_REG_MEM(RingBuffer* reader, uint32_t packet,
-                                       uint32_t count);
-  bool ExecutePacketType3_REG_RMW(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_INDIRECT_BUFFER(PacketDataReader* reader,
+                                          uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_WAIT_REG_MEM(PacketDataReader* reader,
+                                       uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_REG_RMW(PacketDataReader* reader, uint32_t packet,
                                   uint32_t count);
-  bool ExecutePacketType3_REG_TO_MEM(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_REG_TO_MEM(PacketDataReader* reader, uint32_t packet,
                                      uint32_t count);
-  bool ExecutePacketType3_MEM_WRITE(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_MEM_WRITE(PacketDataReader* reader, uint32_t packet,
                                     uint32_t count);
-  bool ExecutePacketType3_COND_WRITE(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_COND_WRITE(PacketDataReader* reader, uint32_t packet,
                                      uint32_t count);
-  bool ExecutePacketType3_EVENT_WRITE(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_EVENT_WRITE(PacketDataReader* reader, uint32_t packet,
                                       uint32_t count);
-  bool ExecutePacketType3_EVENT_WRITE_SHD(RingBuffer* reader, uint32_t packet,
-                                          uint32_t count);
-  bool ExecutePacketType3_EVENT_WRITE_EXT(RingBuffer* reader, uint32_t packet,
-                                          uint32_t count);
-  bool ExecutePacketType3_EVENT_WRITE_ZPD(RingBuffer* reader, uint32_t packet,
-                                          uint32_t count);
-  bool ExecutePacketType3_DRAW_INDX(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_EVENT_WRITE_SHD(PacketDataReader* reader,
+                                          uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_EVENT_WRITE_EXT(PacketDataReader* reader,
+                                          uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_EVENT_WRITE_ZPD(PacketDataReader* reader,
+                                          uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_DRAW_INDX(PacketDataReader* reader, uint32_t packet,
                                     uint32_t count);
-  bool ExecutePacketType3_DRAW_INDX_2(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_DRAW_INDX_2(PacketDataReader* reader, uint32_t packet,
                                       uint32_t count);
-  bool ExecutePacketType3_SET_CONSTANT(RingBuffer* reader, uint32_t packet,
-                                       uint32_t count);
-  bool ExecutePacketType3_SET_CONSTANT2(RingBuffer* reader, uint32_t packet,
-                                        uint32_t count);
-  bool ExecutePacketType3_LOAD_ALU_CONSTANT(RingBuffer* reader, uint32_t packet,
-                                            uint32_t count);
-  bool ExecutePacketType3_SET_SHADER_CONSTANTS(RingBuffer* reader,
+  bool ExecutePacketType3_SET_CONSTANT(PacketDataReader* reader,
+                                       uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_SET_CONSTANT2(PacketDataReader* reader,
+                                        uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_LOAD_ALU_CONSTANT(PacketDataReader* reader,
+                                            uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_SET_SHADER_CONSTANTS(PacketDataReader* reader,
                                                uint32_t packet, uint32_t count);
-  bool ExecutePacketType3_IM_LOAD(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_IM_LOAD(PacketDataReader* reader, uint32_t packet,
                                   uint32_t count);
-  bool ExecutePacketType3_IM_LOAD_IMMEDIATE(RingBuffer* reader,
-
+  bool ExecutePacketType3_IM_LOAD_IMMEDIATE(PacketDataReader* reader,
                                             uint32_t packet, uint32_t count);
-  bool ExecutePacketType3_INVALIDATE_STATE(RingBuffer* reader, uint32_t packet,
-                                           uint32_t count);
-  bool ExecutePacketType3_VIZ_QUERY(RingBuffer* reader, uint32_t packet,
+  bool ExecutePacketType3_INVALIDATE_STATE(PacketDataReader* reader,
+                                           uint32_t packet, uint32_t count);
+  bool ExecutePacketType3_VIZ_QUERY(PacketDataReader* reader, uint32_t packet,
                                     uint32_t count);
 
   virtual Shader* LoadShader(xenos::ShaderType shader_type,
@@ -276,11 +282,22 @@ class CommandProcessor {
   SwapMode swap_mode_ = SwapMode::kNormal;
   SwapState swap_state_;
   std::function<void()> swap_request_handler_;
+  // Host ticks of the previous swap and the intervals since the last log, for
+  // frame_time_stats_interval.
+  uint64_t frame_time_last_swap_ticks_ = 0;
+  uint32_t frame_time_count_ = 0;
+  double frame_time_sum_ = 0.0;
+  double frame_time_square_sum_ = 0.0;
+  double frame_time_max_ = 0.0;
   std::queue<std::function<void()>> pending_fns_;
 
   // MicroEngine binary from PM4_ME_INIT
   std::vector<uint32_t> me_bin_;
 
+  // PM4_IM_LOAD_IMMEDIATE microcode wrapping around the end of the ring buffer,
+  // made contiguous.
+  std::vector<uint32_t> im_load_immediate_ucode_;
+
   uint32_t counter_ = 0;
 
   uint32_t primary_buffer_ptr_ = 0;
@@ -293,6 +310,9 @@ class CommandProcessor {
   std::unique_ptr<xe::threading::Event> write_ptr_index_event_;
   std::atomic<uint32_t> write_ptr_index_;
 
+  // Published to the gpu/command_processor/packets_per_second profiler counter.
+  PacketRateCounter packet_rate_counter_;
+
   uint64_t bin_select_ = 0xFFFFFFFFull;
   uint64_t bin_mask_ = 0xFFFFFFFFull;
 
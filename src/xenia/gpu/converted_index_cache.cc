@@ -0,0 +1,167 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/converted_index_cache.h"
+
+namespace xe {
+namespace gpu {
+
+ConvertedIndexCache::ConvertedIndexCache(Memory& memory,
+                                         TraceWriter& trace_writer)
+    : memory_(memory), trace_writer_(trace_writer) {}
+
+ConvertedIndexCache::~ConvertedIndexCache() { Shutdown(); }
+
+bool ConvertedIndexCache::Initialize() {
+  memory_regions_invalidated_.store(0ull, std::memory_order_relaxed);
+  memory_invalidation_callback_handle_ =
+      memory_.RegisterPhysicalMemoryInvalidationCallback(
+          MemoryInvalidationCallbackThunk, this);
+  return true;
+}
+
+void ConvertedIndexCache::Shutdown() {
+  if (memory_invalidation_callback_handle_ != nullptr) {
+    memory_.UnregisterPhysicalMemoryInvalidationCallback(
+        memory_invalidation_callback_handle_);
+    memory_invalidation_callback_handle_ = nullptr;
+  }
+  ClearCache();
+}
+
+void ConvertedIndexCache::ClearCache() {
+  converted_indices_cache_.clear();
+  memory_regions_used_ = 0;
+}
+
+ConvertedIndexCache::ConversionResult ConvertedIndexCache::ConvertPrimitives(
+    const primitive_conversion::ConversionInfo& info, uint32_t address,
+    const AllocateFunction& allocate, uint64_t& handle_out,
+    uint32_t& index_count_out) {
+  if (!info.index_count) {
+    return ConversionResult::kPrimitiveEmpty;
+  }
+
+  // Invalidate the cache if data behind any entry was modified.
+  if (memory_regions_invalidated_.exchange(0ull, std::memory_order_acquire) &
+      memory_regions_used_) {
+    ClearCache();
+  }
+
+  bool index_32bit = info.format == xenos::IndexFormat::kInt32;
+  address &= index_32bit ? 0x1FFFFFFC : 0x1FFFFFFE;
+  uint32_t index_size = index_32bit ? sizeof(uint32_t) : sizeof(uint16_t);
+  uint32_t index_buffer_size = index_size * info.index_count;
+  uint32_t address_last = address + index_size * (info.index_count - 1);
+
+  // Create the cache entry, currently only for the key.
+  ConvertedIndices converted_indices;
+  converted_indices.key.address = address;
+  converted_indices.key.source_type = info.source_type;
+  converted_indices.key.format = info.format;
+  converted_indices.key.count = info.index_count;
+  converted_indices.key.reset = info.reset ? 1 : 0;
+  converted_indices.key.endianness = info.endianness;
+  converted_indices.key.swap_to_host = info.swap_to_host ? 1 : 0;
+  converted_indices.key.quads_to_triangles =
+      info.convert_quads_to_triangles ? 1 : 0;
+  converted_indices.reset_index = info.reset_index;
+
+  // Try to find the previously converted index buffer.
+  auto found_range =
+      converted_indices_cache_.equal_range(converted_indices.key.value);
+  for (auto iter = found_range.first; iter != found_range.second; ++iter) {
+    const ConvertedIndices& found_converted = iter->second;
+    if (info.reset && found_converted.reset_index != info.reset_index) {
+      continue;
+    }
+    if (found_converted.converted_index_count == 0) {
+      return ConversionResult::kPrimitiveEmpty;
+    }
+    if (!found_converted.converted) {
+      return ConversionResult::kConversionNotNeeded;
+    }
+    handle_out = found_converted.handle;
+    index_count_out = found_converted.converted_index_count;
+    return ConversionResult::kConverted;
+  }
+
+  // Get the memory usage mask for cache invalidation.
+  // 1 bit = (512 / 64) MB = 8 MB.
+  uint64_t memory_regions_used_bits = ~((1ull << (address >> 23)) - 1);
+  if (address_last < (63 << 23)) {
+    memory_regions_used_bits &= (1ull << ((address_last >> 23) + 1)) - 1;
+  }
+
+  const void* source = memory_.TranslatePhysical(address);
+  trace_writer_.WriteMemoryRead(address, index_buffer_size);
+
+  bool conversion_needed;
+  uint32_t converted_index_count = primitive_conversion::GetConvertedIndexCount(
+      info, source, conversion_needed);
+  converted_indices.converted_index_count = converted_index_count;
+
+  // If nothing to convert, store this result so the check won't be happening
+  // again and again and exit.
+  if (!conversion_needed || converted_index_count == 0) {
+    converted_indices.converted = false;
+    converted_indices.handle = 0;
+    converted_indices_cache_.emplace(converted_indices.key.value,
+                                     converted_indices);
+    memory_regions_used_ |= memory_regions_used_bits;
+    return converted_index_count == 0 ? ConversionResult::kPrimitiveEmpty
+                                      : ConversionResult::kConversionNotNeeded;
+  }
+
+  uint64_t handle;
+  void* target = allocate(converted_index_count * index_size, handle);
+  if (target == nullptr) {
+    return ConversionResult::kFailed;
+  }
+  primitive_conversion::ConvertIndices(info, source, target);
+
+  // Cache and return the indices.
+  converted_indices.converted = true;
+  converted_indices.handle = handle;
+  converted_indices_cache_.emplace(converted_indices.key.value,
+                                   converted_indices);
+  memory_regions_used_ |= memory_regions_used_bits;
+  handle_out = handle;
+  index_count_out = converted_index_count;
+  return ConversionResult::kConverted;
+}
+
+std::pair<uint32_t, uint32_t> ConvertedIndexCache::MemoryInvalidationCallback(
+    uint32_t physical_address_start, uint32_t length, bool exact_range) {
+  // 1 bit = (512 / 64) MB = 8 MB. Invalidate a region of this size.
+  uint32_t bit_index_first = physical_address_start >> 23;
+  uint32_t bit_index_last = (physical_address_start + length - 1) >> 23;
+  uint64_t bits = ~((1ull << bit_index_first) - 1);
+  if (bit_index_last < 63) {
+    bits &= (1ull << (bit_index_last + 1)) - 1;
+  }
+  memory_regions_invalidated_ |= bits;
+  return std::make_pair<uint32_t, uint32_t>(0, UINT32_MAX);
+}
+
+std::pair<uint32_t, uint32_t>
+ConvertedIndexCache::MemoryInvalidationCallbackThunk(
+    void* context_ptr, uint32_t physical_address_start, uint32_t length,
+    bool exact_range) {
+  return reinterpret_cast<ConvertedIndexCache*>(context_ptr)
+      ->MemoryInvalidationCallback(physical_address_start, length, exact_range);
+}
+
+void ConvertedIndexCache::InitializeTrace() {
+  // WriteMemoryRead must not be skipped.
+  ClearCache();
+}
+
+}  // namespace gpu
+}  // namespace xe
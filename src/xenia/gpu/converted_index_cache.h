@@ -0,0 +1,138 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_CONVERTED_INDEX_CACHE_H_
+#define XENIA_GPU_CONVERTED_INDEX_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+#include "xenia/gpu/primitive_conversion.h"
+#include "xenia/gpu/trace_writer.h"
+#include "xenia/gpu/xenos.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace gpu {
+
+// Backend-agnostic cache of guest index buffers converted with
+// primitive_conversion, keyed by the guest address range and the conversion
+// parameters, and invalidated when the guest memory is written to. The storage
+// for the converted indices is provided by the backend (for instance, in an
+// upload buffer), so entries must be dropped with ClearCache when that storage
+// is reclaimed.
+class ConvertedIndexCache {
+ public:
+  enum class ConversionResult {
+    // Converted to storage allocated by the backend.
+    kConverted,
+    // Conversion not required - use the index buffer in guest memory.
+    kConversionNotNeeded,
+    // No errors, but nothing to render.
+    kPrimitiveEmpty,
+    // Total failure of the draw call.
+    kFailed
+  };
+
+  // Allocates storage for size bytes of converted indices, returning the
+  // pointer to write them to, or nullptr in case of failure, and an opaque
+  // backend-specific identifier of the allocation (such as the GPU virtual
+  // address) in handle_out.
+  using AllocateFunction =
+      std::function<void*(uint32_t size, uint64_t& handle_out)>;
+
+  ConvertedIndexCache(Memory& memory, TraceWriter& trace_writer);
+  ~ConvertedIndexCache();
+
+  bool Initialize();
+  void Shutdown();
+  void ClearCache();
+
+  // Converts (or finds the previously converted) indices at the guest physical
+  // address. Only writes to the outputs if returning kConverted.
+  ConversionResult ConvertPrimitives(
+      const primitive_conversion::ConversionInfo& info, uint32_t address,
+      const AllocateFunction& allocate, uint64_t& handle_out,
+      uint32_t& index_count_out);
+
+  // Callback for invalidating converted indices mid-frame.
+  std::pair<uint32_t, uint32_t> MemoryInvalidationCallback(
+      uint32_t physical_address_start, uint32_t length, bool exact_range);
+
+  void InitializeTrace();
+
+ private:
+  static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
+      void* context_ptr, uint32_t physical_address_start, uint32_t length,
+      bool exact_range);
+
+  Memory& memory_;
+  TraceWriter& trace_writer_;
+
+  // Not identifying the index buffer uniquely - reset index must also be
+  // checked if reset is enabled.
+  union ConvertedIndicesKey {
+    uint64_t value;
+    struct {
+      uint32_t address;                      // 32
+      xenos::PrimitiveType source_type : 6;  // 38
+      xenos::IndexFormat format : 1;         // 39
+      uint32_t count : 16;                   // 55
+      uint32_t reset : 1;                    // 56
+      xenos::Endian endianness : 2;          // 58
+      uint32_t swap_to_host : 1;             // 59
+      uint32_t quads_to_triangles : 1;       // 60
+    };
+
+    // Clearing the unused bits.
+    ConvertedIndicesKey() : value(0) {}
+    ConvertedIndicesKey(const ConvertedIndicesKey& key) : value(key.value) {}
+    ConvertedIndicesKey& operator=(const ConvertedIndicesKey& key) {
+      value = key.value;
+      return *this;
+    }
+    bool operator==(const ConvertedIndicesKey& key) const {
+      return value == key.value;
+    }
+    bool operator!=(const ConvertedIndicesKey& key) const {
+      return value != key.value;
+    }
+  };
+
+  struct ConvertedIndices {
+    ConvertedIndicesKey key;
+    // If reset is enabled, this also must be checked to find cached indices.
+    uint32_t reset_index;
+
+    // Whether the indices have been written to backend storage - false if
+    // conversion is not needed or the resulting index buffer is empty.
+    bool converted;
+    uint64_t handle;
+    // When conversion is not needed, this must be equal to the original index
+    // count.
+    uint32_t converted_index_count;
+  };
+
+  std::unordered_multimap<uint64_t, ConvertedIndices> converted_indices_cache_;
+
+  // Very coarse cache invalidation - if something is modified in a 8 MB portion
+  // of the physical memory and converted indices are also there, invalidate all
+  // the cache.
+  uint64_t memory_regions_used_ = 0;
+  std::atomic<uint64_t> memory_regions_invalidated_ = 0;
+  void* memory_invalidation_callback_handle_ = nullptr;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_CONVERTED_INDEX_CACHE_H_
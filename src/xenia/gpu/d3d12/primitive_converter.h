@@ -10,10 +10,10 @@
 #ifndef XENIA_GPU_D3D12_PRIMITIVE_CONVERTER_H_
 #define XENIA_GPU_D3D12_PRIMITIVE_CONVERTER_H_
 
-#include <atomic>
 #include <memory>
-#include <unordered_map>
+#include <utility>
 
+#include "xenia/gpu/converted_index_cache.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/trace_writer.h"
 #include "xenia/gpu/xenos.h"
@@ -54,16 +54,7 @@ class PrimitiveConverter {
   static xenos::PrimitiveType GetReplacementPrimitiveType(
       xenos::PrimitiveType type);
 
-  enum class ConversionResult {
-    // Converted to a transient buffer.
-    kConverted,
-    // Conversion not required - use the index buffer in shared memory.
-    kConversionNotNeeded,
-    // No errors, but nothing to render.
-    kPrimitiveEmpty,
-    // Total failure of the draw call.
-    kFailed
-  };
+  using ConversionResult = ConvertedIndexCache::ConversionResult;
 
   // Converts an index buffer to the primitive type returned by
   // GetReplacementPrimitiveType. If conversion has been performed, the returned
@@ -91,17 +82,9 @@ class PrimitiveConverter {
   void InitializeTrace();
 
  private:
-  // simd_offset is source address & 15 - if SIMD is used, the source and the
-  // target must have the same alignment within one register. 0 is optimal when
-  // not using SIMD.
-  void* AllocateIndices(xenos::IndexFormat format, uint32_t count,
-                        uint32_t simd_offset,
+  void* AllocateIndices(uint32_t size,
                         D3D12_GPU_VIRTUAL_ADDRESS& gpu_address_out);
 
-  static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
-      void* context_ptr, uint32_t physical_address_start, uint32_t length,
-      bool exact_range);
-
   D3D12CommandProcessor& command_processor_;
   const RegisterFile& register_file_;
   Memory& memory_;
@@ -130,56 +113,8 @@ class PrimitiveConverter {
   static constexpr uint32_t kStaticIBTotalCount =
       kStaticIBQuadOffset + kStaticIBQuadCount;
 
-  // Not identifying the index buffer uniquely - reset index must also be
-  // checked if reset is enabled.
-  union ConvertedIndicesKey {
-    uint64_t value;
-    struct {
-      uint32_t address;                      // 32
-      xenos::PrimitiveType source_type : 6;  // 38
-      xenos::IndexFormat format : 1;         // 39
-      uint32_t count : 16;                   // 55
-      uint32_t reset : 1;                    // 56
-    };
-
-    // Clearing the unused bits.
-    ConvertedIndicesKey() : value(0) {}
-    ConvertedIndicesKey(const ConvertedIndicesKey& key) : value(key.value) {}
-    ConvertedIndicesKey& operator=(const ConvertedIndicesKey& key) {
-      value = key.value;
-      return *this;
-    }
-    bool operator==(const ConvertedIndicesKey& key) const {
-      return value == key.value;
-    }
-    bool operator!=(const ConvertedIndicesKey& key) const {
-      return value != key.value;
-    }
-  };
-
-  struct ConvertedIndices {
-    ConvertedIndicesKey key;
-    // If reset is enabled, this also must be checked to find cached indices.
-    uint32_t reset_index;
-
-    // Zero GPU address if conversion not needed or the resulting index buffer
-    // is empty.
-    D3D12_GPU_VIRTUAL_ADDRESS gpu_address;
-    // When conversion is not needed, this must be equal to the original index
-    // count.
-    uint32_t converted_index_count;
-  };
-
-  // Cache for a single frame.
-  std::unordered_multimap<uint64_t, ConvertedIndices> converted_indices_cache_;
-
-  // Very coarse cache invalidation - if something is modified in a 8 MB portion
-  // of the physical memory and converted indices are also there, invalidate all
-  // the cache.
-  uint64_t memory_regions_used_;
-  std::atomic<uint64_t> memory_regions_invalidated_ = 0;
-  void* memory_invalidation_callback_handle_ = nullptr;
-  uint32_t system_page_size_;
+  // Converted indices in buffer_pool_, for a single frame.
+  ConvertedIndexCache index_cache_;
 };
 
 }  // namespace d3d12
@@ -46,3 +46,9 @@ DEFINE_int32(query_occlusion_fake_sample_count, 1000,
              "EVENT_WRITE_ZPD by this number. Setting this to 0 means "
              "everything is reported as occluded.",
              "GPU");
+
+DEFINE_int32(frame_time_stats_interval, 0,
+             "If above 0, logs the mean, standard deviation and maximum of the "
+             "time between guest frames every this many frames, for comparing "
+             "frame pacing between configurations such as thread affinities.",
+             "GPU");
@@ -24,4 +24,6 @@ DECLARE_bool(half_pixel_offset);
 
 DECLARE_int32(query_occlusion_fake_sample_count);
 
+DECLARE_int32(frame_time_stats_interval);
+
 #endif  // XENIA_GPU_GPU_FLAGS_H_
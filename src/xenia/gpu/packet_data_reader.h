@@ -0,0 +1,114 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_PACKET_DATA_READER_H_
+#define XENIA_GPU_PACKET_DATA_READER_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/ring_buffer.h"
+
+namespace xe {
+namespace gpu {
+
+// Reader of the payload of a single PM4 packet. The ring buffer is resolved
+// into at most two contiguous spans of big-endian dwords (the second one is
+// only used when the packet wraps around the end of the ring) when the packet
+// header is decoded, so reading the payload involves no per-dword wrap-around
+// bookkeeping, and long payloads can be copied and swapped in bulk.
+class PacketDataReader {
+ public:
+  explicit PacketDataReader(const RingBuffer::ReadRange& read_range)
+      : ptr_(reinterpret_cast<const uint32_t*>(read_range.first)),
+        end_(ptr_ + read_range.first_length / sizeof(uint32_t)),
+        second_(reinterpret_cast<const uint32_t*>(read_range.second)),
+        second_end_(second_ + read_range.second_length / sizeof(uint32_t)) {
+    assert_zero(read_range.first_length & (sizeof(uint32_t) - 1));
+    assert_zero(read_range.second_length & (sizeof(uint32_t) - 1));
+  }
+
+  // Number of dwords not read yet.
+  size_t remaining() const {
+    return size_t(end_ - ptr_) + size_t(second_end_ - second_);
+  }
+
+  // Pointer to the big-endian data at the current position, or nullptr if the
+  // next count dwords are not contiguous in memory.
+  const uint32_t* contiguous_ptr(size_t count) {
+    NextSpanIfNeeded();
+    return size_t(end_ - ptr_) >= count ? ptr_ : nullptr;
+  }
+
+  uint32_t ReadAndSwap() {
+    NextSpanIfNeeded();
+    assert_true(ptr_ < end_);
+    return xe::byte_swap(*(ptr_++));
+  }
+
+  void ReadAndSwap(uint32_t* dest, size_t count) {
+    assert_true(count <= remaining());
+    while (count) {
+      NextSpanIfNeeded();
+      size_t span_count = std::min(count, size_t(end_ - ptr_));
+      xe::copy_and_swap_32_unaligned(dest, ptr_, span_count);
+      ptr_ += span_count;
+      dest += span_count;
+      count -= span_count;
+    }
+  }
+
+  // Copies the data without swapping, for consumers expecting guest memory
+  // layout.
+  void Read(uint32_t* dest, size_t count) {
+    assert_true(count <= remaining());
+    while (count) {
+      NextSpanIfNeeded();
+      size_t span_count = std::min(count, size_t(end_ - ptr_));
+      std::memcpy(dest, ptr_, span_count * sizeof(uint32_t));
+      ptr_ += span_count;
+      dest += span_count;
+      count -= span_count;
+    }
+  }
+
+  void Skip(size_t count) {
+    assert_true(count <= remaining());
+    size_t first_count = std::min(count, size_t(end_ - ptr_));
+    ptr_ += first_count;
+    count -= first_count;
+    if (count) {
+      NextSpanIfNeeded();
+      ptr_ += count;
+    }
+  }
+
+ private:
+  void NextSpanIfNeeded() {
+    if (ptr_ == end_ && second_ != second_end_) {
+      ptr_ = second_;
+      end_ = second_end_;
+      second_ = second_end_;
+    }
+  }
+
+  const uint32_t* ptr_;
+  const uint32_t* end_;
+  const uint32_t* second_;
+  const uint32_t* second_end_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_PACKET_DATA_READER_H_
@@ -0,0 +1,59 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_PACKET_RATE_COUNTER_H_
+#define XENIA_GPU_PACKET_RATE_COUNTER_H_
+
+#include <cstdint>
+
+namespace xe {
+namespace gpu {
+
+// Number of PM4 packets executed by the command processor, and the rate of
+// execution averaged over at least 1 second of host time.
+class PacketRateCounter {
+ public:
+  void Increment() { ++packet_count_; }
+
+  // Recalculates the rate if at least 1 second has passed since the previous
+  // recalculation, returns whether it has been recalculated.
+  bool Update(uint64_t now_ticks, uint64_t tick_frequency) {
+    if (!update_started_) {
+      update_started_ = true;
+      update_time_ticks_ = now_ticks;
+      update_packet_count_ = packet_count_;
+      return false;
+    }
+    uint64_t elapsed_ticks = now_ticks - update_time_ticks_;
+    if (elapsed_ticks < tick_frequency) {
+      return false;
+    }
+    packets_per_second_ =
+        uint32_t(double(packet_count_ - update_packet_count_) /
+                 (double(elapsed_ticks) / double(tick_frequency)));
+    update_time_ticks_ = now_ticks;
+    update_packet_count_ = packet_count_;
+    return true;
+  }
+
+  uint64_t packet_count() const { return packet_count_; }
+  uint32_t packets_per_second() const { return packets_per_second_; }
+
+ private:
+  uint64_t packet_count_ = 0;
+  uint32_t packets_per_second_ = 0;
+  bool update_started_ = false;
+  uint64_t update_time_ticks_ = 0;
+  uint64_t update_packet_count_ = 0;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_PACKET_RATE_COUNTER_H_
@@ -26,6 +26,8 @@ project("xenia-gpu")
   -- local_platform_files("spirv")
   -- local_platform_files("spirv/passes")
 
+include("testing")
+
 group("src")
 project("xenia-gpu-shader-compiler")
   uuid("ad76d3e4-4c62-439b-a0f6-f83fcf0e83c5")
@@ -39,6 +41,7 @@ project("xenia-gpu-shader-compiler")
     "xenia-base",
     "xenia-gpu",
     "xenia-ui-spirv",
+    "xxhash",
   })
   defines({
   })
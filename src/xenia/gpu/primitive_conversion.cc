@@ -0,0 +1,448 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/primitive_conversion.h"
+
+#include <cstring>
+#include <type_traits>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/platform.h"
+
+namespace xe {
+namespace gpu {
+namespace primitive_conversion {
+
+namespace {
+
+// 16-bit indices can only be swapped within 16 bits.
+xenos::Endian GetIndexEndianness(const ConversionInfo& info) {
+  if (info.format == xenos::IndexFormat::kInt16 &&
+      info.endianness != xenos::Endian::kNone) {
+    return xenos::Endian::k8in16;
+  }
+  return info.endianness;
+}
+
+xenos::Endian GetTargetSwap(const ConversionInfo& info) {
+  return info.swap_to_host ? GetIndexEndianness(info) : xenos::Endian::kNone;
+}
+
+template <typename Index>
+Index GetSourceResetIndex(const ConversionInfo& info) {
+  // Indices are compared without swapping, so swap the reset index instead.
+  return xenos::GpuSwap(Index(info.reset_index), GetIndexEndianness(info));
+}
+
+xenos::PrimitiveType GetEffectiveSourceType(const ConversionInfo& info) {
+  // Degenerate line loops are just lines.
+  if (info.source_type == xenos::PrimitiveType::kLineLoop &&
+      info.index_count <= 2) {
+    return xenos::PrimitiveType::kLineStrip;
+  }
+  return info.source_type;
+}
+
+uint32_t GetMinIndexCount(xenos::PrimitiveType type,
+                          bool convert_quads_to_triangles) {
+  switch (type) {
+    case xenos::PrimitiveType::kLineStrip:
+    case xenos::PrimitiveType::kLineLoop:
+      return 2;
+    case xenos::PrimitiveType::kTriangleStrip:
+    case xenos::PrimitiveType::kTriangleFan:
+      return 3;
+    case xenos::PrimitiveType::kQuadList:
+      return convert_quads_to_triangles ? 4 : 1;
+    default:
+      return 1;
+  }
+}
+
+#if XE_ARCH_AMD64
+// XOR applied to byte indices within an element for each xenos::Endian.
+constexpr uint8_t kSwapByteIndexXor[] = {0, 1, 3, 2};
+
+// Creates a _mm_shuffle_epi8 mask gathering the specified source elements
+// (with swapping) into consecutive output elements, zeroing the rest.
+__m128i MakeShuffleMask(const uint8_t* elements, uint32_t element_count,
+                        uint32_t element_size, xenos::Endian swap) {
+  alignas(16) uint8_t mask[16];
+  std::memset(mask, 0x80, sizeof(mask));
+  uint32_t byte_xor = kSwapByteIndexXor[uint32_t(swap)] & (element_size - 1);
+  for (uint32_t i = 0; i < element_count; ++i) {
+    for (uint32_t j = 0; j < element_size; ++j) {
+      mask[i * element_size + j] =
+          uint8_t(elements[i] * element_size + (j ^ byte_xor));
+    }
+  }
+  return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+template <typename Index>
+__m128i SetVector(Index value) {
+  if constexpr (sizeof(Index) == sizeof(uint32_t)) {
+    return _mm_set1_epi32(int(value));
+  } else {
+    return _mm_set1_epi16(short(value));
+  }
+}
+
+template <typename Index>
+__m128i CompareVector(__m128i a, __m128i b) {
+  if constexpr (sizeof(Index) == sizeof(uint32_t)) {
+    return _mm_cmpeq_epi32(a, b);
+  } else {
+    return _mm_cmpeq_epi16(a, b);
+  }
+}
+#endif  // XE_ARCH_AMD64
+
+template <typename Index>
+bool ContainsIndex(const Index* source, uint32_t count, Index value) {
+#if XE_ARCH_AMD64
+  constexpr uint32_t kIndicesPerVector = sizeof(__m128i) / sizeof(Index);
+  __m128i value_vector = SetVector(value);
+  for (; count >= kIndicesPerVector; count -= kIndicesPerVector) {
+    __m128i indices =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+    source += kIndicesPerVector;
+    if (_mm_movemask_epi8(CompareVector<Index>(indices, value_vector))) {
+      return true;
+    }
+  }
+#endif  // XE_ARCH_AMD64
+  for (; count; --count) {
+    if (*(source++) == value) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Copies the indices, replacing the reset index with all ones (the primitive
+// restart index of host APIs, which is the same in either byte order) if
+// needed, and swapping.
+template <typename Index>
+void CopyIndices(const Index* source, Index* target, uint32_t count,
+                 bool replace_reset, Index reset_index, xenos::Endian swap) {
+#if XE_ARCH_AMD64
+  constexpr uint32_t kIndicesPerVector = sizeof(__m128i) / sizeof(Index);
+  static const uint8_t kIdentity[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  __m128i shuffle_mask =
+      MakeShuffleMask(kIdentity, kIndicesPerVector, sizeof(Index), swap);
+  __m128i reset_index_vector = SetVector(reset_index);
+  for (; count >= kIndicesPerVector; count -= kIndicesPerVector) {
+    __m128i indices =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+    source += kIndicesPerVector;
+    if (replace_reset) {
+      indices = _mm_or_si128(
+          indices, CompareVector<Index>(indices, reset_index_vector));
+    }
+    if (swap != xenos::Endian::kNone) {
+      indices = _mm_shuffle_epi8(indices, shuffle_mask);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(target), indices);
+    target += kIndicesPerVector;
+  }
+#endif  // XE_ARCH_AMD64
+  for (; count; --count) {
+    Index index = *(source++);
+    *(target++) = (replace_reset && index == reset_index)
+                      ? Index(-1)
+                      : xenos::GpuSwap(index, swap);
+  }
+}
+
+template <typename Index>
+uint32_t CountTriangleFanIndices(const Index* source, uint32_t count,
+                                 Index reset_index) {
+  uint32_t converted_count = 0;
+  uint32_t current_fan_index_count = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (source[i] == reset_index) {
+      current_fan_index_count = 0;
+      continue;
+    }
+    if (++current_fan_index_count >= 3) {
+      converted_count += 3;
+    }
+  }
+  return converted_count;
+}
+
+template <typename Index>
+void ConvertTriangleFan(const Index* source, Index* target, uint32_t count,
+                        bool reset, Index reset_index, xenos::Endian swap) {
+  // https://docs.microsoft.com/en-us/windows/desktop/direct3d9/triangle-fans
+  // Ordered as (v1, v2, v0), (v2, v3, v0).
+  if (!reset) {
+    Index first_index = xenos::GpuSwap(source[0], swap);
+    Index previous_index = xenos::GpuSwap(source[1], swap);
+    for (uint32_t i = 2; i < count; ++i) {
+      Index index = xenos::GpuSwap(source[i], swap);
+      *(target++) = previous_index;
+      *(target++) = index;
+      *(target++) = first_index;
+      previous_index = index;
+    }
+    return;
+  }
+  uint32_t current_fan_index_count = 0;
+  Index current_fan_first_index = 0;
+  Index previous_index = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    Index index = source[i];
+    if (index == reset_index) {
+      current_fan_index_count = 0;
+      continue;
+    }
+    index = xenos::GpuSwap(index, swap);
+    if (current_fan_index_count == 0) {
+      current_fan_first_index = index;
+    }
+    if (++current_fan_index_count >= 3) {
+      *(target++) = previous_index;
+      *(target++) = index;
+      *(target++) = current_fan_first_index;
+    }
+    previous_index = index;
+  }
+}
+
+template <typename Index>
+uint32_t CountLineLoopIndices(const Index* source, uint32_t count,
+                              Index reset_index) {
+  uint32_t converted_count = 0;
+  uint32_t current_strip_index_count = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (source[i] == reset_index) {
+      // Loop strips with more than 2 vertices.
+      if (current_strip_index_count > 2) {
+        ++converted_count;
+      }
+      current_strip_index_count = 0;
+      continue;
+    }
+    // Start a new strip if 2 vertices, add one vertex if more.
+    if (++current_strip_index_count >= 2) {
+      converted_count += current_strip_index_count == 2 ? 2 : 1;
+    }
+  }
+  return converted_count;
+}
+
+template <typename Index>
+void ConvertLineLoop(const Index* source, Index* target, uint32_t count,
+                     bool reset, Index reset_index, xenos::Endian swap) {
+  if (!reset) {
+    CopyIndices(source, target, count, false, Index(0), swap);
+    target[count] = xenos::GpuSwap(source[0], swap);
+    return;
+  }
+  uint32_t current_strip_index_count = 0;
+  Index current_strip_first_index = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    Index index = source[i];
+    if (index == reset_index) {
+      if (current_strip_index_count > 2) {
+        *(target++) = current_strip_first_index;
+      }
+      current_strip_index_count = 0;
+      continue;
+    }
+    index = xenos::GpuSwap(index, swap);
+    if (current_strip_index_count == 0) {
+      current_strip_first_index = index;
+    }
+    ++current_strip_index_count;
+    if (current_strip_index_count >= 2) {
+      if (current_strip_index_count == 2) {
+        *(target++) = current_strip_first_index;
+      }
+      *(target++) = index;
+    }
+  }
+}
+
+template <typename Index>
+void ConvertQuadList(const Index* source, Index* target, uint32_t quad_count,
+                     xenos::Endian swap) {
+#if XE_ARCH_AMD64
+  // Each quad (v0, v1, v2, v3) becomes (v0, v1, v2), (v0, v2, v3). Expanding
+  // one 16-byte vector of source indices into 24 bytes of target indices.
+  if constexpr (sizeof(Index) == sizeof(uint32_t)) {
+    static const uint8_t kFirst[] = {0, 1, 2, 0};
+    static const uint8_t kSecond[] = {2, 3};
+    __m128i first_mask = MakeShuffleMask(kFirst, 4, sizeof(Index), swap);
+    __m128i second_mask = MakeShuffleMask(kSecond, 2, sizeof(Index), swap);
+    for (; quad_count; --quad_count) {
+      __m128i quad = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+      source += 4;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(target),
+                       _mm_shuffle_epi8(quad, first_mask));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(target + 4),
+                       _mm_shuffle_epi8(quad, second_mask));
+      target += 6;
+    }
+  } else {
+    static const uint8_t kFirst[] = {0, 1, 2, 0, 2, 3, 4, 5};
+    static const uint8_t kSecond[] = {6, 4, 6, 7};
+    __m128i first_mask = MakeShuffleMask(kFirst, 8, sizeof(Index), swap);
+    __m128i second_mask = MakeShuffleMask(kSecond, 4, sizeof(Index), swap);
+    for (; quad_count >= 2; quad_count -= 2) {
+      __m128i quads =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+      source += 8;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(target),
+                       _mm_shuffle_epi8(quads, first_mask));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(target + 8),
+                       _mm_shuffle_epi8(quads, second_mask));
+      target += 12;
+    }
+  }
+#endif  // XE_ARCH_AMD64
+  for (; quad_count; --quad_count) {
+    *(target++) = xenos::GpuSwap(source[0], swap);
+    *(target++) = xenos::GpuSwap(source[1], swap);
+    *(target++) = xenos::GpuSwap(source[2], swap);
+    *(target++) = xenos::GpuSwap(source[0], swap);
+    *(target++) = xenos::GpuSwap(source[2], swap);
+    *(target++) = xenos::GpuSwap(source[3], swap);
+    source += 4;
+  }
+}
+
+template <typename Index>
+uint32_t GetConvertedIndexCountTyped(const ConversionInfo& info,
+                                     xenos::PrimitiveType source_type,
+                                     const Index* source,
+                                     bool& conversion_needed_out) {
+  uint32_t count = info.index_count;
+  Index reset_index = GetSourceResetIndex<Index>(info);
+  switch (source_type) {
+    case xenos::PrimitiveType::kTriangleFan:
+      conversion_needed_out = true;
+      if (info.reset && ContainsIndex(source, count, reset_index)) {
+        return CountTriangleFanIndices(source, count, reset_index);
+      }
+      return 3 * (count - 2);
+    case xenos::PrimitiveType::kLineLoop:
+      conversion_needed_out = true;
+      if (info.reset && ContainsIndex(source, count, reset_index)) {
+        return CountLineLoopIndices(source, count, reset_index);
+      }
+      return count + 1;
+    case xenos::PrimitiveType::kQuadList:
+      if (info.convert_quads_to_triangles) {
+        conversion_needed_out = true;
+        return (count >> 2) * 6;
+      }
+      break;
+    default:
+      break;
+  }
+  conversion_needed_out =
+      GetTargetSwap(info) != xenos::Endian::kNone ||
+      (info.reset && reset_index != Index(-1) &&
+       ContainsIndex(source, count, reset_index));
+  return count;
+}
+
+template <typename Index>
+void ConvertIndicesTyped(const ConversionInfo& info,
+                         xenos::PrimitiveType source_type, const Index* source,
+                         Index* target) {
+  uint32_t count = info.index_count;
+  Index reset_index = GetSourceResetIndex<Index>(info);
+  xenos::Endian swap = GetTargetSwap(info);
+  switch (source_type) {
+    case xenos::PrimitiveType::kTriangleFan:
+      ConvertTriangleFan(source, target, count,
+                         info.reset && ContainsIndex(source, count, reset_index),
+                         reset_index, swap);
+      return;
+    case xenos::PrimitiveType::kLineLoop:
+      ConvertLineLoop(source, target, count,
+                      info.reset && ContainsIndex(source, count, reset_index),
+                      reset_index, swap);
+      return;
+    case xenos::PrimitiveType::kQuadList:
+      if (info.convert_quads_to_triangles) {
+        ConvertQuadList(source, target, count >> 2, swap);
+        return;
+      }
+      break;
+    default:
+      break;
+  }
+  CopyIndices(source, target, count,
+              info.reset && reset_index != Index(-1), reset_index, swap);
+}
+
+}  // namespace
+
+xenos::PrimitiveType GetConvertedPrimitiveType(
+    xenos::PrimitiveType source_type, bool convert_quads_to_triangles) {
+  switch (source_type) {
+    case xenos::PrimitiveType::kTriangleFan:
+      return xenos::PrimitiveType::kTriangleList;
+    case xenos::PrimitiveType::kLineLoop:
+      return xenos::PrimitiveType::kLineStrip;
+    case xenos::PrimitiveType::kQuadList:
+      if (convert_quads_to_triangles) {
+        return xenos::PrimitiveType::kTriangleList;
+      }
+      break;
+    default:
+      break;
+  }
+  return source_type;
+}
+
+uint32_t GetConvertedIndexCount(const ConversionInfo& info, const void* source,
+                                bool& conversion_needed_out) {
+  xenos::PrimitiveType source_type = GetEffectiveSourceType(info);
+  if (info.index_count <
+      GetMinIndexCount(source_type, info.convert_quads_to_triangles)) {
+    conversion_needed_out = false;
+    return 0;
+  }
+  if (info.format == xenos::IndexFormat::kInt32) {
+    return GetConvertedIndexCountTyped(
+        info, source_type, reinterpret_cast<const uint32_t*>(source),
+        conversion_needed_out);
+  }
+  return GetConvertedIndexCountTyped(info, source_type,
+                                     reinterpret_cast<const uint16_t*>(source),
+                                     conversion_needed_out);
+}
+
+void ConvertIndices(const ConversionInfo& info, const void* source,
+                    void* target) {
+  xenos::PrimitiveType source_type = GetEffectiveSourceType(info);
+  if (info.index_count <
+      GetMinIndexCount(source_type, info.convert_quads_to_triangles)) {
+    return;
+  }
+  if (info.format == xenos::IndexFormat::kInt32) {
+    ConvertIndicesTyped(info, source_type,
+                        reinterpret_cast<const uint32_t*>(source),
+                        reinterpret_cast<uint32_t*>(target));
+  } else {
+    ConvertIndicesTyped(info, source_type,
+                        reinterpret_cast<const uint16_t*>(source),
+                        reinterpret_cast<uint16_t*>(target));
+  }
+}
+
+}  // namespace primitive_conversion
+}  // namespace gpu
+}  // namespace xe
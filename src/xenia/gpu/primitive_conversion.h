@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_PRIMITIVE_CONVERSION_H_
+#define XENIA_GPU_PRIMITIVE_CONVERSION_H_
+
+#include <cstdint>
+
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+namespace primitive_conversion {
+
+// CPU-side processing of guest index buffers for primitive types and primitive
+// reset behavior that host graphics APIs don't support directly. Doesn't depend
+// on any GPU backend - the output is written to memory provided by the caller.
+//
+// Conversions performed:
+// - Triangle fans to triangle lists, ordered as (v1, v2, v0), (v2, v3, v0).
+// - Line loops to line strips.
+// - Quad lists to triangle lists (if requested).
+// - Reset index values other than 0xFFFF or 0xFFFFFFFF to the value host APIs
+//   use as the primitive restart index, for all other primitive types.
+// - Optionally swapping indices to host byte order.
+
+struct ConversionInfo {
+  xenos::PrimitiveType source_type;
+  xenos::IndexFormat format;
+  // Byte order of the indices in guest memory.
+  xenos::Endian endianness;
+  uint32_t index_count;
+  // VGT_MULTI_PRIM_IB_RESET_INDX value (not swapped) if PA_SU_SC_MODE_CNTL
+  // multi_prim_ib_ena is set.
+  bool reset;
+  uint32_t reset_index;
+  // Whether the output must be in host byte order rather than in the byte
+  // order of the source.
+  bool swap_to_host;
+  bool convert_quads_to_triangles;
+};
+
+// Returns the primitive type the indices will be in after ConvertIndices.
+xenos::PrimitiveType GetConvertedPrimitiveType(
+    xenos::PrimitiveType source_type, bool convert_quads_to_triangles);
+
+// Returns the number of indices ConvertIndices will write, 0 if there's nothing
+// to draw. conversion_needed_out is set to false if the source indices can be
+// used directly instead (no topology change, no swapping needed, and no reset
+// indices needing replacement actually present in the buffer).
+uint32_t GetConvertedIndexCount(const ConversionInfo& info, const void* source,
+                                bool& conversion_needed_out);
+
+// Converts the source indices, writing GetConvertedIndexCount indices of the
+// same format to target. Uses SIMD where possible, no alignment requirements
+// beyond the natural alignment of the index format.
+void ConvertIndices(const ConversionInfo& info, const void* source,
+                    void* target);
+
+}  // namespace primitive_conversion
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_PRIMITIVE_CONVERSION_H_
@@ -12,9 +12,15 @@
 
 #include <algorithm>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include "xenia/base/arena.h"
 #include "xenia/base/math.h"
 #include "xenia/base/string_buffer.h"
 #include "xenia/gpu/ucode.h"
@@ -666,6 +672,104 @@ class Shader {
     }
   };
 
+  // Microcode parsed into the form consumed by the shader translators. Parsing
+  // doesn't depend on translation modifiers (such as the register count or the
+  // host vertex shader type), so it's done once per shader and shared by all
+  // translations of it.
+  struct ParsedUcode {
+    // Maximum arena chunk size - enough for most shaders in one chunk.
+    static constexpr size_t kArenaChunkSize = 64 * 1024;
+    // Arena space taken by the largest parsed ALU or fetch instruction.
+    static constexpr size_t kMaxInstructionArenaSize =
+        (std::max(sizeof(ParsedAluInstruction),
+                  std::max(sizeof(ParsedVertexFetchInstruction),
+                           sizeof(ParsedTextureFetchInstruction))) +
+         sizeof(void*) - 1) &
+        ~(sizeof(void*) - 1);
+
+    struct Instruction {
+      enum class Type : uint32_t {
+        kAlu,
+        kVertexFetch,
+        kTextureFetch,
+      };
+      Type type;
+      // Whether the instruction has the serialize bit set in the sequence.
+      bool is_sync;
+      // Instruction index in the ucode (in units of 3 dwords).
+      uint32_t address;
+      // Allocated from the arena, depending on the type.
+      union {
+        const ParsedAluInstruction* alu;
+        const ParsedVertexFetchInstruction* vertex_fetch;
+        const ParsedTextureFetchInstruction* texture_fetch;
+      };
+    };
+
+    struct InstructionRange {
+      uint32_t first;
+      uint32_t count;
+    };
+
+    // The first arena chunk is sized for the instructions that may be in the
+    // ucode, so small shaders don't each hold a whole kArenaChunkSize chunk.
+    explicit ParsedUcode(size_t ucode_dword_count)
+        : arena(GetArenaChunkSize(ucode_dword_count)) {}
+
+    static size_t GetArenaChunkSize(size_t ucode_dword_count) {
+      // Every instruction is 3 dwords. Arena::Alloc keeps 4096 bytes of
+      // headroom in the chunk.
+      return std::min(xe::round_up((ucode_dword_count / 3 + 1) *
+                                           kMaxInstructionArenaSize +
+                                       4096,
+                                   size_t(4096)),
+                      kArenaChunkSize);
+    }
+
+    // Allocates a copy of a parsed ALU or fetch instruction in the arena.
+    template <typename T>
+    const T* AllocInstruction(const T& instruction) {
+      static_assert(std::is_trivially_destructible<T>::value,
+                    "Arena-allocated instructions are never destroyed");
+      static_assert(alignof(T) <= sizeof(void*) &&
+                        sizeof(T) % alignof(T) == 0,
+                    "Arena allocations are not aligned explicitly");
+      return new (arena.Alloc(xe::round_up(sizeof(T), sizeof(void*))))
+          T(instruction);
+    }
+
+    // All control flow instructions until the first exec instruction address,
+    // two per 3 dwords.
+    std::vector<ucode::ControlFlowInstruction> cf_instructions;
+    // Control flow instruction indices that are targets of jumps, calls or
+    // loops.
+    std::set<uint32_t> label_cf_indices;
+    // For every control flow instruction, ALU and fetch instructions it
+    // executes in `instructions` (empty for non-exec control flow
+    // instructions).
+    std::vector<InstructionRange> cf_instruction_ranges;
+    std::vector<Instruction> instructions;
+    // Backing storage of the parsed ALU and fetch instructions.
+    xe::Arena arena;
+
+    // Information gathered from the whole shader before translation.
+    int total_attrib_count = 0;
+    std::vector<VertexBinding> vertex_bindings;
+    std::vector<TextureBinding> texture_bindings;
+    uint32_t unique_vertex_bindings = 0;
+    uint32_t unique_texture_bindings = 0;
+    ConstantRegisterMap constant_register_map = {0};
+    bool uses_register_dynamic_addressing = false;
+    bool writes_color_targets[4] = {false, false, false, false};
+    bool writes_depth = false;
+    bool implicit_early_z_allowed = true;
+    uint32_t memexport_alloc_count = 0;
+    uint32_t memexport_eA_written = 0;
+    // ShaderTranslator::kMaxMemExports entries.
+    uint8_t memexport_eM_written[16] = {0};
+    std::set<uint32_t> memexport_stream_constants;
+  };
+
   Shader(xenos::ShaderType shader_type, uint64_t ucode_data_hash,
          const uint32_t* ucode_dwords, size_t ucode_dword_count);
   virtual ~Shader();
@@ -686,6 +790,10 @@ class Shader {
   const uint32_t* ucode_dwords() const { return ucode_data_.data(); }
   size_t ucode_dword_count() const { return ucode_data_.size(); }
 
+  // Parsed microcode, or nullptr if the shader hasn't been passed to a
+  // translator yet.
+  const ParsedUcode* parsed_ucode() const { return parsed_ucode_.get(); }
+
   // All vertex bindings used in the shader.
   // Valid for vertex shaders only.
   const std::vector<VertexBinding>& vertex_bindings() const {
@@ -766,6 +874,10 @@ class Shader {
   std::vector<uint32_t> ucode_data_;
   uint64_t ucode_data_hash_;
 
+  // Built by the first translator the shader is passed to.
+  std::unique_ptr<ParsedUcode> parsed_ucode_;
+  std::once_flag parsed_ucode_once_;
+
   std::vector<VertexBinding> vertex_bindings_;
   std::vector<TextureBinding> texture_bindings_;
   ConstantRegisterMap constant_register_map_ = {0};
@@ -7,20 +7,29 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/main.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/utf8.h"
 #include "xenia/gpu/dxbc_shader_translator.h"
 #include "xenia/gpu/shader_translator.h"
 #include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/ui/spirv/spirv_disassembler.h"
+#include "xenia/ui/spirv/spirv_validator.h"
 
 // For D3DDisassemble:
 #if XE_PLATFORM_WIN32
@@ -46,53 +55,490 @@ DEFINE_bool(shader_output_bindless_resources, false,
 DEFINE_bool(shader_output_dxbc_rov, false,
             "Output ROV-based output-merger code in DXBC pixel shaders.",
             "GPU");
+DEFINE_path(
+    shader_batch_input, "",
+    "Directory to recursively search for .vs and .ps shader binaries, or a "
+    "manifest text file listing one shader binary path per line, to translate "
+    "in batch mode. --shader_output is used as the output directory if set, "
+    "mirroring the directory structure of the inputs.",
+    "GPU");
+DEFINE_string(shader_batch_output_types, "ucode,spirv,dxbc",
+              "Comma-separated translators to run every shader through in "
+              "batch mode: [ucode, spirv, spirvtext, dxbc, dxbctext].",
+              "GPU");
+DEFINE_int32(shader_batch_threads, -1,
+             "Number of translation threads in batch mode, -1 to use all "
+             "logical processors.",
+             "GPU");
+DEFINE_path(shader_batch_report, "",
+            "File to write the batch mode report to - one line per output with "
+            "the XXH64 of the translated binary, for diffing translator "
+            "changes.",
+            "GPU");
 
 namespace xe {
 namespace gpu {
 
-int shader_compiler_main(const std::vector<std::string>& args) {
-  xenos::ShaderType shader_type;
+static bool GetShaderType(const std::filesystem::path& path,
+                          xenos::ShaderType& shader_type_out) {
   if (!cvars::shader_input_type.empty()) {
     if (cvars::shader_input_type == "vs") {
-      shader_type = xenos::ShaderType::kVertex;
-    } else if (cvars::shader_input_type == "ps") {
-      shader_type = xenos::ShaderType::kPixel;
-    } else {
-      XELOGE("Invalid --shader_input_type; must be 'vs' or 'ps'.");
-      return 1;
+      shader_type_out = xenos::ShaderType::kVertex;
+      return true;
+    }
+    if (cvars::shader_input_type == "ps") {
+      shader_type_out = xenos::ShaderType::kPixel;
+      return true;
+    }
+    XELOGE("Invalid --shader_input_type; must be 'vs' or 'ps'.");
+    return false;
+  }
+  if (path.has_extension()) {
+    auto extension = path.extension();
+    if (extension == ".vs") {
+      shader_type_out = xenos::ShaderType::kVertex;
+      return true;
+    }
+    if (extension == ".ps") {
+      shader_type_out = xenos::ShaderType::kPixel;
+      return true;
+    }
+  }
+  return false;
+}
+
+static Shader::HostVertexShaderType GetHostVertexShaderType(
+    xenos::ShaderType shader_type) {
+  if (shader_type != xenos::ShaderType::kVertex) {
+    return Shader::HostVertexShaderType::kVertex;
+  }
+  if (cvars::vertex_shader_output_type == "linedomaincp") {
+    return Shader::HostVertexShaderType::kLineDomainCPIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "linedomainpatch") {
+    return Shader::HostVertexShaderType::kLineDomainPatchIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "triangledomaincp") {
+    return Shader::HostVertexShaderType::kTriangleDomainCPIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "triangledomainpatch") {
+    return Shader::HostVertexShaderType::kTriangleDomainPatchIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "quaddomaincp") {
+    return Shader::HostVertexShaderType::kQuadDomainCPIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "quaddomainpatch") {
+    return Shader::HostVertexShaderType::kQuadDomainPatchIndexed;
+  }
+  return Shader::HostVertexShaderType::kVertex;
+}
+
+static std::unique_ptr<ShaderTranslator> CreateTranslator(
+    const std::string_view output_type) {
+  if (output_type == "spirv" || output_type == "spirvtext") {
+    return std::make_unique<SpirvShaderTranslator>();
+  }
+  if (output_type == "dxbc" || output_type == "dxbctext") {
+    return std::make_unique<DxbcShaderTranslator>(
+        0, cvars::shader_output_bindless_resources,
+        cvars::shader_output_dxbc_rov);
+  }
+  return std::make_unique<UcodeShaderTranslator>();
+}
+
+#if XE_PLATFORM_WIN32
+// Returns the DXBC disassembly, or an empty string if it has failed.
+static std::string DisassembleDxbc(pD3DDisassemble d3d_disassemble,
+                                   const void* dxbc, size_t dxbc_size) {
+  std::string disasm;
+  ID3DBlob* disasm_blob = nullptr;
+  if (SUCCEEDED(d3d_disassemble(dxbc, dxbc_size,
+                                D3D_DISASM_ENABLE_INSTRUCTION_NUMBERING |
+                                    D3D_DISASM_ENABLE_INSTRUCTION_OFFSET,
+                                nullptr, &disasm_blob))) {
+    // Stop at the null terminator.
+    auto disasm_text =
+        reinterpret_cast<const char*>(disasm_blob->GetBufferPointer());
+    disasm.assign(disasm_text,
+                  strnlen(disasm_text, disasm_blob->GetBufferSize()));
+    disasm_blob->Release();
+  }
+  return disasm;
+}
+#endif  // XE_PLATFORM_WIN32
+
+// Adds the paths of the files in the directory and its subdirectories. Entries
+// that can't be accessed are reported and skipped instead of ending the
+// search. Returns the number of such entries.
+static size_t FindFilesRecursively(
+    const std::filesystem::path& directory,
+    std::vector<std::filesystem::path>& paths_out) {
+  size_t error_count = 0;
+  std::error_code error;
+  std::filesystem::directory_iterator it(directory, error);
+  if (error) {
+    XELOGE("Unable to list {}: {}", xe::path_to_utf8(directory),
+           error.message());
+    return 1;
+  }
+  for (; it != std::filesystem::directory_iterator(); it.increment(error)) {
+    const std::filesystem::path& path = it->path();
+    std::error_code entry_error;
+    // Like recursive_directory_iterator, don't follow directory symlinks.
+    auto symlink_status = it->symlink_status(entry_error);
+    if (entry_error) {
+      XELOGE("Unable to access {}: {}", xe::path_to_utf8(path),
+             entry_error.message());
+      ++error_count;
+      continue;
+    }
+    if (std::filesystem::is_directory(symlink_status)) {
+      error_count += FindFilesRecursively(path, paths_out);
+    } else if (it->is_regular_file(entry_error)) {
+      // Dangling symlinks are skipped.
+      paths_out.push_back(path);
+    }
+  }
+  // The iteration ends on errors.
+  if (error) {
+    XELOGE("Unable to list {}: {}", xe::path_to_utf8(directory),
+           error.message());
+    ++error_count;
+  }
+  return error_count;
+}
+
+static bool ReadShaderFile(const std::filesystem::path& path,
+                           std::vector<uint32_t>& ucode_dwords_out) {
+  auto input_file = filesystem::OpenFile(path, "rb");
+  if (!input_file) {
+    return false;
+  }
+  filesystem::Seek(input_file, 0, SEEK_END);
+  int64_t input_file_size = filesystem::Tell(input_file);
+  filesystem::Seek(input_file, 0, SEEK_SET);
+  ucode_dwords_out.resize(size_t(std::max(input_file_size, int64_t(0))) / 4);
+  bool read = ucode_dwords_out.empty() ||
+              fread(ucode_dwords_out.data(), 4, ucode_dwords_out.size(),
+                    input_file) == ucode_dwords_out.size();
+  fclose(input_file);
+  return read;
+}
+
+// Batch mode, for regression testing translator changes on a large corpus of
+// dumped shaders.
+static int shader_compiler_batch_main() {
+  struct BatchInput {
+    std::filesystem::path path;
+    // Path of the outputs relative to --shader_output, preserving the
+    // directory structure so that inputs with the same name don't collide.
+    std::filesystem::path output_relative_path;
+    xenos::ShaderType shader_type;
+  };
+  std::vector<BatchInput> inputs;
+  auto add_input = [&inputs](const std::filesystem::path& path,
+                             const std::filesystem::path& root) {
+    BatchInput input;
+    input.path = path;
+    input.output_relative_path = path.lexically_relative(root);
+    if (input.output_relative_path.empty() ||
+        *input.output_relative_path.begin() == "..") {
+      // Outside the root, mirror the absolute path instead.
+      input.output_relative_path =
+          std::filesystem::absolute(path).lexically_normal().relative_path();
+    }
+    if (GetShaderType(path, input.shader_type)) {
+      inputs.push_back(std::move(input));
+    }
+  };
+  // Directory entries that couldn't be accessed.
+  size_t inaccessible_count = 0;
+  std::error_code input_error;
+  if (std::filesystem::is_directory(cvars::shader_batch_input, input_error)) {
+    std::vector<std::filesystem::path> paths;
+    inaccessible_count =
+        FindFilesRecursively(cvars::shader_batch_input, paths);
+    for (const std::filesystem::path& path : paths) {
+      add_input(path, cvars::shader_batch_input);
     }
   } else {
-    bool valid_type = false;
-    if (cvars::shader_input.has_extension()) {
-      auto extension = cvars::shader_input.extension();
-      if (extension == ".vs") {
-        shader_type = xenos::ShaderType::kVertex;
-        valid_type = true;
-      } else if (extension == ".ps") {
-        shader_type = xenos::ShaderType::kPixel;
-        valid_type = true;
+    FILE* manifest_file =
+        filesystem::OpenFile(cvars::shader_batch_input, "rb");
+    if (!manifest_file) {
+      XELOGE("Unable to open the batch manifest: {}",
+             xe::path_to_utf8(cvars::shader_batch_input));
+      return 1;
+    }
+    std::string manifest;
+    char manifest_buffer[4096];
+    size_t manifest_read;
+    while ((manifest_read = fread(manifest_buffer, 1, sizeof(manifest_buffer),
+                                  manifest_file)) != 0) {
+      manifest.append(manifest_buffer, manifest_read);
+    }
+    fclose(manifest_file);
+    // Relative paths in the manifest are relative to the manifest itself.
+    auto manifest_directory = cvars::shader_batch_input.parent_path();
+    for (auto line : utf8::split(manifest, "\r\n", true)) {
+      add_input(manifest_directory / xe::to_path(line), manifest_directory);
+    }
+  }
+  // Deterministic report order regardless of the directory iteration order.
+  std::sort(inputs.begin(), inputs.end(),
+            [](const BatchInput& a, const BatchInput& b) {
+              return a.path < b.path;
+            });
+
+  std::vector<std::string> output_types;
+  for (auto output_type :
+       utf8::split(cvars::shader_batch_output_types, ", ", true)) {
+    if (output_type != "ucode" && output_type != "spirv" &&
+        output_type != "spirvtext" && output_type != "dxbc" &&
+        output_type != "dxbctext") {
+      XELOGE("Unsupported batch output type {}", output_type);
+      return 1;
+    }
+    output_types.emplace_back(output_type);
+  }
+  if (inputs.empty() || output_types.empty()) {
+    XELOGE("Nothing to translate in batch mode");
+    return 1;
+  }
+
+  if (!cvars::shader_output.empty()) {
+    std::filesystem::create_directories(cvars::shader_output);
+  }
+
+  struct BatchOutput {
+    bool loaded = false;
+    bool translated = false;
+    // Only for SPIR-V.
+    bool validation_failed = false;
+    uint64_t hash = 0;
+    size_t size = 0;
+  };
+  // Indexed by input * output type count + output type.
+  std::vector<BatchOutput> outputs(inputs.size() * output_types.size());
+  // Host ticks spent in each translator, summed across threads.
+  std::vector<std::atomic<uint64_t>> output_type_ticks(output_types.size());
+  for (auto& ticks : output_type_ticks) {
+    ticks.store(0, std::memory_order_relaxed);
+  }
+#if XE_PLATFORM_WIN32
+  // Loaded once for all threads.
+  HMODULE d3d_compiler = nullptr;
+  pD3DDisassemble d3d_disassemble = nullptr;
+  if (std::find(output_types.cbegin(), output_types.cend(), "dxbctext") !=
+      output_types.cend()) {
+    d3d_compiler = LoadLibraryW(L"D3DCompiler_47.dll");
+    if (d3d_compiler != nullptr) {
+      d3d_disassemble =
+          pD3DDisassemble(GetProcAddress(d3d_compiler, "D3DDisassemble"));
+    }
+  }
+#endif  // XE_PLATFORM_WIN32
+
+  std::atomic<size_t> next_input_index(0);
+  std::atomic<uint64_t> ucode_bytes_translated(0);
+
+  auto thread_function = [&]() {
+    // Translators keep state, so each thread has its own.
+    std::vector<std::unique_ptr<ShaderTranslator>> translators;
+    translators.reserve(output_types.size());
+    for (const std::string& output_type : output_types) {
+      translators.push_back(CreateTranslator(output_type));
+    }
+    xe::ui::spirv::SpirvValidator spirv_validator;
+    xe::ui::spirv::SpirvDisassembler spirv_disassembler;
+    std::vector<uint32_t> ucode_dwords;
+    while (true) {
+      size_t input_index =
+          next_input_index.fetch_add(1, std::memory_order_relaxed);
+      if (input_index >= inputs.size()) {
+        break;
+      }
+      const BatchInput& input = inputs[input_index];
+      BatchOutput* input_outputs =
+          outputs.data() + input_index * output_types.size();
+      if (!ReadShaderFile(input.path, ucode_dwords)) {
+        XELOGE("Unable to read {}", xe::path_to_utf8(input.path));
+        continue;
+      }
+      uint64_t ucode_data_hash = XXH64(
+          ucode_dwords.data(), ucode_dwords.size() * sizeof(uint32_t), 0);
+      ucode_bytes_translated.fetch_add(ucode_dwords.size() * sizeof(uint32_t),
+                                       std::memory_order_relaxed);
+      // One Shader for all translators so the ucode is parsed only once - the
+      // translated binary is consumed before it's replaced by the next output
+      // type.
+      Shader shader(input.shader_type, ucode_data_hash, ucode_dwords.data(),
+                    ucode_dwords.size());
+      for (size_t i = 0; i < output_types.size(); ++i) {
+        const std::string& output_type = output_types[i];
+        BatchOutput& output = input_outputs[i];
+        output.loaded = true;
+        uint64_t translation_start = xe::Clock::QueryHostTickCount();
+        output.translated = translators[i]->Translate(
+            &shader, GetHostVertexShaderType(input.shader_type));
+        output_type_ticks[i].fetch_add(
+            xe::Clock::QueryHostTickCount() - translation_start,
+            std::memory_order_relaxed);
+        const std::vector<uint8_t>& binary = shader.translated_binary();
+        bool is_spirv = output_type == "spirv" || output_type == "spirvtext";
+        if (is_spirv && output.translated) {
+          auto validation = spirv_validator.Validate(
+              reinterpret_cast<const uint32_t*>(binary.data()),
+              binary.size() / sizeof(uint32_t));
+          if (!validation || validation->has_error()) {
+            output.validation_failed = true;
+            XELOGE("SPIR-V validation failed for {}: {}",
+                   xe::path_to_utf8(input.path),
+                   validation ? validation->error_string() : "library error");
+          }
+        }
+        const void* output_data = binary.data();
+        size_t output_data_size = binary.size();
+        std::unique_ptr<xe::ui::spirv::SpirvDisassembler::Result>
+            spirv_disasm_result;
+        if (output_type == "spirvtext" && output.translated) {
+          spirv_disasm_result = spirv_disassembler.Disassemble(
+              reinterpret_cast<const uint32_t*>(binary.data()),
+              binary.size() / sizeof(uint32_t));
+          output_data = spirv_disasm_result->text();
+          output_data_size = std::strlen(spirv_disasm_result->text());
+        }
+#if XE_PLATFORM_WIN32
+        std::string dxbc_disasm;
+        if (output_type == "dxbctext" && output.translated &&
+            d3d_disassemble) {
+          dxbc_disasm =
+              DisassembleDxbc(d3d_disassemble, binary.data(), binary.size());
+          if (!dxbc_disasm.empty()) {
+            output_data = dxbc_disasm.data();
+            output_data_size = dxbc_disasm.size();
+          }
+        }
+#endif  // XE_PLATFORM_WIN32
+        output.hash = XXH64(output_data, output_data_size, 0);
+        output.size = output_data_size;
+        if (!cvars::shader_output.empty()) {
+          auto output_path = cvars::shader_output / input.output_relative_path;
+          output_path += "." + output_type;
+          std::error_code create_error;
+          std::filesystem::create_directories(output_path.parent_path(),
+                                              create_error);
+          FILE* output_file = filesystem::OpenFile(output_path, "wb");
+          if (output_file) {
+            fwrite(output_data, 1, output_data_size, output_file);
+            fclose(output_file);
+          }
+        }
       }
     }
-    if (!valid_type) {
+  };
+
+  uint32_t thread_count = xe::threading::logical_processor_count();
+  if (cvars::shader_batch_threads > 0) {
+    thread_count = uint32_t(cvars::shader_batch_threads);
+  }
+  thread_count = std::max(uint32_t(1), thread_count);
+  thread_count = uint32_t(std::min(size_t(thread_count), inputs.size()));
+
+  XELOGI("Translating {} shaders to {} output types on {} threads",
+         inputs.size(), output_types.size(), thread_count);
+  uint64_t batch_start = xe::Clock::QueryHostTickCount();
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.push_back(xe::threading::Thread::Create({}, thread_function));
+    threads.back()->set_name("Shader Translation");
+  }
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  threads.clear();
+#if XE_PLATFORM_WIN32
+  if (d3d_compiler != nullptr) {
+    FreeLibrary(d3d_compiler);
+  }
+#endif  // XE_PLATFORM_WIN32
+  uint64_t tick_frequency = xe::Clock::QueryHostTickFrequency();
+  double batch_seconds =
+      double(xe::Clock::QueryHostTickCount() - batch_start) /
+      double(tick_frequency);
+
+  FILE* report_file = nullptr;
+  if (!cvars::shader_batch_report.empty()) {
+    report_file = filesystem::OpenFile(cvars::shader_batch_report, "wb");
+    if (!report_file) {
+      XELOGE("Unable to open the batch report file: {}",
+             xe::path_to_utf8(cvars::shader_batch_report));
+    }
+  }
+  size_t failed_count = 0, validation_failed_count = 0;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    for (size_t j = 0; j < output_types.size(); ++j) {
+      const BatchOutput& output = outputs[i * output_types.size() + j];
+      const char* status = "ok";
+      if (!output.loaded) {
+        status = "unreadable";
+        ++failed_count;
+      } else if (!output.translated) {
+        status = "failed";
+        ++failed_count;
+      } else if (output.validation_failed) {
+        status = "invalid";
+        ++validation_failed_count;
+      }
+      if (report_file) {
+        fmt::print(report_file, "{:016X}\t{}\t{}\t{}\t{}\n", output.hash,
+                   output.size, output_types[j], status,
+                   xe::path_to_utf8(inputs[i].path));
+      }
+    }
+  }
+  if (report_file) {
+    fclose(report_file);
+  }
+
+  XELOGI("Translated {} shaders ({} KB of ucode) in {:.3f} s: {:.1f} shaders/s",
+         inputs.size(), ucode_bytes_translated.load() / 1024, batch_seconds,
+         batch_seconds > 0.0 ? double(inputs.size()) / batch_seconds : 0.0);
+  for (size_t i = 0; i < output_types.size(); ++i) {
+    double type_seconds =
+        double(output_type_ticks[i].load()) / double(tick_frequency);
+    XELOGI("  {}: {:.3f} thread-s, {:.1f} shaders/thread-s", output_types[i],
+           type_seconds,
+           type_seconds > 0.0 ? double(inputs.size()) / type_seconds : 0.0);
+  }
+  XELOGI(
+      "{} translations failed, {} SPIR-V modules failed validation, {} "
+      "directory entries inaccessible",
+      failed_count, validation_failed_count, inaccessible_count);
+  return (failed_count || validation_failed_count || inaccessible_count) ? 1
+                                                                          : 0;
+}
+
+int shader_compiler_main(const std::vector<std::string>& args) {
+  if (!cvars::shader_batch_input.empty()) {
+    return shader_compiler_batch_main();
+  }
+
+  xenos::ShaderType shader_type;
+  if (!GetShaderType(cvars::shader_input, shader_type)) {
+    if (cvars::shader_input_type.empty()) {
       XELOGE(
           "File type not recognized (use .vs, .ps or "
           "--shader_input_type=vs|ps).");
-      return 1;
     }
+    return 1;
   }
 
-  auto input_file = filesystem::OpenFile(cvars::shader_input, "rb");
-  if (!input_file) {
+  std::vector<uint32_t> ucode_dwords;
+  if (!ReadShaderFile(cvars::shader_input, ucode_dwords)) {
     XELOGE("Unable to open input file: {}",
            xe::path_to_utf8(cvars::shader_input));
     return 1;
   }
-  fseek(input_file, 0, SEEK_END);
-  size_t input_file_size = ftell(input_file);
-  fseek(input_file, 0, SEEK_SET);
-  std::vector<uint32_t> ucode_dwords(input_file_size / 4);
-  fread(ucode_dwords.data(), 4, ucode_dwords.size(), input_file);
-  fclose(input_file);
 
   XELOGI("Opened {} as a {} shader, {} words ({} bytes).",
          xe::path_to_utf8(cvars::shader_input),
@@ -104,44 +550,10 @@ int shader_compiler_main(const std::vector<std::string>& args) {
   auto shader = std::make_unique<Shader>(
       shader_type, ucode_data_hash, ucode_dwords.data(), ucode_dwords.size());
 
-  std::unique_ptr<ShaderTranslator> translator;
-  if (cvars::shader_output_type == "spirv" ||
-      cvars::shader_output_type == "spirvtext") {
-    translator = std::make_unique<SpirvShaderTranslator>();
-  } else if (cvars::shader_output_type == "dxbc" ||
-             cvars::shader_output_type == "dxbctext") {
-    translator = std::make_unique<DxbcShaderTranslator>(
-        0, cvars::shader_output_bindless_resources,
-        cvars::shader_output_dxbc_rov);
-  } else {
-    translator = std::make_unique<UcodeShaderTranslator>();
-  }
-
-  Shader::HostVertexShaderType host_vertex_shader_type =
-      Shader::HostVertexShaderType::kVertex;
-  if (shader_type == xenos::ShaderType::kVertex) {
-    if (cvars::vertex_shader_output_type == "linedomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kLineDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "linedomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kLineDomainPatchIndexed;
-    } else if (cvars::vertex_shader_output_type == "triangledomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kTriangleDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "triangledomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kTriangleDomainPatchIndexed;
-    } else if (cvars::vertex_shader_output_type == "quaddomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kQuadDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "quaddomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kQuadDomainPatchIndexed;
-    }
-  }
-
-  translator->Translate(shader.get(), host_vertex_shader_type);
+  std::unique_ptr<ShaderTranslator> translator =
+      CreateTranslator(cvars::shader_output_type);
+
+  translator->Translate(shader.get(), GetHostVertexShaderType(shader_type));
 
   const void* source_data = shader->translated_binary().data();
   size_t source_data_size = shader->translated_binary().size();
@@ -155,7 +567,7 @@ int shader_compiler_main(const std::vector<std::string>& args) {
     source_data_size = std::strlen(spirv_disasm_result->text()) + 1;
   }
 #if XE_PLATFORM_WIN32
-  ID3DBlob* dxbc_disasm_blob = nullptr;
+  std::string dxbc_disasm;
   if (cvars::shader_output_type == "dxbctext") {
     HMODULE d3d_compiler = LoadLibraryW(L"D3DCompiler_47.dll");
     if (d3d_compiler != nullptr) {
@@ -163,19 +575,11 @@ int shader_compiler_main(const std::vector<std::string>& args) {
           pD3DDisassemble(GetProcAddress(d3d_compiler, "D3DDisassemble"));
       if (d3d_disassemble != nullptr) {
         // Disassemble DXBC.
-        if (SUCCEEDED(d3d_disassemble(source_data, source_data_size,
-                                      D3D_DISASM_ENABLE_INSTRUCTION_NUMBERING |
-                                          D3D_DISASM_ENABLE_INSTRUCTION_OFFSET,
-                                      nullptr, &dxbc_disasm_blob))) {
-          source_data = dxbc_disasm_blob->GetBufferPointer();
-          source_data_size = dxbc_disasm_blob->GetBufferSize();
-          // Stop at the null terminator.
-          for (size_t i = 0; i < source_data_size; ++i) {
-            if (reinterpret_cast<const char*>(source_data)[i] == '\0') {
-              source_data_size = i;
-              break;
-            }
-          }
+        dxbc_disasm =
+            DisassembleDxbc(d3d_disassemble, source_data, source_data_size);
+        if (!dxbc_disasm.empty()) {
+          source_data = dxbc_disasm.data();
+          source_data_size = dxbc_disasm.size();
         }
       }
       FreeLibrary(d3d_compiler);
@@ -189,12 +593,6 @@ int shader_compiler_main(const std::vector<std::string>& args) {
     fclose(output_file);
   }
 
-#if XE_PLATFORM_WIN32
-  if (dxbc_disasm_blob != nullptr) {
-    dxbc_disasm_blob->Release();
-  }
-#endif  // XE_PLATFORM_WIN32
-
   return 0;
 }
 
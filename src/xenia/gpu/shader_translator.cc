@@ -11,6 +11,9 @@
 #include "xenia/gpu/shader_translator.h"
 
 #include <cstdarg>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 
@@ -68,6 +71,7 @@ void ShaderTranslator::Reset() {
   memexport_eA_written_ = 0;
   std::memset(&memexport_eM_written_, 0, sizeof(memexport_eM_written_));
   memexport_stream_constants_.clear();
+  parsed_ucode_ = nullptr;
 }
 
 bool ShaderTranslator::GatherAllBindingInformation(Shader* shader) {
@@ -78,23 +82,7 @@ bool ShaderTranslator::GatherAllBindingInformation(Shader* shader) {
   ucode_dwords_ = shader->ucode_dwords();
   ucode_dword_count_ = shader->ucode_dword_count();
 
-  uint32_t max_cf_dword_index = static_cast<uint32_t>(ucode_dword_count_);
-  for (uint32_t i = 0; i < max_cf_dword_index; i += 3) {
-    ControlFlowInstruction cf_a;
-    ControlFlowInstruction cf_b;
-    UnpackControlFlowInstructions(ucode_dwords_ + i, &cf_a, &cf_b);
-    if (IsControlFlowOpcodeExec(cf_a.opcode())) {
-      max_cf_dword_index =
-          std::min(max_cf_dword_index, cf_a.exec.address() * 3);
-    }
-    if (IsControlFlowOpcodeExec(cf_b.opcode())) {
-      max_cf_dword_index =
-          std::min(max_cf_dword_index, cf_b.exec.address() * 3);
-    }
-
-    GatherInstructionInformation(cf_a);
-    GatherInstructionInformation(cf_b);
-  }
+  LoadParsedUcode(*shader);
 
   shader->vertex_bindings_ = std::move(vertex_bindings_);
   shader->texture_bindings_ = std::move(texture_bindings_);
@@ -123,71 +111,41 @@ bool ShaderTranslator::Translate(
   return TranslateInternal(shader, host_vertex_shader_type);
 }
 
+bool ShaderTranslator::RestoreTranslation(
+    Shader* shader, reg::SQ_PROGRAM_CNTL cntl,
+    Shader::HostVertexShaderType host_vertex_shader_type,
+    std::vector<uint8_t> translated_binary) {
+  Reset();
+  uint32_t cntl_num_reg = shader->type() == xenos::ShaderType::kVertex
+                              ? cntl.vs_num_reg
+                              : cntl.ps_num_reg;
+  register_count_ = (cntl_num_reg & 0x80) ? 0 : (cntl_num_reg + 1);
+
+  return TranslateInternal(shader, host_vertex_shader_type, &translated_binary);
+}
+
 bool ShaderTranslator::TranslateInternal(
-    Shader* shader, Shader::HostVertexShaderType host_vertex_shader_type) {
+    Shader* shader, Shader::HostVertexShaderType host_vertex_shader_type,
+    std::vector<uint8_t>* restored_binary) {
   shader_type_ = shader->type();
   host_vertex_shader_type_ = host_vertex_shader_type;
   ucode_dwords_ = shader->ucode_dwords();
   ucode_dword_count_ = shader->ucode_dword_count();
 
-  // Run through and gather all binding, operand addressing and export
-  // information. Translators may need this before they start codegen.
-  uint32_t max_cf_dword_index = static_cast<uint32_t>(ucode_dword_count_);
-  for (uint32_t i = 0; i < max_cf_dword_index; i += 3) {
-    ControlFlowInstruction cf_a;
-    ControlFlowInstruction cf_b;
-    UnpackControlFlowInstructions(ucode_dwords_ + i, &cf_a, &cf_b);
-    if (IsControlFlowOpcodeExec(cf_a.opcode())) {
-      max_cf_dword_index =
-          std::min(max_cf_dword_index, cf_a.exec.address() * 3);
-    }
-    if (IsControlFlowOpcodeExec(cf_b.opcode())) {
-      max_cf_dword_index =
-          std::min(max_cf_dword_index, cf_b.exec.address() * 3);
-    }
-
-    GatherInstructionInformation(cf_a);
-    GatherInstructionInformation(cf_b);
-  }
+  // Get all binding, operand addressing and export information (parsing the
+  // shader if this is its first translation). Translators may need this
+  // before they start codegen.
+  LoadParsedUcode(*shader);
 
-  if (constant_register_map_.float_dynamic_addressing) {
-    // All potentially can be referenced.
-    constant_register_map_.float_count = 256;
-    memset(constant_register_map_.float_bitmap, UINT8_MAX,
-           sizeof(constant_register_map_.float_bitmap));
+  if (restored_binary) {
+    shader->translated_binary_ = std::move(*restored_binary);
   } else {
-    constant_register_map_.float_count = 0;
-    for (int i = 0; i < 4; ++i) {
-      // Each bit indicates a vec4 (4 floats).
-      constant_register_map_.float_count +=
-          xe::bit_count(constant_register_map_.float_bitmap[i]);
-    }
+    StartTranslation();
+    TranslateBlocks();
+    shader->translated_binary_ = CompleteTranslation();
   }
 
-  // Cleanup invalid/unneeded memexport allocs.
-  for (uint32_t i = 0; i < kMaxMemExports; ++i) {
-    if (!(memexport_eA_written_ & (uint32_t(1) << i))) {
-      memexport_eM_written_[i] = 0;
-    } else if (!memexport_eM_written_[i]) {
-      memexport_eA_written_ &= ~(uint32_t(1) << i);
-    }
-  }
-  if (memexport_eA_written_ == 0) {
-    memexport_stream_constants_.clear();
-  }
-  if (!memexport_stream_constants_.empty()) {
-    // TODO(Triang3l): Investigate what happens to memexport when the pixel
-    // fails the depth/stencil test, but in Direct3D 11 UAV writes disable early
-    // depth/stencil.
-    implicit_early_z_allowed_ = false;
-  }
-
-  StartTranslation();
-
-  TranslateBlocks();
-
   shader->errors_ = std::move(errors_);
-  shader->translated_binary_ = CompleteTranslation();
   shader->ucode_disassembly_ = ucode_disasm_buffer_.to_string();
   shader->host_vertex_shader_type_ = host_vertex_shader_type_;
   shader->vertex_bindings_ = std::move(vertex_bindings_);
@@ -212,7 +170,9 @@ bool ShaderTranslator::TranslateInternal(
     }
   }
 
-  PostTranslation(shader);
+  if (!restored_binary) {
+    PostTranslation(shader);
+  }
 
   return shader->is_valid_;
 }
@@ -254,7 +214,11 @@ void ShaderTranslator::EmitTranslationError(const char* message,
 }
 
 void ShaderTranslator::GatherInstructionInformation(
-    const ControlFlowInstruction& cf) {
+    const ControlFlowInstruction& cf, Shader::ParsedUcode& parsed_ucode) {
+  Shader::ParsedUcode::InstructionRange instruction_range;
+  instruction_range.first = uint32_t(parsed_ucode.instructions.size());
+  instruction_range.count = 0;
+
   uint32_t bool_constant_index = UINT32_MAX;
   switch (cf.opcode()) {
     case ControlFlowOpcode::kCondExec:
@@ -307,6 +271,9 @@ void ShaderTranslator::GatherInstructionInformation(
       for (uint32_t instr_offset = cf.exec.address();
            instr_offset < cf.exec.address() + cf.exec.count();
            ++instr_offset, sequence >>= 2) {
+        Shader::ParsedUcode::Instruction instruction;
+        instruction.is_sync = (sequence & 0x2) == 0x2;
+        instruction.address = instr_offset;
         bool is_fetch = (sequence & 0x1) == 0x1;
         if (is_fetch) {
           // Gather vertex and texture fetches.
@@ -314,13 +281,25 @@ void ShaderTranslator::GatherInstructionInformation(
               static_cast<FetchOpcode>(ucode_dwords_[instr_offset * 3] & 0x1F);
           if (fetch_opcode == FetchOpcode::kVertexFetch) {
             assert_true(is_vertex_shader());
-            GatherVertexFetchInformation(
-                *reinterpret_cast<const VertexFetchInstruction*>(
-                    ucode_dwords_ + instr_offset * 3));
+            auto& op = *reinterpret_cast<const VertexFetchInstruction*>(
+                ucode_dwords_ + instr_offset * 3);
+            ParsedVertexFetchInstruction fetch_instr;
+            ParseVertexFetchInstruction(op, &fetch_instr);
+            GatherVertexFetchInformation(op, fetch_instr);
+            instruction.type =
+                Shader::ParsedUcode::Instruction::Type::kVertexFetch;
+            instruction.vertex_fetch =
+                parsed_ucode.AllocInstruction(fetch_instr);
           } else {
-            GatherTextureFetchInformation(
-                *reinterpret_cast<const TextureFetchInstruction*>(
-                    ucode_dwords_ + instr_offset * 3));
+            auto& op = *reinterpret_cast<const TextureFetchInstruction*>(
+                ucode_dwords_ + instr_offset * 3);
+            ParsedTextureFetchInstruction fetch_instr;
+            ParseTextureFetchInstruction(op, &fetch_instr);
+            GatherTextureFetchInformation(op, fetch_instr);
+            instruction.type =
+                Shader::ParsedUcode::Instruction::Type::kTextureFetch;
+            instruction.texture_fetch =
+                parsed_ucode.AllocInstruction(fetch_instr);
           }
         } else {
           // Gather info needed for the translation pass because having such
@@ -332,6 +311,8 @@ void ShaderTranslator::GatherInstructionInformation(
                                                               instr_offset * 3);
           ParsedAluInstruction instr;
           ParseAluInstruction(op, instr);
+          instruction.type = Shader::ParsedUcode::Instruction::Type::kAlu;
+          instruction.alu = parsed_ucode.AllocInstruction(instr);
 
           const auto& vector_opcode_info =
               alu_vector_opcode_infos_[uint32_t(op.vector_opcode())];
@@ -443,18 +424,20 @@ void ShaderTranslator::GatherInstructionInformation(
             }
           }
         }
+        parsed_ucode.instructions.push_back(instruction);
+        ++instruction_range.count;
       }
     } break;
     default:
       break;
   }
+
+  parsed_ucode.cf_instruction_ranges.push_back(instruction_range);
 }
 
 void ShaderTranslator::GatherVertexFetchInformation(
-    const VertexFetchInstruction& op) {
-  ParsedVertexFetchInstruction fetch_instr;
-  ParseVertexFetchInstruction(op, &fetch_instr);
-
+    const VertexFetchInstruction& op,
+    const ParsedVertexFetchInstruction& fetch_instr) {
   // Don't bother setting up a binding for an instruction that fetches nothing.
   if (!op.fetches_any_data()) {
     return;
@@ -498,7 +481,8 @@ void ShaderTranslator::GatherVertexFetchInformation(
 }
 
 void ShaderTranslator::GatherTextureFetchInformation(
-    const TextureFetchInstruction& op) {
+    const TextureFetchInstruction& op,
+    const ParsedTextureFetchInstruction& fetch_instr) {
   // Check if using dynamic register indices.
   if (op.is_dest_relative() || op.is_src_relative()) {
     uses_register_dynamic_addressing_ = true;
@@ -516,7 +500,7 @@ void ShaderTranslator::GatherTextureFetchInformation(
   }
   Shader::TextureBinding binding;
   binding.binding_index = -1;
-  ParseTextureFetchInstruction(op, &binding.fetch_instr);
+  binding.fetch_instr = fetch_instr;
   binding.fetch_constant = binding.fetch_instr.operands[1].storage_index;
 
   // Check and see if this fetch constant was previously used...
@@ -556,18 +540,19 @@ void AddControlFlowTargetLabel(const ControlFlowInstruction& cf,
   }
 }
 
-bool ShaderTranslator::TranslateBlocks() {
+void ShaderTranslator::ParseUcode(Shader& shader) {
+  static_assert(sizeof(Shader::ParsedUcode::memexport_eM_written) ==
+                    sizeof(memexport_eM_written_),
+                "Parsed ucode must store all memexport eM write masks");
+  auto parsed_ucode =
+      std::make_unique<Shader::ParsedUcode>(ucode_dword_count_);
+
   // Control flow instructions come paired in blocks of 3 dwords and all are
   // listed at the top of the ucode.
-  // Each control flow instruction is executed sequentially until the final
-  // ending instruction.
-
   // Guess how long the control flow program is by scanning for the first
   // kExec-ish and instruction and using its address as the upper bound.
   // This is what freedreno does.
   uint32_t max_cf_dword_index = static_cast<uint32_t>(ucode_dword_count_);
-  std::set<uint32_t> label_addresses;
-  std::vector<ControlFlowInstruction> cf_instructions;
   for (uint32_t i = 0; i < max_cf_dword_index; i += 3) {
     ControlFlowInstruction cf_a;
     ControlFlowInstruction cf_b;
@@ -580,44 +565,118 @@ bool ShaderTranslator::TranslateBlocks() {
       max_cf_dword_index =
           std::min(max_cf_dword_index, cf_b.exec.address() * 3);
     }
-    AddControlFlowTargetLabel(cf_a, &label_addresses);
-    AddControlFlowTargetLabel(cf_b, &label_addresses);
+    AddControlFlowTargetLabel(cf_a, &parsed_ucode->label_cf_indices);
+    AddControlFlowTargetLabel(cf_b, &parsed_ucode->label_cf_indices);
+    parsed_ucode->cf_instructions.push_back(cf_a);
+    parsed_ucode->cf_instructions.push_back(cf_b);
+
+    // Parse ALU and fetch instructions and gather all binding, operand
+    // addressing and export information.
+    GatherInstructionInformation(cf_a, *parsed_ucode);
+    GatherInstructionInformation(cf_b, *parsed_ucode);
+  }
+
+  if (constant_register_map_.float_dynamic_addressing) {
+    // All potentially can be referenced.
+    constant_register_map_.float_count = 256;
+    memset(constant_register_map_.float_bitmap, UINT8_MAX,
+           sizeof(constant_register_map_.float_bitmap));
+  } else {
+    constant_register_map_.float_count = 0;
+    for (int i = 0; i < 4; ++i) {
+      // Each bit indicates a vec4 (4 floats).
+      constant_register_map_.float_count +=
+          xe::bit_count(constant_register_map_.float_bitmap[i]);
+    }
+  }
+
+  // Cleanup invalid/unneeded memexport allocs.
+  for (uint32_t i = 0; i < kMaxMemExports; ++i) {
+    if (!(memexport_eA_written_ & (uint32_t(1) << i))) {
+      memexport_eM_written_[i] = 0;
+    } else if (!memexport_eM_written_[i]) {
+      memexport_eA_written_ &= ~(uint32_t(1) << i);
+    }
+  }
+  if (memexport_eA_written_ == 0) {
+    memexport_stream_constants_.clear();
+  }
+  if (!memexport_stream_constants_.empty()) {
+    // TODO(Triang3l): Investigate what happens to memexport when the pixel
+    // fails the depth/stencil test, but in Direct3D 11 UAV writes disable early
+    // depth/stencil.
+    implicit_early_z_allowed_ = false;
+  }
 
-    cf_instructions.push_back(cf_a);
-    cf_instructions.push_back(cf_b);
+  parsed_ucode->total_attrib_count = total_attrib_count_;
+  parsed_ucode->vertex_bindings = std::move(vertex_bindings_);
+  parsed_ucode->texture_bindings = std::move(texture_bindings_);
+  parsed_ucode->unique_vertex_bindings = unique_vertex_bindings_;
+  parsed_ucode->unique_texture_bindings = unique_texture_bindings_;
+  parsed_ucode->constant_register_map = constant_register_map_;
+  parsed_ucode->uses_register_dynamic_addressing =
+      uses_register_dynamic_addressing_;
+  for (size_t i = 0; i < xe::countof(writes_color_targets_); ++i) {
+    parsed_ucode->writes_color_targets[i] = writes_color_targets_[i];
   }
+  parsed_ucode->writes_depth = writes_depth_;
+  parsed_ucode->implicit_early_z_allowed = implicit_early_z_allowed_;
+  parsed_ucode->memexport_alloc_count = memexport_alloc_count_;
+  parsed_ucode->memexport_eA_written = memexport_eA_written_;
+  std::memcpy(parsed_ucode->memexport_eM_written, memexport_eM_written_,
+              sizeof(memexport_eM_written_));
+  parsed_ucode->memexport_stream_constants =
+      std::move(memexport_stream_constants_);
+
+  shader.parsed_ucode_ = std::move(parsed_ucode);
+}
 
-  PreProcessControlFlowInstructions(cf_instructions);
+void ShaderTranslator::LoadParsedUcode(Shader& shader) {
+  std::call_once(shader.parsed_ucode_once_,
+                 [this, &shader]() { ParseUcode(shader); });
+  const Shader::ParsedUcode& parsed_ucode = *shader.parsed_ucode_;
+  parsed_ucode_ = &parsed_ucode;
+
+  total_attrib_count_ = parsed_ucode.total_attrib_count;
+  vertex_bindings_ = parsed_ucode.vertex_bindings;
+  texture_bindings_ = parsed_ucode.texture_bindings;
+  unique_vertex_bindings_ = parsed_ucode.unique_vertex_bindings;
+  unique_texture_bindings_ = parsed_ucode.unique_texture_bindings;
+  constant_register_map_ = parsed_ucode.constant_register_map;
+  uses_register_dynamic_addressing_ =
+      parsed_ucode.uses_register_dynamic_addressing;
+  for (size_t i = 0; i < xe::countof(writes_color_targets_); ++i) {
+    writes_color_targets_[i] = parsed_ucode.writes_color_targets[i];
+  }
+  writes_depth_ = parsed_ucode.writes_depth;
+  implicit_early_z_allowed_ = parsed_ucode.implicit_early_z_allowed;
+  memexport_alloc_count_ = parsed_ucode.memexport_alloc_count;
+  memexport_eA_written_ = parsed_ucode.memexport_eA_written;
+  std::memcpy(memexport_eM_written_, parsed_ucode.memexport_eM_written,
+              sizeof(memexport_eM_written_));
+  memexport_stream_constants_ = parsed_ucode.memexport_stream_constants;
+}
 
-  // Translate all instructions.
-  for (uint32_t i = 0, cf_index = 0; i < max_cf_dword_index; i += 3) {
-    ControlFlowInstruction cf_a;
-    ControlFlowInstruction cf_b;
-    UnpackControlFlowInstructions(ucode_dwords_ + i, &cf_a, &cf_b);
+bool ShaderTranslator::TranslateBlocks() {
+  // Each control flow instruction is executed sequentially until the final
+  // ending instruction.
+  const Shader::ParsedUcode& parsed_ucode = *parsed_ucode_;
 
-    cf_index_ = cf_index;
-    MarkUcodeInstruction(i);
-    if (label_addresses.count(cf_index)) {
-      AppendUcodeDisasmFormat("                label L%u\n", cf_index);
-      ProcessLabel(cf_index);
-    }
-    AppendUcodeDisasmFormat("/* %4u.0 */ ", cf_index / 2);
-    ProcessControlFlowInstructionBegin(cf_index);
-    TranslateControlFlowInstruction(cf_a);
-    ProcessControlFlowInstructionEnd(cf_index);
-    ++cf_index;
+  PreProcessControlFlowInstructions(parsed_ucode.cf_instructions);
 
+  // Translate all instructions.
+  uint32_t cf_count = uint32_t(parsed_ucode.cf_instructions.size());
+  for (uint32_t cf_index = 0; cf_index < cf_count; ++cf_index) {
     cf_index_ = cf_index;
-    MarkUcodeInstruction(i);
-    if (label_addresses.count(cf_index)) {
+    MarkUcodeInstruction(cf_index / 2 * 3);
+    if (parsed_ucode.label_cf_indices.count(cf_index)) {
       AppendUcodeDisasmFormat("                label L%u\n", cf_index);
       ProcessLabel(cf_index);
     }
-    AppendUcodeDisasmFormat("/* %4u.1 */ ", cf_index / 2);
+    AppendUcodeDisasmFormat("/* %4u.%u */ ", cf_index / 2, cf_index & 1);
     ProcessControlFlowInstructionBegin(cf_index);
-    TranslateControlFlowInstruction(cf_b);
+    TranslateControlFlowInstruction(parsed_ucode.cf_instructions[cf_index]);
     ProcessControlFlowInstructionEnd(cf_index);
-    ++cf_index;
   }
 
   return true;
@@ -875,33 +934,26 @@ void ShaderTranslator::TranslateExecInstructions(
 
   ProcessExecInstructionBegin(instr);
 
-  uint32_t sequence = instr.sequence;
-  for (uint32_t instr_offset = instr.instruction_address;
-       instr_offset < instr.instruction_address + instr.instruction_count;
-       ++instr_offset, sequence >>= 2) {
-    MarkUcodeInstruction(instr_offset);
-    AppendUcodeDisasmFormat("/* %4u   */ ", instr_offset);
-    bool is_sync = (sequence & 0x2) == 0x2;
-    bool is_fetch = (sequence & 0x1) == 0x1;
-    if (is_sync) {
+  const Shader::ParsedUcode::InstructionRange& instruction_range =
+      parsed_ucode_->cf_instruction_ranges[cf_index_];
+  for (uint32_t i = 0; i < instruction_range.count; ++i) {
+    const Shader::ParsedUcode::Instruction& instruction =
+        parsed_ucode_->instructions[instruction_range.first + i];
+    MarkUcodeInstruction(instruction.address);
+    AppendUcodeDisasmFormat("/* %4u   */ ", instruction.address);
+    if (instruction.is_sync) {
       AppendUcodeDisasm("         serialize\n             ");
     }
-    if (is_fetch) {
-      auto fetch_opcode =
-          static_cast<FetchOpcode>(ucode_dwords_[instr_offset * 3] & 0x1F);
-      if (fetch_opcode == FetchOpcode::kVertexFetch) {
-        auto& op = *reinterpret_cast<const VertexFetchInstruction*>(
-            ucode_dwords_ + instr_offset * 3);
-        TranslateVertexFetchInstruction(op);
-      } else {
-        auto& op = *reinterpret_cast<const TextureFetchInstruction*>(
-            ucode_dwords_ + instr_offset * 3);
-        TranslateTextureFetchInstruction(op);
-      }
-    } else {
-      auto& op = *reinterpret_cast<const AluInstruction*>(ucode_dwords_ +
-                                                          instr_offset * 3);
-      TranslateAluInstruction(op);
+    switch (instruction.type) {
+      case Shader::ParsedUcode::Instruction::Type::kAlu:
+        TranslateAluInstruction(*instruction.alu);
+        break;
+      case Shader::ParsedUcode::Instruction::Type::kVertexFetch:
+        TranslateVertexFetchInstruction(*instruction.vertex_fetch);
+        break;
+      case Shader::ParsedUcode::Instruction::Type::kTextureFetch:
+        TranslateTextureFetchInstruction(*instruction.texture_fetch);
+        break;
     }
   }
 
@@ -938,9 +990,7 @@ void ParseFetchInstructionResult(uint32_t dest, uint32_t swizzle,
 }
 
 void ShaderTranslator::TranslateVertexFetchInstruction(
-    const VertexFetchInstruction& op) {
-  ParsedVertexFetchInstruction instr;
-  ParseVertexFetchInstruction(op, &instr);
+    const ParsedVertexFetchInstruction& instr) {
   instr.Disassemble(&ucode_disasm_buffer_);
   ProcessVertexFetchInstruction(instr);
 }
@@ -995,9 +1045,7 @@ void ShaderTranslator::ParseVertexFetchInstruction(
 }
 
 void ShaderTranslator::TranslateTextureFetchInstruction(
-    const TextureFetchInstruction& op) {
-  ParsedTextureFetchInstruction instr;
-  ParseTextureFetchInstruction(op, &instr);
+    const ParsedTextureFetchInstruction& instr) {
   instr.Disassemble(&ucode_disasm_buffer_);
   ProcessTextureFetchInstruction(instr);
 }
@@ -1247,9 +1295,8 @@ const ShaderTranslator::AluOpcodeInfo
         {"retain_prev", 0, 0, false},  // 50
 };
 
-void ShaderTranslator::TranslateAluInstruction(const AluInstruction& op) {
-  ParsedAluInstruction instr;
-  ParseAluInstruction(op, instr);
+void ShaderTranslator::TranslateAluInstruction(
+    const ParsedAluInstruction& instr) {
   instr.Disassemble(&ucode_disasm_buffer_);
   ProcessAluInstruction(instr);
 }
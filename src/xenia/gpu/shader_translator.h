@@ -40,6 +40,15 @@ class ShaderTranslator {
                  Shader::HostVertexShaderType host_vertex_shader_type =
                      Shader::HostVertexShaderType::kVertex);
 
+  // Populates the shader with a host binary produced by an earlier translation
+  // of the same microcode with the same modifiers (loaded from a persistent
+  // shader storage, for instance). Only the information gathering pass is
+  // performed - no code is generated, and the ucode disassembly is not
+  // available for such shaders.
+  bool RestoreTranslation(Shader* shader, reg::SQ_PROGRAM_CNTL cntl,
+                          Shader::HostVertexShaderType host_vertex_shader_type,
+                          std::vector<uint8_t> translated_binary);
+
  protected:
   ShaderTranslator();
 
@@ -192,18 +201,33 @@ class ShaderTranslator {
     bool disable_implicit_early_z;
   };
 
+  // If restored_binary is not null, it's used as the result instead of
+  // performing the actual translation.
   bool TranslateInternal(Shader* shader,
-                         Shader::HostVertexShaderType host_vertex_shader_type);
+                         Shader::HostVertexShaderType host_vertex_shader_type,
+                         std::vector<uint8_t>* restored_binary = nullptr);
 
   void MarkUcodeInstruction(uint32_t dword_offset);
   void AppendUcodeDisasm(char c);
   void AppendUcodeDisasm(const char* value);
   void AppendUcodeDisasmFormat(const char* format, ...);
 
+  // Parses the microcode and gathers the information needed before
+  // translation, storing the results in the shader.
+  void ParseUcode(Shader& shader);
+  // Parses the microcode of the shader if not done yet, and loads the gathered
+  // information into the translator.
+  void LoadParsedUcode(Shader& shader);
+
   bool TranslateBlocks();
-  void GatherInstructionInformation(const ucode::ControlFlowInstruction& cf);
-  void GatherVertexFetchInformation(const ucode::VertexFetchInstruction& op);
-  void GatherTextureFetchInformation(const ucode::TextureFetchInstruction& op);
+  void GatherInstructionInformation(const ucode::ControlFlowInstruction& cf,
+                                    Shader::ParsedUcode& parsed_ucode);
+  void GatherVertexFetchInformation(
+      const ucode::VertexFetchInstruction& op,
+      const ParsedVertexFetchInstruction& fetch_instr);
+  void GatherTextureFetchInformation(
+      const ucode::TextureFetchInstruction& op,
+      const ParsedTextureFetchInstruction& fetch_instr);
   void TranslateControlFlowInstruction(const ucode::ControlFlowInstruction& cf);
   void TranslateControlFlowNop(const ucode::ControlFlowInstruction& cf);
   void TranslateControlFlowExec(const ucode::ControlFlowExecInstruction& cf);
@@ -225,16 +249,17 @@ class ShaderTranslator {
 
   void TranslateExecInstructions(const ParsedExecInstruction& instr);
 
-  void TranslateVertexFetchInstruction(const ucode::VertexFetchInstruction& op);
+  void TranslateVertexFetchInstruction(
+      const ParsedVertexFetchInstruction& instr);
   void ParseVertexFetchInstruction(const ucode::VertexFetchInstruction& op,
                                    ParsedVertexFetchInstruction* out_instr);
 
   void TranslateTextureFetchInstruction(
-      const ucode::TextureFetchInstruction& op);
+      const ParsedTextureFetchInstruction& instr);
   void ParseTextureFetchInstruction(const ucode::TextureFetchInstruction& op,
                                     ParsedTextureFetchInstruction* out_instr);
 
-  void TranslateAluInstruction(const ucode::AluInstruction& op);
+  void TranslateAluInstruction(const ParsedAluInstruction& instr);
   void ParseAluInstruction(const ucode::AluInstruction& op,
                            ParsedAluInstruction& out_instr) const;
   static void ParseAluInstructionOperand(const ucode::AluInstruction& op,
@@ -253,6 +278,8 @@ class ShaderTranslator {
   size_t ucode_dword_count_;
   reg::SQ_PROGRAM_CNTL program_cntl_;
   uint32_t register_count_;
+  // Parsed microcode of the shader being translated, owned by the shader.
+  const Shader::ParsedUcode* parsed_ucode_ = nullptr;
 
   // Accumulated translation errors.
   std::vector<Shader::Error> errors_;
@@ -0,0 +1,165 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/spirv_shader_storage.h"
+
+#include <cstring>
+
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/memory.h"
+#include "xenia/gpu/spirv_shader_translator.h"
+
+namespace xe {
+namespace gpu {
+
+namespace {
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version_swapped;
+  uint32_t translator_version_swapped;
+};
+// 'XESV'.
+const uint32_t kFileMagic = 0x56534558;
+}  // namespace
+
+SpirvShaderStorage::~SpirvShaderStorage() {
+  if (file_) {
+    fclose(file_);
+  }
+}
+
+uint64_t SpirvShaderStorage::GetKey(
+    uint64_t ucode_data_hash, xenos::ShaderType type,
+    reg::SQ_PROGRAM_CNTL cntl,
+    Shader::HostVertexShaderType host_vertex_shader_type) {
+  struct {
+    uint64_t ucode_data_hash;
+    uint32_t type;
+    uint32_t sq_program_cntl;
+    uint32_t host_vertex_shader_type;
+    uint32_t translator_version;
+  } key;
+  // Don't hash padding.
+  std::memset(&key, 0, sizeof(key));
+  key.ucode_data_hash = ucode_data_hash;
+  key.type = uint32_t(type);
+  key.sq_program_cntl = cntl.value;
+  key.host_vertex_shader_type = uint32_t(host_vertex_shader_type);
+  key.translator_version = SpirvShaderTranslator::kVersion;
+  return XXH64(&key, sizeof(key), 0);
+}
+
+size_t SpirvShaderStorage::Load(const LoadCallback& callback) {
+  keys_.clear();
+
+  FileHeader file_header;
+  if (!xe::filesystem::Seek(file_, 0, SEEK_SET) ||
+      !fread(&file_header, sizeof(file_header), 1, file_) ||
+      file_header.magic != kFileMagic ||
+      xe::byte_swap(file_header.version_swapped) != RecordHeader::kVersion ||
+      xe::byte_swap(file_header.translator_version_swapped) !=
+          SpirvShaderTranslator::kVersion) {
+    // Empty, corrupted or produced by a different translator - start over.
+    xe::filesystem::TruncateStdioFile(file_, 0);
+    file_header.magic = kFileMagic;
+    file_header.version_swapped = xe::byte_swap(RecordHeader::kVersion);
+    file_header.translator_version_swapped =
+        xe::byte_swap(SpirvShaderTranslator::kVersion);
+    fwrite(&file_header, sizeof(file_header), 1, file_);
+    return 0;
+  }
+
+  uint64_t valid_bytes = sizeof(file_header);
+  RecordHeader header;
+  std::vector<uint32_t> ucode_dwords;
+  ucode_dwords.reserve(0xFFFF);
+  size_t records_loaded = 0;
+  // Read until the end of the file or until a corrupted record is detected.
+  while (true) {
+    if (!fread(&header, sizeof(header), 1, file_)) {
+      break;
+    }
+    size_t ucode_byte_count = header.ucode_dword_count * sizeof(uint32_t);
+    ucode_dwords.resize(header.ucode_dword_count);
+    if (ucode_byte_count &&
+        !fread(ucode_dwords.data(), ucode_byte_count, 1, file_)) {
+      break;
+    }
+    if (XXH64(ucode_dwords.data(), ucode_byte_count, 0) !=
+        header.ucode_data_hash) {
+      break;
+    }
+    Translation translation;
+    translation.sq_program_cntl = header.sq_program_cntl;
+    translation.host_vertex_shader_type = header.host_vertex_shader_type;
+    size_t spirv_byte_count =
+        size_t(header.spirv_dword_count) * sizeof(uint32_t);
+    translation.spirv.resize(spirv_byte_count);
+    if (!spirv_byte_count ||
+        !fread(translation.spirv.data(), spirv_byte_count, 1, file_) ||
+        XXH64(translation.spirv.data(), spirv_byte_count, 0) !=
+            header.spirv_hash) {
+      break;
+    }
+    valid_bytes += sizeof(header) + ucode_byte_count + spirv_byte_count;
+    uint64_t key = GetKey(header.ucode_data_hash, header.type,
+                          header.sq_program_cntl,
+                          header.host_vertex_shader_type);
+    keys_.insert(key);
+    callback(key, std::move(translation));
+    ++records_loaded;
+  }
+
+  // Drop the corrupted tail (if any) so new records are appended after valid
+  // ones.
+  xe::filesystem::TruncateStdioFile(file_, valid_bytes);
+  xe::filesystem::Seek(file_, 0, SEEK_END);
+  return records_loaded;
+}
+
+bool SpirvShaderStorage::Store(const Shader& shader,
+                               reg::SQ_PROGRAM_CNTL cntl) {
+  if (!keys_
+           .insert(GetKey(shader.ucode_data_hash(), shader.type(), cntl,
+                          shader.host_vertex_shader_type()))
+           .second) {
+    return false;
+  }
+
+  const std::vector<uint8_t>& spirv = shader.translated_binary();
+  RecordHeader header;
+  // Don't leak anything in unused bits.
+  std::memset(&header, 0, sizeof(header));
+  header.ucode_data_hash = shader.ucode_data_hash();
+  header.ucode_dword_count = uint32_t(shader.ucode_dword_count());
+  header.type = shader.type();
+  header.host_vertex_shader_type = shader.host_vertex_shader_type();
+  header.sq_program_cntl = cntl;
+  header.spirv_dword_count = uint32_t(spirv.size() / sizeof(uint32_t));
+  header.spirv_hash = XXH64(spirv.data(), spirv.size(), 0);
+  fwrite(&header, sizeof(header), 1, file_);
+  if (header.ucode_dword_count) {
+    ucode_guest_endian_.resize(header.ucode_dword_count);
+    // Need to swap because the hash is calculated for the shader with guest
+    // endianness.
+    xe::copy_and_swap(ucode_guest_endian_.data(), shader.ucode_dwords(),
+                      header.ucode_dword_count);
+    fwrite(ucode_guest_endian_.data(),
+           header.ucode_dword_count * sizeof(uint32_t), 1, file_);
+  }
+  fwrite(spirv.data(), spirv.size(), 1, file_);
+  return true;
+}
+
+void SpirvShaderStorage::Flush() { fflush(file_); }
+
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,94 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_SPIRV_SHADER_STORAGE_H_
+#define XENIA_GPU_SPIRV_SHADER_STORAGE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/hash.h"
+#include "xenia/base/platform.h"
+#include "xenia/gpu/registers.h"
+#include "xenia/gpu/shader.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+
+// File of SPIR-V translated from guest shaders, so shaders translated in
+// previous emulator runs don't need to be translated again. Records are
+// appended, and a corrupted tail (left by a crash during writing, for
+// instance) is dropped when loading.
+// Not thread-safe - must be used by one thread at a time.
+class SpirvShaderStorage {
+ public:
+  struct Translation {
+    reg::SQ_PROGRAM_CNTL sq_program_cntl;
+    Shader::HostVertexShaderType host_vertex_shader_type;
+    std::vector<uint8_t> spirv;
+  };
+
+  using LoadCallback =
+      std::function<void(uint64_t key, Translation&& translation)>;
+
+  // Takes ownership of a file opened for binary reading and writing.
+  explicit SpirvShaderStorage(FILE* file) : file_(file) {}
+  ~SpirvShaderStorage();
+  SpirvShaderStorage(const SpirvShaderStorage&) = delete;
+  SpirvShaderStorage& operator=(const SpirvShaderStorage&) = delete;
+
+  // Returns the key of a translation of the microcode with the given
+  // modifiers, passed to the load callback.
+  static uint64_t GetKey(uint64_t ucode_data_hash, xenos::ShaderType type,
+                         reg::SQ_PROGRAM_CNTL cntl,
+                         Shader::HostVertexShaderType host_vertex_shader_type);
+
+  // Reads all valid records from the beginning of the file, passing them to
+  // the callback. If the file is empty or was written by a different version
+  // of the translator, it's cleared. Returns the number of records loaded.
+  size_t Load(const LoadCallback& callback);
+
+  // Appends the translation of the shader, unless the file already contains a
+  // record with the same key (for a shader requested before the file was
+  // loaded, for instance). Returns whether the record was written.
+  bool Store(const Shader& shader, reg::SQ_PROGRAM_CNTL cntl);
+
+  void Flush();
+
+ private:
+  XEPACKEDSTRUCT(RecordHeader, {
+    uint64_t ucode_data_hash;
+
+    uint32_t ucode_dword_count : 16;
+    xenos::ShaderType type : 1;
+    Shader::HostVertexShaderType host_vertex_shader_type : 3;
+
+    reg::SQ_PROGRAM_CNTL sq_program_cntl;
+
+    uint32_t spirv_dword_count;
+    uint64_t spirv_hash;
+
+    // The SPIR-V translator version is also written to the file header.
+    static constexpr uint32_t kVersion = 0x20201019;
+  });
+
+  FILE* file_;
+  // Keys of the records in the file.
+  std::unordered_set<uint64_t, xe::hash::IdentityHasher<uint64_t>> keys_;
+  std::vector<uint32_t> ucode_guest_endian_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_SPIRV_SHADER_STORAGE_H_
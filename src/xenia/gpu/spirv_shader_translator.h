@@ -55,6 +55,10 @@ constexpr uint32_t kSpirvPushConstantsSize = sizeof(SpirvPushConstants);
 
 class SpirvShaderTranslator : public ShaderTranslator {
  public:
+  // Increase this whenever the generated SPIR-V may change for the same input,
+  // so persistent shader storages containing SPIR-V are invalidated.
+  static constexpr uint32_t kVersion = 0x20201019;
+
   SpirvShaderTranslator();
   ~SpirvShaderTranslator() override;
 
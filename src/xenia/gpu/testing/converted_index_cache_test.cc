@@ -0,0 +1,203 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/converted_index_cache.h"
+
+#include <cstring>
+#include <vector>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/gpu/trace_writer.h"
+#include "xenia/memory.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace gpu {
+namespace test {
+using namespace xe::gpu::primitive_conversion;
+
+// Triangle fans of 16-bit indices in guest physical memory, converted to
+// triangle lists in host storage.
+class IndexCacheTest {
+ public:
+  static constexpr uint32_t kFanIndexCount = 5;
+  static constexpr uint32_t kListIndexCount = (kFanIndexCount - 2) * 3;
+
+  IndexCacheTest() : trace_writer_(nullptr), cache_(memory_, trace_writer_) {
+    REQUIRE(memory_.Initialize());
+    REQUIRE(cache_.Initialize());
+    heap_ = static_cast<PhysicalHeap*>(memory_.LookupHeapByType(true, 4096));
+    // Two allocations in different 8 MB invalidation regions.
+    for (uint32_t region = 0; region < 2; ++region) {
+      REQUIRE(heap_->AllocFixed(
+          virtual_address(region), 4096, 4096,
+          kMemoryAllocationReserve | kMemoryAllocationCommit,
+          kMemoryProtectRead | kMemoryProtectWrite));
+    }
+  }
+
+  ~IndexCacheTest() { cache_.Shutdown(); }
+
+  uint32_t virtual_address(uint32_t region) const {
+    return heap_->heap_base() + region * (16 << 20);
+  }
+  uint32_t physical_address(uint32_t region) const {
+    return heap_->GetPhysicalAddress(virtual_address(region));
+  }
+
+  // Writes the fan through the virtual mapping, like the guest does, so
+  // watched pages trigger the invalidation callbacks.
+  void WriteFan(uint32_t region, uint16_t first_index) {
+    auto indices = memory_.TranslateVirtual<uint16_t*>(virtual_address(region));
+    for (uint32_t i = 0; i < kFanIndexCount; ++i) {
+      xe::store_and_swap<uint16_t>(indices + i, uint16_t(first_index + i));
+    }
+  }
+
+  // Watches the pages of the fan like a backend does when it uploads them.
+  void WatchFan(uint32_t region) {
+    memory_.EnablePhysicalMemoryAccessCallbacks(
+        physical_address(region), kFanIndexCount * sizeof(uint16_t), true,
+        false);
+  }
+
+  ConvertedIndexCache::ConversionResult Convert(uint32_t region,
+                                                uint64_t& handle_out) {
+    ConversionInfo info;
+    info.source_type = xenos::PrimitiveType::kTriangleFan;
+    info.format = xenos::IndexFormat::kInt16;
+    info.endianness = xenos::Endian::k8in16;
+    info.index_count = kFanIndexCount;
+    info.reset = false;
+    info.reset_index = 0;
+    info.swap_to_host = true;
+    info.convert_quads_to_triangles = false;
+    uint32_t index_count = 0;
+    auto result = cache_.ConvertPrimitives(
+        info, physical_address(region),
+        [this](uint32_t size, uint64_t& handle_out) -> void* {
+          handle_out = allocations_.size();
+          allocations_.emplace_back(size / sizeof(uint16_t));
+          return allocations_.back().data();
+        },
+        handle_out, index_count);
+    if (result == ConvertedIndexCache::ConversionResult::kConverted) {
+      REQUIRE(index_count == kListIndexCount);
+    }
+    return result;
+  }
+
+  // Checks that the converted list is the fan starting at first_index, ordered
+  // as (v1, v2, v0), (v2, v3, v0).
+  void RequireList(uint64_t handle, uint16_t first_index) const {
+    REQUIRE(handle < allocations_.size());
+    const std::vector<uint16_t>& list = allocations_[handle];
+    REQUIRE(list.size() == kListIndexCount);
+    for (uint32_t i = 0; i < kFanIndexCount - 2; ++i) {
+      REQUIRE(list[i * 3] == first_index + i + 1);
+      REQUIRE(list[i * 3 + 1] == first_index + i + 2);
+      REQUIRE(list[i * 3 + 2] == first_index);
+    }
+  }
+
+  size_t allocation_count() const { return allocations_.size(); }
+  ConvertedIndexCache& cache() { return cache_; }
+
+ private:
+  Memory memory_;
+  TraceWriter trace_writer_;
+  ConvertedIndexCache cache_;
+  PhysicalHeap* heap_;
+  // Host storage of the converted indices, the handle is the index.
+  std::vector<std::vector<uint16_t>> allocations_;
+};
+
+TEST_CASE("CONVERTED_INDEX_CACHE_HIT_MISS", "[converted_index_cache]") {
+  IndexCacheTest test;
+  test.WriteFan(0, 10);
+  test.WriteFan(1, 20);
+
+  uint64_t handle_0, handle_1, handle;
+  REQUIRE(test.Convert(0, handle_0) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  test.RequireList(handle_0, 10);
+  REQUIRE(test.allocation_count() == 1);
+
+  // Hit - no new storage allocated.
+  REQUIRE(test.Convert(0, handle) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  REQUIRE(handle == handle_0);
+  REQUIRE(test.allocation_count() == 1);
+
+  // Miss for a different address.
+  REQUIRE(test.Convert(1, handle_1) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  REQUIRE(handle_1 != handle_0);
+  test.RequireList(handle_1, 20);
+  REQUIRE(test.allocation_count() == 2);
+}
+
+TEST_CASE("CONVERTED_INDEX_CACHE_EVICTION", "[converted_index_cache]") {
+  IndexCacheTest test;
+  test.WriteFan(0, 10);
+
+  uint64_t handle_before, handle_after;
+  REQUIRE(test.Convert(0, handle_before) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  // The backend storage has been reclaimed.
+  test.cache().ClearCache();
+  REQUIRE(test.Convert(0, handle_after) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  REQUIRE(handle_after != handle_before);
+  test.RequireList(handle_after, 10);
+  REQUIRE(test.allocation_count() == 2);
+}
+
+TEST_CASE("CONVERTED_INDEX_CACHE_INVALIDATION", "[converted_index_cache]") {
+  IndexCacheTest test;
+  test.WriteFan(0, 10);
+  test.WriteFan(1, 20);
+
+  uint64_t handle_0, handle_1, handle;
+  REQUIRE(test.Convert(0, handle_0) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  test.WatchFan(0);
+  REQUIRE(test.Convert(1, handle_1) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  test.WatchFan(1);
+  REQUIRE(test.allocation_count() == 2);
+
+  // The guest writes new indices to region 1 - the write to the watched page
+  // triggers the invalidation, and the indices are converted again.
+  test.WriteFan(1, 30);
+  REQUIRE(test.Convert(1, handle) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  REQUIRE(handle != handle_1);
+  test.RequireList(handle, 30);
+  REQUIRE(test.allocation_count() == 3);
+
+  // The invalidation drops the whole cache.
+  REQUIRE(test.Convert(0, handle) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  REQUIRE(handle != handle_0);
+  test.RequireList(handle, 10);
+  REQUIRE(test.allocation_count() == 4);
+
+  // Nothing written since - hits.
+  REQUIRE(test.Convert(0, handle) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  REQUIRE(test.Convert(1, handle) ==
+          ConvertedIndexCache::ConversionResult::kConverted);
+  REQUIRE(test.allocation_count() == 4);
+}
+
+}  // namespace test
+}  // namespace gpu
+}  // namespace xe
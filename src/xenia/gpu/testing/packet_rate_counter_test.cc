@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/packet_rate_counter.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace gpu {
+namespace test {
+
+TEST_CASE("PACKET_RATE_COUNTER", "[packet_rate_counter]") {
+  const uint64_t kTickFrequency = 1000;
+  PacketRateCounter counter;
+  REQUIRE(counter.packet_count() == 0);
+  REQUIRE(counter.packets_per_second() == 0);
+
+  // The first update only starts the measurement.
+  REQUIRE(!counter.Update(5000, kTickFrequency));
+  for (uint32_t i = 0; i < 300; ++i) {
+    counter.Increment();
+  }
+  REQUIRE(counter.packet_count() == 300);
+  REQUIRE(!counter.Update(5999, kTickFrequency));
+  REQUIRE(counter.packets_per_second() == 0);
+  REQUIRE(counter.Update(6000, kTickFrequency));
+  REQUIRE(counter.packets_per_second() == 300);
+
+  // Averaged over the whole time since the previous recalculation, including
+  // idle time.
+  for (uint32_t i = 0; i < 100; ++i) {
+    counter.Increment();
+  }
+  REQUIRE(!counter.Update(6500, kTickFrequency));
+  REQUIRE(counter.Update(10000, kTickFrequency));
+  REQUIRE(counter.packets_per_second() == 25);
+  REQUIRE(counter.packet_count() == 400);
+
+  // No packets.
+  REQUIRE(counter.Update(11000, kTickFrequency));
+  REQUIRE(counter.packets_per_second() == 0);
+}
+
+}  // namespace test
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,18 @@
+project_root = "../../../.."
+include(project_root.."/tools/build")
+
+test_suite("xenia-gpu-tests", project_root, ".", {
+  links = {
+    "fmt",
+    "glslang-spirv",
+    "snappy",
+    "spirv-tools",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-gpu",
+    "xenia-ui",
+    "xenia-ui-spirv",
+    "xxhash",
+  },
+})
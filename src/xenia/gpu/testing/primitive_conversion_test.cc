@@ -0,0 +1,215 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/primitive_conversion.h"
+
+#include <vector>
+
+#include "xenia/base/testing/util.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace gpu {
+namespace test {
+using namespace xe::gpu::primitive_conversion;
+
+template <typename Index>
+ConversionInfo MakeInfo(xenos::PrimitiveType source_type, uint32_t count) {
+  ConversionInfo info;
+  info.source_type = source_type;
+  if (sizeof(Index) == sizeof(uint32_t)) {
+    info.format = xenos::IndexFormat::kInt32;
+    info.endianness = xenos::Endian::k8in32;
+  } else {
+    info.format = xenos::IndexFormat::kInt16;
+    info.endianness = xenos::Endian::k8in16;
+  }
+  info.index_count = count;
+  info.reset = false;
+  info.reset_index = 0;
+  info.swap_to_host = false;
+  info.convert_quads_to_triangles = false;
+  return info;
+}
+
+// Stores the indices the way they are in guest memory.
+template <typename Index>
+std::vector<Index> ToGuest(const ConversionInfo& info,
+                           const std::vector<Index>& indices) {
+  std::vector<Index> guest;
+  for (Index index : indices) {
+    guest.push_back(xenos::GpuSwap(index, info.endianness));
+  }
+  return guest;
+}
+
+template <typename Index>
+std::vector<Index> Convert(const ConversionInfo& info,
+                           const std::vector<Index>& source,
+                           bool& conversion_needed_out) {
+  uint32_t count =
+      GetConvertedIndexCount(info, source.data(), conversion_needed_out);
+  // Guard values to check for out-of-bounds writes.
+  std::vector<Index> target(count + 1, Index(0xABCDABCD));
+  ConvertIndices(info, source.data(), target.data());
+  REQUIRE(target.back() == Index(0xABCDABCD));
+  target.pop_back();
+  return target;
+}
+
+TEST_CASE("PRIMITIVE_CONVERSION_TRIANGLE_FAN", "[primitive_conversion]") {
+  auto info = MakeInfo<uint16_t>(xenos::PrimitiveType::kTriangleFan, 5);
+  bool conversion_needed;
+  auto target = Convert<uint16_t>(
+      info, ToGuest<uint16_t>(info, {0, 1, 2, 3, 4}), conversion_needed);
+  REQUIRE(conversion_needed);
+  REQUIRE(target == ToGuest<uint16_t>(info, {1, 2, 0, 2, 3, 0, 3, 4, 0}));
+
+  // Primitive reset with a non-host reset index.
+  info.index_count = 8;
+  info.reset = true;
+  info.reset_index = 7;
+  target = Convert<uint16_t>(
+      info, ToGuest<uint16_t>(info, {0, 1, 2, 7, 3, 4, 5, 6}),
+      conversion_needed);
+  REQUIRE(conversion_needed);
+  REQUIRE(target == ToGuest<uint16_t>(info, {1, 2, 0, 4, 5, 3, 5, 6, 3}));
+
+  // Too few indices for a triangle.
+  info.index_count = 2;
+  info.reset = false;
+  REQUIRE(GetConvertedIndexCount(info, ToGuest<uint16_t>(info, {0, 1}).data(),
+                                 conversion_needed) == 0);
+}
+
+TEST_CASE("PRIMITIVE_CONVERSION_LINE_LOOP", "[primitive_conversion]") {
+  auto info = MakeInfo<uint32_t>(xenos::PrimitiveType::kLineLoop, 4);
+  info.swap_to_host = true;
+  bool conversion_needed;
+  auto target = Convert<uint32_t>(
+      info, ToGuest<uint32_t>(info, {10, 11, 12, 13}), conversion_needed);
+  REQUIRE(conversion_needed);
+  REQUIRE(target == std::vector<uint32_t>({10, 11, 12, 13, 10}));
+}
+
+TEST_CASE("PRIMITIVE_CONVERSION_QUAD_LIST", "[primitive_conversion]") {
+  // Odd quad counts to cover both the SIMD and the scalar paths.
+  {
+    auto info = MakeInfo<uint32_t>(xenos::PrimitiveType::kQuadList, 12);
+    info.convert_quads_to_triangles = true;
+    info.swap_to_host = true;
+    std::vector<uint32_t> source;
+    std::vector<uint32_t> expected;
+    for (uint32_t i = 0; i < 3; ++i) {
+      uint32_t v = 0x10000 * i;
+      source.insert(source.end(), {v, v + 1, v + 2, v + 3});
+      expected.insert(expected.end(), {v, v + 1, v + 2, v, v + 2, v + 3});
+    }
+    bool conversion_needed;
+    auto target = Convert<uint32_t>(info, ToGuest<uint32_t>(info, source),
+                                    conversion_needed);
+    REQUIRE(conversion_needed);
+    REQUIRE(target == expected);
+  }
+  {
+    auto info = MakeInfo<uint16_t>(xenos::PrimitiveType::kQuadList, 22);
+    info.convert_quads_to_triangles = true;
+    std::vector<uint16_t> source;
+    std::vector<uint16_t> expected;
+    for (uint16_t i = 0; i < 5; ++i) {
+      uint16_t v = 0x100 * i;
+      source.insert(source.end(), {v, uint16_t(v + 1), uint16_t(v + 2),
+                                   uint16_t(v + 3)});
+      expected.insert(expected.end(),
+                      {v, uint16_t(v + 1), uint16_t(v + 2), v, uint16_t(v + 2),
+                       uint16_t(v + 3)});
+    }
+    // Incomplete quad at the end.
+    source.insert(source.end(), {0x500, 0x501});
+    bool conversion_needed;
+    auto target = Convert<uint16_t>(info, ToGuest<uint16_t>(info, source),
+                                    conversion_needed);
+    REQUIRE(conversion_needed);
+    REQUIRE(target == ToGuest<uint16_t>(info, expected));
+  }
+}
+
+TEST_CASE("PRIMITIVE_CONVERSION_STRIP_RESET", "[primitive_conversion]") {
+  auto info = MakeInfo<uint16_t>(xenos::PrimitiveType::kTriangleStrip, 21);
+  info.reset = true;
+  info.reset_index = 0x1234;
+  std::vector<uint16_t> source;
+  std::vector<uint16_t> expected;
+  for (uint16_t i = 0; i < 21; ++i) {
+    if (i % 5 == 4) {
+      source.push_back(0x1234);
+      expected.push_back(0xFFFF);
+    } else {
+      source.push_back(i);
+      expected.push_back(i);
+    }
+  }
+  bool conversion_needed;
+  auto target = Convert<uint16_t>(info, ToGuest<uint16_t>(info, source),
+                                  conversion_needed);
+  REQUIRE(conversion_needed);
+  REQUIRE(target == ToGuest<uint16_t>(info, expected));
+
+  info.swap_to_host = true;
+  target = Convert<uint16_t>(info, ToGuest<uint16_t>(info, source),
+                             conversion_needed);
+  REQUIRE(conversion_needed);
+  REQUIRE(target == expected);
+
+  // The reset index is not actually used - the guest indices can be used
+  // directly.
+  info.swap_to_host = false;
+  info.reset_index = 0x4321;
+  REQUIRE(GetConvertedIndexCount(info, ToGuest<uint16_t>(info, source).data(),
+                                 conversion_needed) == 21);
+  REQUIRE_FALSE(conversion_needed);
+}
+
+TEST_CASE("PRIMITIVE_CONVERSION_BENCHMARK", "[.benchmark]") {
+  constexpr uint32_t kIndexCount = 65535;
+  constexpr uint32_t kIterations = 1000;
+  auto info = MakeInfo<uint16_t>(xenos::PrimitiveType::kTriangleFan,
+                                 kIndexCount);
+  info.reset = true;
+  info.reset_index = 0x1234;
+  std::vector<uint16_t> source(kIndexCount);
+  for (uint32_t i = 0; i < kIndexCount; ++i) {
+    source[i] = uint16_t(i % 100 == 99 ? 0x3412 : i);
+  }
+  std::vector<uint16_t> target(kIndexCount * 3);
+  const xenos::PrimitiveType types[] = {
+      xenos::PrimitiveType::kTriangleFan,
+      xenos::PrimitiveType::kTriangleStrip,
+      xenos::PrimitiveType::kQuadList,
+  };
+  for (xenos::PrimitiveType type : types) {
+    info.source_type = type;
+    info.convert_quads_to_triangles = true;
+    testing::BenchmarkTimer timer;
+    for (uint32_t i = 0; i < kIterations; ++i) {
+      bool conversion_needed;
+      GetConvertedIndexCount(info, source.data(), conversion_needed);
+      ConvertIndices(info, source.data(), target.data());
+    }
+    double seconds = timer.seconds();
+    WARN("Primitive type " << uint32_t(type) << ": "
+                           << kIndexCount * double(kIterations) / seconds / 1e6
+                           << " million indices per second");
+  }
+}
+
+}  // namespace test
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,242 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/spirv_shader_storage.h"
+
+#include <cstdio>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/math.h"
+#include "xenia/gpu/shader.h"
+#include "xenia/gpu/spirv_shader_translator.h"
+#include "xenia/gpu/ucode.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace gpu {
+namespace test {
+
+// Guest (big-endian) microcode assembled from host dwords.
+class TestUcode {
+ public:
+  // Control flow: a single exec ending the shader, running the instructions
+  // after it - sequence has 2 bits per instruction, 1 for fetches.
+  TestUcode(uint32_t instruction_count, uint32_t sequence) {
+    Append(1 | (instruction_count << 12) | (sequence << 16),
+           uint32_t(ucode::ControlFlowOpcode::kExecEnd) << 12, 0);
+  }
+
+  void Append(uint32_t dword_0, uint32_t dword_1, uint32_t dword_2) {
+    for (uint32_t dword : {dword_0, dword_1, dword_2}) {
+      dwords_.push_back(xe::byte_swap(dword));
+    }
+  }
+
+  // r[dest].xyzw = 32_32_32_32_FLOAT vertex data from fetch constant 95, with
+  // the index in r0.x.
+  void AppendVertexFetch(uint32_t dest) {
+    Append((dest << 12) | (1 << 19) | (31 << 20) | (2 << 25),
+           0x688 | (uint32_t(xenos::VertexFormat::k_32_32_32_32_FLOAT) << 16),
+           4);
+  }
+
+  // Exports max(src, src) (a move) to the export register, with src being a
+  // temporary or a float constant register.
+  void AppendExportMove(uint32_t export_index, uint32_t src, bool src_temp) {
+    Append(export_index | (1 << 15) | (0xF << 16) |
+               (uint32_t(ucode::AluScalarOpcode::kRetainPrev) << 26),
+           0,
+           (src << 8) | (src << 16) |
+               (uint32_t(ucode::AluVectorOpcode::kMax) << 24) |
+               (uint32_t(src_temp) << 30) | (uint32_t(src_temp) << 31));
+  }
+
+  std::unique_ptr<Shader> CreateShader(xenos::ShaderType type) const {
+    // Hashed with guest endianness, like shaders loaded from guest memory.
+    return std::make_unique<Shader>(
+        type, XXH64(dwords_.data(), dwords_.size() * sizeof(uint32_t), 0),
+        dwords_.data(), dwords_.size());
+  }
+
+ private:
+  std::vector<uint32_t> dwords_;
+};
+
+TestUcode CreateVertexShaderUcode() {
+  TestUcode ucode(2, 0b0001);
+  ucode.AppendVertexFetch(1);
+  ucode.AppendExportMove(uint32_t(ucode::ExportRegister::kVSPosition), 1,
+                         true);
+  return ucode;
+}
+
+TestUcode CreatePixelShaderUcode() {
+  TestUcode ucode(1, 0b00);
+  ucode.AppendExportMove(uint32_t(ucode::ExportRegister::kPSColor0), 0, false);
+  return ucode;
+}
+
+reg::SQ_PROGRAM_CNTL CreateProgramCntl() {
+  reg::SQ_PROGRAM_CNTL cntl;
+  cntl.value = 0;
+  // r0 and r1 in the vertex shader, r0 in the pixel shader.
+  cntl.vs_num_reg = 1;
+  cntl.ps_num_reg = 0;
+  return cntl;
+}
+
+// The information gathered from the ucode must be the same as if the shader
+// was translated, as it's used for binding resources.
+void RequireSameInfo(const Shader& restored, const Shader& translated) {
+  REQUIRE(restored.is_valid() == translated.is_valid());
+  REQUIRE(restored.is_translated() == translated.is_translated());
+  REQUIRE(restored.host_vertex_shader_type() ==
+          translated.host_vertex_shader_type());
+
+  REQUIRE(restored.vertex_bindings().size() ==
+          translated.vertex_bindings().size());
+  for (size_t i = 0; i < restored.vertex_bindings().size(); ++i) {
+    const auto& restored_binding = restored.vertex_bindings()[i];
+    const auto& translated_binding = translated.vertex_bindings()[i];
+    REQUIRE(restored_binding.binding_index == translated_binding.binding_index);
+    REQUIRE(restored_binding.fetch_constant ==
+            translated_binding.fetch_constant);
+    REQUIRE(restored_binding.stride_words == translated_binding.stride_words);
+    REQUIRE(restored_binding.attributes.size() ==
+            translated_binding.attributes.size());
+    for (size_t j = 0; j < restored_binding.attributes.size(); ++j) {
+      REQUIRE(restored_binding.attributes[j].attrib_index ==
+              translated_binding.attributes[j].attrib_index);
+      REQUIRE(restored_binding.attributes[j].size_words ==
+              translated_binding.attributes[j].size_words);
+    }
+  }
+  REQUIRE(restored.texture_bindings().size() ==
+          translated.texture_bindings().size());
+
+  const auto& restored_constants = restored.constant_register_map();
+  const auto& translated_constants = translated.constant_register_map();
+  REQUIRE(restored_constants.float_count == translated_constants.float_count);
+  for (size_t i = 0; i < xe::countof(restored_constants.float_bitmap); ++i) {
+    REQUIRE(restored_constants.float_bitmap[i] ==
+            translated_constants.float_bitmap[i]);
+  }
+  for (uint32_t i = 0; i < 4; ++i) {
+    REQUIRE(restored.writes_color_target(i) ==
+            translated.writes_color_target(i));
+  }
+  REQUIRE(restored.writes_depth() == translated.writes_depth());
+}
+
+std::unique_ptr<Shader> Translate(const TestUcode& ucode,
+                                  xenos::ShaderType type,
+                                  reg::SQ_PROGRAM_CNTL cntl) {
+  SpirvShaderTranslator translator;
+  auto shader = ucode.CreateShader(type);
+  REQUIRE(translator.Translate(shader.get(), cntl));
+  REQUIRE(!shader->translated_binary().empty());
+  return shader;
+}
+
+using StoredTranslations =
+    std::unordered_map<uint64_t, SpirvShaderStorage::Translation>;
+
+size_t Load(SpirvShaderStorage& storage, StoredTranslations& translations) {
+  translations.clear();
+  return storage.Load(
+      [&translations](uint64_t key,
+                      SpirvShaderStorage::Translation&& translation) {
+        REQUIRE(translations.emplace(key, std::move(translation)).second);
+      });
+}
+
+TEST_CASE("SPIRV_SHADER_STORAGE_RESTORE", "[spirv_shader_storage]") {
+  auto cntl = CreateProgramCntl();
+  const xenos::ShaderType types[] = {xenos::ShaderType::kVertex,
+                                     xenos::ShaderType::kPixel};
+  TestUcode ucodes[] = {CreateVertexShaderUcode(), CreatePixelShaderUcode()};
+
+  SpirvShaderStorage storage(std::tmpfile());
+  StoredTranslations translations;
+  REQUIRE(Load(storage, translations) == 0);
+  for (size_t i = 0; i < xe::countof(types); ++i) {
+    auto shader = Translate(ucodes[i], types[i], cntl);
+    REQUIRE(storage.Store(*shader, cntl));
+    // Already in the file.
+    REQUIRE(!storage.Store(*shader, cntl));
+  }
+  storage.Flush();
+
+  // Load the file like in the next emulator run, and check that the stored
+  // SPIR-V gives the same shaders as translating the same ucode again.
+  REQUIRE(Load(storage, translations) == xe::countof(types));
+  for (size_t i = 0; i < xe::countof(types); ++i) {
+    auto translated = Translate(ucodes[i], types[i], cntl);
+    if (types[i] == xenos::ShaderType::kVertex) {
+      REQUIRE(translated->vertex_bindings().size() == 1);
+      REQUIRE(translated->vertex_bindings()[0].fetch_constant == 95);
+    } else {
+      REQUIRE(translated->writes_color_target(0));
+      REQUIRE(translated->constant_register_map().float_count == 1);
+    }
+
+    auto it = translations.find(SpirvShaderStorage::GetKey(
+        translated->ucode_data_hash(), types[i], cntl,
+        Shader::HostVertexShaderType::kVertex));
+    REQUIRE(it != translations.end());
+    REQUIRE(it->second.sq_program_cntl.value == cntl.value);
+    REQUIRE(it->second.host_vertex_shader_type ==
+            Shader::HostVertexShaderType::kVertex);
+
+    SpirvShaderTranslator translator;
+    auto restored = ucodes[i].CreateShader(types[i]);
+    REQUIRE(translator.RestoreTranslation(restored.get(), cntl,
+                                          it->second.host_vertex_shader_type,
+                                          std::move(it->second.spirv)));
+    REQUIRE(restored->translated_binary() == translated->translated_binary());
+    RequireSameInfo(*restored, *translated);
+
+    // A shader translated before the loading was completed must not be stored
+    // again.
+    REQUIRE(!storage.Store(*translated, cntl));
+  }
+}
+
+TEST_CASE("SPIRV_SHADER_STORAGE_CORRUPTED_TAIL", "[spirv_shader_storage]") {
+  auto cntl = CreateProgramCntl();
+  FILE* file = std::tmpfile();
+  SpirvShaderStorage storage(file);
+  StoredTranslations translations;
+  REQUIRE(Load(storage, translations) == 0);
+  auto vertex_shader =
+      Translate(CreateVertexShaderUcode(), xenos::ShaderType::kVertex, cntl);
+  REQUIRE(storage.Store(*vertex_shader, cntl));
+
+  // A record cut off by a crash during writing.
+  const uint8_t garbage[] = {0x12, 0x34, 0x56, 0x78, 0x9A};
+  REQUIRE(fwrite(garbage, sizeof(garbage), 1, file) == 1);
+  storage.Flush();
+  REQUIRE(Load(storage, translations) == 1);
+
+  // New records must be appended after the valid ones.
+  auto pixel_shader =
+      Translate(CreatePixelShaderUcode(), xenos::ShaderType::kPixel, cntl);
+  REQUIRE(storage.Store(*pixel_shader, cntl));
+  storage.Flush();
+  REQUIRE(Load(storage, translations) == 2);
+}
+
+}  // namespace test
+}  // namespace gpu
+}  // namespace xe
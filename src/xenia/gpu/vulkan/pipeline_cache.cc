@@ -9,7 +9,10 @@
 
 #include "xenia/gpu/vulkan/pipeline_cache.h"
 
+#include "third_party/fmt/include/fmt/format.h"
 #include "third_party/xxhash/xxhash.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
@@ -169,6 +172,7 @@ VkResult PipelineCache::Initialize(
 }
 
 void PipelineCache::Shutdown() {
+  ShutdownShaderStorage();
   ClearCache();
 
   // Destroy geometry shaders.
@@ -203,6 +207,198 @@ void PipelineCache::Shutdown() {
   }
 }
 
+void PipelineCache::InitializeShaderStorage(
+    const std::filesystem::path& storage_root, uint32_t title_id,
+    bool blocking) {
+  ShutdownShaderStorage();
+
+  // SPIR-V and the driver pipeline cache are specific to the translator
+  // version and the host, so they go to the local (non-shareable) directory.
+  auto shader_storage_local_root = storage_root / "shaders" / "local";
+  if (!std::filesystem::exists(shader_storage_local_root)) {
+    if (!std::filesystem::create_directories(shader_storage_local_root)) {
+      XELOGE(
+          "Failed to create the local shader storage directory, persistent "
+          "Vulkan shader storage will be disabled: {}",
+          xe::path_to_utf8(shader_storage_local_root));
+      return;
+    }
+  }
+
+  auto shader_storage_file_path =
+      shader_storage_local_root / fmt::format("{:08X}.vk.xspv", title_id);
+  FILE* shader_storage_file =
+      xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
+  if (!shader_storage_file) {
+    XELOGE(
+        "Failed to open the Vulkan shader storage file for writing, persistent "
+        "Vulkan shader storage will be disabled: {}",
+        xe::path_to_utf8(shader_storage_file_path));
+    return;
+  }
+  shader_storage_ = std::make_unique<SpirvShaderStorage>(shader_storage_file);
+  shader_storage_root_ = storage_root;
+  shader_storage_title_id_ = title_id;
+
+  // The driver pipeline cache must be merged on this thread because the
+  // destination cache is externally synchronized in vkMergePipelineCaches.
+  pipeline_cache_storage_file_path_ =
+      shader_storage_local_root /
+      fmt::format("{:08X}.vk.pipeline_cache", title_id);
+  LoadStoredPipelineCache();
+
+  storage_loading_done_ = false;
+  storage_thread_shutdown_ = false;
+  storage_thread_ =
+      xe::threading::Thread::Create({}, [this]() { StorageThread(); });
+  storage_thread_->set_name("Vulkan Shader Storage");
+
+  if (blocking) {
+    std::unique_lock<std::mutex> lock(storage_mutex_);
+    while (!storage_loading_done_) {
+      storage_cond_.wait(lock);
+    }
+  }
+}
+
+void PipelineCache::ShutdownShaderStorage() {
+  if (storage_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_mutex_);
+      storage_thread_shutdown_ = true;
+    }
+    storage_cond_.notify_all();
+    xe::threading::Wait(storage_thread_.get(), false);
+    storage_thread_.reset();
+  }
+  storage_write_queue_.clear();
+  stored_shaders_.clear();
+  storage_loading_done_ = false;
+
+  if (shader_storage_) {
+    shader_storage_.reset();
+    WriteStoredPipelineCache();
+  }
+  pipeline_cache_storage_file_path_.clear();
+
+  shader_storage_root_.clear();
+  shader_storage_title_id_ = 0;
+}
+
+void PipelineCache::StorageThread() {
+  uint64_t shader_storage_load_start = xe::Clock::QueryHostTickCount();
+  size_t shaders_loaded = shader_storage_->Load(
+      [this](uint64_t key, SpirvShaderStorage::Translation&& translation) {
+        std::lock_guard<std::mutex> lock(storage_mutex_);
+        stored_shaders_[key] = std::move(translation);
+      });
+  XELOGGPU("Loaded {} SPIR-V shaders from the storage in {} milliseconds",
+           shaders_loaded,
+           (xe::Clock::QueryHostTickCount() - shader_storage_load_start) *
+               1000 / xe::Clock::QueryHostTickFrequency());
+  {
+    std::lock_guard<std::mutex> lock(storage_mutex_);
+    storage_loading_done_ = true;
+  }
+  storage_cond_.notify_all();
+
+  while (true) {
+    std::pair<const VulkanShader*, reg::SQ_PROGRAM_CNTL> shader_pair;
+    {
+      std::unique_lock<std::mutex> lock(storage_mutex_);
+      if (storage_write_queue_.empty()) {
+        if (storage_thread_shutdown_) {
+          break;
+        }
+        storage_cond_.wait(lock);
+        continue;
+      }
+      shader_pair = storage_write_queue_.front();
+      storage_write_queue_.pop_front();
+    }
+
+    // Shaders requested before the loading was completed may already be in
+    // the file, Store skips them.
+    shader_storage_->Store(*shader_pair.first, shader_pair.second);
+    bool flush;
+    {
+      std::lock_guard<std::mutex> lock(storage_mutex_);
+      flush = storage_write_queue_.empty();
+    }
+    if (flush) {
+      shader_storage_->Flush();
+    }
+  }
+  shader_storage_->Flush();
+}
+
+void PipelineCache::LoadStoredPipelineCache() {
+  FILE* file = xe::filesystem::OpenFile(pipeline_cache_storage_file_path_, "rb");
+  if (!file) {
+    return;
+  }
+  std::vector<uint8_t> data;
+  if (xe::filesystem::Seek(file, 0, SEEK_END)) {
+    int64_t size = xe::filesystem::Tell(file);
+    if (size > 0 && xe::filesystem::Seek(file, 0, SEEK_SET)) {
+      data.resize(size_t(size));
+      if (!fread(data.data(), data.size(), 1, file)) {
+        data.clear();
+      }
+    }
+  }
+  fclose(file);
+  if (data.empty()) {
+    return;
+  }
+
+  // The driver validates the header (vendor, device, cache UUID) itself and
+  // ignores incompatible data.
+  VkPipelineCacheCreateInfo pipeline_cache_info;
+  pipeline_cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  pipeline_cache_info.pNext = nullptr;
+  pipeline_cache_info.flags = 0;
+  pipeline_cache_info.initialDataSize = data.size();
+  pipeline_cache_info.pInitialData = data.data();
+  VkPipelineCache stored_pipeline_cache = nullptr;
+  if (vkCreatePipelineCache(*device_, &pipeline_cache_info, nullptr,
+                            &stored_pipeline_cache) != VK_SUCCESS) {
+    XELOGW("Failed to create a pipeline cache from the stored data");
+    return;
+  }
+  if (vkMergePipelineCaches(*device_, pipeline_cache_, 1,
+                            &stored_pipeline_cache) != VK_SUCCESS) {
+    XELOGW("Failed to merge the stored pipeline cache");
+  }
+  vkDestroyPipelineCache(*device_, stored_pipeline_cache, nullptr);
+}
+
+void PipelineCache::WriteStoredPipelineCache() {
+  if (pipeline_cache_storage_file_path_.empty() || !pipeline_cache_) {
+    return;
+  }
+  size_t data_size = 0;
+  if (vkGetPipelineCacheData(*device_, pipeline_cache_, &data_size, nullptr) !=
+          VK_SUCCESS ||
+      !data_size) {
+    return;
+  }
+  std::vector<uint8_t> data(data_size);
+  if (vkGetPipelineCacheData(*device_, pipeline_cache_, &data_size,
+                             data.data()) != VK_SUCCESS) {
+    return;
+  }
+  FILE* file =
+      xe::filesystem::OpenFile(pipeline_cache_storage_file_path_, "wb");
+  if (!file) {
+    XELOGE("Failed to open the pipeline cache storage file for writing: {}",
+           xe::path_to_utf8(pipeline_cache_storage_file_path_));
+    return;
+  }
+  fwrite(data.data(), 1, data_size, file);
+  fclose(file);
+}
+
 VulkanShader* PipelineCache::LoadShader(xenos::ShaderType shader_type,
                                         uint32_t guest_address,
                                         const uint32_t* host_address,
@@ -273,6 +469,15 @@ PipelineCache::UpdateStatus PipelineCache::ConfigurePipeline(
 }
 
 void PipelineCache::ClearCache() {
+  // The storage writer references the shaders being destroyed, so let it finish
+  // and reopen the storage afterwards.
+  bool reinitialize_shader_storage = shader_storage_ != nullptr;
+  std::filesystem::path shader_storage_root = shader_storage_root_;
+  uint32_t shader_storage_title_id = shader_storage_title_id_;
+  if (reinitialize_shader_storage) {
+    ShutdownShaderStorage();
+  }
+
   // Destroy all pipelines.
   for (auto it : cached_pipelines_) {
     vkDestroyPipeline(*device_, it.second, nullptr);
@@ -285,6 +490,11 @@ void PipelineCache::ClearCache() {
     delete it.second;
   }
   shader_map_.clear();
+
+  if (reinitialize_shader_storage) {
+    InitializeShaderStorage(shader_storage_root, shader_storage_title_id,
+                            false);
+  }
 }
 
 VkPipeline PipelineCache::GetPipeline(const RenderState* render_state,
@@ -364,11 +574,52 @@ VkPipeline PipelineCache::GetPipeline(const RenderState* render_state,
 
 bool PipelineCache::TranslateShader(VulkanShader* shader,
                                     reg::SQ_PROGRAM_CNTL cntl) {
-  // Perform translation.
-  // If this fails the shader will be marked as invalid and ignored later.
-  if (!shader_translator_->Translate(shader, cntl)) {
-    XELOGE("Shader translation failed; marking shader as ignored");
-    return false;
+  // Reuse the SPIR-V translated in a previous run if available.
+  bool restored = false;
+  if (shader_storage_) {
+    SpirvShaderStorage::Translation stored_translation;
+    bool stored_translation_found = false;
+    {
+      std::lock_guard<std::mutex> lock(storage_mutex_);
+      auto it = stored_shaders_.find(SpirvShaderStorage::GetKey(
+          shader->ucode_data_hash(), shader->type(), cntl,
+          Shader::HostVertexShaderType::kVertex));
+      if (it != stored_shaders_.end()) {
+        // Check for key hash collisions.
+        if (it->second.sq_program_cntl.value == cntl.value &&
+            it->second.host_vertex_shader_type ==
+                Shader::HostVertexShaderType::kVertex) {
+          stored_translation = std::move(it->second);
+          stored_translation_found = true;
+        }
+        stored_shaders_.erase(it);
+      }
+    }
+    if (stored_translation_found) {
+      restored = shader_translator_->RestoreTranslation(
+          shader, cntl, Shader::HostVertexShaderType::kVertex,
+          std::move(stored_translation.spirv));
+      if (!restored) {
+        XELOGW("Failed to restore stored shader {:016X}, retranslating",
+               shader->ucode_data_hash());
+      }
+    }
+  }
+
+  if (!restored) {
+    // Perform translation.
+    // If this fails the shader will be marked as invalid and ignored later.
+    if (!shader_translator_->Translate(shader, cntl)) {
+      XELOGE("Shader translation failed; marking shader as ignored");
+      return false;
+    }
+    if (shader_storage_ && shader->is_valid()) {
+      {
+        std::lock_guard<std::mutex> lock(storage_mutex_);
+        storage_write_queue_.emplace_back(shader, cntl);
+      }
+      storage_cond_.notify_all();
+    }
   }
 
   // Prepare the shader for use (creates our VkShaderModule).
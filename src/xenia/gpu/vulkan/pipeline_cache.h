@@ -10,11 +10,21 @@
 #ifndef XENIA_GPU_VULKAN_PIPELINE_CACHE_H_
 #define XENIA_GPU_VULKAN_PIPELINE_CACHE_H_
 
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "third_party/xxhash/xxhash.h"
 
+#include "xenia/base/hash.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/register_file.h"
+#include "xenia/gpu/spirv_shader_storage.h"
 #include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/gpu/vulkan/render_cache.h"
 #include "xenia/gpu/vulkan/vulkan_shader.h"
@@ -46,6 +56,13 @@ class PipelineCache {
                       VkDescriptorSetLayout vertex_descriptor_set_layout);
   void Shutdown();
 
+  // Opens the persistent SPIR-V storage for the title and starts loading the
+  // shaders translated in previous runs on a background thread. If blocking is
+  // true, waits for the loading to be completed.
+  void InitializeShaderStorage(const std::filesystem::path& storage_root,
+                               uint32_t title_id, bool blocking);
+  void ShutdownShaderStorage();
+
   // Loads a shader from the cache, possibly translating it.
   VulkanShader* LoadShader(xenos::ShaderType shader_type,
                            uint32_t guest_address, const uint32_t* host_address,
@@ -81,6 +98,11 @@ class PipelineCache {
 
   bool TranslateShader(VulkanShader* shader, reg::SQ_PROGRAM_CNTL cntl);
 
+  // Background thread loading stored shaders, and then appending new ones.
+  void StorageThread();
+  void LoadStoredPipelineCache();
+  void WriteStoredPipelineCache();
+
   void DumpShaderDisasmAMD(VkPipeline pipeline);
   void DumpShaderDisasmNV(const VkGraphicsPipelineCreateInfo& info);
 
@@ -99,6 +121,29 @@ class PipelineCache {
   // All loaded shaders mapped by their guest hash key.
   std::unordered_map<uint64_t, VulkanShader*> shader_map_;
 
+  // Currently open shader storage path.
+  std::filesystem::path shader_storage_root_;
+  uint32_t shader_storage_title_id_ = 0;
+  // Translated SPIR-V storage, for preload in the next emulator runs. Accessed
+  // only by the storage thread while it's running.
+  std::unique_ptr<SpirvShaderStorage> shader_storage_;
+  // Path to the serialized VkPipelineCache of the title.
+  std::filesystem::path pipeline_cache_storage_file_path_;
+
+  // Protects everything below that is accessed by the storage thread.
+  std::mutex storage_mutex_;
+  std::condition_variable storage_cond_;
+  // Translations loaded from the storage, keyed by SpirvShaderStorage::GetKey.
+  // The entries are moved out when the shader is requested.
+  std::unordered_map<uint64_t, SpirvShaderStorage::Translation,
+                     xe::hash::IdentityHasher<uint64_t>>
+      stored_shaders_;
+  bool storage_loading_done_ = false;
+  std::deque<std::pair<const VulkanShader*, reg::SQ_PROGRAM_CNTL>>
+      storage_write_queue_;
+  bool storage_thread_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> storage_thread_;
+
   // Vulkan pipeline cache, which in theory helps us out.
   // This can be serialized to disk and reused, if we want.
   VkPipelineCache pipeline_cache_ = nullptr;
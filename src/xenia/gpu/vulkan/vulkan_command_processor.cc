@@ -59,6 +59,13 @@ void VulkanCommandProcessor::ClearCaches() {
   cache_clear_requested_ = true;
 }
 
+void VulkanCommandProcessor::InitializeShaderStorage(
+    const std::filesystem::path& storage_root, uint32_t title_id,
+    bool blocking) {
+  CommandProcessor::InitializeShaderStorage(storage_root, title_id, blocking);
+  pipeline_cache_->InitializeShaderStorage(storage_root, title_id, blocking);
+}
+
 bool VulkanCommandProcessor::SetupContext() {
   if (!CommandProcessor::SetupContext()) {
     XELOGE("Unable to initialize base command processor context");
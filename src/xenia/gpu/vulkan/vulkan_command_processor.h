@@ -55,6 +55,9 @@ class VulkanCommandProcessor : public CommandProcessor {
   void RestoreEdramSnapshot(const void* snapshot) override;
   void ClearCaches() override;
 
+  void InitializeShaderStorage(const std::filesystem::path& storage_root,
+                               uint32_t title_id, bool blocking) override;
+
   RenderCache* render_cache() { return render_cache_.get(); }
 
  private:
@@ -14,3 +14,11 @@ DEFINE_bool(headless, false,
             "UI");
 DEFINE_bool(log_high_frequency_kernel_calls, false,
             "Log kernel calls with the kHighFrequency tag.", "Kernel");
+DEFINE_bool(profile_kernel_calls, false,
+            "Record call counts and latencies of kernel exports, per export "
+            "and per thread, for kernel_call_profile_path and the debugger.",
+            "Kernel");
+DEFINE_path(kernel_call_profile_path, "",
+            "Path to write the kernel call profile to as JSON on exit, if "
+            "profile_kernel_calls is enabled.",
+            "Kernel");
@@ -19,6 +19,7 @@
 #include "xenia/cpu/processor.h"
 #include "xenia/emulator.h"
 #include "xenia/kernel/user_module.h"
+#include "xenia/kernel/util/kernel_call_profiler.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xam/xam_module.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_module.h"
@@ -28,6 +29,12 @@
 #include "xenia/kernel/xobject.h"
 #include "xenia/kernel/xthread.h"
 
+DEFINE_int32(io_worker_thread_count, 4,
+             "Number of host threads executing reads and writes of "
+             "asynchronous guest files. 0 to complete them on the calling "
+             "guest thread.",
+             "Kernel");
+
 namespace xe {
 namespace kernel {
 
@@ -62,9 +69,19 @@ KernelState::KernelState(Emulator* emulator)
   tls_bitmap_.Resize(2048);
 
   xam::AppManager::RegisterApps(this, app_manager_.get());
+
+  if (cvars::io_worker_thread_count > 0) {
+    io_worker_pool_ = std::make_unique<vfs::IoWorkerPool>(
+        uint32_t(cvars::io_worker_thread_count));
+  }
 }
 
 KernelState::~KernelState() {
+  if (cvars::profile_kernel_calls &&
+      !cvars::kernel_call_profile_path.empty()) {
+    util::KernelCallProfiler::DumpJson(cvars::kernel_call_profile_path);
+  }
+
   SetExecutableModule(nullptr);
 
   if (dispatch_thread_running_) {
@@ -73,6 +90,9 @@ KernelState::~KernelState() {
     dispatch_thread_->Wait(0, 0, 0, nullptr);
   }
 
+  // Finish the pending I/O while the objects it references are still alive.
+  io_worker_pool_.reset();
+
   executable_module_.reset();
   user_modules_.clear();
   kernel_modules_.clear();
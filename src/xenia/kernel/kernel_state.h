@@ -27,6 +27,7 @@
 #include "xenia/kernel/xam/content_manager.h"
 #include "xenia/kernel/xam/user_profile.h"
 #include "xenia/memory.h"
+#include "xenia/vfs/io_worker_pool.h"
 #include "xenia/vfs/virtual_file_system.h"
 #include "xenia/xbox.h"
 
@@ -95,6 +96,8 @@ class KernelState {
   Memory* memory() const { return memory_; }
   cpu::Processor* processor() const { return processor_; }
   vfs::VirtualFileSystem* file_system() const { return file_system_; }
+  // nullptr if I/O of asynchronous files must be completed synchronously.
+  vfs::IoWorkerPool* io_worker_pool() const { return io_worker_pool_.get(); }
 
   uint32_t title_id() const;
 
@@ -214,6 +217,8 @@ class KernelState {
   std::condition_variable_any dispatch_cond_;
   std::list<std::function<void()>> dispatch_queue_;
 
+  std::unique_ptr<vfs::IoWorkerPool> io_worker_pool_;
+
   BitMap tls_bitmap_;
 
   friend class XObject;
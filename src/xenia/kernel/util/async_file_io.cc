@@ -0,0 +1,50 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/async_file_io.h"
+
+#include <utility>
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+void CompleteAsyncIo(const AsyncIoCompletion& completion, X_STATUS result,
+                     uint32_t information) {
+  if (completion.io_status_block) {
+    completion.io_status_block->status = result;
+    completion.io_status_block->information =
+        XSUCCEEDED(result) ? information : 0;
+  }
+  if (completion.signal_event) {
+    completion.signal_event();
+  }
+  if (completion.queue_apc) {
+    completion.queue_apc();
+  }
+}
+
+void QueueAsyncIo(vfs::IoWorkerPool& pool,
+                  std::function<X_STATUS(uint32_t& information)> operation,
+                  AsyncIoCompletion completion) {
+  if (completion.io_status_block) {
+    completion.io_status_block->status = X_STATUS_PENDING;
+    completion.io_status_block->information = 0;
+  }
+  pool.Queue([operation = std::move(operation),
+              completion = std::move(completion)]() {
+    uint32_t information = 0;
+    X_STATUS result = operation(information);
+    CompleteAsyncIo(completion, result, information);
+  });
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
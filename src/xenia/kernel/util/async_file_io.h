@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_ASYNC_FILE_IO_H_
+#define XENIA_KERNEL_UTIL_ASYNC_FILE_IO_H_
+
+#include <cstdint>
+#include <functional>
+
+#include "xenia/vfs/io_worker_pool.h"
+#include "xenia/xbox.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// Whether an NtReadFile or NtWriteFile byte offset refers to the file position
+// (-1 in the high part, FILE_USE_FILE_POINTER_POSITION and
+// FILE_WRITE_TO_END_OF_FILE) rather than being explicit. Such requests depend
+// on the order they're issued in, so they must be executed synchronously.
+inline bool IsFilePositionByteOffset(uint64_t byte_offset) {
+  return uint32_t(byte_offset >> 32) == UINT32_MAX;
+}
+
+// Where the result of a file I/O request executed on an I/O worker thread is
+// reported to the guest.
+struct AsyncIoCompletion {
+  // Host pointer to the guest X_IO_STATUS_BLOCK, or null.
+  X_IO_STATUS_BLOCK* io_status_block = nullptr;
+  // Signals the event passed with the request, if any.
+  std::function<void()> signal_event;
+  // Queues the APC passed with the request to the issuing thread, if any.
+  std::function<void()> queue_apc;
+};
+
+// Reports the result, writing the status block before signaling the event and
+// queuing the APC, so that both see the result.
+void CompleteAsyncIo(const AsyncIoCompletion& completion, X_STATUS result,
+                     uint32_t information);
+
+// Marks the status block as pending and queues the operation, which returns
+// the status and the number of bytes transferred, to the pool, completing the
+// request once it's done.
+void QueueAsyncIo(vfs::IoWorkerPool& pool,
+                  std::function<X_STATUS(uint32_t& information)> operation,
+                  AsyncIoCompletion completion);
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_ASYNC_FILE_IO_H_
@@ -0,0 +1,355 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/kernel_call_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/export_resolver.h"
+#include "xenia/kernel/xthread.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+namespace {
+
+// Counters of one export on one thread, only updated by that thread.
+struct ExportCounters {
+  std::atomic<uint64_t> call_count;
+  std::atomic<uint64_t> total_tick_count;
+  std::atomic<uint64_t> max_tick_count;
+  std::atomic<uint64_t> histogram[KernelCallProfiler::kHistogramBucketCount];
+};
+
+struct ThreadCounters {
+  ~ThreadCounters() {
+    for (uint32_t i = 0; i < export_count; ++i) {
+      delete exports[i].load();
+    }
+  }
+
+  uint32_t thread_id = 0;
+  std::string name;
+  // Allocated on the first call of each export. Replaced by a larger array,
+  // with the registry locked, if exports are registered after the thread's
+  // first call.
+  std::unique_ptr<std::atomic<ExportCounters*>[]> exports;
+  uint32_t export_count = 0;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::pair<const char*, const cpu::Export*>> exports;
+  // Inline call counts of the exports at the last reset.
+  std::vector<uint64_t> inline_call_count_bases;
+  // Kept after the threads exit, so their calls are still in snapshots.
+  std::vector<std::unique_ptr<ThreadCounters>> threads;
+};
+
+Registry& registry() {
+  // Never destroyed, as exports are registered during static initialization
+  // and threads may still be recording during shutdown.
+  static auto registry = new Registry();
+  return *registry;
+}
+
+thread_local ThreadCounters* current_thread_counters_ = nullptr;
+
+ThreadCounters* GetCurrentThreadCounters() {
+  if (current_thread_counters_) {
+    return current_thread_counters_;
+  }
+  auto counters = std::make_unique<ThreadCounters>();
+  if (XThread::IsInThread()) {
+    auto thread = XThread::GetCurrentThread();
+    counters->thread_id = thread->thread_id();
+    counters->name = thread->name();
+  } else {
+    counters->thread_id = xe::threading::current_thread_id();
+  }
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  counters->export_count = uint32_t(reg.exports.size());
+  counters->exports.reset(
+      new std::atomic<ExportCounters*>[counters->export_count]());
+  current_thread_counters_ = counters.get();
+  reg.threads.push_back(std::move(counters));
+  return current_thread_counters_;
+}
+
+// Makes room for the exports registered since the thread's counters were
+// allocated.
+void GrowThreadCounters(ThreadCounters* thread_counters) {
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  uint32_t export_count = uint32_t(reg.exports.size());
+  std::unique_ptr<std::atomic<ExportCounters*>[]> exports(
+      new std::atomic<ExportCounters*>[export_count]());
+  for (uint32_t i = 0; i < thread_counters->export_count; ++i) {
+    exports[i].store(thread_counters->exports[i].load());
+  }
+  thread_counters->exports = std::move(exports);
+  thread_counters->export_count = export_count;
+}
+
+uint64_t GetInlineCallCount(const cpu::Export* export_entry) {
+  if (export_entry->type != cpu::Export::Type::kFunction) {
+    return 0;
+  }
+  // Incremented by guest code with locked instructions.
+  const volatile uint64_t& inline_call_count =
+      export_entry->function_data.intrinsic_hit_count;
+  return inline_call_count;
+}
+
+uint32_t GetHistogramBucket(uint64_t us) {
+  if (!us) {
+    return 0;
+  }
+  return std::min(uint32_t(64 - xe::lzcnt(us)),
+                  KernelCallProfiler::kHistogramBucketCount - 1);
+}
+
+std::string JsonString(const std::string_view value) {
+  std::string result = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (uint8_t(c) < 0x20) {
+      result += fmt::format("\\u{:04x}", c);
+    } else {
+      result += c;
+    }
+  }
+  result += '"';
+  return result;
+}
+
+// Inline calls and histograms are only written for the totals.
+void AppendExportStatsJson(std::string& json,
+                           const KernelCallProfiler::ExportStats& stats,
+                           bool is_total) {
+  json += fmt::format(
+      "{{\"module\": {}, \"ordinal\": {}, \"name\": {}, \"blocking\": {}, "
+      "\"calls\": {}, ",
+      JsonString(stats.module_name), stats.export_entry->ordinal,
+      JsonString(stats.export_entry->name),
+      (stats.export_entry->tags & cpu::ExportTag::kBlocking) ? "true"
+                                                              : "false",
+      stats.call_count);
+  if (is_total) {
+    json += fmt::format("\"inline_calls\": {}, ", stats.inline_call_count);
+  }
+  json += fmt::format("\"total_ns\": {}, \"max_ns\": {}", stats.total_ns,
+                      stats.max_ns);
+  if (is_total) {
+    json += ", \"histogram\": [";
+    for (uint32_t i = 0; i < KernelCallProfiler::kHistogramBucketCount; ++i) {
+      json += fmt::format(i ? ", {}" : "{}", stats.histogram[i]);
+    }
+    json += "]";
+  }
+  json += "}";
+}
+
+}  // namespace
+
+uint32_t KernelCallProfiler::RegisterExport(const char* module_name,
+                                            const cpu::Export* export_entry) {
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  reg.exports.emplace_back(module_name, export_entry);
+  reg.inline_call_count_bases.push_back(GetInlineCallCount(export_entry));
+  return uint32_t(reg.exports.size() - 1);
+}
+
+void KernelCallProfiler::Record(uint32_t export_index,
+                                uint64_t host_tick_count) {
+  auto thread_counters = GetCurrentThreadCounters();
+  if (export_index >= thread_counters->export_count) {
+    GrowThreadCounters(thread_counters);
+  }
+  auto& counters_ptr = thread_counters->exports[export_index];
+  auto counters = counters_ptr.load(std::memory_order_acquire);
+  if (!counters) {
+    counters = new ExportCounters();
+    counters_ptr.store(counters, std::memory_order_release);
+  }
+
+  counters->call_count.fetch_add(1, std::memory_order_relaxed);
+  counters->total_tick_count.fetch_add(host_tick_count,
+                                       std::memory_order_relaxed);
+  if (host_tick_count >
+      counters->max_tick_count.load(std::memory_order_relaxed)) {
+    counters->max_tick_count.store(host_tick_count,
+                                   std::memory_order_relaxed);
+  }
+  static const double us_per_tick =
+      1000000.0 / double(Clock::QueryHostTickFrequency());
+  uint32_t bucket =
+      GetHistogramBucket(uint64_t(double(host_tick_count) * us_per_tick));
+  counters->histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+KernelCallProfiler::Snapshot KernelCallProfiler::TakeSnapshot() {
+  Snapshot snapshot;
+  double ns_per_tick = 1000000000.0 / double(Clock::QueryHostTickFrequency());
+
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  std::vector<ExportStats> totals(reg.exports.size());
+  for (size_t i = 0; i < reg.exports.size(); ++i) {
+    totals[i].module_name = reg.exports[i].first;
+    totals[i].export_entry = reg.exports[i].second;
+    totals[i].inline_call_count = GetInlineCallCount(totals[i].export_entry) -
+                                  reg.inline_call_count_bases[i];
+  }
+  for (auto& thread_counters : reg.threads) {
+    ThreadStats thread_stats;
+    thread_stats.thread_id = thread_counters->thread_id;
+    thread_stats.name = thread_counters->name;
+    for (uint32_t i = 0; i < thread_counters->export_count; ++i) {
+      auto counters = thread_counters->exports[i].load();
+      if (!counters) {
+        continue;
+      }
+      ExportStats stats;
+      stats.module_name = totals[i].module_name;
+      stats.export_entry = totals[i].export_entry;
+      stats.call_count = counters->call_count.load(std::memory_order_relaxed);
+      if (!stats.call_count) {
+        continue;
+      }
+      stats.total_ns = uint64_t(
+          double(counters->total_tick_count.load(std::memory_order_relaxed)) *
+          ns_per_tick);
+      stats.max_ns = uint64_t(
+          double(counters->max_tick_count.load(std::memory_order_relaxed)) *
+          ns_per_tick);
+      auto& total = totals[i];
+      total.call_count += stats.call_count;
+      total.total_ns += stats.total_ns;
+      total.max_ns = std::max(total.max_ns, stats.max_ns);
+      for (uint32_t j = 0; j < kHistogramBucketCount; ++j) {
+        stats.histogram[j] =
+            counters->histogram[j].load(std::memory_order_relaxed);
+        total.histogram[j] += stats.histogram[j];
+      }
+      thread_stats.call_count += stats.call_count;
+      thread_stats.total_ns += stats.total_ns;
+      if (stats.export_entry->tags & cpu::ExportTag::kBlocking) {
+        thread_stats.blocked_ns += stats.total_ns;
+      }
+      thread_stats.exports.push_back(stats);
+    }
+    if (thread_stats.call_count) {
+      std::sort(thread_stats.exports.begin(), thread_stats.exports.end(),
+                [](const ExportStats& a, const ExportStats& b) {
+                  return a.total_ns > b.total_ns;
+                });
+      snapshot.threads.push_back(std::move(thread_stats));
+    }
+  }
+
+  for (auto& total : totals) {
+    if (total.call_count || total.inline_call_count) {
+      snapshot.exports.push_back(total);
+    }
+  }
+  std::sort(snapshot.exports.begin(), snapshot.exports.end(),
+            [](const ExportStats& a, const ExportStats& b) {
+              return a.total_ns > b.total_ns;
+            });
+  return snapshot;
+}
+
+void KernelCallProfiler::Reset() {
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  for (size_t i = 0; i < reg.exports.size(); ++i) {
+    reg.inline_call_count_bases[i] = GetInlineCallCount(reg.exports[i].second);
+  }
+  for (auto& thread_counters : reg.threads) {
+    for (uint32_t i = 0; i < thread_counters->export_count; ++i) {
+      auto counters = thread_counters->exports[i].load();
+      if (!counters) {
+        continue;
+      }
+      // Calls being recorded meanwhile may be partially kept.
+      counters->call_count.store(0, std::memory_order_relaxed);
+      counters->total_tick_count.store(0, std::memory_order_relaxed);
+      counters->max_tick_count.store(0, std::memory_order_relaxed);
+      for (auto& bucket : counters->histogram) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+std::string KernelCallProfiler::ToJson(const Snapshot& snapshot) {
+  std::string json = "{\n  \"histogram_bucket_limits_us\": [";
+  for (uint32_t i = 0; i + 1 < kHistogramBucketCount; ++i) {
+    json += fmt::format(i ? ", {}" : "{}", uint64_t(1) << i);
+  }
+  json += "],\n  \"exports\": [";
+  for (size_t i = 0; i < snapshot.exports.size(); ++i) {
+    json += i ? ",\n    " : "\n    ";
+    AppendExportStatsJson(json, snapshot.exports[i], true);
+  }
+  json += "\n  ],\n  \"threads\": [";
+  for (size_t i = 0; i < snapshot.threads.size(); ++i) {
+    auto& thread_stats = snapshot.threads[i];
+    json += fmt::format(
+        "{}{{\"id\": {}, \"name\": {}, \"calls\": {}, \"total_ns\": {}, "
+        "\"blocked_ns\": {}, \"exports\": [",
+        i ? ",\n    " : "\n    ", thread_stats.thread_id,
+        JsonString(thread_stats.name), thread_stats.call_count,
+        thread_stats.total_ns, thread_stats.blocked_ns);
+    for (size_t j = 0; j < thread_stats.exports.size(); ++j) {
+      json += j ? ",\n      " : "\n      ";
+      AppendExportStatsJson(json, thread_stats.exports[j], false);
+    }
+    json += "]}";
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+bool KernelCallProfiler::DumpJson(const std::filesystem::path& path) {
+  auto json = ToJson(TakeSnapshot());
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Failed to open {} for the kernel call profile",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+  fclose(file);
+  if (!written) {
+    XELOGE("Failed to write the kernel call profile to {}",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  XELOGI("Wrote the kernel call profile to {}", xe::path_to_utf8(path));
+  return true;
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
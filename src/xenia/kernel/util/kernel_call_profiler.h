@@ -0,0 +1,111 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_KERNEL_CALL_PROFILER_H_
+#define XENIA_KERNEL_UTIL_KERNEL_CALL_PROFILER_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/kernel/kernel_flags.h"
+
+namespace xe {
+namespace cpu {
+class Export;
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// Call counts and latencies of the kernel exports, recorded by the shim
+// trampolines while the profile_kernel_calls cvar is set. Each thread records
+// to its own counters, which are only summed up when taking a snapshot.
+class KernelCallProfiler {
+ public:
+  // Latency histogram buckets: bucket 0 is below 1 us, bucket i is
+  // [2^(i-1), 2^i) us, and the last one also has all longer calls.
+  static constexpr uint32_t kHistogramBucketCount = 24;
+
+  struct ExportStats {
+    const char* module_name = nullptr;
+    const cpu::Export* export_entry = nullptr;
+    uint64_t call_count = 0;
+    // Calls completed by the fast paths inlined in guest code by the backend
+    // (inline_kernel_exports), which don't go through the trampolines, so
+    // they're not timed and are only known in total, not per thread.
+    uint64_t inline_call_count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t histogram[kHistogramBucketCount] = {};
+  };
+
+  struct ThreadStats {
+    uint32_t thread_id = 0;
+    std::string name;
+    uint64_t call_count = 0;
+    uint64_t total_ns = 0;
+    // Time spent in exports with the kBlocking tag.
+    uint64_t blocked_ns = 0;
+    // Exports called by the thread, without histograms.
+    std::vector<ExportStats> exports;
+  };
+
+  struct Snapshot {
+    // Sorted by the total time, longest first.
+    std::vector<ExportStats> exports;
+    std::vector<ThreadStats> threads;
+  };
+
+  static bool is_enabled() { return cvars::profile_kernel_calls; }
+
+  // Registers an export during static initialization, returning the index to
+  // record its calls with.
+  static uint32_t RegisterExport(const char* module_name,
+                                 const cpu::Export* export_entry);
+
+  // Records a call to the export on the current thread.
+  static void Record(uint32_t export_index, uint64_t host_tick_count);
+
+  static Snapshot TakeSnapshot();
+  static void Reset();
+
+  static std::string ToJson(const Snapshot& snapshot);
+  static bool DumpJson(const std::filesystem::path& path);
+};
+
+// Profiles the kernel call in its scope if profiling is enabled.
+class ScopedKernelCallProfile {
+ public:
+  explicit ScopedKernelCallProfile(uint32_t export_index)
+      : export_index_(export_index),
+        start_tick_count_(KernelCallProfiler::is_enabled()
+                              ? Clock::QueryHostTickCount()
+                              : 0) {}
+  ~ScopedKernelCallProfile() {
+    if (start_tick_count_) {
+      KernelCallProfiler::Record(
+          export_index_, Clock::QueryHostTickCount() - start_tick_count_);
+    }
+  }
+
+ private:
+  uint32_t export_index_;
+  uint64_t start_tick_count_;
+};
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_KERNEL_CALL_PROFILER_H_
@@ -26,73 +26,61 @@ ObjectTable::ObjectTable() {}
 ObjectTable::~ObjectTable() { Reset(); }
 
 void ObjectTable::Reset() {
-  auto global_lock = global_critical_region_.Acquire();
-
-  // Release all objects.
-  for (uint32_t n = 0; n < table_capacity_; n++) {
-    ObjectTableEntry& entry = table_[n];
-    if (entry.object) {
-      entry.object->Release();
+  std::vector<ObjectTableEntry*> segments;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& segment : segments_) {
+      auto segment_entries = segment.exchange(nullptr);
+      if (segment_entries) {
+        segments.push_back(segment_entries);
+      }
     }
+    table_capacity_ = 0;
+    free_slots_.clear();
   }
 
-  table_capacity_ = 0;
-  last_free_entry_ = 0;
-  free(table_);
-  table_ = nullptr;
-}
-
-X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
-  // Find a free slot.
-  uint32_t slot = last_free_entry_;
-  uint32_t scan_count = 0;
-  while (scan_count < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (!entry.object) {
-      *out_slot = slot;
-      return X_STATUS_SUCCESS;
-    }
-    scan_count++;
-    slot = (slot + 1) % table_capacity_;
-    if (slot == 0) {
-      // Never allow 0 handles.
-      scan_count++;
-      slot++;
+  // Release all objects, outside the lock as they may access the table when
+  // destroyed.
+  for (auto segment : segments) {
+    for (uint32_t i = 0; i < kSegmentSlotCount; ++i) {
+      auto object = segment[i].object.exchange(nullptr);
+      if (object) {
+        object->Release();
+      }
     }
   }
+  for (auto segment : segments) {
+    delete[] segment;
+  }
+}
 
+X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
   // Table out of slots, expand.
-  uint32_t new_table_capacity = std::max(16 * 1024u, table_capacity_ * 2);
-  if (!Resize(new_table_capacity)) {
+  if (free_slots_.empty() && !AddSegment()) {
     return X_STATUS_NO_MEMORY;
   }
 
-  // Never allow 0 handles.
-  slot = ++last_free_entry_;
-  *out_slot = slot;
-
+  *out_slot = free_slots_.front();
+  free_slots_.pop_front();
   return X_STATUS_SUCCESS;
 }
 
-bool ObjectTable::Resize(uint32_t new_capacity) {
-  uint32_t new_size = new_capacity * sizeof(ObjectTableEntry);
-  uint32_t old_size = table_capacity_ * sizeof(ObjectTableEntry);
-  auto new_table =
-      reinterpret_cast<ObjectTableEntry*>(realloc(table_, new_size));
-  if (!new_table) {
+bool ObjectTable::AddSegment() {
+  uint32_t capacity = table_capacity_.load(std::memory_order_relaxed);
+  uint32_t segment_index = capacity >> kSegmentSlotCountLog2;
+  if (segment_index >= kSegmentCount) {
     return false;
   }
-
-  // Zero out new entries.
-  if (new_size > old_size) {
-    std::memset(reinterpret_cast<uint8_t*>(new_table) + old_size, 0,
-                new_size - old_size);
+  auto segment = new ObjectTableEntry[kSegmentSlotCount];
+  segments_[segment_index].store(segment, std::memory_order_release);
+  table_capacity_.store(capacity + kSegmentSlotCount,
+                        std::memory_order_release);
+  for (uint32_t i = 0; i < kSegmentSlotCount; ++i) {
+    // Never allow 0 handles.
+    if (capacity + i) {
+      free_slots_.push_back(capacity + i);
+    }
   }
-
-  last_free_entry_ = table_capacity_;
-  table_capacity_ = new_capacity;
-  table_ = new_table;
-
   return true;
 }
 
@@ -101,7 +89,7 @@ X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
 
   uint32_t handle = 0;
   {
-    auto global_lock = global_critical_region_.Acquire();
+    std::lock_guard<std::mutex> lock(mutex_);
 
     // Find a free slot.
     uint32_t slot = 0;
@@ -109,14 +97,20 @@ X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
 
     // Stash.
     if (XSUCCEEDED(result)) {
-      ObjectTableEntry& entry = table_[slot];
-      entry.object = object;
-      entry.handle_ref_count = 1;
-      handle = XObject::kHandleBase + (slot << 2);
+      ObjectTableEntry* entry = GetEntry(slot);
+      uint32_t generation =
+          StateGeneration(entry->state.load(std::memory_order_relaxed));
+      handle = MakeHandle(slot, generation);
       object->handles().push_back(handle);
 
       // Retain so long as the object is in the table.
       object->Retain();
+      entry->object.store(object, std::memory_order_relaxed);
+
+      // Make the handle valid for lookups.
+      entry->state.store(
+          uint64_t(generation) << kStateGenerationShift | kStateHandleRef,
+          std::memory_order_release);
 
       XELOGI("Added handle:{:08X} for {}", handle, typeid(*object).name());
     }
@@ -135,7 +129,7 @@ X_STATUS ObjectTable::DuplicateHandle(X_HANDLE handle, X_HANDLE* out_handle) {
   X_STATUS result = X_STATUS_SUCCESS;
   handle = TranslateHandle(handle);
 
-  XObject* object = LookupObject(handle, false);
+  XObject* object = LookupObject(handle);
   if (object) {
     result = AddHandle(object, out_handle);
     object->Release();  // Release the ref that LookupObject took
@@ -147,28 +141,46 @@ X_STATUS ObjectTable::DuplicateHandle(X_HANDLE handle, X_HANDLE* out_handle) {
 }
 
 X_STATUS ObjectTable::RetainHandle(X_HANDLE handle) {
-  auto global_lock = global_critical_region_.Acquire();
-
+  handle = TranslateHandle(handle);
   ObjectTableEntry* entry = LookupTable(handle);
   if (!entry) {
     return X_STATUS_INVALID_HANDLE;
   }
 
-  entry->handle_ref_count++;
+  uint32_t generation = GetHandleGeneration(handle);
+  uint64_t state = entry->state.load(std::memory_order_relaxed);
+  do {
+    if (StateGeneration(state) != generation ||
+        !StateHandleRefCount(state)) {
+      return X_STATUS_INVALID_HANDLE;
+    }
+  } while (!entry->state.compare_exchange_weak(state, state + kStateHandleRef,
+                                               std::memory_order_relaxed));
   return X_STATUS_SUCCESS;
 }
 
 X_STATUS ObjectTable::ReleaseHandle(X_HANDLE handle) {
-  auto global_lock = global_critical_region_.Acquire();
-
+  handle = TranslateHandle(handle);
   ObjectTableEntry* entry = LookupTable(handle);
   if (!entry) {
     return X_STATUS_INVALID_HANDLE;
   }
 
-  if (--entry->handle_ref_count == 0) {
+  uint32_t generation = GetHandleGeneration(handle);
+  uint64_t state = entry->state.load(std::memory_order_relaxed);
+  uint64_t new_state;
+  do {
+    if (StateGeneration(state) != generation ||
+        !StateHandleRefCount(state)) {
+      return X_STATUS_INVALID_HANDLE;
+    }
+    new_state = state - kStateHandleRef;
+  } while (!entry->state.compare_exchange_weak(state, new_state,
+                                               std::memory_order_acq_rel));
+
+  if (!StateHandleRefCount(new_state) && !StatePinCount(new_state)) {
     // No more references. Remove it from the table.
-    return RemoveHandle(handle);
+    FreeEntry(entry, handle);
   }
 
   // FIXME: Return a status code telling the caller it wasn't released
@@ -177,51 +189,103 @@ X_STATUS ObjectTable::ReleaseHandle(X_HANDLE handle) {
 }
 
 X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
-  X_STATUS result = X_STATUS_SUCCESS;
-
   handle = TranslateHandle(handle);
-  if (!handle) {
-    return X_STATUS_INVALID_HANDLE;
-  }
-
   ObjectTableEntry* entry = LookupTable(handle);
   if (!entry) {
     return X_STATUS_INVALID_HANDLE;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
-  if (entry->object) {
-    auto object = entry->object;
-    entry->object = nullptr;
-    assert_zero(entry->handle_ref_count);
-    entry->handle_ref_count = 0;
+  // Drop all references to the handle.
+  uint32_t generation = GetHandleGeneration(handle);
+  uint64_t state = entry->state.load(std::memory_order_relaxed);
+  uint64_t new_state;
+  do {
+    if (StateGeneration(state) != generation ||
+        !StateHandleRefCount(state)) {
+      return X_STATUS_INVALID_HANDLE;
+    }
+    new_state = state & ~(kStateCountMask * kStateHandleRef);
+  } while (!entry->state.compare_exchange_weak(state, new_state,
+                                               std::memory_order_acq_rel));
+
+  if (!StatePinCount(new_state)) {
+    FreeEntry(entry, handle);
+  }
+
+  return X_STATUS_SUCCESS;
+}
+
+bool ObjectTable::PinEntry(ObjectTableEntry* entry, X_HANDLE handle) {
+  uint32_t generation = GetHandleGeneration(handle);
+  uint64_t state = entry->state.load(std::memory_order_acquire);
+  do {
+    if (StateGeneration(state) != generation ||
+        !StateHandleRefCount(state)) {
+      return false;
+    }
+  } while (!entry->state.compare_exchange_weak(state, state + kStatePin,
+                                               std::memory_order_acquire));
+  return true;
+}
+
+void ObjectTable::UnpinEntry(ObjectTableEntry* entry, X_HANDLE handle) {
+  uint64_t state =
+      entry->state.fetch_sub(kStatePin, std::memory_order_acq_rel) -
+      kStatePin;
+  if (!StateHandleRefCount(state) && !StatePinCount(state)) {
+    // The handle was closed during the lookup.
+    FreeEntry(entry, handle);
+  }
+}
 
-    // Walk the object's handles and remove this one.
-    auto handle_entry =
-        std::find(object->handles().begin(), object->handles().end(), handle);
-    if (handle_entry != object->handles().end()) {
-      object->handles().erase(handle_entry);
+void ObjectTable::FreeEntry(ObjectTableEntry* entry, X_HANDLE handle) {
+  XObject* object;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    object = entry->object.exchange(nullptr, std::memory_order_acquire);
+    if (object) {
+      // Walk the object's handles and remove this one.
+      auto handle_entry = std::find(object->handles().begin(),
+                                    object->handles().end(), handle);
+      if (handle_entry != object->handles().end()) {
+        object->handles().erase(handle_entry);
+      }
     }
 
+    // Invalidate the handle and reuse the slot.
+    uint32_t generation =
+        (GetHandleGeneration(handle) + 1) & ((1u << kGenerationBits) - 1);
+    entry->state.store(uint64_t(generation) << kStateGenerationShift,
+                       std::memory_order_release);
+    free_slots_.push_back(GetHandleSlot(handle));
+  }
+
+  if (object) {
     XELOGI("Removed handle:{:08X} for {}", handle, typeid(*object).name());
 
     // Release now that the object has been removed from the table.
     object->Release();
   }
-
-  return X_STATUS_SUCCESS;
 }
 
 std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
-  auto lock = global_critical_region_.Acquire();
   std::vector<object_ref<XObject>> results;
 
-  for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && std::find(results.begin(), results.end(),
-                                  entry.object) == results.end()) {
-      entry.object->Retain();
-      results.push_back(object_ref<XObject>(entry.object));
+  uint32_t capacity = table_capacity_.load(std::memory_order_acquire);
+  for (uint32_t slot = 0; slot < capacity; slot++) {
+    ObjectTableEntry* entry = GetEntry(slot);
+    if (!entry) {
+      break;
+    }
+    uint64_t state = entry->state.load(std::memory_order_relaxed);
+    if (!StateHandleRefCount(state)) {
+      continue;
+    }
+    auto object = object_ref<XObject>(
+        LookupObject(MakeHandle(slot, StateGeneration(state))));
+    if (object && std::find(results.begin(), results.end(), object.get()) ==
+                      results.end()) {
+      results.push_back(std::move(object));
     }
   }
 
@@ -229,87 +293,81 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
 }
 
 void ObjectTable::PurgeAllObjects() {
-  auto lock = global_critical_region_.Acquire();
-  for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && !entry.object->is_host_object()) {
-      entry.handle_ref_count = 0;
-      entry.object->Release();
-
-      entry.object = nullptr;
+  uint32_t capacity = table_capacity_.load(std::memory_order_acquire);
+  for (uint32_t slot = 0; slot < capacity; slot++) {
+    ObjectTableEntry* entry = GetEntry(slot);
+    if (!entry) {
+      break;
+    }
+    uint64_t state = entry->state.load(std::memory_order_relaxed);
+    if (!StateHandleRefCount(state)) {
+      continue;
+    }
+    X_HANDLE handle = MakeHandle(slot, StateGeneration(state));
+    auto object = object_ref<XObject>(LookupObject(handle));
+    if (object && !object->is_host_object()) {
+      RemoveHandle(handle);
     }
   }
 }
 
 ObjectTable::ObjectTableEntry* ObjectTable::LookupTable(X_HANDLE handle) {
-  handle = TranslateHandle(handle);
-  if (!handle) {
+  if (handle < XObject::kHandleBase) {
     return nullptr;
   }
+  return GetEntry(GetHandleSlot(handle));
+}
 
-  auto global_lock = global_critical_region_.Acquire();
-
-  // Lower 2 bits are ignored.
-  uint32_t slot = GetHandleSlot(handle);
-  if (slot <= table_capacity_) {
-    return &table_[slot];
+ObjectTable::ObjectTableEntry* ObjectTable::GetEntry(uint32_t slot) const {
+  auto segment = segments_[slot >> kSegmentSlotCountLog2].load(
+      std::memory_order_acquire);
+  if (!segment) {
+    return nullptr;
   }
-
-  return nullptr;
+  return &segment[slot & (kSegmentSlotCount - 1)];
 }
 
 // Generic lookup
 template <>
 object_ref<XObject> ObjectTable::LookupObject<XObject>(X_HANDLE handle) {
-  auto object = ObjectTable::LookupObject(handle, false);
+  auto object = ObjectTable::LookupObject(handle);
   auto result = object_ref<XObject>(reinterpret_cast<XObject*>(object));
   return result;
 }
 
-XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
+XObject* ObjectTable::LookupObject(X_HANDLE handle) {
   handle = TranslateHandle(handle);
-  if (!handle) {
+  ObjectTableEntry* entry = LookupTable(handle);
+  if (!entry || !PinEntry(entry, handle)) {
     return nullptr;
   }
 
-  XObject* object = nullptr;
-  if (!already_locked) {
-    global_critical_region_.mutex().lock();
-  }
-
-  // Lower 2 bits are ignored.
-  uint32_t slot = GetHandleSlot(handle);
-
-  // Verify slot.
-  if (slot < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (entry.object) {
-      object = entry.object;
-    }
-  }
-
-  // Retain the object pointer.
+  // Retain the object pointer. The pin keeps it in the table until then.
+  XObject* object = entry->object.load(std::memory_order_acquire);
   if (object) {
     object->Retain();
   }
 
-  if (!already_locked) {
-    global_critical_region_.mutex().unlock();
-  }
-
+  UnpinEntry(entry, handle);
   return object;
 }
 
 void ObjectTable::GetObjectsByType(XObject::Type type,
                                    std::vector<object_ref<XObject>>* results) {
-  auto global_lock = global_critical_region_.Acquire();
-  for (uint32_t slot = 0; slot < table_capacity_; ++slot) {
-    auto& entry = table_[slot];
-    if (entry.object) {
-      if (entry.object->type() == type) {
-        entry.object->Retain();
-        results->push_back(object_ref<XObject>(entry.object));
-      }
+  uint32_t capacity = table_capacity_.load(std::memory_order_acquire);
+  for (uint32_t slot = 0; slot < capacity; ++slot) {
+    ObjectTableEntry* entry = GetEntry(slot);
+    if (!entry) {
+      break;
+    }
+    uint64_t state = entry->state.load(std::memory_order_relaxed);
+    if (!StateHandleRefCount(state)) {
+      continue;
+    }
+    auto object = object_ref<XObject>(
+        LookupObject(MakeHandle(slot, StateGeneration(state))));
+    if (object && object->type() == type) {
+      results->push_back(std::move(object));
     }
   }
 }
@@ -329,7 +387,7 @@ X_HANDLE ObjectTable::TranslateHandle(X_HANDLE handle) {
 
 X_STATUS ObjectTable::AddNameMapping(const std::string_view name,
                                      X_HANDLE handle) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
   if (name_table_.count(string_key_case(name))) {
     return X_STATUS_OBJECT_NAME_COLLISION;
   }
@@ -339,7 +397,7 @@ X_STATUS ObjectTable::AddNameMapping(const std::string_view name,
 
 void ObjectTable::RemoveNameMapping(const std::string_view name) {
   // Names are case-insensitive.
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
   auto it = name_table_.find(string_key_case(name));
   if (it != name_table_.end()) {
     name_table_.erase(it);
@@ -348,17 +406,21 @@ void ObjectTable::RemoveNameMapping(const std::string_view name) {
 
 X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
                                       X_HANDLE* out_handle) {
-  // Names are case-insensitive.
-  auto global_lock = global_critical_region_.Acquire();
-  auto it = name_table_.find(string_key_case(name));
-  if (it == name_table_.end()) {
-    *out_handle = X_INVALID_HANDLE_VALUE;
-    return X_STATUS_OBJECT_NAME_NOT_FOUND;
+  X_HANDLE handle;
+  {
+    // Names are case-insensitive.
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = name_table_.find(string_key_case(name));
+    if (it == name_table_.end()) {
+      *out_handle = X_INVALID_HANDLE_VALUE;
+      return X_STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+    handle = it->second;
   }
-  *out_handle = it->second;
+  *out_handle = handle;
 
   // We need to ref the handle. I think.
-  auto obj = LookupObject(it->second, true);
+  auto obj = LookupObject(handle);
   if (obj) {
     obj->RetainHandle();
     obj->Release();
@@ -368,33 +430,48 @@ X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
 }
 
 bool ObjectTable::Save(ByteStream* stream) {
-  stream->Write<uint32_t>(table_capacity_);
-  for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
-    stream->Write<int32_t>(entry.handle_ref_count);
+  uint32_t capacity = table_capacity_.load(std::memory_order_acquire);
+  stream->Write<uint32_t>(capacity);
+  for (uint32_t i = 0; i < capacity; i++) {
+    uint64_t state = GetEntry(i)->state.load(std::memory_order_relaxed);
+    stream->Write<int32_t>(int32_t(StateHandleRefCount(state)));
+    stream->Write<uint32_t>(StateGeneration(state));
   }
 
   return true;
 }
 
 bool ObjectTable::Restore(ByteStream* stream) {
-  Resize(stream->Read<uint32_t>());
-  for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
-    // entry.object = nullptr;
-    entry.handle_ref_count = stream->Read<int32_t>();
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint32_t capacity = stream->Read<uint32_t>();
+  while (table_capacity_ < capacity) {
+    if (!AddSegment()) {
+      return false;
+    }
+  }
+  free_slots_.clear();
+  for (uint32_t i = 0; i < capacity; i++) {
+    // The objects are restored with RestoreHandle.
+    auto handle_ref_count = uint32_t(stream->Read<int32_t>());
+    uint32_t generation = stream->Read<uint32_t>();
+    GetEntry(i)->state.store(
+        uint64_t(generation) << kStateGenerationShift |
+            handle_ref_count * kStateHandleRef,
+        std::memory_order_relaxed);
+    if (!handle_ref_count && i) {
+      free_slots_.push_back(i);
+    }
   }
 
   return true;
 }
 
 X_STATUS ObjectTable::RestoreHandle(X_HANDLE handle, XObject* object) {
-  uint32_t slot = GetHandleSlot(handle);
-  assert_true(table_capacity_ >= slot);
+  ObjectTableEntry* entry = LookupTable(handle);
+  assert_not_null(entry);
 
-  if (table_capacity_ >= slot) {
-    auto& entry = table_[slot];
-    entry.object = object;
+  if (entry) {
+    entry->object.store(object, std::memory_order_release);
     object->Retain();
   }
 
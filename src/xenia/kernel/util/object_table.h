@@ -10,6 +10,11 @@
 #ifndef XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 #define XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -27,6 +32,13 @@ namespace xe {
 namespace kernel {
 namespace util {
 
+// Handles are looked up, retained and released without locking, as nearly
+// every kernel call takes one. Slots are in segments that are never moved or
+// freed until the table is reset, and the state of each slot is a single
+// atomic word with the handle reference count and the generation of the slot,
+// which is also in the handle so that stale handles to reused slots are
+// rejected. Only adding and removing handles, growing the table and the name
+// map take a lock.
 class ObjectTable {
  public:
   ObjectTable();
@@ -49,7 +61,7 @@ class ObjectTable {
 
   template <typename T>
   object_ref<T> LookupObject(X_HANDLE handle) {
-    auto object = LookupObject(handle, false);
+    auto object = LookupObject(handle);
     if (object) {
       assert_true(object->type() == T::kType);
     }
@@ -81,27 +93,76 @@ class ObjectTable {
   void PurgeAllObjects();  // Purges the object table of all guest objects
 
  private:
+  // Handle layout: kHandleBase | generation << 18 | slot << 2. The lower 2 bits
+  // are ignored.
+  static constexpr uint32_t kSlotBits = 16;
+  static constexpr uint32_t kGenerationBits = 9;
+  static constexpr uint32_t kSegmentSlotCountLog2 = 10;
+  static constexpr uint32_t kSegmentSlotCount = 1u << kSegmentSlotCountLog2;
+  static constexpr uint32_t kSegmentCount =
+      (1u << kSlotBits) / kSegmentSlotCount;
+  static_assert(2 + kSlotBits + kGenerationBits <= 27,
+                "Handles must be above kHandleBase");
+
+  // Entry state: lookups in progress in bits 0-23, handle references in bits
+  // 24-47, generation in bits 48-63. Lookups pin the entry so the object isn't
+  // released before they retain it, and the object is released by whichever
+  // thread drops the last handle reference or pin.
+  static constexpr uint64_t kStatePin = 1;
+  static constexpr uint64_t kStateHandleRef = uint64_t(1) << 24;
+  static constexpr uint64_t kStateCountMask = (uint64_t(1) << 24) - 1;
+  static constexpr uint32_t kStateGenerationShift = 48;
+  static constexpr uint32_t StatePinCount(uint64_t state) {
+    return uint32_t(state & kStateCountMask);
+  }
+  static constexpr uint32_t StateHandleRefCount(uint64_t state) {
+    return uint32_t((state >> 24) & kStateCountMask);
+  }
+  static constexpr uint32_t StateGeneration(uint64_t state) {
+    return uint32_t(state >> kStateGenerationShift);
+  }
+
   struct ObjectTableEntry {
-    int handle_ref_count = 0;
-    XObject* object = nullptr;
+    std::atomic<uint64_t> state{0};
+    std::atomic<XObject*> object{nullptr};
   };
 
+  static constexpr uint32_t GetHandleSlot(X_HANDLE handle) {
+    return ((handle - XObject::kHandleBase) >> 2) & ((1u << kSlotBits) - 1);
+  }
+  static constexpr uint32_t GetHandleGeneration(X_HANDLE handle) {
+    return ((handle - XObject::kHandleBase) >> (2 + kSlotBits)) &
+           ((1u << kGenerationBits) - 1);
+  }
+  static constexpr X_HANDLE MakeHandle(uint32_t slot, uint32_t generation) {
+    return XObject::kHandleBase | generation << (2 + kSlotBits) | slot << 2;
+  }
+
+  // Returns the entry for the slot of the handle, without checking whether
+  // the handle is valid.
   ObjectTableEntry* LookupTable(X_HANDLE handle);
-  XObject* LookupObject(X_HANDLE handle, bool already_locked);
+  ObjectTableEntry* GetEntry(uint32_t slot) const;
+  XObject* LookupObject(X_HANDLE handle);
+  // Pins the entry if the handle is valid.
+  bool PinEntry(ObjectTableEntry* entry, X_HANDLE handle);
+  void UnpinEntry(ObjectTableEntry* entry, X_HANDLE handle);
+  // Releases the object of the entry once it has no handle references or
+  // pins, and frees the slot.
+  void FreeEntry(ObjectTableEntry* entry, X_HANDLE handle);
   void GetObjectsByType(XObject::Type type,
                         std::vector<object_ref<XObject>>* results);
 
   X_HANDLE TranslateHandle(X_HANDLE handle);
-  static constexpr uint32_t GetHandleSlot(X_HANDLE handle) {
-    return (handle - XObject::kHandleBase) >> 2;
-  }
   X_STATUS FindFreeSlot(uint32_t* out_slot);
-  bool Resize(uint32_t new_capacity);
-
-  xe::global_critical_region global_critical_region_;
-  uint32_t table_capacity_ = 0;
-  ObjectTableEntry* table_ = nullptr;
-  uint32_t last_free_entry_ = 0;
+  bool AddSegment();
+
+  // Guards the free slots, adding segments, the handle lists of the objects,
+  // and the name map.
+  std::mutex mutex_;
+  std::array<std::atomic<ObjectTableEntry*>, kSegmentCount> segments_ = {};
+  std::atomic<uint32_t> table_capacity_{0};
+  // Reused in order, so slots of closed handles are reused late.
+  std::deque<uint32_t> free_slots_;
   std::unordered_map<string_key_case, X_HANDLE> name_table_;
 };
 
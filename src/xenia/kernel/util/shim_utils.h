@@ -22,6 +22,7 @@
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/kernel/kernel_flags.h"
 #include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/util/kernel_call_profiler.h"
 
 namespace xe {
 namespace kernel {
@@ -465,6 +466,18 @@ enum class KernelModuleId {
   xbdm,
 };
 
+constexpr const char* GetKernelModuleName(KernelModuleId module) {
+  switch (module) {
+    case KernelModuleId::xboxkrnl:
+      return "xboxkrnl.exe";
+    case KernelModuleId::xam:
+      return "xam.xex";
+    case KernelModuleId::xbdm:
+      return "xbdm.xex";
+  }
+  return "";
+}
+
 template <size_t I = 0, typename... Ps>
 typename std::enable_if<I == sizeof...(Ps)>::type AppendKernelCallParams(
     StringBuffer& string_buffer, xe::cpu::Export* export_entry,
@@ -514,6 +527,9 @@ xe::cpu::Export* RegisterExport(R (*fn)(Ps&...), const char* name,
       ORDINAL, xe::cpu::Export::Type::kFunction, name,
       tags | xe::cpu::ExportTag::kImplemented | xe::cpu::ExportTag::kLog);
   static R (*FN)(Ps & ...) = fn;
+  static const uint32_t profile_index =
+      util::KernelCallProfiler::RegisterExport(GetKernelModuleName(MODULE),
+                                               export_entry);
   struct X {
     static void Trampoline(PPCContext* ppc_context) {
       ++export_entry->function_data.call_count;
@@ -528,6 +544,7 @@ xe::cpu::Export* RegisterExport(R (*fn)(Ps&...), const char* name,
            cvars::log_high_frequency_kernel_calls)) {
         PrintKernelCall(export_entry, params);
       }
+      util::ScopedKernelCallProfile profile(profile_index);
       auto result =
           KernelTrampoline(FN, std::forward<std::tuple<Ps...>>(params),
                            std::make_index_sequence<sizeof...(Ps)>());
@@ -549,6 +566,9 @@ xe::cpu::Export* RegisterExport(void (*fn)(Ps&...), const char* name,
       ORDINAL, xe::cpu::Export::Type::kFunction, name,
       tags | xe::cpu::ExportTag::kImplemented | xe::cpu::ExportTag::kLog);
   static void (*FN)(Ps & ...) = fn;
+  static const uint32_t profile_index =
+      util::KernelCallProfiler::RegisterExport(GetKernelModuleName(MODULE),
+                                               export_entry);
   struct X {
     static void Trampoline(PPCContext* ppc_context) {
       ++export_entry->function_data.call_count;
@@ -562,6 +582,7 @@ xe::cpu::Export* RegisterExport(void (*fn)(Ps&...), const char* name,
            cvars::log_high_frequency_kernel_calls)) {
         PrintKernelCall(export_entry, params);
       }
+      util::ScopedKernelCallProfile profile(profile_index);
       KernelTrampoline(FN, std::forward<std::tuple<Ps...>>(params),
                        std::make_index_sequence<sizeof...(Ps)>());
     }
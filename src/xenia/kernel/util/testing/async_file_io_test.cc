@@ -0,0 +1,123 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/async_file_io.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+namespace test {
+using namespace std::chrono_literals;
+
+TEST_CASE("ASYNC_FILE_IO_BYTE_OFFSET", "[async_file_io]") {
+  REQUIRE(!IsFilePositionByteOffset(0));
+  REQUIRE(!IsFilePositionByteOffset(0x00000001FFFFFFFEull));
+  // FILE_USE_FILE_POINTER_POSITION and FILE_WRITE_TO_END_OF_FILE.
+  REQUIRE(IsFilePositionByteOffset(0xFFFFFFFFFFFFFFFEull));
+  REQUIRE(IsFilePositionByteOffset(0xFFFFFFFFFFFFFFFFull));
+}
+
+TEST_CASE("ASYNC_FILE_IO_COMPLETION", "[async_file_io]") {
+  struct Request {
+    X_IO_STATUS_BLOCK io_status_block;
+    std::unique_ptr<threading::Event> event;
+    // Status block contents seen by the APC.
+    std::atomic<uint32_t> apc_count{0};
+    X_STATUS apc_status = X_STATUS_UNSUCCESSFUL;
+    uint32_t apc_information = UINT32_MAX;
+  };
+  constexpr uint32_t kRequestCount = 64;
+  std::vector<Request> requests(kRequestCount);
+  // Holds the operations back to check the state before they complete.
+  auto start_event = threading::Event::CreateManualResetEvent(false);
+
+  vfs::IoWorkerPool pool(4);
+  for (uint32_t i = 0; i < kRequestCount; ++i) {
+    Request& request = requests[i];
+    request.io_status_block.status = X_STATUS_UNSUCCESSFUL;
+    request.io_status_block.information = UINT32_MAX;
+    request.event = threading::Event::CreateManualResetEvent(false);
+    AsyncIoCompletion completion;
+    completion.io_status_block = &request.io_status_block;
+    completion.signal_event = [&request]() { request.event->Set(); };
+    completion.queue_apc = [&request]() {
+      request.apc_status = request.io_status_block.status;
+      request.apc_information = request.io_status_block.information;
+      ++request.apc_count;
+    };
+    // Every fourth request fails.
+    QueueAsyncIo(
+        pool,
+        [&start_event, i](uint32_t& information) {
+          threading::Wait(start_event.get(), false);
+          information = i * 16;
+          return (i & 3) == 3 ? X_STATUS_END_OF_FILE : X_STATUS_SUCCESS;
+        },
+        std::move(completion));
+    REQUIRE(request.io_status_block.status == X_STATUS_PENDING);
+    REQUIRE(request.io_status_block.information == 0);
+  }
+  for (const Request& request : requests) {
+    REQUIRE(threading::Wait(request.event.get(), false, 0ms) ==
+            threading::WaitResult::kTimeout);
+  }
+
+  start_event->Set();
+  for (uint32_t i = 0; i < kRequestCount; ++i) {
+    Request& request = requests[i];
+    REQUIRE(threading::Wait(request.event.get(), false, 5s) ==
+            threading::WaitResult::kSuccess);
+    X_STATUS expected_status =
+        (i & 3) == 3 ? X_STATUS_END_OF_FILE : X_STATUS_SUCCESS;
+    uint32_t expected_information = (i & 3) == 3 ? 0 : i * 16;
+    REQUIRE(request.io_status_block.status == expected_status);
+    REQUIRE(request.io_status_block.information == expected_information);
+  }
+  // The APCs are queued after the event is signaled.
+  for (uint32_t i = 0; i < kRequestCount; ++i) {
+    Request& request = requests[i];
+    for (int j = 0; j < 5000 && !request.apc_count; ++j) {
+      threading::Sleep(1ms);
+    }
+    REQUIRE(request.apc_count == 1);
+    REQUIRE(request.apc_status == request.io_status_block.status);
+    REQUIRE(request.apc_information == request.io_status_block.information);
+  }
+}
+
+TEST_CASE("ASYNC_FILE_IO_NO_TARGETS", "[async_file_io]") {
+  // Requests without a status block, event or APC still execute.
+  std::atomic<uint32_t> executed_count(0);
+  {
+    vfs::IoWorkerPool pool(2);
+    for (uint32_t i = 0; i < 16; ++i) {
+      QueueAsyncIo(
+          pool,
+          [&executed_count](uint32_t& information) {
+            ++executed_count;
+            return X_STATUS_SUCCESS;
+          },
+          AsyncIoCompletion());
+    }
+  }
+  REQUIRE(executed_count == 16);
+}
+
+}  // namespace test
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
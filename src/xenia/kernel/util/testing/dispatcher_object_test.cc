@@ -0,0 +1,232 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/xdispatcherobject.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/base/testing/util.h"
+#include "xenia/base/threading.h"
+#include "xenia/kernel/xevent.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+namespace test {
+using namespace std::chrono_literals;
+
+// Relative timeout in 100-nanosecond guest ticks.
+constexpr uint64_t kTimeout50Ms = uint64_t(-500000);
+constexpr uint64_t kTimeout5S = uint64_t(-50000000);
+
+// Event with its dispatch header in host memory, like a guest KEVENT.
+class TestEvent {
+ public:
+  explicit TestEvent(bool manual_reset) {
+    header_.type = manual_reset ? 0x00 : 0x01;
+    header_.signal_state = 0;
+    event_ = object_ref<XEvent>(new XEvent(nullptr));
+    event_->InitializeNative(nullptr, &header_);
+  }
+
+  XEvent* get() const { return event_.get(); }
+  XEvent* operator->() const { return event_.get(); }
+  int32_t signal_state() const { return header_.signal_state; }
+
+ private:
+  X_DISPATCH_HEADER header_ = {};
+  object_ref<XEvent> event_;
+};
+
+// Object waited for through a host semaphore, like a thread or a mutant.
+class TestHostObject : public XObject {
+ public:
+  static const XObject::Type kType = XObject::kTypeSemaphore;
+
+  TestHostObject() : XObject(kType) {
+    semaphore_ = xe::threading::Semaphore::Create(1, 1);
+  }
+
+  bool is_available() {
+    if (xe::threading::Wait(semaphore_.get(), false, 0ms) !=
+        xe::threading::WaitResult::kSuccess) {
+      return false;
+    }
+    int previous_count;
+    semaphore_->Release(1, &previous_count);
+    return true;
+  }
+
+  std::atomic<uint32_t> wait_callback_count{0};
+  std::atomic<uint32_t> undo_wait_count{0};
+
+ protected:
+  xe::threading::WaitHandle* GetWaitHandle() override {
+    return semaphore_.get();
+  }
+  void WaitCallback() override { ++wait_callback_count; }
+  void UndoWait() override {
+    ++undo_wait_count;
+    int previous_count;
+    semaphore_->Release(1, &previous_count);
+  }
+
+ private:
+  std::unique_ptr<xe::threading::Semaphore> semaphore_;
+};
+
+// Seems signaled, but can't be acquired, like an object taken by another
+// thread between the checks of a wait for all objects.
+class TestStolenObject : public XDispatcherObject {
+ public:
+  TestStolenObject() : XDispatcherObject(nullptr, kTypeEvent) {}
+
+  void Signal() override {}
+
+ protected:
+  bool IsSignaled() const override { return true; }
+  bool TryAcquire() override { return false; }
+  void UndoAcquire() override {}
+};
+
+TEST_CASE("DISPATCHER_OBJECT_PULSE", "[dispatcher_object]") {
+  // A pulse of a manual-reset event releases all waiting threads, without
+  // leaving the event signaled.
+  TestEvent event(true);
+  TestEvent other_event(true);
+  constexpr uint32_t kThreadCount = 4;
+  std::atomic<uint32_t> started_count(0);
+  std::vector<X_STATUS> results(kThreadCount, X_STATUS_UNSUCCESSFUL);
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&, i]() {
+      uint64_t timeout = kTimeout5S;
+      ++started_count;
+      if (i & 1) {
+        // Waits for several objects use wait blocks instead.
+        XObject* objects[] = {other_event.get(), event.get()};
+        results[i] = XDispatcherObject::WaitMultiple(2, objects, false, false,
+                                                     &timeout);
+      } else {
+        results[i] = event->WaitSingle(false, &timeout);
+      }
+    });
+  }
+  while (started_count != kThreadCount) {
+    xe::threading::Sleep(1ms);
+  }
+  xe::threading::Sleep(100ms);
+  REQUIRE(event->Pulse(0, false) == 0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    REQUIRE(results[i] == X_STATUS((i & 1) ? 1 : 0));
+  }
+  REQUIRE(event.signal_state() == 0);
+
+  // Later waits aren't satisfied by it.
+  uint64_t timeout = kTimeout50Ms;
+  REQUIRE(event->WaitSingle(false, &timeout) == X_STATUS_TIMEOUT);
+}
+
+TEST_CASE("DISPATCHER_OBJECT_WAIT_ALL", "[dispatcher_object]") {
+  TestEvent event(false);
+  auto host_object = object_ref<TestHostObject>(new TestHostObject());
+
+  // The host object isn't acquired while the event isn't signaled.
+  {
+    XObject* objects[] = {event.get(), host_object.get()};
+    uint64_t timeout = kTimeout50Ms;
+    REQUIRE(XDispatcherObject::WaitMultiple(2, objects, true, false,
+                                            &timeout) == X_STATUS_TIMEOUT);
+    REQUIRE(host_object->is_available());
+    REQUIRE(host_object->wait_callback_count == 0);
+  }
+
+  // The host object is released if the other objects can't be acquired after
+  // it, and not kept when the wait times out.
+  {
+    auto stolen_object = object_ref<TestStolenObject>(new TestStolenObject());
+    XObject* objects[] = {stolen_object.get(), host_object.get()};
+    uint64_t timeout = kTimeout50Ms;
+    REQUIRE(XDispatcherObject::WaitMultiple(2, objects, true, false,
+                                            &timeout) == X_STATUS_TIMEOUT);
+    REQUIRE(host_object->undo_wait_count != 0);
+    REQUIRE(host_object->wait_callback_count == 0);
+    REQUIRE(host_object->is_available());
+  }
+
+  // Satisfied once the event is signaled from another thread, acquiring both.
+  {
+    XObject* objects[] = {event.get(), host_object.get()};
+    std::thread thread([&]() {
+      xe::threading::Sleep(20ms);
+      event->Set(0, false);
+    });
+    uint64_t timeout = kTimeout5S;
+    REQUIRE(XDispatcherObject::WaitMultiple(2, objects, true, false,
+                                            &timeout) == X_STATUS_SUCCESS);
+    thread.join();
+    REQUIRE(event.signal_state() == 0);
+    REQUIRE(host_object->wait_callback_count == 1);
+    REQUIRE(!host_object->is_available());
+  }
+}
+
+TEST_CASE("DISPATCHER_OBJECT_BENCHMARK", "[.benchmark]") {
+  // Round trips between two threads signaling each other through auto-reset
+  // events, as guest threads do with KeSetEvent and KeWaitForSingleObject or
+  // KeWaitForMultipleObjects.
+  constexpr uint32_t kRoundTripCount = 200000;
+  for (bool wait_multiple : {false, true}) {
+    TestEvent ping(false);
+    TestEvent pong(false);
+    TestEvent unused(false);
+    auto wait = [&](XEvent* event) {
+      if (wait_multiple) {
+        XObject* objects[] = {unused.get(), event};
+        return XDispatcherObject::WaitMultiple(2, objects, false, false,
+                                               nullptr) == 1;
+      }
+      return event->WaitSingle(false, nullptr) == X_STATUS_SUCCESS;
+    };
+    std::atomic<uint32_t> failure_count(0);
+    testing::BenchmarkTimer timer;
+    std::thread thread([&]() {
+      for (uint32_t i = 0; i < kRoundTripCount; ++i) {
+        if (!wait(ping.get())) {
+          ++failure_count;
+        }
+        pong->Set(0, false);
+      }
+    });
+    for (uint32_t i = 0; i < kRoundTripCount; ++i) {
+      ping->Set(0, false);
+      if (!wait(pong.get())) {
+        ++failure_count;
+      }
+    }
+    thread.join();
+    double seconds = timer.seconds();
+    REQUIRE(failure_count == 0);
+    WARN((wait_multiple ? "WaitMultiple" : "WaitSingle")
+         << ": " << seconds * 1e6 / kRoundTripCount << " us per round trip");
+  }
+}
+
+}  // namespace test
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
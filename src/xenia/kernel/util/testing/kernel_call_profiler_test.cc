@@ -0,0 +1,128 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/kernel_call_profiler.h"
+
+#include <thread>
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/cpu/export_resolver.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+namespace test {
+
+TEST_CASE("KERNEL_CALL_PROFILER", "[kernel_call_profiler]") {
+  static cpu::Export wait_export(1, cpu::Export::Type::kFunction,
+                                 "TestWaitForObject",
+                                 cpu::ExportTag::kBlocking);
+  static cpu::Export query_export(2, cpu::Export::Type::kFunction,
+                                  "TestQueryValue");
+  static const uint32_t wait_index =
+      KernelCallProfiler::RegisterExport("test.xex", &wait_export);
+  static const uint32_t query_index =
+      KernelCallProfiler::RegisterExport("test.xex", &query_export);
+  KernelCallProfiler::Reset();
+
+  uint64_t ticks_per_ms = Clock::QueryHostTickFrequency() / 1000;
+  KernelCallProfiler::Record(query_index, 0);
+  KernelCallProfiler::Record(query_index, 0);
+  std::thread([&]() {
+    KernelCallProfiler::Record(wait_index, ticks_per_ms * 10);
+    KernelCallProfiler::Record(query_index, 0);
+  }).join();
+
+  auto snapshot = KernelCallProfiler::TakeSnapshot();
+  REQUIRE(snapshot.exports.size() == 2);
+  // Sorted by the total time.
+  REQUIRE(snapshot.exports[0].export_entry == &wait_export);
+  REQUIRE(snapshot.exports[0].call_count == 1);
+  REQUIRE(snapshot.exports[0].total_ns >= 9000000);
+  // 10 ms is in the [8192, 16384) us bucket.
+  REQUIRE(snapshot.exports[0].histogram[14] == 1);
+  REQUIRE(snapshot.exports[1].export_entry == &query_export);
+  REQUIRE(snapshot.exports[1].call_count == 3);
+  REQUIRE(snapshot.exports[1].histogram[0] == 3);
+
+  REQUIRE(snapshot.threads.size() == 2);
+  auto& waiting_thread = snapshot.threads[0].exports.size() == 2
+                             ? snapshot.threads[0]
+                             : snapshot.threads[1];
+  REQUIRE(waiting_thread.call_count == 2);
+  REQUIRE(waiting_thread.blocked_ns == snapshot.exports[0].total_ns);
+
+  auto json = KernelCallProfiler::ToJson(snapshot);
+  REQUIRE(json.find("\"name\": \"TestWaitForObject\", \"blocking\": true, "
+                    "\"calls\": 1, \"inline_calls\": 0") != std::string::npos);
+
+  KernelCallProfiler::Reset();
+  REQUIRE(KernelCallProfiler::TakeSnapshot().exports.empty());
+}
+
+TEST_CASE("KERNEL_CALL_PROFILER_LATE_EXPORT", "[kernel_call_profiler]") {
+  static cpu::Export early_export(3, cpu::Export::Type::kFunction,
+                                  "TestEarlyExport");
+  static const uint32_t early_index =
+      KernelCallProfiler::RegisterExport("test.xex", &early_export);
+  KernelCallProfiler::Reset();
+
+  // Registered after the thread's counters have been allocated.
+  std::thread([]() {
+    KernelCallProfiler::Record(early_index, 0);
+    static cpu::Export late_export(4, cpu::Export::Type::kFunction,
+                                   "TestLateExport");
+    uint32_t late_index =
+        KernelCallProfiler::RegisterExport("test.xex", &late_export);
+    KernelCallProfiler::Record(late_index, 0);
+    KernelCallProfiler::Record(early_index, 0);
+  }).join();
+
+  auto snapshot = KernelCallProfiler::TakeSnapshot();
+  REQUIRE(snapshot.exports.size() == 2);
+  for (auto& stats : snapshot.exports) {
+    REQUIRE(stats.call_count ==
+            (stats.export_entry == &early_export ? 2 : 1));
+  }
+  KernelCallProfiler::Reset();
+}
+
+TEST_CASE("KERNEL_CALL_PROFILER_INLINE_CALLS", "[kernel_call_profiler]") {
+  static cpu::Export inline_export(5, cpu::Export::Type::kFunction,
+                                   "TestInlineExport");
+  static const uint32_t inline_index =
+      KernelCallProfiler::RegisterExport("test.xex", &inline_export);
+  // Calls before the reset are not counted.
+  inline_export.function_data.intrinsic_hit_count += 7;
+  KernelCallProfiler::Reset();
+
+  // Completed by the fast path in guest code.
+  inline_export.function_data.intrinsic_hit_count += 3;
+  auto snapshot = KernelCallProfiler::TakeSnapshot();
+  REQUIRE(snapshot.exports.size() == 1);
+  REQUIRE(snapshot.exports[0].export_entry == &inline_export);
+  REQUIRE(snapshot.exports[0].call_count == 0);
+  REQUIRE(snapshot.exports[0].inline_call_count == 3);
+
+  // The slow path goes through the trampoline.
+  KernelCallProfiler::Record(inline_index, 0);
+  snapshot = KernelCallProfiler::TakeSnapshot();
+  REQUIRE(snapshot.exports[0].call_count == 1);
+  REQUIRE(snapshot.exports[0].inline_call_count == 3);
+  REQUIRE(KernelCallProfiler::ToJson(snapshot).find(
+              "\"calls\": 1, \"inline_calls\": 3") != std::string::npos);
+
+  KernelCallProfiler::Reset();
+  REQUIRE(KernelCallProfiler::TakeSnapshot().exports.empty());
+}
+
+}  // namespace test
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
@@ -0,0 +1,154 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/object_table.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/testing/util.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace kernel {
+namespace util {
+namespace test {
+
+class TestObject : public XObject {
+ public:
+  static const XObject::Type kType = XObject::kTypeEvent;
+
+  TestObject() : XObject(kType) {}
+};
+
+TEST_CASE("OBJECT_TABLE_HANDLES", "[object_table]") {
+  ObjectTable table;
+  auto object = object_ref<TestObject>(new TestObject());
+
+  X_HANDLE handle = 0;
+  REQUIRE(table.AddHandle(object.get(), &handle) == X_STATUS_SUCCESS);
+  REQUIRE(handle >= XObject::kHandleBase);
+  REQUIRE(object->handles().size() == 1);
+  REQUIRE(table.LookupObject<TestObject>(handle) == object.get());
+
+  X_HANDLE duplicate_handle = 0;
+  REQUIRE(table.DuplicateHandle(handle, &duplicate_handle) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(duplicate_handle != handle);
+  REQUIRE(table.LookupObject<TestObject>(duplicate_handle) == object.get());
+
+  // References to a handle keep it open.
+  REQUIRE(table.RetainHandle(handle) == X_STATUS_SUCCESS);
+  REQUIRE(table.ReleaseHandle(handle) == X_STATUS_SUCCESS);
+  REQUIRE(table.LookupObject<TestObject>(handle) == object.get());
+  REQUIRE(table.ReleaseHandle(handle) == X_STATUS_SUCCESS);
+  REQUIRE(!table.LookupObject<TestObject>(handle));
+  REQUIRE(table.ReleaseHandle(handle) == X_STATUS_INVALID_HANDLE);
+  REQUIRE(object->handles().size() == 1);
+
+  REQUIRE(table.RemoveHandle(duplicate_handle) == X_STATUS_SUCCESS);
+  REQUIRE(!table.LookupObject<TestObject>(duplicate_handle));
+  REQUIRE(object->handles().empty());
+
+  // Handles to slots of closed handles differ by the generation.
+  std::vector<X_HANDLE> handles;
+  bool reused_handle = false;
+  for (uint32_t i = 0; i < 4096; ++i) {
+    X_HANDLE new_handle = 0;
+    REQUIRE(table.AddHandle(object.get(), &new_handle) == X_STATUS_SUCCESS);
+    reused_handle = reused_handle || new_handle == handle ||
+                    new_handle == duplicate_handle;
+    handles.push_back(new_handle);
+  }
+  REQUIRE(!reused_handle);
+  REQUIRE(!table.LookupObject<TestObject>(handle));
+  REQUIRE(table.GetAllObjects().size() == 1);
+  for (X_HANDLE new_handle : handles) {
+    REQUIRE(table.ReleaseHandle(new_handle) == X_STATUS_SUCCESS);
+  }
+  REQUIRE(object->handles().empty());
+  REQUIRE(table.GetAllObjects().empty());
+}
+
+TEST_CASE("OBJECT_TABLE_CONCURRENT", "[object_table]") {
+  ObjectTable table;
+  auto object = object_ref<TestObject>(new TestObject());
+  X_HANDLE handle = 0;
+  REQUIRE(table.AddHandle(object.get(), &handle) == X_STATUS_SUCCESS);
+
+  // Lookups racing with closing handles, and reusing their slots, must never
+  // return another object or a released one.
+  std::atomic<X_HANDLE> other_handle(0);
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> wrong_lookup_count(0);
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < 4; ++i) {
+    threads.emplace_back([&]() {
+      while (!done.load(std::memory_order_relaxed)) {
+        if (table.LookupObject<TestObject>(handle).get() != object.get()) {
+          wrong_lookup_count.fetch_add(1);
+        }
+        auto other = table.LookupObject<TestObject>(other_handle.load());
+        if (other && other->type() != TestObject::kType) {
+          wrong_lookup_count.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (uint32_t i = 0; i < 100000; ++i) {
+    auto other = object_ref<TestObject>(new TestObject());
+    X_HANDLE new_handle = 0;
+    REQUIRE(table.AddHandle(other.get(), &new_handle) == X_STATUS_SUCCESS);
+    other_handle = new_handle;
+    REQUIRE(table.LookupObject<TestObject>(new_handle) == other.get());
+    REQUIRE(table.ReleaseHandle(new_handle) == X_STATUS_SUCCESS);
+  }
+  done = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(wrong_lookup_count == 0);
+  REQUIRE(table.RemoveHandle(handle) == X_STATUS_SUCCESS);
+}
+
+TEST_CASE("OBJECT_TABLE_BENCHMARK", "[.benchmark]") {
+  ObjectTable table;
+  auto object = object_ref<TestObject>(new TestObject());
+  X_HANDLE handle = 0;
+  REQUIRE(table.AddHandle(object.get(), &handle) == X_STATUS_SUCCESS);
+
+  // Lookups of a handle shared by all threads, like waits on a shared event.
+  constexpr uint32_t kLookupCount = 2000000;
+  for (uint32_t thread_count = 1; thread_count <= 8; thread_count *= 2) {
+    std::vector<std::thread> threads;
+    testing::BenchmarkTimer timer;
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      threads.emplace_back([&]() {
+        for (uint32_t j = 0; j < kLookupCount; ++j) {
+          table.LookupObject<TestObject>(handle);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    double seconds = timer.seconds();
+    WARN(thread_count << " threads: " << seconds * 1e9 / kLookupCount
+                      << " ns per lookup");
+  }
+
+  REQUIRE(table.RemoveHandle(handle) == X_STATUS_SUCCESS);
+}
+
+}  // namespace test
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
@@ -13,6 +13,7 @@
 #include "xenia/cpu/processor.h"
 #include "xenia/kernel/info/file.h"
 #include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/util/async_file_io.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_private.h"
 #include "xenia/kernel/xevent.h"
@@ -159,6 +160,30 @@ dword_result_t NtOpenFile(lpdword_t handle_out, dword_t desired_access,
 }
 DECLARE_XBOXKRNL_EXPORT1(NtOpenFile, kFileSystem, kImplemented);
 
+// Completion of a request executed on an I/O worker thread, like the
+// synchronous paths of NtReadFile and NtWriteFile complete it.
+static util::AsyncIoCompletion MakeAsyncIoCompletion(
+    const pointer_t<X_IO_STATUS_BLOCK>& io_status_block, object_ref<XEvent> ev,
+    uint32_t apc_routine, uint32_t apc_context) {
+  util::AsyncIoCompletion completion;
+  completion.io_status_block = io_status_block;
+  if (ev) {
+    completion.signal_event = [ev]() { ev->Set(0, false); };
+  }
+  if (apc_routine && apc_context) {
+    uint32_t io_status_block_ptr = io_status_block.guest_address();
+    auto thread = retain_object(XThread::GetCurrentThread());
+    completion.queue_apc = [thread, apc_routine, apc_context,
+                            io_status_block_ptr]() {
+      // The issuing thread may have exited in the meantime.
+      if (thread->is_running()) {
+        thread->EnqueueApc(apc_routine, apc_context, io_status_block_ptr, 0);
+      }
+    };
+  }
+  return completion;
+}
+
 dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
                           lpvoid_t apc_routine_ptr, lpvoid_t apc_context,
                           pointer_t<X_IO_STATUS_BLOCK> io_status_block,
@@ -177,14 +202,24 @@ dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
     result = X_STATUS_INVALID_HANDLE;
   }
 
+  // Low bit probably means do not queue to IO ports.
+  uint32_t apc_routine = static_cast<uint32_t>(apc_routine_ptr) & ~1u;
+
   if (XSUCCEEDED(result)) {
-    if (true || file->is_synchronous()) {
+    // Requests without an explicit offset use the file position, which must
+    // be consistent with the order they're issued in.
+    auto io_worker_pool = kernel_state()->io_worker_pool();
+    uint64_t byte_offset =
+        byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1;
+    if (util::IsFilePositionByteOffset(byte_offset)) {
+      byte_offset = -1;
+    }
+    if (file->is_synchronous() || byte_offset == uint64_t(-1) ||
+        !io_worker_pool) {
       // Synchronous.
       uint32_t bytes_read = 0;
-      result = file->Read(
-          buffer.guest_address(), buffer_length,
-          byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1,
-          &bytes_read, apc_context);
+      result = file->Read(buffer.guest_address(), buffer_length, byte_offset,
+                          &bytes_read, apc_context);
       if (io_status_block) {
         io_status_block->status = result;
         io_status_block->information = bytes_read;
@@ -192,12 +227,10 @@ dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
 
       // Queue the APC callback. It must be delivered via the APC mechanism even
       // though were are completing immediately.
-      // Low bit probably means do not queue to IO ports.
-      if ((uint32_t)apc_routine_ptr & ~1) {
+      if (apc_routine) {
         if (apc_context) {
           auto thread = XThread::GetCurrentThread();
-          thread->EnqueueApc(static_cast<uint32_t>(apc_routine_ptr) & ~1u,
-                             apc_context, io_status_block, 0);
+          thread->EnqueueApc(apc_routine, apc_context, io_status_block, 0);
         }
       }
 
@@ -209,22 +242,25 @@ dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
       // we have written the info out.
       signal_event = true;
     } else {
-      // TODO(benvanik): async.
-
-      // X_STATUS_PENDING if not returning immediately.
-      // XFile is waitable and signalled after each async req completes.
-      // reset the input event (->Reset())
-      /*xeNtReadFileState* call_state = new xeNtReadFileState();
-      XAsyncRequest* request = new XAsyncRequest(
-      state, file,
-      (XAsyncRequest::CompletionCallback)xeNtReadFileCompleted,
-      call_state);*/
-      // result = file->Read(buffer.guest_address(), buffer_length, byte_offset,
-      //                     request);
-      if (io_status_block) {
-        io_status_block->status = X_STATUS_PENDING;
-        io_status_block->information = 0;
+      // Asynchronous. The event is signaled, the APC is queued and the I/O
+      // completion ports are notified on the I/O worker thread once the read
+      // is done.
+      if (ev) {
+        ev->Reset();
       }
+      // Waits for the file itself must not be satisfied by an earlier
+      // request.
+      file->ResetAsyncEvent();
+      util::QueueAsyncIo(
+          *io_worker_pool,
+          [file, buffer_ptr = buffer.guest_address(),
+           length = static_cast<uint32_t>(buffer_length), byte_offset,
+           apc_context = apc_context.guest_address()](uint32_t& information) {
+            return file->Read(buffer_ptr, length, byte_offset, &information,
+                              apc_context);
+          },
+          MakeAsyncIoCompletion(io_status_block, ev, apc_routine,
+                                apc_context.guest_address()));
 
       result = X_STATUS_PENDING;
     }
@@ -244,13 +280,10 @@ dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
 DECLARE_XBOXKRNL_EXPORT2(NtReadFile, kFileSystem, kImplemented, kHighFrequency);
 
 dword_result_t NtWriteFile(dword_t file_handle, dword_t event_handle,
-                           function_t apc_routine, lpvoid_t apc_context,
+                           function_t apc_routine_ptr, lpvoid_t apc_context,
                            pointer_t<X_IO_STATUS_BLOCK> io_status_block,
                            lpvoid_t buffer, dword_t buffer_length,
                            lpqword_t byte_offset_ptr) {
-  // Async not supported yet.
-  assert_zero(apc_routine);
-
   X_STATUS result = X_STATUS_SUCCESS;
   uint32_t info = 0;
 
@@ -267,16 +300,23 @@ dword_result_t NtWriteFile(dword_t file_handle, dword_t event_handle,
     result = X_STATUS_INVALID_HANDLE;
   }
 
+  // Low bit probably means do not queue to IO ports, like in NtReadFile.
+  uint32_t apc_routine = static_cast<uint32_t>(apc_routine_ptr) & ~1u;
+
   // Execute write.
   if (XSUCCEEDED(result)) {
-    // TODO(benvanik): async path.
-    if (true || file->is_synchronous()) {
+    auto io_worker_pool = kernel_state()->io_worker_pool();
+    uint64_t byte_offset =
+        byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1;
+    if (util::IsFilePositionByteOffset(byte_offset)) {
+      byte_offset = -1;
+    }
+    if (file->is_synchronous() || byte_offset == uint64_t(-1) ||
+        !io_worker_pool) {
       // Synchronous request.
       uint32_t bytes_written = 0;
-      result = file->Write(
-          buffer.guest_address(), buffer_length,
-          byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1,
-          &bytes_written, apc_context);
+      result = file->Write(buffer.guest_address(), buffer_length, byte_offset,
+                           &bytes_written, apc_context);
       if (XSUCCEEDED(result)) {
         info = bytes_written;
       }
@@ -290,18 +330,34 @@ dword_result_t NtWriteFile(dword_t file_handle, dword_t event_handle,
         io_status_block->information = info;
       }
 
+      if (apc_routine && apc_context) {
+        auto thread = XThread::GetCurrentThread();
+        thread->EnqueueApc(apc_routine, apc_context, io_status_block, 0);
+      }
+
       // Mark that we should signal the event now. We do this after
       // we have written the info out.
       signal_event = true;
     } else {
-      // X_STATUS_PENDING if not returning immediately.
-      result = X_STATUS_PENDING;
-      info = 0;
-
-      if (io_status_block) {
-        io_status_block->status = X_STATUS_SUCCESS;
-        io_status_block->information = info;
+      // Asynchronous, completed on an I/O worker thread.
+      if (ev) {
+        ev->Reset();
       }
+      // Waits for the file itself must not be satisfied by an earlier
+      // request.
+      file->ResetAsyncEvent();
+      util::QueueAsyncIo(
+          *io_worker_pool,
+          [file, buffer_ptr = buffer.guest_address(),
+           length = static_cast<uint32_t>(buffer_length), byte_offset,
+           apc_context = apc_context.guest_address()](uint32_t& information) {
+            return file->Write(buffer_ptr, length, byte_offset, &information,
+                               apc_context);
+          },
+          MakeAsyncIoCompletion(io_status_block, ev, apc_routine,
+                                apc_context.guest_address()));
+
+      result = X_STATUS_PENDING;
     }
   }
 
@@ -348,34 +348,6 @@ pointer_result_t RtlImageXexHeaderField(pointer_t<xex2_header> xex_header,
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlImageXexHeaderField, kNone, kImplemented);
 
-// Unfortunately the Windows RTL_CRITICAL_SECTION object is bigger than the one
-// on the 360 (32b vs. 28b). This means that we can't do in-place splatting of
-// the critical sections. Also, the 360 never calls RtlDeleteCriticalSection
-// so we can't clean up the native handles.
-//
-// Because of this, we reimplement it poorly. Hooray.
-// We have 28b to work with so we need to be careful. We map our struct directly
-// into guest memory, as it should be opaque and so long as our size is right
-// the user code will never know.
-//
-// Ref:
-// https://web.archive.org/web/20161214022602/https://msdn.microsoft.com/en-us/magazine/cc164040.aspx
-// Ref:
-// https://github.com/reactos/reactos/blob/master/sdk/lib/rtl/critical.c
-
-// This structure tries to match the one on the 360 as best I can figure out.
-// Unfortunately some games have the critical sections pre-initialized in
-// their embedded data and InitializeCriticalSection will never be called.
-#pragma pack(push, 1)
-struct X_RTL_CRITICAL_SECTION {
-  X_DISPATCH_HEADER header;
-  int32_t lock_count;               // 0x10 -1 -> 0 on first lock
-  xe::be<int32_t> recursion_count;  // 0x14  0 -> 1 on first lock
-  xe::be<uint32_t> owning_thread;   // 0x18 PKTHREAD 0 unless locked
-};
-#pragma pack(pop)
-static_assert_size(X_RTL_CRITICAL_SECTION, 28);
-
 void xeRtlInitializeCriticalSection(X_RTL_CRITICAL_SECTION* cs,
                                     uint32_t cs_ptr) {
   cs->header.type = 1;      // EventSynchronizationObject (auto reset)
@@ -419,14 +391,45 @@ dword_result_t RtlInitializeCriticalSectionAndSpinCount(
 DECLARE_XBOXKRNL_EXPORT1(RtlInitializeCriticalSectionAndSpinCount, kNone,
                          kImplemented);
 
+bool xeRtlTryEnterCriticalSection(X_RTL_CRITICAL_SECTION* cs,
+                                  uint32_t cur_thread) {
+  if (xe::atomic_cas(-1, 0, &cs->lock_count)) {
+    // Able to steal the lock right away.
+    cs->owning_thread = cur_thread;
+    cs->recursion_count = 1;
+    return true;
+  } else if (cs->owning_thread == cur_thread) {
+    // Already own the lock.
+    xe::atomic_inc(&cs->lock_count);
+    ++cs->recursion_count;
+    return true;
+  }
+
+  // Failed to acquire lock.
+  return false;
+}
+
+bool xeRtlLeaveCriticalSection(X_RTL_CRITICAL_SECTION* cs) {
+  // Drop recursion count - if it isn't zero we still have the lock.
+  assert_true(cs->recursion_count > 0);
+  if (--cs->recursion_count != 0) {
+    assert_true(cs->recursion_count >= 0);
+
+    xe::atomic_dec(&cs->lock_count);
+    return false;
+  }
+
+  // Not owned - unlock!
+  cs->owning_thread = 0;
+  // Waiters, if any, need to be woken.
+  return xe::atomic_dec(&cs->lock_count) != -1;
+}
+
 void RtlEnterCriticalSection(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
   uint32_t cur_thread = XThread::GetCurrentThread()->guest_object();
   uint32_t spin_count = cs->header.absolute * 256;
 
-  if (cs->owning_thread == cur_thread) {
-    // We already own the lock.
-    xe::atomic_inc(&cs->lock_count);
-    cs->recursion_count++;
+  if (xeRtlTryEnterCriticalSection(cs, cur_thread)) {
     return;
   }
 
@@ -455,22 +458,8 @@ DECLARE_XBOXKRNL_EXPORT2(RtlEnterCriticalSection, kNone, kImplemented,
 
 dword_result_t RtlTryEnterCriticalSection(
     pointer_t<X_RTL_CRITICAL_SECTION> cs) {
-  uint32_t thread = XThread::GetCurrentThread()->guest_object();
-
-  if (xe::atomic_cas(-1, 0, &cs->lock_count)) {
-    // Able to steal the lock right away.
-    cs->owning_thread = thread;
-    cs->recursion_count = 1;
-    return 1;
-  } else if (cs->owning_thread == thread) {
-    // Already own the lock.
-    xe::atomic_inc(&cs->lock_count);
-    ++cs->recursion_count;
-    return 1;
-  }
-
-  // Failed to acquire lock.
-  return 0;
+  return xeRtlTryEnterCriticalSection(
+      cs, XThread::GetCurrentThread()->guest_object());
 }
 DECLARE_XBOXKRNL_EXPORT2(RtlTryEnterCriticalSection, kNone, kImplemented,
                          kHighFrequency);
@@ -478,18 +467,7 @@ DECLARE_XBOXKRNL_EXPORT2(RtlTryEnterCriticalSection, kNone, kImplemented,
 void RtlLeaveCriticalSection(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
   assert_true(cs->owning_thread == XThread::GetCurrentThread()->guest_object());
 
-  // Drop recursion count - if it isn't zero we still have the lock.
-  assert_true(cs->recursion_count > 0);
-  if (--cs->recursion_count != 0) {
-    assert_true(cs->recursion_count >= 0);
-
-    xe::atomic_dec(&cs->lock_count);
-    return;
-  }
-
-  // Not owned - unlock!
-  cs->owning_thread = 0;
-  if (xe::atomic_dec(&cs->lock_count) != -1) {
+  if (xeRtlLeaveCriticalSection(cs)) {
     // There were waiters - wake one of them.
     xeKeSetEvent(reinterpret_cast<X_KEVENT*>(cs.host_address()), 1, 0);
   }
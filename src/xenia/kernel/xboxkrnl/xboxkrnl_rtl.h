@@ -10,19 +10,54 @@
 #ifndef XENIA_KERNEL_XBOXKRNL_XBOXKRNL_RTL_H_
 #define XENIA_KERNEL_XBOXKRNL_XBOXKRNL_RTL_H_
 
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/kernel/xobject.h"
 #include "xenia/xbox.h"
 
 namespace xe {
 namespace kernel {
 namespace xboxkrnl {
 
-struct X_RTL_CRITICAL_SECTION;
+// Unfortunately the Windows RTL_CRITICAL_SECTION object is bigger than the one
+// on the 360 (32b vs. 28b). This means that we can't do in-place splatting of
+// the critical sections. Also, the 360 never calls RtlDeleteCriticalSection
+// so we can't clean up the native handles.
+//
+// Because of this, we reimplement it poorly. Hooray.
+// We have 28b to work with so we need to be careful. We map our struct directly
+// into guest memory, as it should be opaque and so long as our size is right
+// the user code will never know.
+//
+// Ref:
+// https://web.archive.org/web/20161214022602/https://msdn.microsoft.com/en-us/magazine/cc164040.aspx
+// Ref:
+// https://github.com/reactos/reactos/blob/master/sdk/lib/rtl/critical.c
+
+// This structure tries to match the one on the 360 as best I can figure out.
+// Unfortunately some games have the critical sections pre-initialized in
+// their embedded data and InitializeCriticalSection will never be called.
+#pragma pack(push, 1)
+struct X_RTL_CRITICAL_SECTION {
+  X_DISPATCH_HEADER header;
+  int32_t lock_count;               // 0x10 -1 -> 0 on first lock
+  xe::be<int32_t> recursion_count;  // 0x14  0 -> 1 on first lock
+  xe::be<uint32_t> owning_thread;   // 0x18 PKTHREAD 0 unless locked
+};
+#pragma pack(pop)
+static_assert_size(X_RTL_CRITICAL_SECTION, 28);
 
 void xeRtlInitializeCriticalSection(X_RTL_CRITICAL_SECTION* cs,
                                     uint32_t cs_ptr);
 X_STATUS xeRtlInitializeCriticalSectionAndSpinCount(X_RTL_CRITICAL_SECTION* cs,
                                                     uint32_t cs_ptr,
                                                     uint32_t spin_count);
+// Acquires the critical section for the thread (X_KTHREAD guest address) if
+// it's free or already owned by it. Also done inline by the x64 backend.
+bool xeRtlTryEnterCriticalSection(X_RTL_CRITICAL_SECTION* cs,
+                                  uint32_t cur_thread);
+// Leaves the critical section once, returns whether a waiter must be woken.
+bool xeRtlLeaveCriticalSection(X_RTL_CRITICAL_SECTION* cs);
 
 }  // namespace xboxkrnl
 }  // namespace kernel
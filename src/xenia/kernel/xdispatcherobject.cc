@@ -0,0 +1,379 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/xdispatcherobject.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+
+namespace xe {
+namespace kernel {
+
+namespace {
+
+using WaitClock = std::chrono::steady_clock;
+
+// Remaining time until a deadline for waits, which may be without a deadline.
+class WaitDeadline {
+ public:
+  explicit WaitDeadline(std::chrono::milliseconds timeout)
+      : has_deadline_(timeout != std::chrono::milliseconds::max()) {
+    if (has_deadline_) {
+      deadline_ = WaitClock::now() + timeout;
+    }
+  }
+  std::chrono::milliseconds remaining() const {
+    if (!has_deadline_) {
+      return std::chrono::milliseconds::max();
+    }
+    return std::max(std::chrono::ceil<std::chrono::milliseconds>(
+                        deadline_ - WaitClock::now()),
+                    std::chrono::milliseconds(0));
+  }
+  std::chrono::nanoseconds remaining_nanoseconds() const {
+    if (!has_deadline_) {
+      return std::chrono::nanoseconds::max();
+    }
+    return deadline_ - WaitClock::now();
+  }
+
+ private:
+  bool has_deadline_;
+  WaitClock::time_point deadline_;
+};
+
+// Set with the sequence of the wait block for waits that also block on host
+// objects. Auto-reset, and reset before every wait, so it can't have more than
+// the notifications of the current wait.
+xe::threading::Event* GetThreadWaitEvent() {
+  thread_local std::unique_ptr<xe::threading::Event> wait_event;
+  if (!wait_event) {
+    wait_event = xe::threading::Event::CreateAutoResetEvent(false);
+  }
+  return wait_event.get();
+}
+
+X_STATUS WaitResultToStatus(xe::threading::WaitResult result, size_t index) {
+  switch (result) {
+    case xe::threading::WaitResult::kSuccess:
+      return X_STATUS(index);
+    case xe::threading::WaitResult::kUserCallback:
+      // Or X_STATUS_ALERTED?
+      return X_STATUS_USER_APC;
+    case xe::threading::WaitResult::kTimeout:
+      xe::threading::MaybeYield();
+      return X_STATUS_TIMEOUT;
+    default:
+    case xe::threading::WaitResult::kAbandoned:
+      return X_STATUS(X_STATUS_ABANDONED_WAIT_0 + index);
+    case xe::threading::WaitResult::kFailed:
+      return X_STATUS_UNSUCCESSFUL;
+  }
+}
+
+}  // namespace
+
+XDispatcherObject::XDispatcherObject(KernelState* kernel_state, Type type)
+    : XObject(kernel_state, type),
+      single_waiter_count_(0),
+      wake_sequence_(0),
+      pulse_count_(0),
+      wait_block_count_(0) {}
+
+XDispatcherObject::~XDispatcherObject() = default;
+
+std::chrono::milliseconds XDispatcherObject::WaitTimeout(
+    const uint64_t* opt_timeout) {
+  if (!opt_timeout) {
+    return std::chrono::milliseconds::max();
+  }
+  return std::chrono::milliseconds(
+      Clock::ScaleGuestDurationMillis(TimeoutTicksToMs(*opt_timeout)));
+}
+
+int32_t XDispatcherObject::signal_state() const {
+  return xe::byte_swap(int32_t(*signal_state_ptr()));
+}
+
+bool XDispatcherObject::CompareExchangeSignalState(int32_t expected_value,
+                                                   int32_t new_value) {
+  return xe::atomic_cas(xe::byte_swap(expected_value),
+                        xe::byte_swap(new_value), signal_state_ptr());
+}
+
+int32_t XDispatcherObject::ExchangeSignalState(int32_t new_value) {
+  return xe::byte_swap(
+      xe::atomic_exchange(xe::byte_swap(new_value), signal_state_ptr()));
+}
+
+void XDispatcherObject::NotifyWaiters() {
+  // Waiters are counted before checking the state, and read their sequence
+  // before the check, so either they see the new state, or they are seen here
+  // and their sequence changes. Those that haven't blocked yet return from the
+  // wait immediately as the sequence has changed.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (single_waiter_count_.load()) {
+    wake_sequence_.fetch_add(1);
+    xe::threading::WakeByAddressAll(&wake_sequence_);
+  }
+  if (wait_block_count_.load()) {
+    std::lock_guard<std::mutex> lock(wait_blocks_mutex_);
+    for (WaitBlock* wait_block : wait_blocks_) {
+      wait_block->sequence.fetch_add(1);
+      if (wait_block->host_event) {
+        wait_block->host_event->Set();
+      } else {
+        xe::threading::WakeByAddressAll(&wait_block->sequence);
+      }
+    }
+  }
+}
+
+bool XDispatcherObject::HasWaiters() const {
+  return single_waiter_count_.load() || wait_block_count_.load();
+}
+
+void XDispatcherObject::NotifyPulse() {
+  pulse_count_.fetch_add(1);
+  NotifyWaiters();
+}
+
+bool XDispatcherObject::TryAcquireOrPulsed(uint32_t start_pulse_count) {
+  return TryAcquire() || pulse_count_.load() != start_pulse_count;
+}
+
+void XDispatcherObject::AddWaitBlock(WaitBlock* wait_block) {
+  std::lock_guard<std::mutex> lock(wait_blocks_mutex_);
+  wait_blocks_.push_back(wait_block);
+  wait_block_count_.fetch_add(1);
+}
+
+void XDispatcherObject::RemoveWaitBlock(WaitBlock* wait_block) {
+  std::lock_guard<std::mutex> lock(wait_blocks_mutex_);
+  auto it = std::find(wait_blocks_.begin(), wait_blocks_.end(), wait_block);
+  assert_true(it != wait_blocks_.end());
+  wait_blocks_.erase(it);
+  wait_block_count_.fetch_sub(1);
+}
+
+X_STATUS XDispatcherObject::WaitSingle(bool alertable, uint64_t* opt_timeout) {
+  if (TryAcquire()) {
+    return X_STATUS_SUCCESS;
+  }
+  if (alertable) {
+    // Only waits for host objects are interrupted by user callbacks.
+    XObject* object = this;
+    return WaitMultiple(1, &object, false, true, opt_timeout);
+  }
+
+  WaitDeadline deadline(WaitTimeout(opt_timeout));
+  uint32_t start_pulse_count = pulse_count_.load();
+  X_STATUS result = X_STATUS_TIMEOUT;
+  single_waiter_count_.fetch_add(1);
+  while (true) {
+    // Read before checking the state, so that any notification after the
+    // check prevents the sleep.
+    uint32_t sequence = wake_sequence_.load();
+    if (TryAcquireOrPulsed(start_pulse_count)) {
+      result = X_STATUS_SUCCESS;
+      break;
+    }
+    auto remaining = deadline.remaining_nanoseconds();
+    if (remaining.count() <= 0) {
+      break;
+    }
+    xe::threading::WaitOnAddress(&wake_sequence_, sequence, remaining);
+  }
+  single_waiter_count_.fetch_sub(1);
+  if (result == X_STATUS_TIMEOUT) {
+    xe::threading::MaybeYield();
+  }
+  return result;
+}
+
+X_STATUS XDispatcherObject::WaitMultiple(uint32_t count, XObject** objects,
+                                         bool wait_all, bool alertable,
+                                         uint64_t* opt_timeout) {
+  WaitDeadline deadline(WaitTimeout(opt_timeout));
+
+  std::vector<XDispatcherObject*> dispatcher_objects;
+  std::vector<uint32_t> start_pulse_counts;
+  // Indices of the host objects, and their wait handles.
+  std::vector<uint32_t> host_indices;
+  std::vector<xe::threading::WaitHandle*> host_wait_handles;
+  for (uint32_t i = 0; i < count; ++i) {
+    auto dispatcher_object = objects[i]->AsDispatcherObject();
+    if (dispatcher_object) {
+      dispatcher_objects.push_back(dispatcher_object);
+      start_pulse_counts.push_back(dispatcher_object->pulse_count_.load());
+    } else {
+      host_indices.push_back(i);
+      host_wait_handles.push_back(objects[i]->GetWaitHandle());
+      assert_not_null(host_wait_handles.back());
+    }
+  }
+
+  WaitBlock wait_block;
+  if (alertable || !host_wait_handles.empty()) {
+    wait_block.host_event = GetThreadWaitEvent();
+    wait_block.host_event->Reset();
+  }
+  for (auto dispatcher_object : dispatcher_objects) {
+    dispatcher_object->AddWaitBlock(&wait_block);
+  }
+
+  X_STATUS result = X_STATUS_SUCCESS;
+  if (!wait_all) {
+    std::vector<xe::threading::WaitHandle*> wait_handles = host_wait_handles;
+    if (wait_block.host_event) {
+      wait_handles.push_back(wait_block.host_event);
+    }
+    while (true) {
+      // Read before checking the states, so that any notification after the
+      // check prevents the sleep.
+      uint32_t sequence = wait_block.sequence.load();
+      // Check in order, like the blocking wait does.
+      bool acquired = false;
+      size_t dispatcher_index = 0;
+      for (uint32_t i = 0; i < count && !acquired; ++i) {
+        auto dispatcher_object = objects[i]->AsDispatcherObject();
+        if (dispatcher_object) {
+          acquired = dispatcher_object->TryAcquireOrPulsed(
+              start_pulse_counts[dispatcher_index++]);
+        } else if (xe::threading::Wait(objects[i]->GetWaitHandle(), false,
+                                       std::chrono::milliseconds(0)) ==
+                   xe::threading::WaitResult::kSuccess) {
+          objects[i]->WaitCallback();
+          acquired = true;
+        }
+        if (acquired) {
+          result = X_STATUS(i);
+        }
+      }
+      if (acquired) {
+        break;
+      }
+      if (!wait_block.host_event) {
+        auto remaining = deadline.remaining_nanoseconds();
+        if (remaining.count() <= 0) {
+          result = WaitResultToStatus(xe::threading::WaitResult::kTimeout, 0);
+          break;
+        }
+        xe::threading::WaitOnAddress(&wait_block.sequence, sequence,
+                                     remaining);
+        continue;
+      }
+      auto wait_result =
+          xe::threading::WaitAny(wait_handles.data(), wait_handles.size(),
+                                 alertable, deadline.remaining());
+      size_t host_index = wait_result.second;
+      if (wait_result.first == xe::threading::WaitResult::kSuccess &&
+          host_index >= host_indices.size()) {
+        // A dispatcher object was notified, check again.
+        continue;
+      }
+      uint32_t index =
+          host_index < host_indices.size() ? host_indices[host_index] : 0;
+      if (wait_result.first == xe::threading::WaitResult::kSuccess) {
+        objects[index]->WaitCallback();
+      }
+      result = WaitResultToStatus(wait_result.first, index);
+      break;
+    }
+  } else {
+    std::vector<XDispatcherObject*> acquired_objects;
+    while (true) {
+      uint32_t sequence = wait_block.sequence.load();
+      // Only try to acquire when all dispatcher objects seem signaled, as
+      // undoing the acquisition wakes the waiters, including this one.
+      bool all_signaled = true;
+      for (size_t i = 0; i < dispatcher_objects.size(); ++i) {
+        all_signaled = all_signaled &&
+                       (dispatcher_objects[i]->IsSignaled() ||
+                        dispatcher_objects[i]->pulse_count_.load() !=
+                            start_pulse_counts[i]);
+      }
+      if (all_signaled) {
+        // Host objects can only be checked by acquiring them. Block until they
+        // are all acquired, while holding nothing else, then try to acquire
+        // the dispatcher objects without blocking. Everything is released if
+        // that fails, so nothing is kept while blocking or on failure.
+        if (!host_wait_handles.empty()) {
+          auto wait_result = xe::threading::WaitAll(
+              host_wait_handles.data(), host_wait_handles.size(), alertable,
+              deadline.remaining());
+          if (wait_result != xe::threading::WaitResult::kSuccess) {
+            result = WaitResultToStatus(wait_result, 0);
+            break;
+          }
+        }
+        bool acquired_all = true;
+        for (size_t i = 0; i < dispatcher_objects.size() && acquired_all;
+             ++i) {
+          auto dispatcher_object = dispatcher_objects[i];
+          if (dispatcher_object->pulse_count_.load() !=
+              start_pulse_counts[i]) {
+            continue;
+          }
+          if (dispatcher_object->TryAcquire()) {
+            acquired_objects.push_back(dispatcher_object);
+          } else {
+            acquired_all = false;
+          }
+        }
+        if (acquired_all) {
+          for (uint32_t host_index : host_indices) {
+            objects[host_index]->WaitCallback();
+          }
+          result = X_STATUS_SUCCESS;
+          break;
+        }
+        while (!acquired_objects.empty()) {
+          acquired_objects.back()->UndoAcquire();
+          acquired_objects.pop_back();
+        }
+        for (uint32_t host_index : host_indices) {
+          objects[host_index]->UndoWait();
+        }
+      }
+      if (!wait_block.host_event) {
+        auto remaining = deadline.remaining_nanoseconds();
+        if (remaining.count() <= 0) {
+          result = WaitResultToStatus(xe::threading::WaitResult::kTimeout, 0);
+          break;
+        }
+        xe::threading::WaitOnAddress(&wait_block.sequence, sequence,
+                                     remaining);
+        continue;
+      }
+      xe::threading::WaitHandle* host_event = wait_block.host_event;
+      auto wait_result = xe::threading::WaitAny(&host_event, 1, alertable,
+                                                deadline.remaining());
+      if (wait_result.first != xe::threading::WaitResult::kSuccess) {
+        result = WaitResultToStatus(wait_result.first, 0);
+        break;
+      }
+    }
+  }
+
+  for (auto dispatcher_object : dispatcher_objects) {
+    dispatcher_object->RemoveWaitBlock(&wait_block);
+  }
+  return result;
+}
+
+}  // namespace kernel
+}  // namespace xe
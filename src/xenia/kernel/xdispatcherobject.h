@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_XDISPATCHEROBJECT_H_
+#define XENIA_KERNEL_XDISPATCHEROBJECT_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+#include "xenia/kernel/xobject.h"
+#include "xenia/xbox.h"
+
+namespace xe {
+namespace kernel {
+
+// Dispatcher object (event or semaphore) with its state held only in the
+// signal_state of its X_DISPATCH_HEADER in guest memory, so that signaling and
+// waiting without contention is a single atomic operation on guest memory.
+// Threads waiting for just the object block on a wake sequence of the object.
+// Waits for multiple objects register a wait block with each object, with a
+// sequence incremented on every notification, and check the states again when
+// it changes. Waits that can also be satisfied by host objects, or
+// interrupted by user callbacks (alertable waits), block on a per-thread host
+// event set along with the sequence instead.
+class XDispatcherObject : public XObject {
+ public:
+  ~XDispatcherObject() override;
+
+  XDispatcherObject* AsDispatcherObject() override { return this; }
+
+  X_STATUS WaitSingle(bool alertable, uint64_t* opt_timeout);
+  // Wait for any mix of dispatcher and host objects. Waits for all objects
+  // acquire the host objects when the dispatcher ones are signaled, and
+  // release them (XObject::UndoWait) if the dispatcher ones can't be acquired
+  // then, so nothing is held while blocking or when the wait fails.
+  static X_STATUS WaitMultiple(uint32_t count, XObject** objects,
+                               bool wait_all, bool alertable,
+                               uint64_t* opt_timeout);
+
+  // Signals the object for SignalAndWait.
+  virtual void Signal() = 0;
+
+ protected:
+  XDispatcherObject(KernelState* kernel_state, Type type);
+
+  // Binds the object to its dispatch header, initialized by the guest or
+  // created with CreateNative.
+  void SetDispatchHeader(X_DISPATCH_HEADER* header) { header_ = header; }
+  X_DISPATCH_HEADER* dispatch_header() const { return header_; }
+
+  int32_t signal_state() const;
+  bool CompareExchangeSignalState(int32_t expected_value, int32_t new_value);
+  int32_t ExchangeSignalState(int32_t new_value);
+  // Wakes the waiting threads after the state was signaled.
+  void NotifyWaiters();
+  bool HasWaiters() const;
+  // Satisfies the waits in progress without changing the state, for pulsing
+  // events.
+  void NotifyPulse();
+
+  // Whether a wait would currently be satisfied, without updating the state.
+  virtual bool IsSignaled() const = 0;
+  // Updates the state for a satisfied wait if the object is signaled.
+  virtual bool TryAcquire() = 0;
+  // Reverts TryAcquire when not all objects of a wait for all were acquired.
+  virtual void UndoAcquire() = 0;
+
+ private:
+  // A thread in WaitMultiple.
+  struct WaitBlock {
+    // Incremented on every notification, for WaitOnAddress.
+    std::atomic<uint32_t> sequence{0};
+    // Set on every notification if the thread blocks on host objects.
+    xe::threading::Event* host_event = nullptr;
+  };
+
+  static std::chrono::milliseconds WaitTimeout(const uint64_t* opt_timeout);
+
+  volatile int32_t* signal_state_ptr() const {
+    return reinterpret_cast<volatile int32_t*>(&header_->signal_state);
+  }
+
+  // Whether the wait is satisfied, either by acquiring the object or by a
+  // pulse since the wait has started.
+  bool TryAcquireOrPulsed(uint32_t start_pulse_count);
+
+  void AddWaitBlock(WaitBlock* wait_block);
+  void RemoveWaitBlock(WaitBlock* wait_block);
+
+  X_DISPATCH_HEADER* header_ = nullptr;
+  // Threads in WaitSingle blocked on wake_sequence_.
+  std::atomic<uint32_t> single_waiter_count_;
+  std::atomic<uint32_t> wake_sequence_;
+  std::atomic<uint32_t> pulse_count_;
+  // Threads in WaitMultiple.
+  std::atomic<uint32_t> wait_block_count_;
+  std::mutex wait_blocks_mutex_;
+  std::vector<WaitBlock*> wait_blocks_;
+};
+
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_XDISPATCHEROBJECT_H_
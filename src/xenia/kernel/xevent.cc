@@ -15,24 +15,26 @@
 namespace xe {
 namespace kernel {
 
-XEvent::XEvent(KernelState* kernel_state) : XObject(kernel_state, kType) {}
+XEvent::XEvent(KernelState* kernel_state)
+    : XDispatcherObject(kernel_state, kType) {}
 
 XEvent::~XEvent() = default;
 
 void XEvent::Initialize(bool manual_reset, bool initial_state) {
-  assert_false(event_);
+  assert_null(dispatch_header());
 
-  this->CreateNative<X_KEVENT>();
+  auto event = CreateNative<X_KEVENT>();
 
-  if (manual_reset) {
-    event_ = xe::threading::Event::CreateManualResetEvent(initial_state);
-  } else {
-    event_ = xe::threading::Event::CreateAutoResetEvent(initial_state);
-  }
+  manual_reset_ = manual_reset;
+  // EventNotificationObject (manual reset) or EventSynchronizationObject
+  // (auto reset).
+  event->header.type = manual_reset ? 0x00 : 0x01;
+  event->header.signal_state = initial_state ? 1 : 0;
+  SetDispatchHeader(&event->header);
 }
 
 void XEvent::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
-  assert_false(event_);
+  assert_null(dispatch_header());
 
   switch (header->type) {
     case 0x00:  // EventNotificationObject (manual reset)
@@ -46,53 +48,64 @@ void XEvent::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
       return;
   }
 
-  bool initial_state = header->signal_state ? true : false;
-  if (manual_reset_) {
-    event_ = xe::threading::Event::CreateManualResetEvent(initial_state);
-  } else {
-    event_ = xe::threading::Event::CreateAutoResetEvent(initial_state);
-  }
+  // The state stays in the guest header, initialized by the guest.
+  SetDispatchHeader(header);
 }
 
 int32_t XEvent::Set(uint32_t priority_increment, bool wait) {
-  event_->Set();
-  return 1;
+  int32_t previous_state = ExchangeSignalState(1);
+  NotifyWaiters();
+  return previous_state;
 }
 
 int32_t XEvent::Pulse(uint32_t priority_increment, bool wait) {
-  event_->Pulse();
-  return 1;
+  // Like PulseEvent, only releases the threads that are already waiting.
+  int32_t previous_state;
+  if (!HasWaiters()) {
+    previous_state = ExchangeSignalState(0);
+  } else if (!manual_reset_) {
+    // Satisfies one waiting thread, which resets the state.
+    previous_state = ExchangeSignalState(1);
+    NotifyWaiters();
+  } else {
+    // Satisfies all waiting threads without leaving the event signaled.
+    previous_state = ExchangeSignalState(0);
+    NotifyPulse();
+  }
+  return previous_state;
 }
 
-int32_t XEvent::Reset() {
-  event_->Reset();
-  return 1;
-}
+int32_t XEvent::Reset() { return ExchangeSignalState(0); }
 
-void XEvent::Clear() { event_->Reset(); }
+void XEvent::Clear() { ExchangeSignalState(0); }
 
-bool XEvent::Save(ByteStream* stream) {
-  XELOGD("XEvent {:08X} ({})", handle(), manual_reset_ ? "manual" : "auto");
-  SaveObject(stream);
+void XEvent::Signal() { Set(0, false); }
 
-  bool signaled = true;
-  auto result =
-      xe::threading::Wait(event_.get(), false, std::chrono::milliseconds(0));
-  if (result == xe::threading::WaitResult::kSuccess) {
-    signaled = true;
-  } else if (result == xe::threading::WaitResult::kTimeout) {
-    signaled = false;
-  } else {
-    assert_always();
+bool XEvent::IsSignaled() const { return signal_state() != 0; }
+
+bool XEvent::TryAcquire() {
+  if (manual_reset_) {
+    return signal_state() != 0;
   }
+  return CompareExchangeSignalState(1, 0);
+}
 
-  if (signaled) {
-    // Reset the event in-case it's an auto-reset.
-    event_->Set();
+void XEvent::UndoAcquire() {
+  if (!manual_reset_) {
+    ExchangeSignalState(1);
+    NotifyWaiters();
   }
+}
 
-  stream->Write<bool>(signaled);
+bool XEvent::Save(ByteStream* stream) {
+  XELOGD("XEvent {:08X} ({})", handle(), manual_reset_ ? "manual" : "auto");
+  SaveObject(stream);
+
+  stream->Write<bool>(signal_state() != 0);
   stream->Write<bool>(manual_reset_);
+  // Natively initialized events have their header in guest memory, which is
+  // saved separately.
+  stream->Write<uint32_t>(memory()->HostToGuestVirtual(dispatch_header()));
 
   return true;
 }
@@ -106,15 +119,17 @@ object_ref<XEvent> XEvent::Restore(KernelState* kernel_state,
   bool signaled = stream->Read<bool>();
   evt->manual_reset_ = stream->Read<bool>();
 
-  if (evt->manual_reset_) {
-    evt->event_ = xe::threading::Event::CreateManualResetEvent(false);
-  } else {
-    evt->event_ = xe::threading::Event::CreateAutoResetEvent(false);
-  }
+  uint32_t header_ptr = stream->Read<uint32_t>();
 
-  if (signaled) {
-    evt->event_->Set();
+  X_DISPATCH_HEADER* header;
+  if (header_ptr) {
+    header = evt->memory()->TranslateVirtual<X_DISPATCH_HEADER*>(header_ptr);
+  } else {
+    header = &evt->CreateNative<X_KEVENT>()->header;
+    header->type = evt->manual_reset_ ? 0x00 : 0x01;
   }
+  header->signal_state = signaled ? 1 : 0;
+  evt->SetDispatchHeader(header);
 
   return object_ref<XEvent>(evt);
 }
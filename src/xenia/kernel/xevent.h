@@ -10,8 +10,7 @@
 #ifndef XENIA_KERNEL_XEVENT_H_
 #define XENIA_KERNEL_XEVENT_H_
 
-#include "xenia/base/threading.h"
-#include "xenia/kernel/xobject.h"
+#include "xenia/kernel/xdispatcherobject.h"
 #include "xenia/xbox.h"
 
 namespace xe {
@@ -23,7 +22,7 @@ struct X_KEVENT {
 };
 static_assert_size(X_KEVENT, 0x10);
 
-class XEvent : public XObject {
+class XEvent : public XDispatcherObject {
  public:
   static const Type kType = kTypeEvent;
 
@@ -42,12 +41,15 @@ class XEvent : public XObject {
   static object_ref<XEvent> Restore(KernelState* kernel_state,
                                     ByteStream* stream);
 
+  void Signal() override;
+
  protected:
-  xe::threading::WaitHandle* GetWaitHandle() override { return event_.get(); }
+  bool IsSignaled() const override;
+  bool TryAcquire() override;
+  void UndoAcquire() override;
 
  private:
   bool manual_reset_ = false;
-  std::unique_ptr<xe::threading::Event> event_;
 };
 
 }  // namespace kernel
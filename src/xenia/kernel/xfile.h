@@ -10,6 +10,7 @@
 #ifndef XENIA_KERNEL_XFILE_H_
 #define XENIA_KERNEL_XFILE_H_
 
+#include <atomic>
 #include <string>
 
 #include "xenia/kernel/xevent.h"
@@ -116,12 +117,17 @@ class XFile : public XObject {
 
   bool is_synchronous() const { return is_synchronous_; }
 
+  // Clears the completion of earlier requests before queuing an asynchronous
+  // one, so that waits for the file wait for the new request.
+  void ResetAsyncEvent() { async_event_->Reset(); }
+
  protected:
   void NotifyIOCompletionPorts(XIOCompletion::IONotification& notification);
 
   xe::threading::WaitHandle* GetWaitHandle() override {
     return async_event_.get();
   }
+  void UndoWait() override { async_event_->Set(); }
 
  private:
   XFile();
@@ -134,7 +140,8 @@ class XFile : public XObject {
 
   // TODO(benvanik): create flags, open state, etc.
 
-  uint64_t position_ = 0;
+  // Updated by asynchronous reads and writes on I/O worker threads.
+  std::atomic<uint64_t> position_ = 0;
 
   xe::filesystem::WildcardEngine find_engine_;
   size_t find_index_ = 0;
@@ -89,5 +89,7 @@ object_ref<XMutant> XMutant::Restore(KernelState* kernel_state,
 
 void XMutant::WaitCallback() { owning_thread_ = XThread::GetCurrentThread(); }
 
+void XMutant::UndoWait() { mutant_->Release(); }
+
 }  // namespace kernel
 }  // namespace xe
@@ -37,6 +37,7 @@ class XMutant : public XObject {
  protected:
   xe::threading::WaitHandle* GetWaitHandle() override { return mutant_.get(); }
   void WaitCallback() override;
+  void UndoWait() override;
 
  private:
   XMutant();
@@ -16,6 +16,7 @@
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_private.h"
+#include "xenia/kernel/xdispatcherobject.h"
 #include "xenia/kernel/xenumerator.h"
 #include "xenia/kernel/xevent.h"
 #include "xenia/kernel/xfile.h"
@@ -180,19 +181,31 @@ void XObject::SetAttributes(uint32_t obj_attributes_ptr) {
 uint32_t XObject::TimeoutTicksToMs(int64_t timeout_ticks) {
   if (timeout_ticks > 0) {
     // Absolute time, based on January 1, 1601.
-    // TODO(benvanik): convert time to relative time.
-    assert_always();
-    return 0;
-  } else if (timeout_ticks < 0) {
-    // Relative time.
-    return (uint32_t)(-timeout_ticks / 10000);  // Ticks -> MS
-  } else {
-    return 0;
+    timeout_ticks = std::min(
+        int64_t(Clock::QueryGuestSystemTime()) - timeout_ticks, int64_t(0));
+  }
+  return (uint32_t)(-timeout_ticks / 10000);  // Ticks -> MS
+}
+
+std::chrono::nanoseconds XObject::TimeoutTicksToDuration(
+    int64_t timeout_ticks) {
+  if (timeout_ticks > 0) {
+    // Absolute time, based on January 1, 1601.
+    timeout_ticks = std::min(
+        int64_t(Clock::QueryGuestSystemTime()) - timeout_ticks, int64_t(0));
   }
+  return std::chrono::nanoseconds(
+      -Clock::ScaleGuestDurationFileTime(timeout_ticks) * 100);
 }
 
 X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
                        uint32_t alertable, uint64_t* opt_timeout) {
+  auto dispatcher_object = AsDispatcherObject();
+  if (dispatcher_object) {
+    return dispatcher_object->WaitSingle(alertable ? true : false,
+                                         opt_timeout);
+  }
+
   auto wait_handle = GetWaitHandle();
   if (!wait_handle) {
     // Object doesn't support waiting.
@@ -226,6 +239,22 @@ X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
 X_STATUS XObject::SignalAndWait(XObject* signal_object, XObject* wait_object,
                                 uint32_t wait_reason, uint32_t processor_mode,
                                 uint32_t alertable, uint64_t* opt_timeout) {
+  // Dispatcher objects have no host handles to signal and wait for atomically,
+  // signal first and then wait separately.
+  if (signal_object->AsDispatcherObject() ||
+      wait_object->AsDispatcherObject()) {
+    auto signal_dispatcher_object = signal_object->AsDispatcherObject();
+    if (signal_dispatcher_object) {
+      signal_dispatcher_object->Signal();
+    } else if (signal_object->type() == kTypeMutant) {
+      static_cast<XMutant*>(signal_object)->ReleaseMutant(0, false, false);
+    } else {
+      assert_always("Object can't be signaled");
+    }
+    return wait_object->Wait(wait_reason, processor_mode, alertable,
+                             opt_timeout);
+  }
+
   auto timeout_ms =
       opt_timeout ? std::chrono::milliseconds(Clock::ScaleGuestDurationMillis(
                         TimeoutTicksToMs(*opt_timeout)))
@@ -255,6 +284,14 @@ X_STATUS XObject::WaitMultiple(uint32_t count, XObject** objects,
                                uint32_t wait_type, uint32_t wait_reason,
                                uint32_t processor_mode, uint32_t alertable,
                                uint64_t* opt_timeout) {
+  for (uint32_t i = 0; i < count; ++i) {
+    if (objects[i]->AsDispatcherObject()) {
+      return XDispatcherObject::WaitMultiple(count, objects, !wait_type,
+                                             alertable ? true : false,
+                                             opt_timeout);
+    }
+  }
+
   std::vector<xe::threading::WaitHandle*> wait_handles(count);
   for (size_t i = 0; i < count; ++i) {
     wait_handles[i] = objects[i]->GetWaitHandle();
@@ -373,10 +410,21 @@ object_ref<XObject> XObject::GetNativeObject(KernelState* kernel_state,
   // We identify this by setting wait_list_flink to a magic value. When set,
   // wait_list_blink will hold a handle to our object.
 
-  auto global_lock = xe::global_critical_region::AcquireDirect();
-
   auto header = reinterpret_cast<X_DISPATCH_HEADER*>(native_ptr);
 
+  // Objects are looked up on every guest wait and signal, so check for an
+  // already initialized object without the global lock first.
+  if (header->wait_list_flink == 'XEN\0') {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto object = kernel_state->object_table()->LookupObject<XObject>(
+        header->wait_list_blink);
+    if (object) {
+      return object;
+    }
+  }
+
+  auto global_lock = xe::global_critical_region::AcquireDirect();
+
   if (as_type == -1) {
     as_type = header->type;
   }
@@ -12,6 +12,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <string>
 
@@ -28,6 +29,7 @@ namespace xe {
 namespace kernel {
 
 class KernelState;
+class XDispatcherObject;
 
 template <typename T>
 class object_ref;
@@ -143,6 +145,10 @@ class XObject {
 
   Type type() const;
 
+  // Objects with their state in the guest dispatch header, waited for without
+  // host synchronization objects.
+  virtual XDispatcherObject* AsDispatcherObject() { return nullptr; }
+
   // Returns the primary handle of this object.
   X_HANDLE handle() const { return handles_[0]; }
 
@@ -196,11 +202,16 @@ class XObject {
                                        void* native_ptr, int32_t as_type = -1);
 
  protected:
+  friend class XDispatcherObject;
+
   bool SaveObject(ByteStream* stream);
   bool RestoreObject(ByteStream* stream);
 
   // Called on successful wait.
   virtual void WaitCallback() {}
+  // Reverts acquiring the wait handle when a wait for all objects acquired it,
+  // but couldn't acquire the other objects. WaitCallback wasn't called.
+  virtual void UndoWait() {}
   virtual xe::threading::WaitHandle* GetWaitHandle() { return nullptr; }
 
   // Creates the kernel object for guest code to use. Typically not needed.
@@ -213,12 +224,20 @@ class XObject {
   }
 
   // Stash native pointer into X_DISPATCH_HEADER
+  // The handle is written first, so it's valid whenever the magic value is
+  // seen, and GetNativeObject can check it without the global lock.
   static void StashHandle(X_DISPATCH_HEADER* header, uint32_t handle) {
-    header->wait_list_flink = 'XEN\0';
     header->wait_list_blink = handle;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->wait_list_flink = 'XEN\0';
   }
 
+  // Timeouts in 100 ns ticks, relative when negative, or absolute guest system
+  // times when positive.
   static uint32_t TimeoutTicksToMs(int64_t timeout_ticks);
+  // Scaled host duration until a timeout, 0 if it has already passed.
+  static std::chrono::nanoseconds TimeoutTicksToDuration(
+      int64_t timeout_ticks);
 
   KernelState* kernel_state_;
 
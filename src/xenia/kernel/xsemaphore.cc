@@ -16,55 +16,77 @@ namespace xe {
 namespace kernel {
 
 XSemaphore::XSemaphore(KernelState* kernel_state)
-    : XObject(kernel_state, kTypeSemaphore) {}
+    : XDispatcherObject(kernel_state, kTypeSemaphore) {}
 
 XSemaphore::~XSemaphore() = default;
 
 void XSemaphore::Initialize(int32_t initial_count, int32_t maximum_count) {
-  assert_false(semaphore_);
+  assert_null(dispatch_header());
 
-  CreateNative(sizeof(X_KSEMAPHORE));
+  auto semaphore = CreateNative<X_KSEMAPHORE>();
 
   maximum_count_ = maximum_count;
-  semaphore_ = xe::threading::Semaphore::Create(initial_count, maximum_count);
+  semaphore->header.type = 0x05;  // SemaphoreObject
+  semaphore->header.signal_state = initial_count;
+  semaphore->limit = maximum_count;
+  SetDispatchHeader(&semaphore->header);
 }
 
 void XSemaphore::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
-  assert_false(semaphore_);
+  assert_null(dispatch_header());
 
+  // The count stays in the guest header, initialized by the guest.
   auto semaphore = reinterpret_cast<X_KSEMAPHORE*>(native_ptr);
   maximum_count_ = semaphore->limit;
-  semaphore_ = xe::threading::Semaphore::Create(semaphore->header.signal_state,
-                                                semaphore->limit);
+  SetDispatchHeader(header);
 }
 
 int32_t XSemaphore::ReleaseSemaphore(int32_t release_count) {
-  int32_t previous_count = 0;
-  semaphore_->Release(release_count, &previous_count);
+  int32_t previous_count;
+  do {
+    previous_count = signal_state();
+    if (release_count > maximum_count_ - previous_count) {
+      // Would exceed the limit, the count is left unchanged.
+      break;
+    }
+  } while (!CompareExchangeSignalState(previous_count,
+                                       previous_count + release_count));
+  NotifyWaiters();
   return previous_count;
 }
 
+void XSemaphore::Signal() { ReleaseSemaphore(1); }
+
+bool XSemaphore::IsSignaled() const { return signal_state() > 0; }
+
+bool XSemaphore::TryAcquire() {
+  int32_t count;
+  do {
+    count = signal_state();
+    if (count <= 0) {
+      return false;
+    }
+  } while (!CompareExchangeSignalState(count, count - 1));
+  return true;
+}
+
+void XSemaphore::UndoAcquire() { ReleaseSemaphore(1); }
+
 bool XSemaphore::Save(ByteStream* stream) {
   if (!SaveObject(stream)) {
     return false;
   }
 
-  // Get the free number of slots from the semaphore.
-  uint32_t free_count = 0;
-  while (
-      threading::Wait(semaphore_.get(), false, std::chrono::milliseconds(0)) ==
-      threading::WaitResult::kSuccess) {
-    free_count++;
-  }
+  uint32_t free_count = uint32_t(signal_state());
 
   XELOGD("XSemaphore {:08X} (count {}/{})", handle(), free_count,
          maximum_count_);
 
-  // Restore the semaphore back to its previous count.
-  semaphore_->Release(free_count, nullptr);
-
   stream->Write(maximum_count_);
   stream->Write(free_count);
+  // Natively initialized semaphores have their header in guest memory, which
+  // is saved separately.
+  stream->Write<uint32_t>(memory()->HostToGuestVirtual(dispatch_header()));
 
   return true;
 }
@@ -78,13 +100,23 @@ object_ref<XSemaphore> XSemaphore::Restore(KernelState* kernel_state,
     return nullptr;
   }
 
-  sem->maximum_count_ = stream->Read<uint32_t>();
+  sem->maximum_count_ = stream->Read<int32_t>();
   auto free_count = stream->Read<uint32_t>();
+  uint32_t header_ptr = stream->Read<uint32_t>();
   XELOGD("XSemaphore {:08X} (count {}/{})", sem->handle(), free_count,
          sem->maximum_count_);
 
-  sem->semaphore_ =
-      threading::Semaphore::Create(free_count, sem->maximum_count_);
+  X_DISPATCH_HEADER* header;
+  if (header_ptr) {
+    header = sem->memory()->TranslateVirtual<X_DISPATCH_HEADER*>(header_ptr);
+  } else {
+    auto semaphore = sem->CreateNative<X_KSEMAPHORE>();
+    semaphore->header.type = 0x05;  // SemaphoreObject
+    semaphore->limit = sem->maximum_count_;
+    header = &semaphore->header;
+  }
+  header->signal_state = free_count;
+  sem->SetDispatchHeader(header);
 
   return object_ref<XSemaphore>(sem);
 }
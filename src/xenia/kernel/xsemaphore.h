@@ -10,8 +10,7 @@
 #ifndef XENIA_KERNEL_XSEMAPHORE_H_
 #define XENIA_KERNEL_XSEMAPHORE_H_
 
-#include "xenia/base/threading.h"
-#include "xenia/kernel/xobject.h"
+#include "xenia/kernel/xdispatcherobject.h"
 #include "xenia/xbox.h"
 
 namespace xe {
@@ -23,7 +22,7 @@ struct X_KSEMAPHORE {
 };
 static_assert_size(X_KSEMAPHORE, 0x14);
 
-class XSemaphore : public XObject {
+class XSemaphore : public XDispatcherObject {
  public:
   static const Type kType = kTypeSemaphore;
 
@@ -39,14 +38,15 @@ class XSemaphore : public XObject {
   static object_ref<XSemaphore> Restore(KernelState* kernel_state,
                                         ByteStream* stream);
 
+  void Signal() override;
+
  protected:
-  xe::threading::WaitHandle* GetWaitHandle() override {
-    return semaphore_.get();
-  }
+  bool IsSignaled() const override;
+  bool TryAcquire() override;
+  void UndoAcquire() override;
 
  private:
-  std::unique_ptr<xe::threading::Semaphore> semaphore_;
-  uint32_t maximum_count_ = 0;
+  int32_t maximum_count_ = 0;
 };
 
 }  // namespace kernel
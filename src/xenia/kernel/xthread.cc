@@ -10,6 +10,8 @@
 #include "xenia/kernel/xthread.h"
 
 #include <cstring>
+#include <string>
+#include <vector>
 
 #ifdef XE_PLATFORM_WIN32
 #include <objbase.h>
@@ -35,6 +37,21 @@ DEFINE_bool(ignore_thread_priorities, true,
             "Ignores game-specified thread priorities.", "Kernel");
 DEFINE_bool(ignore_thread_affinities, true,
             "Ignores game-specified thread affinities.", "Kernel");
+DEFINE_string(
+    thread_affinity_mapping, "cores",
+    "How game-specified thread affinities (when not ignored) map the 6 guest "
+    "hardware threads to host logical processors.\n"
+    " direct: guest hardware thread N to host logical processor N.\n"
+    " core_pairs: each guest core (pair of hardware threads) to a host "
+    "physical core, like on the console.\n"
+    " cores: each guest hardware thread to its own host physical core, "
+    "avoiding contention between the threads of a guest core.",
+    "Kernel");
+DEFINE_bool(isolate_host_worker_threads, true,
+            "Keeps the GPU command processor and audio threads on host "
+            "physical cores that game threads are not mapped to, when thread "
+            "affinities are not ignored and there are enough cores.",
+            "Kernel");
 
 namespace xe {
 namespace kernel {
@@ -157,6 +174,69 @@ void XThread::set_name(const std::string_view name) {
 }
 
 uint8_t next_cpu = 0;
+namespace {
+
+// Host affinity masks for guest hardware threads and isolated host work.
+struct HostAffinityMapping {
+  uint64_t hardware_thread_masks[6] = {};
+  uint64_t isolated_masks[2] = {};
+};
+
+const HostAffinityMapping& GetHostAffinityMapping() {
+  static const HostAffinityMapping mapping = []() {
+    HostAffinityMapping mapping;
+    std::vector<uint64_t> cores =
+        xe::threading::physical_core_processor_masks();
+    const std::string& mode = cvars::thread_affinity_mapping;
+    if (mode != "direct" && mode != "core_pairs" && mode != "cores") {
+      XELOGW("Unknown thread_affinity_mapping '{}', using direct", mode);
+    }
+    bool by_cores = (mode == "core_pairs" || mode == "cores") &&
+                    !cores.empty();
+    if (by_cores && cvars::isolate_host_worker_threads) {
+      // Leave the last cores for the GPU command processor and audio if game
+      // threads still get a core for each guest core at least.
+      size_t isolated_core_count = xe::countof(mapping.isolated_masks);
+      if (cores.size() >= 3 + isolated_core_count) {
+        for (size_t i = 0; i < isolated_core_count; ++i) {
+          mapping.isolated_masks[i] =
+              cores[cores.size() - isolated_core_count + i];
+        }
+        cores.resize(cores.size() - isolated_core_count);
+      }
+    }
+    for (uint32_t i = 0; i < 6; ++i) {
+      if (!by_cores) {
+        mapping.hardware_thread_masks[i] = uint64_t(1) << i;
+      } else if (mode == "core_pairs") {
+        mapping.hardware_thread_masks[i] = cores[(i >> 1) % cores.size()];
+      } else {
+        mapping.hardware_thread_masks[i] = cores[i % cores.size()];
+      }
+    }
+    for (uint32_t i = 0; i < 6; ++i) {
+      XELOGI("Guest hardware thread {} mapped to host processors {:016X}", i,
+             mapping.hardware_thread_masks[i]);
+    }
+    return mapping;
+  }();
+  return mapping;
+}
+
+// Host affinity mask for a guest affinity mask, 0 to not restrict.
+uint64_t GuestToHostAffinityMask(uint32_t guest_mask) {
+  const HostAffinityMapping& mapping = GetHostAffinityMapping();
+  uint64_t host_mask = 0;
+  for (uint32_t i = 0; i < 6; ++i) {
+    if (guest_mask & (1 << i)) {
+      host_mask |= mapping.hardware_thread_masks[i];
+    }
+  }
+  return host_mask;
+}
+
+}  // namespace
+
 uint8_t GetFakeCpuNumber(uint8_t proc_mask) {
   if (!proc_mask) {
     next_cpu = (next_cpu + 1) % 6;
@@ -416,7 +496,10 @@ X_STATUS XThread::Create() {
   }
 
   if (!cvars::ignore_thread_affinities) {
-    thread_->set_affinity_mask(proc_mask);
+    uint64_t host_mask = GuestToHostAffinityMask(proc_mask);
+    if (host_mask) {
+      thread_->set_affinity_mask(host_mask);
+    }
   }
 
   // Set the thread name based on host ID (for easier debugging).
@@ -716,7 +799,10 @@ void XThread::SetAffinity(uint32_t affinity) {
   SetActiveCpu(GetFakeCpuNumber(affinity));
   affinity_ = affinity;
   if (!cvars::ignore_thread_affinities) {
-    thread_->set_affinity_mask(affinity);
+    uint64_t host_mask = GuestToHostAffinityMask(affinity);
+    if (host_mask) {
+      thread_->set_affinity_mask(host_mask);
+    }
   }
 }
 
@@ -784,34 +870,27 @@ X_STATUS XThread::Suspend(uint32_t* out_suspend_count) {
 
 X_STATUS XThread::Delay(uint32_t processor_mode, uint32_t alertable,
                         uint64_t interval) {
-  int64_t timeout_ticks = interval;
-  uint32_t timeout_ms;
-  if (timeout_ticks > 0) {
-    // Absolute time, based on January 1, 1601.
-    // TODO(benvanik): convert time to relative time.
-    assert_always();
-    timeout_ms = 0;
-  } else if (timeout_ticks < 0) {
-    // Relative time.
-    timeout_ms = uint32_t(-timeout_ticks / 10000);  // Ticks -> MS
-  } else {
-    timeout_ms = 0;
-  }
-  timeout_ms = Clock::ScaleGuestDurationMillis(timeout_ms);
-  if (alertable) {
-    auto result =
-        xe::threading::AlertableSleep(std::chrono::milliseconds(timeout_ms));
-    switch (result) {
-      default:
-      case xe::threading::SleepResult::kSuccess:
-        return X_STATUS_SUCCESS;
-      case xe::threading::SleepResult::kAlerted:
-        return X_STATUS_USER_APC;
+  auto duration = TimeoutTicksToDuration(int64_t(interval));
+  if (!duration.count()) {
+    // Only give up the rest of the time slice, like NtYieldExecution.
+    if (alertable) {
+      return xe::threading::AlertableSleep(std::chrono::microseconds(0)) ==
+                     xe::threading::SleepResult::kAlerted
+                 ? X_STATUS_USER_APC
+                 : X_STATUS_SUCCESS;
     }
-  } else {
-    xe::threading::Sleep(std::chrono::milliseconds(timeout_ms));
+    xe::threading::MaybeYield();
     return X_STATUS_SUCCESS;
   }
+  // Frame pacing often delays for fractions of a millisecond.
+  auto result = xe::threading::HighResolutionSleep(duration, alertable != 0);
+  switch (result) {
+    default:
+    case xe::threading::SleepResult::kSuccess:
+      return X_STATUS_SUCCESS;
+    case xe::threading::SleepResult::kAlerted:
+      return X_STATUS_USER_APC;
+  }
 }
 
 struct ThreadSavedState {
@@ -1039,6 +1118,16 @@ XHostThread::XHostThread(KernelState* kernel_state, uint32_t stack_size,
   can_debugger_suspend_ = false;
 }
 
+void XHostThread::Isolate(IsolatedWork work) {
+  if (cvars::ignore_thread_affinities || !thread_) {
+    return;
+  }
+  uint64_t host_mask = GetHostAffinityMapping().isolated_masks[size_t(work)];
+  if (host_mask) {
+    thread_->set_affinity_mask(host_mask);
+  }
+}
+
 void XHostThread::Execute() {
   XELOGKERNEL(
       "XThread::Execute thid {} (handle={:08X}, '{}', native={:08X}, <host>)",
@@ -232,6 +232,14 @@ class XHostThread : public XThread {
   XHostThread(KernelState* kernel_state, uint32_t stack_size,
               uint32_t creation_flags, std::function<int()> host_fn);
 
+  // Latency-sensitive host work kept off the host cores of guest threads.
+  enum class IsolatedWork {
+    kGpuCommandProcessor,
+    kAudio,
+  };
+  // Moves the created thread to the host core reserved for the work, if any.
+  void Isolate(IsolatedWork work);
+
   virtual void Execute();
 
  private:
@@ -9,6 +9,9 @@
 
 #include "xenia/kernel/xtimer.h"
 
+#include <atomic>
+#include <memory>
+
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/cpu/processor.h"
@@ -29,6 +32,7 @@ void XTimer::Initialize(uint32_t timer_type) {
       break;
     case 1:  // SynchronizationTimer
       timer_ = xe::threading::Timer::CreateSynchronizationTimer();
+      is_synchronization_ = true;
       break;
     default:
       assert_always();
@@ -43,37 +47,23 @@ X_STATUS XTimer::SetTimer(int64_t due_time, uint32_t period_ms,
     return X_STATUS_TIMER_RESUME_IGNORED;
   }
 
-  due_time = Clock::ScaleGuestDurationFileTime(due_time);
+  // Absolute due times are in the guest system time, which may differ from
+  // the host one, so always set the host timer relative to now.
+  auto due_duration = TimeoutTicksToDuration(due_time);
   period_ms = Clock::ScaleGuestDurationMillis(period_ms);
+  period_ms_ = period_ms;
 
   // Stash routine for callback.
   callback_thread_ = XThread::GetCurrentThread();
   callback_routine_ = routine;
   callback_routine_arg_ = routine_arg;
 
-  // This callback will only be issued when the timer is fired.
-  std::function<void()> callback = nullptr;
-  if (callback_routine_) {
-    callback = [this]() {
-      // Queue APC to call back routine with (arg, low, high).
-      // It'll be executed on the thread that requested the timer.
-      uint64_t time = xe::Clock::QueryGuestSystemTime();
-      uint32_t time_low = static_cast<uint32_t>(time);
-      uint32_t time_high = static_cast<uint32_t>(time >> 32);
-      XELOGI(
-          "XTimer enqueuing timer callback to {:08X}({:08X}, {:08X}, {:08X})",
-          callback_routine_, callback_routine_arg_, time_low, time_high);
-      callback_thread_->EnqueueApc(callback_routine_, callback_routine_arg_,
-                                   time_low, time_high);
-    };
-  }
-
+  std::function<void()> callback = CreateCallback();
   bool result;
   if (!period_ms) {
-    result = timer_->SetOnce(std::chrono::nanoseconds(due_time * 100),
-                             std::move(callback));
+    result = timer_->SetOnce(-due_duration, std::move(callback));
   } else {
-    result = timer_->SetRepeating(std::chrono::nanoseconds(due_time * 100),
+    result = timer_->SetRepeating(-due_duration,
                                   std::chrono::milliseconds(period_ms),
                                   std::move(callback));
   }
@@ -81,6 +71,50 @@ X_STATUS XTimer::SetTimer(int64_t due_time, uint32_t period_ms,
   return result ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
 }
 
+std::function<void()> XTimer::CreateCallback() {
+  // This callback will only be issued when the timer is fired.
+  if (!callback_routine_) {
+    return nullptr;
+  }
+  return [this]() {
+    // Queue APC to call back routine with (arg, low, high).
+    // It'll be executed on the thread that requested the timer.
+    uint64_t time = xe::Clock::QueryGuestSystemTime();
+    uint32_t time_low = static_cast<uint32_t>(time);
+    uint32_t time_high = static_cast<uint32_t>(time >> 32);
+    XELOGI("XTimer enqueuing timer callback to {:08X}({:08X}, {:08X}, {:08X})",
+           callback_routine_, callback_routine_arg_, time_low, time_high);
+    callback_thread_->EnqueueApc(callback_routine_, callback_routine_arg_,
+                                 time_low, time_high);
+  };
+}
+
+void XTimer::UndoWait() {
+  // Notification timers stay signaled when waited for.
+  if (!is_synchronization_) {
+    return;
+  }
+  // Signal the timer again right away. The host timer has no way of setting
+  // the state directly, so a periodic timer restarts its period from now, and
+  // skips the callback for the signal that already had one.
+  if (!period_ms_) {
+    timer_->SetOnce(std::chrono::nanoseconds(0));
+    return;
+  }
+  std::function<void()> callback = CreateCallback();
+  if (callback) {
+    auto skip_callback = std::make_shared<std::atomic<bool>>(true);
+    callback = [skip_callback, callback]() {
+      if (!skip_callback->exchange(false)) {
+        callback();
+      }
+    };
+  }
+  timer_->SetRepeating(std::chrono::nanoseconds(0),
+                       std::chrono::milliseconds(period_ms_),
+                       std::move(callback));
+}
+
 X_STATUS XTimer::Cancel() {
   return timer_->Cancel() ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
 }
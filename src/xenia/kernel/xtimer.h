@@ -10,6 +10,8 @@
 #ifndef XENIA_KERNEL_XTIMER_H_
 #define XENIA_KERNEL_XTIMER_H_
 
+#include <functional>
+
 #include "xenia/base/threading.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/xbox.h"
@@ -34,9 +36,14 @@ class XTimer : public XObject {
 
  protected:
   xe::threading::WaitHandle* GetWaitHandle() override { return timer_.get(); }
+  void UndoWait() override;
 
  private:
+  std::function<void()> CreateCallback();
+
   std::unique_ptr<xe::threading::Timer> timer_;
+  bool is_synchronization_ = false;
+  uint32_t period_ms_ = 0;
 
   XThread* callback_thread_ = nullptr;
   uint32_t callback_routine_ = 0;
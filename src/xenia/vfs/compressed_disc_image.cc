@@ -0,0 +1,430 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/compressed_disc_image.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "third_party/snappy/snappy.h"
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+
+namespace xe {
+namespace vfs {
+
+using xe::filesystem::FileAccess;
+using xe::filesystem::FileHandle;
+
+namespace {
+
+bool IsValidBlockSize(uint32_t block_size) {
+  return block_size >= CompressedDiscImage::kMinBlockSize &&
+         block_size <= CompressedDiscImage::kMaxBlockSize &&
+         !(block_size & (block_size - 1));
+}
+
+uint64_t GetBlockCount(uint64_t image_size, uint32_t block_size) {
+  return xe::round_up(image_size, uint64_t(block_size)) / block_size;
+}
+
+bool ReadExactly(FileHandle* file, uint64_t offset, void* buffer,
+                 size_t length) {
+  size_t bytes_read = 0;
+  return file->Read(size_t(offset), buffer, length, &bytes_read) &&
+         bytes_read == length;
+}
+
+// Reads a block of the raw image, padding the last one with zeros.
+bool ReadRawBlock(FileHandle* file, uint64_t image_size, uint32_t block_size,
+                  uint32_t block_index, uint8_t* buffer) {
+  uint64_t offset = uint64_t(block_index) * block_size;
+  size_t length = size_t(std::min(uint64_t(block_size), image_size - offset));
+  std::memset(buffer + length, 0, block_size - length);
+  return ReadExactly(file, offset, buffer, length);
+}
+
+}  // namespace
+
+std::unique_ptr<CompressedDiscImage> CompressedDiscImage::Open(
+    const std::filesystem::path& path, size_t cache_size,
+    uint32_t read_ahead_block_count) {
+  auto file = FileHandle::OpenExisting(path, FileAccess::kFileReadData);
+  if (!file) {
+    XELOGE("Unable to open compressed disc image {}", xe::path_to_utf8(path));
+    return nullptr;
+  }
+  auto image = std::unique_ptr<CompressedDiscImage>(new CompressedDiscImage(
+      path, std::move(file), cache_size, read_ahead_block_count));
+  if (!image->ReadIndex()) {
+    return nullptr;
+  }
+  return image;
+}
+
+CompressedDiscImage::CompressedDiscImage(const std::filesystem::path& path,
+                                         std::unique_ptr<FileHandle> file,
+                                         size_t cache_size,
+                                         uint32_t read_ahead_block_count)
+    : path_(path),
+      file_(std::move(file)),
+      cache_capacity_(cache_size),
+      read_ahead_block_count_(read_ahead_block_count) {}
+
+CompressedDiscImage::~CompressedDiscImage() = default;
+
+bool CompressedDiscImage::ReadIndex() {
+  std::error_code error;
+  uint64_t file_size = std::filesystem::file_size(path_, error);
+  if (error || file_size < sizeof(Header) ||
+      !ReadExactly(file_.get(), 0, &header_, sizeof(header_))) {
+    XELOGE("Unable to read the compressed disc image header");
+    return false;
+  }
+  if (std::memcmp(header_.magic, kMagic, sizeof(kMagic)) ||
+      header_.version != kVersion || !IsValidBlockSize(header_.block_size) ||
+      header_.block_count !=
+          GetBlockCount(header_.image_size, header_.block_size) ||
+      header_.index_offset < sizeof(Header) ||
+      header_.index_offset > file_size ||
+      (file_size - header_.index_offset) / sizeof(IndexEntry) <
+          header_.block_count) {
+    XELOGE("Invalid compressed disc image header");
+    return false;
+  }
+
+  index_.resize(header_.block_count);
+  if (!ReadExactly(file_.get(), header_.index_offset, index_.data(),
+                   index_.size() * sizeof(IndexEntry))) {
+    XELOGE("Unable to read the compressed disc image index");
+    return false;
+  }
+  size_t max_compressed_size =
+      snappy::MaxCompressedLength(header_.block_size);
+  for (const IndexEntry& entry : index_) {
+    bool valid;
+    switch (entry.encoding) {
+      case BlockEncoding::kZero:
+        valid = !entry.size;
+        break;
+      case BlockEncoding::kNone:
+        valid = entry.size == header_.block_size;
+        break;
+      case BlockEncoding::kSnappy:
+        valid = entry.size && entry.size <= max_compressed_size;
+        break;
+      default:
+        valid = false;
+        break;
+    }
+    if (!valid || (entry.size && (entry.offset < sizeof(Header) ||
+                                  entry.offset > header_.index_offset ||
+                                  header_.index_offset - entry.offset <
+                                      entry.size))) {
+      XELOGE("Invalid compressed disc image index entry");
+      return false;
+    }
+  }
+
+  zero_block_ = std::make_shared<std::vector<uint8_t>>(header_.block_size);
+  // The blocks being read ahead must fit in the cache alongside the block
+  // being read.
+  cache_capacity_ = std::max(cache_capacity_ / header_.block_size,
+                             size_t(read_ahead_block_count_) + 2);
+  return true;
+}
+
+bool CompressedDiscImage::Read(uint64_t offset, void* buffer, size_t length) {
+  if (offset > header_.image_size || header_.image_size - offset < length) {
+    return false;
+  }
+  auto buffer_ptr = reinterpret_cast<uint8_t*>(buffer);
+  while (length) {
+    auto block_index = uint32_t(offset / header_.block_size);
+    size_t block_offset = size_t(offset % header_.block_size);
+    size_t copy_length = std::min(length, header_.block_size - block_offset);
+    Block block = GetBlock(block_index);
+    if (!block) {
+      return false;
+    }
+    std::memcpy(buffer_ptr, block->data() + block_offset, copy_length);
+    buffer_ptr += copy_length;
+    offset += copy_length;
+    length -= copy_length;
+  }
+  return true;
+}
+
+CompressedDiscImage::Statistics CompressedDiscImage::statistics() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+CompressedDiscImage::Block CompressedDiscImage::GetBlock(
+    uint32_t block_index) {
+  uint32_t load_count = 1;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++statistics_.block_reads;
+    bool sequential = block_index == last_block_index_ + 1;
+    last_block_index_ = block_index;
+    if (index_[block_index].encoding == BlockEncoding::kZero) {
+      ++statistics_.cache_hits;
+      return zero_block_;
+    }
+    auto it = cache_.find(block_index);
+    if (it != cache_.end()) {
+      ++statistics_.cache_hits;
+      lru_.splice(lru_.begin(), lru_, it->second.lru_iterator);
+      return it->second.block;
+    }
+    if (sequential) {
+      load_count += read_ahead_block_count_;
+    }
+  }
+  // Load without holding the lock so other threads can use cached blocks.
+  return LoadBlocks(block_index, load_count);
+}
+
+CompressedDiscImage::Block CompressedDiscImage::LoadBlocks(
+    uint32_t block_index, uint32_t block_count) {
+  // Extend the host read over the following blocks as long as their data is
+  // stored right after and they aren't cached yet. Zero blocks in between
+  // have no data and don't interrupt the run.
+  const IndexEntry& first_entry = index_[block_index];
+  uint64_t end_offset = first_entry.offset + first_entry.size;
+  uint32_t load_count = 1;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (load_count < block_count &&
+           block_index + load_count < header_.block_count) {
+      const IndexEntry& entry = index_[block_index + load_count];
+      if (entry.encoding != BlockEncoding::kZero &&
+          (entry.offset != end_offset ||
+           cache_.count(block_index + load_count))) {
+        break;
+      }
+      end_offset += entry.size;
+      ++load_count;
+    }
+  }
+
+  std::vector<uint8_t> data(size_t(end_offset - first_entry.offset));
+  if (!ReadExactly(file_.get(), first_entry.offset, data.data(),
+                   data.size())) {
+    XELOGE("Unable to read compressed disc image block {}", block_index);
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++statistics_.host_reads;
+    statistics_.host_bytes_read += data.size();
+  }
+
+  Block first_block;
+  const uint8_t* data_ptr = data.data();
+  for (uint32_t i = 0; i < load_count; ++i) {
+    if (index_[block_index + i].encoding == BlockEncoding::kZero) {
+      continue;
+    }
+    Block block = DecodeBlock(block_index + i, data_ptr);
+    if (!block) {
+      XELOGE("Unable to decompress compressed disc image block {}",
+             block_index + i);
+      return nullptr;
+    }
+    data_ptr += index_[block_index + i].size;
+    block = CacheBlock(block_index + i, std::move(block));
+    if (!i) {
+      first_block = std::move(block);
+    }
+  }
+  return first_block;
+}
+
+CompressedDiscImage::Block CompressedDiscImage::DecodeBlock(
+    uint32_t block_index, const uint8_t* data) {
+  const IndexEntry& entry = index_[block_index];
+  auto block = std::make_shared<std::vector<uint8_t>>(header_.block_size);
+  switch (entry.encoding) {
+    case BlockEncoding::kNone:
+      std::memcpy(block->data(), data, header_.block_size);
+      break;
+    case BlockEncoding::kSnappy: {
+      auto compressed = reinterpret_cast<const char*>(data);
+      size_t uncompressed_length = 0;
+      if (!snappy::GetUncompressedLength(compressed, entry.size,
+                                         &uncompressed_length) ||
+          uncompressed_length != header_.block_size ||
+          !snappy::RawUncompress(compressed, entry.size,
+                                 reinterpret_cast<char*>(block->data()))) {
+        return nullptr;
+      }
+    } break;
+    default:
+      assert_unhandled_case(entry.encoding);
+      return nullptr;
+  }
+  return block;
+}
+
+CompressedDiscImage::Block CompressedDiscImage::CacheBlock(
+    uint32_t block_index, Block block) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = cache_.find(block_index);
+  if (it != cache_.end()) {
+    return it->second.block;
+  }
+  lru_.push_front(block_index);
+  cache_.emplace(block_index, CacheEntry{block, lru_.begin()});
+  while (cache_.size() > cache_capacity_) {
+    cache_.erase(lru_.back());
+    lru_.pop_back();
+  }
+  return block;
+}
+
+bool CompressedDiscImage::Create(const std::filesystem::path& source_path,
+                                 const std::filesystem::path& target_path,
+                                 const CreateOptions& options,
+                                 CreateStatistics* out_statistics) {
+  uint32_t block_size = options.block_size;
+  if (!IsValidBlockSize(block_size)) {
+    XELOGE("Invalid compressed disc image block size {}", block_size);
+    return false;
+  }
+  std::error_code error;
+  uint64_t image_size = std::filesystem::file_size(source_path, error);
+  auto source =
+      FileHandle::OpenExisting(source_path, FileAccess::kFileReadData);
+  if (error || !source) {
+    XELOGE("Unable to open disc image {}", xe::path_to_utf8(source_path));
+    return false;
+  }
+  uint64_t block_count = GetBlockCount(image_size, block_size);
+  if (block_count > UINT32_MAX) {
+    XELOGE("Disc image {} is too large", xe::path_to_utf8(source_path));
+    return false;
+  }
+  FILE* target = xe::filesystem::OpenFile(target_path, "wb");
+  if (!target) {
+    XELOGE("Unable to create {}", xe::path_to_utf8(target_path));
+    return false;
+  }
+  auto fail = [&]() {
+    fclose(target);
+    std::filesystem::remove(target_path, error);
+    return false;
+  };
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.image_size = image_size;
+  header.block_size = block_size;
+  header.block_count = uint32_t(block_count);
+  // Rewritten once the location of the index is known.
+  if (fwrite(&header, sizeof(header), 1, target) != 1) {
+    XELOGE("Unable to write {}", xe::path_to_utf8(target_path));
+    return fail();
+  }
+  uint64_t offset = sizeof(header);
+
+  CreateStatistics statistics = {};
+  statistics.image_size = image_size;
+  statistics.block_count = header.block_count;
+  std::vector<IndexEntry> index(header.block_count);
+  // Hashes of the blocks stored so far, to find duplicates.
+  std::unordered_multimap<uint64_t, uint32_t> stored_blocks;
+  std::vector<uint8_t> block(block_size);
+  std::vector<uint8_t> stored_block(block_size);
+  std::vector<char> compressed(snappy::MaxCompressedLength(block_size));
+  for (uint32_t i = 0; i < header.block_count; ++i) {
+    if (!ReadRawBlock(source.get(), image_size, block_size, i, block.data())) {
+      XELOGE("Unable to read {}", xe::path_to_utf8(source_path));
+      return fail();
+    }
+    IndexEntry& entry = index[i];
+    if (std::all_of(block.begin(), block.end(),
+                    [](uint8_t value) { return !value; })) {
+      entry = {0, 0, BlockEncoding::kZero};
+      ++statistics.zero_block_count;
+      continue;
+    }
+
+    uint64_t hash = 0;
+    if (options.deduplicate) {
+      hash = XXH64(block.data(), block_size, 0);
+      auto range = stored_blocks.equal_range(hash);
+      auto it = range.first;
+      for (; it != range.second; ++it) {
+        if (!ReadRawBlock(source.get(), image_size, block_size, it->second,
+                          stored_block.data())) {
+          XELOGE("Unable to read {}", xe::path_to_utf8(source_path));
+          return fail();
+        }
+        if (stored_block == block) {
+          break;
+        }
+      }
+      if (it != range.second) {
+        entry = index[it->second];
+        ++statistics.duplicate_block_count;
+        continue;
+      }
+    }
+
+    size_t compressed_length = 0;
+    snappy::RawCompress(reinterpret_cast<const char*>(block.data()),
+                        block_size, compressed.data(), &compressed_length);
+    // Blocks that barely shrink aren't worth decompressing on every load.
+    const void* data;
+    if (compressed_length < block_size - block_size / 8) {
+      entry = {offset, uint32_t(compressed_length), BlockEncoding::kSnappy};
+      data = compressed.data();
+    } else {
+      entry = {offset, block_size, BlockEncoding::kNone};
+      data = block.data();
+      ++statistics.uncompressed_block_count;
+    }
+    if (fwrite(data, 1, entry.size, target) != entry.size) {
+      XELOGE("Unable to write {}", xe::path_to_utf8(target_path));
+      return fail();
+    }
+    offset += entry.size;
+    if (options.deduplicate) {
+      stored_blocks.emplace(hash, i);
+    }
+  }
+
+  header.index_offset = offset;
+  if (fwrite(index.data(), sizeof(IndexEntry), index.size(), target) !=
+          index.size() ||
+      !xe::filesystem::Seek(target, 0, SEEK_SET) ||
+      fwrite(&header, sizeof(header), 1, target) != 1) {
+    XELOGE("Unable to write {}", xe::path_to_utf8(target_path));
+    return fail();
+  }
+  if (fclose(target)) {
+    XELOGE("Unable to write {}", xe::path_to_utf8(target_path));
+    std::filesystem::remove(target_path, error);
+    return false;
+  }
+
+  statistics.container_size = offset + index.size() * sizeof(IndexEntry);
+  if (out_statistics) {
+    *out_statistics = statistics;
+  }
+  return true;
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,157 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_COMPRESSED_DISC_IMAGE_H_
+#define XENIA_VFS_COMPRESSED_DISC_IMAGE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/filesystem.h"
+
+namespace xe {
+namespace vfs {
+
+// Disc image split into fixed-size blocks compressed individually, so that
+// any part of it can be read without decompressing the rest.
+//
+// File layout (all values little-endian):
+//   Header
+//   Block data, in any order - blocks with identical contents may share it.
+//   Index - one IndexEntry per block, at header.index_offset.
+//
+// The last block is padded with zeros to the block size.
+class CompressedDiscImage {
+ public:
+  static constexpr char kMagic[4] = {'X', 'C', 'D', 'I'};
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint32_t kMinBlockSize = 0x800;
+  static constexpr uint32_t kMaxBlockSize = 0x1000000;
+  static constexpr uint32_t kDefaultBlockSize = 0x10000;
+
+  enum class BlockEncoding : uint32_t {
+    // All zeros, no data stored.
+    kZero,
+    // Stored as is.
+    kNone,
+    kSnappy,
+  };
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t image_size;
+    uint32_t block_size;
+    uint32_t block_count;
+    uint64_t index_offset;
+    uint8_t reserved[32];
+  };
+  static_assert(sizeof(Header) == 64, "Header must be 64 bytes");
+
+  struct IndexEntry {
+    uint64_t offset;
+    uint32_t size;
+    BlockEncoding encoding;
+  };
+  static_assert(sizeof(IndexEntry) == 16, "IndexEntry must be 16 bytes");
+
+  struct Statistics {
+    uint64_t block_reads;
+    uint64_t cache_hits;
+    uint64_t host_reads;
+    uint64_t host_bytes_read;
+  };
+
+  struct CreateOptions {
+    uint32_t block_size = kDefaultBlockSize;
+    // Store blocks with the same contents once.
+    bool deduplicate = true;
+  };
+
+  struct CreateStatistics {
+    uint64_t image_size;
+    uint64_t container_size;
+    uint32_t block_count;
+    uint32_t zero_block_count;
+    uint32_t duplicate_block_count;
+    uint32_t uncompressed_block_count;
+  };
+
+  // Opens a compressed image, keeping up to cache_size bytes of decompressed
+  // blocks in memory. Sequential reads load up to read_ahead_block_count
+  // blocks following the requested one with a single host read.
+  static std::unique_ptr<CompressedDiscImage> Open(
+      const std::filesystem::path& path, size_t cache_size,
+      uint32_t read_ahead_block_count);
+
+  // Compresses the raw image at source_path into target_path.
+  static bool Create(const std::filesystem::path& source_path,
+                     const std::filesystem::path& target_path,
+                     const CreateOptions& options,
+                     CreateStatistics* out_statistics = nullptr);
+
+  ~CompressedDiscImage();
+
+  const std::filesystem::path& path() const { return path_; }
+  // Size of the uncompressed image.
+  uint64_t size() const { return header_.image_size; }
+  uint32_t block_size() const { return header_.block_size; }
+
+  // Reads from the uncompressed image. Safe to call from multiple threads.
+  // Fails if the range is out of bounds or the host file can't be read.
+  bool Read(uint64_t offset, void* buffer, size_t length);
+
+  Statistics statistics();
+
+ private:
+  using Block = std::shared_ptr<const std::vector<uint8_t>>;
+
+  CompressedDiscImage(const std::filesystem::path& path,
+                      std::unique_ptr<xe::filesystem::FileHandle> file,
+                      size_t cache_size, uint32_t read_ahead_block_count);
+
+  bool ReadIndex();
+  Block GetBlock(uint32_t block_index);
+  // Loads block_index and the read-ahead blocks stored after it, returning
+  // the first one.
+  Block LoadBlocks(uint32_t block_index, uint32_t block_count);
+  Block DecodeBlock(uint32_t block_index, const uint8_t* data);
+  // Adds the block to the cache, and returns the block already cached if it
+  // was loaded by another thread in the meantime.
+  Block CacheBlock(uint32_t block_index, Block block);
+
+  std::filesystem::path path_;
+  std::unique_ptr<xe::filesystem::FileHandle> file_;
+  Header header_ = {};
+  std::vector<IndexEntry> index_;
+  Block zero_block_;
+
+  std::mutex mutex_;
+  // Most recently used blocks at the front.
+  std::list<uint32_t> lru_;
+  struct CacheEntry {
+    Block block;
+    std::list<uint32_t>::iterator lru_iterator;
+  };
+  std::unordered_map<uint32_t, CacheEntry> cache_;
+  size_t cache_capacity_;
+  uint32_t read_ahead_block_count_;
+  uint32_t last_block_index_ = UINT32_MAX;
+  Statistics statistics_ = {};
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_COMPRESSED_DISC_IMAGE_H_
@@ -0,0 +1,108 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
+
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/vfs/devices/compressed_disc_image_entry.h"
+#include "xenia/vfs/devices/gdfx_parser.h"
+
+namespace xe {
+namespace vfs {
+
+namespace {
+
+class CompressedDiscImageBlockReader : public BlockReader {
+ public:
+  explicit CompressedDiscImageBlockReader(CompressedDiscImage* image)
+      : image_(image) {}
+
+  uint64_t size() const override { return image_->size(); }
+  bool Read(uint64_t offset, void* buffer, size_t length) override {
+    return image_->Read(offset, buffer, length);
+  }
+
+ private:
+  CompressedDiscImage* image_;
+};
+
+}  // namespace
+
+CompressedDiscImageDevice::CompressedDiscImageDevice(
+    const std::string_view mount_path, const std::filesystem::path& host_path,
+    size_t cache_size, uint32_t read_ahead_block_count)
+    : Device(mount_path),
+      name_("GDFX"),
+      host_path_(host_path),
+      cache_size_(cache_size),
+      read_ahead_block_count_(read_ahead_block_count) {}
+
+CompressedDiscImageDevice::~CompressedDiscImageDevice() = default;
+
+bool CompressedDiscImageDevice::Initialize() {
+  image_ = CompressedDiscImage::Open(host_path_, cache_size_,
+                                     read_ahead_block_count_);
+  if (!image_) {
+    XELOGE("Compressed disc image could not be opened");
+    return false;
+  }
+
+  auto root_entry =
+      new CompressedDiscImageEntry(this, nullptr, "", image_.get());
+  root_entry->attributes_ = kFileAttributeDirectory;
+  root_entry_ = std::unique_ptr<Entry>(root_entry);
+
+  CompressedDiscImageBlockReader reader(image_.get());
+  auto result = GdfxParser(&reader).Parse(
+      root_entry, [this](Entry* parent, const GdfxParser::EntryInfo& info) {
+        auto entry = CompressedDiscImageEntry::Create(this, parent, info.name,
+                                                      image_.get());
+        entry->attributes_ = info.attributes | kFileAttributeReadOnly;
+        entry->size_ = info.size;
+        entry->allocation_size_ = xe::round_up(info.size, bytes_per_sector());
+
+        // Set to January 1, 1970 (UTC) in 100-nanosecond intervals
+        entry->create_timestamp_ = 10000 * 11644473600000LL;
+        entry->access_timestamp_ = 10000 * 11644473600000LL;
+        entry->write_timestamp_ = 10000 * 11644473600000LL;
+
+        entry->data_offset_ = size_t(info.data_offset);
+        entry->data_size_ =
+            (info.attributes & kFileAttributeDirectory) ? 0 : info.size;
+
+        Entry* entry_ptr = entry.get();
+        static_cast<CompressedDiscImageEntry*>(parent)->children_.emplace_back(
+            std::move(entry));
+        return entry_ptr;
+      });
+  if (result != GdfxParser::Error::kSuccess) {
+    XELOGE("Failed to read the GDFX file system: {}", int(result));
+    return false;
+  }
+  root_entry->IndexChildren(true);
+
+  return true;
+}
+
+void CompressedDiscImageDevice::Dump(StringBuffer* string_buffer) {
+  auto global_lock = global_critical_region_.Acquire();
+  root_entry_->Dump(string_buffer, 0);
+}
+
+Entry* CompressedDiscImageDevice::ResolvePath(const std::string_view path) {
+  // The filesystem will have stripped our prefix off already, so the path will
+  // be in the form:
+  // some\PATH.foo
+  XELOGFS("CompressedDiscImageDevice::ResolvePath({})", path);
+  return root_entry_->ResolvePath(path);
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
+#define XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
+
+#include <memory>
+#include <string>
+
+#include "xenia/vfs/compressed_disc_image.h"
+#include "xenia/vfs/device.h"
+
+namespace xe {
+namespace vfs {
+
+// GDFX disc image stored as a CompressedDiscImage, read on demand rather than
+// mapped as a whole.
+class CompressedDiscImageDevice : public Device {
+ public:
+  // See CompressedDiscImage::Open for cache_size and read_ahead_block_count.
+  CompressedDiscImageDevice(const std::string_view mount_path,
+                            const std::filesystem::path& host_path,
+                            size_t cache_size,
+                            uint32_t read_ahead_block_count);
+  ~CompressedDiscImageDevice() override;
+
+  bool Initialize() override;
+  void Dump(StringBuffer* string_buffer) override;
+  Entry* ResolvePath(const std::string_view path) override;
+
+  const std::string& name() const override { return name_; }
+  uint32_t attributes() const override { return 0; }
+  uint32_t component_name_max_length() const override { return 255; }
+
+  uint32_t total_allocation_units() const override {
+    return uint32_t(image_->size() / sectors_per_allocation_unit() /
+                    bytes_per_sector());
+  }
+  uint32_t available_allocation_units() const override { return 0; }
+  uint32_t sectors_per_allocation_unit() const override { return 1; }
+  uint32_t bytes_per_sector() const override { return 0x200; }
+
+  CompressedDiscImage* image() const { return image_.get(); }
+
+ private:
+  std::string name_;
+  std::filesystem::path host_path_;
+  size_t cache_size_;
+  uint32_t read_ahead_block_count_;
+  std::unique_ptr<Entry> root_entry_;
+  std::unique_ptr<CompressedDiscImage> image_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
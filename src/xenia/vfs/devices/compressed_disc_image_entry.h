@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_ENTRY_H_
+#define XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_ENTRY_H_
+
+#include <string>
+#include <vector>
+
+#include "xenia/vfs/compressed_disc_image.h"
+#include "xenia/vfs/entry.h"
+
+namespace xe {
+namespace vfs {
+
+class CompressedDiscImageDevice;
+
+class CompressedDiscImageEntry : public Entry {
+ public:
+  CompressedDiscImageEntry(Device* device, Entry* parent,
+                           const std::string_view path,
+                           CompressedDiscImage* image);
+  ~CompressedDiscImageEntry() override;
+
+  static std::unique_ptr<CompressedDiscImageEntry> Create(
+      Device* device, Entry* parent, const std::string_view name,
+      CompressedDiscImage* image);
+
+  CompressedDiscImage* image() const { return image_; }
+  size_t data_offset() const { return data_offset_; }
+  size_t data_size() const { return data_size_; }
+
+  X_STATUS Open(uint32_t desired_access, File** out_file) override;
+
+ private:
+  friend class CompressedDiscImageDevice;
+
+  CompressedDiscImage* image_;
+  size_t data_offset_;
+  size_t data_size_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_ENTRY_H_
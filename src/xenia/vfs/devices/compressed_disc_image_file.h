@@ -0,0 +1,43 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_FILE_H_
+#define XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_FILE_H_
+
+#include "xenia/vfs/file.h"
+
+namespace xe {
+namespace vfs {
+
+class CompressedDiscImageEntry;
+
+class CompressedDiscImageFile : public File {
+ public:
+  CompressedDiscImageFile(uint32_t file_access,
+                          CompressedDiscImageEntry* entry);
+  ~CompressedDiscImageFile() override;
+
+  void Destroy() override;
+
+  X_STATUS ReadSync(void* buffer, size_t buffer_length, size_t byte_offset,
+                    size_t* out_bytes_read) override;
+  X_STATUS WriteSync(const void* buffer, size_t buffer_length,
+                     size_t byte_offset, size_t* out_bytes_written) override {
+    return X_STATUS_ACCESS_DENIED;
+  }
+  X_STATUS SetLength(size_t length) override { return X_STATUS_ACCESS_DENIED; }
+
+ private:
+  CompressedDiscImageEntry* entry_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_FILE_H_
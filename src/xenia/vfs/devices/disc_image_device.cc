@@ -9,14 +9,36 @@
 
 #include "xenia/vfs/devices/disc_image_device.h"
 
+#include <cstring>
+
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/vfs/devices/disc_image_entry.h"
+#include "xenia/vfs/devices/gdfx_parser.h"
 
 namespace xe {
 namespace vfs {
 
-const size_t kXESectorSize = 2048;
+namespace {
+
+class MappedMemoryBlockReader : public BlockReader {
+ public:
+  explicit MappedMemoryBlockReader(MappedMemory* mmap) : mmap_(mmap) {}
+
+  uint64_t size() const override { return mmap_->size(); }
+  bool Read(uint64_t offset, void* buffer, size_t length) override {
+    if (offset > mmap_->size() || mmap_->size() - offset < length) {
+      return false;
+    }
+    std::memcpy(buffer, mmap_->data() + offset, length);
+    return true;
+  }
+
+ private:
+  MappedMemory* mmap_;
+};
+
+}  // namespace
 
 DiscImageDevice::DiscImageDevice(const std::string_view mount_path,
                                  const std::filesystem::path& host_path)
@@ -31,20 +53,38 @@ bool DiscImageDevice::Initialize() {
     return false;
   }
 
-  ParseState state = {0};
-  state.ptr = mmap_->data();
-  state.size = mmap_->size();
-  auto result = Verify(&state);
-  if (result != Error::kSuccess) {
-    XELOGE("Failed to verify disc image header: {}", result);
-    return false;
-  }
+  auto root_entry = new DiscImageEntry(this, nullptr, "", mmap_.get());
+  root_entry->attributes_ = kFileAttributeDirectory;
+  root_entry_ = std::unique_ptr<Entry>(root_entry);
 
-  result = ReadAllEntries(&state, state.ptr + state.root_offset);
-  if (result != Error::kSuccess) {
-    XELOGE("Failed to read all GDFX entries: {}", result);
+  MappedMemoryBlockReader reader(mmap_.get());
+  auto result = GdfxParser(&reader).Parse(
+      root_entry, [this](Entry* parent, const GdfxParser::EntryInfo& info) {
+        auto entry =
+            DiscImageEntry::Create(this, parent, info.name, mmap_.get());
+        entry->attributes_ = info.attributes | kFileAttributeReadOnly;
+        entry->size_ = info.size;
+        entry->allocation_size_ = xe::round_up(info.size, bytes_per_sector());
+
+        // Set to January 1, 1970 (UTC) in 100-nanosecond intervals
+        entry->create_timestamp_ = 10000 * 11644473600000LL;
+        entry->access_timestamp_ = 10000 * 11644473600000LL;
+        entry->write_timestamp_ = 10000 * 11644473600000LL;
+
+        entry->data_offset_ = size_t(info.data_offset);
+        entry->data_size_ =
+            (info.attributes & kFileAttributeDirectory) ? 0 : info.size;
+
+        Entry* entry_ptr = entry.get();
+        static_cast<DiscImageEntry*>(parent)->children_.emplace_back(
+            std::move(entry));
+        return entry_ptr;
+      });
+  if (result != GdfxParser::Error::kSuccess) {
+    XELOGE("Failed to read the GDFX file system: {}", int(result));
     return false;
   }
+  root_entry->IndexChildren(true);
 
   return true;
 }
@@ -62,124 +102,5 @@ Entry* DiscImageDevice::ResolvePath(const std::string_view path) {
   return root_entry_->ResolvePath(path);
 }
 
-DiscImageDevice::Error DiscImageDevice::Verify(ParseState* state) {
-  // Find sector 32 of the game partition - try at a few points.
-  static const size_t likely_offsets[] = {
-      0x00000000, 0x0000FB20, 0x00020600, 0x02080000, 0x0FD90000,
-  };
-  bool magic_found = false;
-  for (size_t n = 0; n < xe::countof(likely_offsets); n++) {
-    state->game_offset = likely_offsets[n];
-    if (VerifyMagic(state, state->game_offset + (32 * kXESectorSize))) {
-      magic_found = true;
-      break;
-    }
-  }
-  if (!magic_found) {
-    // File doesn't have the magic values - likely not a real GDFX source.
-    return Error::kErrorFileMismatch;
-  }
-
-  // Read sector 32 to get FS state.
-  if (state->size < state->game_offset + (32 * kXESectorSize)) {
-    return Error::kErrorReadError;
-  }
-  uint8_t* fs_ptr = state->ptr + state->game_offset + (32 * kXESectorSize);
-  state->root_sector = xe::load<uint32_t>(fs_ptr + 20);
-  state->root_size = xe::load<uint32_t>(fs_ptr + 24);
-  state->root_offset =
-      state->game_offset + (state->root_sector * kXESectorSize);
-  if (state->root_size < 13 || state->root_size > 32 * 1024 * 1024) {
-    return Error::kErrorDamagedFile;
-  }
-
-  return Error::kSuccess;
-}
-
-bool DiscImageDevice::VerifyMagic(ParseState* state, size_t offset) {
-  if (offset >= state->size) {
-    return false;
-  }
-
-  // Simple check to see if the given offset contains the magic value.
-  return std::memcmp(state->ptr + offset, "MICROSOFT*XBOX*MEDIA", 20) == 0;
-}
-
-DiscImageDevice::Error DiscImageDevice::ReadAllEntries(
-    ParseState* state, const uint8_t* root_buffer) {
-  auto root_entry = new DiscImageEntry(this, nullptr, "", mmap_.get());
-  root_entry->attributes_ = kFileAttributeDirectory;
-  root_entry_ = std::unique_ptr<Entry>(root_entry);
-
-  if (!ReadEntry(state, root_buffer, 0, root_entry)) {
-    return Error::kErrorOutOfMemory;
-  }
-
-  return Error::kSuccess;
-}
-
-bool DiscImageDevice::ReadEntry(ParseState* state, const uint8_t* buffer,
-                                uint16_t entry_ordinal,
-                                DiscImageEntry* parent) {
-  const uint8_t* p = buffer + (entry_ordinal * 4);
-
-  uint16_t node_l = xe::load<uint16_t>(p + 0);
-  uint16_t node_r = xe::load<uint16_t>(p + 2);
-  size_t sector = xe::load<uint32_t>(p + 4);
-  size_t length = xe::load<uint32_t>(p + 8);
-  uint8_t attributes = xe::load<uint8_t>(p + 12);
-  uint8_t name_length = xe::load<uint8_t>(p + 13);
-  auto name_buffer = reinterpret_cast<const char*>(p + 14);
-
-  if (node_l && !ReadEntry(state, buffer, node_l, parent)) {
-    return false;
-  }
-
-  auto name = std::string(name_buffer, name_length);
-
-  auto entry = DiscImageEntry::Create(this, parent, name, mmap_.get());
-  entry->attributes_ = attributes | kFileAttributeReadOnly;
-  entry->size_ = length;
-  entry->allocation_size_ = xe::round_up(length, bytes_per_sector());
-
-  // Set to January 1, 1970 (UTC) in 100-nanosecond intervals
-  entry->create_timestamp_ = 10000 * 11644473600000LL;
-  entry->access_timestamp_ = 10000 * 11644473600000LL;
-  entry->write_timestamp_ = 10000 * 11644473600000LL;
-
-  if (attributes & kFileAttributeDirectory) {
-    // Folder.
-    entry->data_offset_ = 0;
-    entry->data_size_ = 0;
-    if (length) {
-      // Not a leaf - read in children.
-      if (state->size < state->game_offset + (sector * kXESectorSize)) {
-        // Out of bounds read.
-        return false;
-      }
-      // Read child list.
-      uint8_t* folder_ptr =
-          state->ptr + state->game_offset + (sector * kXESectorSize);
-      if (!ReadEntry(state, folder_ptr, 0, entry.get())) {
-        return false;
-      }
-    }
-  } else {
-    // File.
-    entry->data_offset_ = state->game_offset + (sector * kXESectorSize);
-    entry->data_size_ = length;
-  }
-
-  // Add to parent.
-  parent->children_.emplace_back(std::move(entry));
-
-  // Read next file in the list.
-  if (node_r && !ReadEntry(state, buffer, node_r, parent)) {
-    return false;
-  }
-
-  return true;
-}
-
 }  // namespace vfs
 }  // namespace xe
@@ -19,8 +19,6 @@
 namespace xe {
 namespace vfs {
 
-class DiscImageEntry;
-
 class DiscImageDevice : public Device {
  public:
   DiscImageDevice(const std::string_view mount_path,
@@ -44,33 +42,10 @@ class DiscImageDevice : public Device {
   uint32_t bytes_per_sector() const override { return 0x200; }
 
  private:
-  enum class Error {
-    kSuccess = 0,
-    kErrorOutOfMemory = -1,
-    kErrorReadError = -10,
-    kErrorFileMismatch = -30,
-    kErrorDamagedFile = -31,
-  };
-
   std::string name_;
   std::filesystem::path host_path_;
   std::unique_ptr<Entry> root_entry_;
   std::unique_ptr<MappedMemory> mmap_;
-
-  typedef struct {
-    uint8_t* ptr;
-    size_t size;         // Size (bytes) of total image.
-    size_t game_offset;  // Offset (bytes) of game partition.
-    size_t root_sector;  // Offset (sector) of root.
-    size_t root_offset;  // Offset (bytes) of root.
-    size_t root_size;    // Size (bytes) of root.
-  } ParseState;
-
-  Error Verify(ParseState* state);
-  bool VerifyMagic(ParseState* state, size_t offset);
-  Error ReadAllEntries(ParseState* state, const uint8_t* root_buffer);
-  bool ReadEntry(ParseState* state, const uint8_t* buffer,
-                 uint16_t entry_ordinal, DiscImageEntry* parent);
 };
 
 }  // namespace vfs
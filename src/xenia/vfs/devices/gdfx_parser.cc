@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/gdfx_parser.h"
+
+#include <cstring>
+
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+
+namespace xe {
+namespace vfs {
+
+const size_t kXESectorSize = 2048;
+
+GdfxParser::Error GdfxParser::Parse(Entry* root_entry,
+                                    const CreateEntryFunction& create_entry) {
+  Error result = Verify();
+  if (result != Error::kSuccess) {
+    return result;
+  }
+
+  std::vector<uint8_t> root_buffer(root_size_);
+  if (!reader_->Read(root_offset_, root_buffer.data(), root_buffer.size())) {
+    return Error::kErrorReadError;
+  }
+  if (!ReadEntry(root_buffer, 0, root_entry, create_entry)) {
+    return Error::kErrorOutOfMemory;
+  }
+
+  return Error::kSuccess;
+}
+
+GdfxParser::Error GdfxParser::Verify() {
+  // Find sector 32 of the game partition - try at a few points.
+  static const size_t likely_offsets[] = {
+      0x00000000, 0x0000FB20, 0x00020600, 0x02080000, 0x0FD90000,
+  };
+  bool magic_found = false;
+  for (size_t n = 0; n < xe::countof(likely_offsets); n++) {
+    game_offset_ = likely_offsets[n];
+    if (VerifyMagic(game_offset_ + (32 * kXESectorSize))) {
+      magic_found = true;
+      break;
+    }
+  }
+  if (!magic_found) {
+    // File doesn't have the magic values - likely not a real GDFX source.
+    return Error::kErrorFileMismatch;
+  }
+
+  // Read sector 32 to get FS state.
+  uint8_t fs_header[28];
+  if (!reader_->Read(game_offset_ + (32 * kXESectorSize), fs_header,
+                     sizeof(fs_header))) {
+    return Error::kErrorReadError;
+  }
+  uint32_t root_sector = xe::load<uint32_t>(fs_header + 20);
+  root_size_ = xe::load<uint32_t>(fs_header + 24);
+  root_offset_ = game_offset_ + (uint64_t(root_sector) * kXESectorSize);
+  if (root_size_ < 13 || root_size_ > 32 * 1024 * 1024) {
+    return Error::kErrorDamagedFile;
+  }
+
+  return Error::kSuccess;
+}
+
+bool GdfxParser::VerifyMagic(uint64_t offset) {
+  // Simple check to see if the given offset contains the magic value.
+  char magic[20];
+  return reader_->Read(offset, magic, sizeof(magic)) &&
+         std::memcmp(magic, "MICROSOFT*XBOX*MEDIA", 20) == 0;
+}
+
+bool GdfxParser::ReadEntry(const std::vector<uint8_t>& buffer,
+                           uint16_t entry_ordinal, Entry* parent,
+                           const CreateEntryFunction& create_entry) {
+  if (entry_ordinal * 4 + 14 > buffer.size()) {
+    // Out of bounds read.
+    return false;
+  }
+  const uint8_t* p = buffer.data() + (entry_ordinal * 4);
+
+  uint16_t node_l = xe::load<uint16_t>(p + 0);
+  uint16_t node_r = xe::load<uint16_t>(p + 2);
+  uint32_t sector = xe::load<uint32_t>(p + 4);
+  uint32_t length = xe::load<uint32_t>(p + 8);
+  uint8_t attributes = xe::load<uint8_t>(p + 12);
+  uint8_t name_length = xe::load<uint8_t>(p + 13);
+  auto name_buffer = reinterpret_cast<const char*>(p + 14);
+  if (entry_ordinal * 4 + 14 + name_length > buffer.size()) {
+    return false;
+  }
+
+  if (node_l && !ReadEntry(buffer, node_l, parent, create_entry)) {
+    return false;
+  }
+
+  EntryInfo info;
+  info.name = std::string(name_buffer, name_length);
+  info.attributes = attributes;
+  info.size = length;
+  uint64_t data_offset = game_offset_ + (uint64_t(sector) * kXESectorSize);
+  info.data_offset = (attributes & kFileAttributeDirectory) ? 0 : data_offset;
+  Entry* entry = create_entry(parent, info);
+
+  if ((attributes & kFileAttributeDirectory) && length) {
+    // Not a leaf - read in the child list.
+    std::vector<uint8_t> folder_buffer(length);
+    if (!reader_->Read(data_offset, folder_buffer.data(),
+                       folder_buffer.size())) {
+      // Out of bounds read.
+      return false;
+    }
+    if (!ReadEntry(folder_buffer, 0, entry, create_entry)) {
+      return false;
+    }
+  }
+
+  // Read next file in the list.
+  if (node_r && !ReadEntry(buffer, node_r, parent, create_entry)) {
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,82 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DEVICES_GDFX_PARSER_H_
+#define XENIA_VFS_DEVICES_GDFX_PARSER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "xenia/vfs/entry.h"
+
+namespace xe {
+namespace vfs {
+
+// Random access to the bytes of a disc image, however they are stored.
+class BlockReader {
+ public:
+  virtual ~BlockReader() = default;
+
+  virtual uint64_t size() const = 0;
+  // Returns false if the range is out of bounds or couldn't be read.
+  virtual bool Read(uint64_t offset, void* buffer, size_t length) = 0;
+};
+
+// Parses the GDFX file system of Xbox 360 game discs, shared by the disc image
+// devices. The entries are created by the device, as their type depends on
+// how the image is stored.
+class GdfxParser {
+ public:
+  enum class Error {
+    kSuccess = 0,
+    kErrorOutOfMemory = -1,
+    kErrorReadError = -10,
+    kErrorFileMismatch = -30,
+    kErrorDamagedFile = -31,
+  };
+
+  // An entry as stored in a directory of the image.
+  struct EntryInfo {
+    std::string name;
+    uint8_t attributes;
+    // Offset (bytes) of the file data in the image, 0 for directories.
+    uint64_t data_offset;
+    // Size (bytes) of the file, or of the child list of a directory.
+    uint32_t size;
+  };
+
+  // Creates the entry and adds it to the children of the parent, returns it
+  // to add the children of directories to.
+  using CreateEntryFunction =
+      std::function<Entry*(Entry* parent, const EntryInfo& info)>;
+
+  explicit GdfxParser(BlockReader* reader) : reader_(reader) {}
+
+  // Adds all entries of the image to root_entry, without indexing them.
+  Error Parse(Entry* root_entry, const CreateEntryFunction& create_entry);
+
+ private:
+  Error Verify();
+  bool VerifyMagic(uint64_t offset);
+  bool ReadEntry(const std::vector<uint8_t>& buffer, uint16_t entry_ordinal,
+                 Entry* parent, const CreateEntryFunction& create_entry);
+
+  BlockReader* reader_;
+  uint64_t game_offset_ = 0;  // Offset (bytes) of game partition.
+  uint64_t root_offset_ = 0;  // Offset (bytes) of root.
+  uint32_t root_size_ = 0;    // Size (bytes) of root.
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DEVICES_GDFX_PARSER_H_
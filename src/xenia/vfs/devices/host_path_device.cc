@@ -43,6 +43,7 @@ bool HostPathDevice::Initialize() {
   root_entry->attributes_ = kFileAttributeDirectory;
   root_entry_ = std::unique_ptr<Entry>(root_entry);
   PopulateEntry(root_entry);
+  root_entry->IndexChildren(true);
 
   return true;
 }
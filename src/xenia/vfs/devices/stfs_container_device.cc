@@ -312,7 +312,9 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSVOD() {
   root_entry_ = std::unique_ptr<Entry>(root_entry);
 
   // Traverse all child entries
-  return ReadEntrySVOD(root_block, 0, root_entry);
+  auto result = ReadEntrySVOD(root_block, 0, root_entry);
+  root_entry->IndexChildren(true);
+  return result;
 }
 
 StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
@@ -391,8 +393,6 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
       uint32_t block_index = data_block;
       size_t remaining_size = xe::round_up(length, 0x800);
 
-      size_t last_record = -1;
-      size_t last_offset = -1;
       while (remaining_size) {
         const size_t BLOCK_SIZE = 0x800;
 
@@ -402,16 +402,8 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
         block_index++;
         remaining_size -= BLOCK_SIZE;
 
-        if (offset - last_offset == 0x800) {
-          // Consecutive, so append to last entry.
-          entry->block_list_[last_record].length += BLOCK_SIZE;
-          last_offset = offset;
-          continue;
-        }
-
-        entry->block_list_.push_back({file_index, offset, BLOCK_SIZE});
-        last_record = entry->block_list_.size() - 1;
-        last_offset = offset;
+        // Consecutive blocks are merged into a single record.
+        entry->AddBlock(file_index, offset, BLOCK_SIZE);
       }
     }
   }
@@ -554,7 +546,8 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
 
       // Fill in all block records.
       // It's easier to do this now and just look them up later, at the cost
-      // of some memory. Nasty chain walk.
+      // of some memory. Nasty chain walk. Blocks between hash tables are
+      // usually consecutive and end up coalesced into a few records.
       // TODO(benvanik): optimize if flag 0x40 (consecutive) is set.
       if (entry->attributes() & X_FILE_ATTRIBUTE_NORMAL) {
         uint32_t block_index = start_block_index;
@@ -564,7 +557,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
           size_t block_size =
               std::min(static_cast<size_t>(0x1000), remaining_size);
           size_t offset = BlockToOffsetSTFS(block_index);
-          entry->block_list_.push_back({0, offset, block_size});
+          entry->AddBlock(0, offset, block_size);
           remaining_size -= block_size;
           auto block_hash = GetBlockHash(data, block_index, 0);
           if (table_size_shift_ && block_hash.info < 0x80) {
@@ -588,6 +581,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
     }
   }
 
+  root_entry->IndexChildren(true);
   return Error::kSuccess;
 }
 
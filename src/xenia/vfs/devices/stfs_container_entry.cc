@@ -11,6 +11,7 @@
 #include "xenia/base/math.h"
 #include "xenia/vfs/devices/stfs_container_file.h"
 
+#include <algorithm>
 #include <map>
 
 namespace xe {
@@ -36,6 +37,39 @@ std::unique_ptr<StfsContainerEntry> StfsContainerEntry::Create(
   return std::move(entry);
 }
 
+void StfsContainerEntry::AddBlock(size_t file, size_t offset, size_t length) {
+  if (!block_list_.empty()) {
+    auto& last_record = block_list_.back();
+    if (last_record.file == file &&
+        last_record.offset + last_record.length == offset) {
+      last_record.length += length;
+      return;
+    }
+  }
+  size_t entry_offset = 0;
+  if (!block_list_.empty()) {
+    entry_offset = block_list_.back().entry_offset + block_list_.back().length;
+  }
+  block_list_.push_back({file, offset, length, entry_offset});
+}
+
+size_t StfsContainerEntry::FindBlock(size_t entry_offset) const {
+  // First record starting after the offset, the one before contains it.
+  auto it = std::upper_bound(block_list_.cbegin(), block_list_.cend(),
+                             entry_offset,
+                             [](size_t offset, const BlockRecord& record) {
+                               return offset < record.entry_offset;
+                             });
+  if (it == block_list_.cbegin()) {
+    return block_list_.size();
+  }
+  --it;
+  if (entry_offset - it->entry_offset >= it->length) {
+    return block_list_.size();
+  }
+  return size_t(it - block_list_.cbegin());
+}
+
 X_STATUS StfsContainerEntry::Open(uint32_t desired_access, File** out_file) {
   *out_file = new StfsContainerFile(desired_access, this);
   return X_STATUS_SUCCESS;
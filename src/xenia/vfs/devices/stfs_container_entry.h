@@ -42,13 +42,22 @@ class StfsContainerEntry : public Entry {
 
   X_STATUS Open(uint32_t desired_access, File** out_file) override;
 
+  // A contiguous run of blocks in one of the mapped files.
   struct BlockRecord {
     size_t file;
     size_t offset;
     size_t length;
+    // Offset of the first byte of the run in the entry data.
+    size_t entry_offset;
   };
   const std::vector<BlockRecord>& block_list() const { return block_list_; }
 
+  // Appends a block, merging it into the last record if it's contiguous.
+  void AddBlock(size_t file, size_t offset, size_t length);
+  // Returns the index of the record containing entry_offset, or the size of
+  // the block list if entry_offset is past the last record.
+  size_t FindBlock(size_t entry_offset) const;
+
  private:
   friend class StfsContainerDevice;
 
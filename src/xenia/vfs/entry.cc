@@ -9,6 +9,8 @@
 
 #include "xenia/vfs/entry.h"
 
+#include <atomic>
+
 #include "xenia/base/filesystem.h"
 #include "xenia/base/string.h"
 #include "xenia/vfs/device.h"
@@ -16,6 +18,11 @@
 namespace xe {
 namespace vfs {
 
+// Linear search is as fast in small directories.
+constexpr size_t kMinimumIndexedChildCount = 8;
+
+static std::atomic<uint64_t> tree_generation_ = {0};
+
 Entry::Entry(Device* device, Entry* parent, const std::string_view path)
     : device_(device),
       parent_(parent),
@@ -48,14 +55,27 @@ bool Entry::is_read_only() const { return device_->is_read_only(); }
 
 Entry* Entry::GetChild(const std::string_view name) {
   auto global_lock = global_critical_region_.Acquire();
-  auto it = std::find_if(children_.cbegin(), children_.cend(),
-                         [&](const auto& child) {
-                           return xe::utf8::equal_case(child->name(), name);
-                         });
-  if (it == children_.cend()) {
-    return nullptr;
+  if (children_.size() < kMinimumIndexedChildCount) {
+    auto it = std::find_if(children_.cbegin(), children_.cend(),
+                           [&](const auto& child) {
+                             return xe::utf8::equal_case(child->name(), name);
+                           });
+    if (it == children_.cend()) {
+      return nullptr;
+    }
+    return (*it).get();
   }
-  return (*it).get();
+  if (children_index_.size() != children_.size()) {
+    // Children were added directly by the device.
+    IndexChildren(false);
+  }
+  auto range = children_index_.equal_range(xe::utf8::hash_fnv1a_case(name));
+  for (auto it = range.first; it != range.second; ++it) {
+    if (xe::utf8::equal_case(it->second->name(), name)) {
+      return it->second;
+    }
+  }
+  return nullptr;
 }
 
 Entry* Entry::ResolvePath(const std::string_view path) {
@@ -71,6 +91,27 @@ Entry* Entry::ResolvePath(const std::string_view path) {
   return entry;
 }
 
+void Entry::IndexChildren(bool recursive) {
+  auto global_lock = global_critical_region_.Acquire();
+  children_index_.clear();
+  if (children_.size() >= kMinimumIndexedChildCount) {
+    children_index_.reserve(children_.size());
+    for (auto& child : children_) {
+      children_index_.emplace(xe::utf8::hash_fnv1a_case(child->name()),
+                              child.get());
+    }
+  }
+  if (recursive) {
+    for (auto& child : children_) {
+      child->IndexChildren(true);
+    }
+  }
+}
+
+uint64_t Entry::tree_generation() {
+  return tree_generation_.load(std::memory_order_acquire);
+}
+
 Entry* Entry::IterateChildren(const xe::filesystem::WildcardEngine& engine,
                               size_t* current_index) {
   auto global_lock = global_critical_region_.Acquire();
@@ -97,10 +138,16 @@ Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
   if (!entry) {
     return nullptr;
   }
+  Entry* child = entry.get();
   children_.push_back(std::move(entry));
   // TODO(benvanik): resort? would break iteration?
+  if (children_.size() >= kMinimumIndexedChildCount &&
+      children_index_.size() + 1 == children_.size()) {
+    children_index_.emplace(xe::utf8::hash_fnv1a_case(child->name()), child);
+  }
+  tree_generation_.fetch_add(1, std::memory_order_release);
   Touch();
-  return children_.back().get();
+  return child;
 }
 
 bool Entry::Delete(Entry* entry) {
@@ -114,12 +161,21 @@ bool Entry::Delete(Entry* entry) {
   if (!DeleteEntryInternal(entry)) {
     return false;
   }
+  auto range =
+      children_index_.equal_range(xe::utf8::hash_fnv1a_case(entry->name()));
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == entry) {
+      children_index_.erase(it);
+      break;
+    }
+  }
   for (auto it = children_.begin(); it != children_.end(); ++it) {
     if (it->get() == entry) {
       children_.erase(it);
       break;
     }
   }
+  tree_generation_.fetch_add(1, std::memory_order_release);
   Touch();
   return true;
 }
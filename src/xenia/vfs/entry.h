@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/filesystem.h"
@@ -99,6 +100,14 @@ class Entry {
   Entry* GetChild(const std::string_view name);
   Entry* ResolvePath(const std::string_view path);
 
+  // Builds the case-insensitive name index used by GetChild. Devices do this
+  // once the tree is populated, a stale index is also rebuilt on lookup.
+  void IndexChildren(bool recursive);
+
+  // Incremented whenever any entry is created or deleted, for caches of
+  // resolved entries.
+  static uint64_t tree_generation();
+
   const std::vector<std::unique_ptr<Entry>>& children() const {
     return children_;
   }
@@ -145,6 +154,9 @@ class Entry {
   uint64_t access_timestamp_;
   uint64_t write_timestamp_;
   std::vector<std::unique_ptr<Entry>> children_;
+  // hash_fnv1a_case of the name -> child. Only for larger directories, empty
+  // otherwise.
+  std::unordered_multimap<size_t, Entry*> children_index_;
 };
 
 }  // namespace vfs
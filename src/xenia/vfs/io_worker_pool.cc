@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/io_worker_pool.h"
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace vfs {
+
+IoWorkerPool::IoWorkerPool(uint32_t thread_count) {
+  assert_not_zero(thread_count);
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads_.emplace_back([this]() { WorkerMain(); });
+    threading::set_name(threads_.back().native_handle(),
+                        fmt::format("I/O Worker {}", i));
+  }
+}
+
+IoWorkerPool::~IoWorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  request_cond_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void IoWorkerPool::Queue(std::function<void()> request) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(std::move(request));
+  }
+  request_cond_.notify_one();
+}
+
+void IoWorkerPool::WorkerMain() {
+  while (true) {
+    std::function<void()> request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      request_cond_.wait(
+          lock, [this]() { return shutting_down_ || !requests_.empty(); });
+      if (requests_.empty()) {
+        // Shutting down and nothing left to do.
+        break;
+      }
+      request = std::move(requests_.front());
+      requests_.pop_front();
+    }
+    request();
+  }
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,54 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_IO_WORKER_POOL_H_
+#define XENIA_VFS_IO_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xe {
+namespace vfs {
+
+// Host threads executing file I/O requests, so that the threads issuing them
+// don't have to wait for the host disk.
+class IoWorkerPool {
+ public:
+  explicit IoWorkerPool(uint32_t thread_count);
+  // Executes all queued requests before returning.
+  ~IoWorkerPool();
+
+  uint32_t thread_count() const { return uint32_t(threads_.size()); }
+
+  // Queues a request for execution on one of the worker threads. Requests may
+  // run concurrently and complete in any order, even on the same file, so
+  // they must only use positional file operations (File::ReadSync and
+  // File::WriteSync).
+  void Queue(std::function<void()> request);
+
+ private:
+  void WorkerMain();
+
+  std::mutex mutex_;
+  std::condition_variable request_cond_;
+  std::deque<std::function<void()>> requests_;
+  bool shutting_down_ = false;
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_IO_WORKER_POOL_H_
@@ -7,12 +7,14 @@ project("xenia-vfs")
   kind("StaticLib")
   language("C++")
   links({
+    "snappy",
     "xenia-base",
+    "xxhash",
   })
   defines({
   })
   recursive_platform_files()
-  removefiles({"vfs_dump.cc"})
+  removefiles({"vfs_compress.cc", "vfs_dump.cc"})
 
 project("xenia-vfs-dump")
   uuid("2EF270C7-41A8-4D0E-ACC5-59693A9CCE32")
@@ -20,8 +22,10 @@ project("xenia-vfs-dump")
   language("C++")
   links({
     "fmt",
+    "snappy",
     "xenia-base",
     "xenia-vfs",
+    "xxhash",
   })
   defines({})
 
@@ -33,3 +37,25 @@ project("xenia-vfs-dump")
     project_root,
   })
 
+project("xenia-vfs-compress")
+  uuid("7f4d2b1e-93a6-4c58-b0e2-5d61c8a94f37")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "snappy",
+    "xenia-base",
+    "xenia-vfs",
+    "xxhash",
+  })
+  defines({})
+
+  files({
+    "vfs_compress.cc",
+    project_root.."/src/xenia/base/main_"..platform_suffix..".cc",
+  })
+  resincludedirs({
+    project_root,
+  })
+
+include("testing")
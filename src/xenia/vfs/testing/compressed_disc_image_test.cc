@@ -0,0 +1,305 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/compressed_disc_image.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "xenia/base/filesystem.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/testing/util.h"
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
+#include "xenia/vfs/devices/disc_image_device.h"
+#include "xenia/vfs/file.h"
+
+#if XE_PLATFORM_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif  // XE_PLATFORM_LINUX
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace vfs {
+namespace test {
+
+constexpr size_t kSectorSize = 2048;
+constexpr uint32_t kBlockSize = 0x10000;
+constexpr size_t kRootSector = 34;
+constexpr size_t kDataSector = 64;
+
+void WriteGdfxEntry(uint8_t* p, uint16_t node_r, size_t sector, size_t length,
+                    const char* name) {
+  xe::store<uint16_t>(p + 0, 0);
+  xe::store<uint16_t>(p + 2, node_r);
+  xe::store<uint32_t>(p + 4, uint32_t(sector));
+  xe::store<uint32_t>(p + 8, uint32_t(length));
+  xe::store<uint8_t>(p + 12, kFileAttributeNormal);
+  xe::store<uint8_t>(p + 13, uint8_t(std::strlen(name)));
+  std::memcpy(p + 14, name, std::strlen(name));
+}
+
+// A raw GDFX image with a single Data.bin file made of blocks of random
+// bytes, zeros, copies of the first block and text, and its compressed
+// version.
+class TestImage {
+ public:
+  explicit TestImage(size_t data_size)
+      : data_size_(data_size), directory_("xenia-vfs-compressed-test") {
+    raw_path_ = directory_.path() / "test.iso";
+    compressed_path_ = directory_.path() / "test.xcdi";
+
+    data_.resize(kDataSector * kSectorSize + data_size);
+    uint8_t* header = data_.data() + 32 * kSectorSize;
+    std::memcpy(header, "MICROSOFT*XBOX*MEDIA", 20);
+    xe::store<uint32_t>(header + 20, uint32_t(kRootSector));
+    xe::store<uint32_t>(header + 24, uint32_t(kSectorSize));
+    WriteGdfxEntry(data_.data() + kRootSector * kSectorSize, 0, kDataSector,
+                   data_size, "Data.bin");
+
+    std::mt19937 random(0);
+    uint8_t* data = data_.data() + kDataSector * kSectorSize;
+    for (size_t offset = 0; offset < data_size; offset += kBlockSize) {
+      size_t length = std::min(size_t(kBlockSize), data_size - offset);
+      switch (offset / kBlockSize % 4) {
+        case 0:
+          for (size_t i = 0; i < length; ++i) {
+            data[offset + i] = uint8_t(random());
+          }
+          break;
+        case 1:
+          // Left as zeros.
+          break;
+        case 2:
+          std::memcpy(data + offset, data, length);
+          break;
+        case 3:
+          for (size_t i = 0; i < length; i += 16) {
+            static const char* words[] = {"xenia", "vfs", "disc", "image"};
+            snprintf(reinterpret_cast<char*>(data + offset + i),
+                     std::min(size_t(16), length - i), "%-15s",
+                     words[random() % xe::countof(words)]);
+          }
+          break;
+      }
+    }
+
+    FILE* file = xe::filesystem::OpenFile(raw_path_, "wb");
+    REQUIRE(file != nullptr);
+    REQUIRE(fwrite(data_.data(), 1, data_.size(), file) == data_.size());
+    fclose(file);
+
+    CompressedDiscImage::CreateOptions options;
+    options.block_size = kBlockSize;
+    REQUIRE(CompressedDiscImage::Create(raw_path_, compressed_path_, options,
+                                        &statistics_));
+  }
+  size_t data_size() const { return data_size_; }
+  const std::vector<uint8_t>& data() const { return data_; }
+  const std::filesystem::path& raw_path() const { return raw_path_; }
+  const std::filesystem::path& compressed_path() const {
+    return compressed_path_;
+  }
+  const CompressedDiscImage::CreateStatistics& statistics() const {
+    return statistics_;
+  }
+
+ private:
+  size_t data_size_;
+  testing::TempDirectory directory_;
+  std::filesystem::path raw_path_;
+  std::filesystem::path compressed_path_;
+  std::vector<uint8_t> data_;
+  CompressedDiscImage::CreateStatistics statistics_;
+};
+
+TEST_CASE("COMPRESSED_DISC_IMAGE_READ", "[vfs]") {
+  TestImage test_image(40 * kBlockSize + 0x1234);
+  auto& statistics = test_image.statistics();
+  auto& data = test_image.data();
+  REQUIRE(statistics.image_size == data.size());
+  // 2 blocks of GDFX header, the first one all zeros, then data blocks
+  // cycling through random, zero, duplicate and text.
+  REQUIRE(statistics.block_count == 43);
+  REQUIRE(statistics.zero_block_count == 11);
+  REQUIRE(statistics.duplicate_block_count == 10);
+  // The last random block is mostly padding.
+  REQUIRE(statistics.uncompressed_block_count == 10);
+  REQUIRE(statistics.container_size < data.size() * 3 / 4);
+
+  // Small cache to exercise eviction.
+  auto image = CompressedDiscImage::Open(test_image.compressed_path(),
+                                         8 * kBlockSize, 4);
+  REQUIRE(image != nullptr);
+  REQUIRE(image->size() == data.size());
+
+  std::vector<uint8_t> buffer(data.size());
+  REQUIRE(image->Read(0, buffer.data(), buffer.size()));
+  REQUIRE(buffer == data);
+  // Read-ahead over sequential reads.
+  REQUIRE(image->statistics().host_reads < 40);
+
+  std::mt19937 random(0);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    size_t offset = random() % data.size();
+    size_t length = std::min(size_t(random() % (4 * kBlockSize) + 1),
+                             data.size() - offset);
+    REQUIRE(image->Read(offset, buffer.data(), length));
+    REQUIRE(!std::memcmp(buffer.data(), data.data() + offset, length));
+  }
+
+  REQUIRE(image->Read(data.size() - 1, buffer.data(), 1));
+  REQUIRE(!image->Read(data.size() - 1, buffer.data(), 2));
+  REQUIRE(!image->Read(data.size() + 1, buffer.data(), 0));
+}
+
+TEST_CASE("COMPRESSED_DISC_IMAGE_DEVICE", "[vfs]") {
+  TestImage test_image(10 * kBlockSize + 0x1234);
+  CompressedDiscImageDevice device("\\Device\\Cdrom0",
+                                   test_image.compressed_path(),
+                                   16 * kBlockSize, 4);
+  REQUIRE(device.Initialize());
+
+  Entry* entry = device.ResolvePath("data.bin");
+  REQUIRE(entry != nullptr);
+  REQUIRE(entry->size() == test_image.data_size());
+  REQUIRE(!entry->can_map());
+
+  File* file = nullptr;
+  REQUIRE(entry->Open(FileAccess::kFileReadData, &file) == X_STATUS_SUCCESS);
+  std::vector<uint8_t> buffer(entry->size() + 0x100);
+  size_t bytes_read = 0;
+  REQUIRE(file->ReadSync(buffer.data(), buffer.size(), 0, &bytes_read) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(bytes_read == entry->size());
+  REQUIRE(!std::memcmp(buffer.data(),
+                       test_image.data().data() + kDataSector * kSectorSize,
+                       bytes_read));
+  REQUIRE(file->ReadSync(buffer.data(), buffer.size(), entry->size(),
+                         &bytes_read) == X_STATUS_END_OF_FILE);
+  file->Destroy();
+
+  // The same file system as with the raw image.
+  DiscImageDevice raw_device("\\Device\\Cdrom0", test_image.raw_path());
+  REQUIRE(raw_device.Initialize());
+  Entry* raw_entry = raw_device.ResolvePath("data.bin");
+  REQUIRE(raw_entry != nullptr);
+  REQUIRE(raw_entry->name() == entry->name());
+  REQUIRE(raw_entry->attributes() == entry->attributes());
+  REQUIRE(raw_entry->size() == entry->size());
+}
+
+// Drops the pages of the file from the host file cache, so the next reads
+// come from the disk. Returns false if that's not possible on the host.
+bool DropFromHostFileCache(const std::filesystem::path& path) {
+#if XE_PLATFORM_LINUX
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    return false;
+  }
+  // Dirty pages of a file that has just been written are not dropped.
+  bool dropped = !fdatasync(file) &&
+                 !posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+  close(file);
+  return dropped;
+#else
+  return false;
+#endif  // XE_PLATFORM_LINUX
+}
+
+// Reads all the files under the entry in buffer-sized reads, returns the
+// number of bytes read.
+uint64_t ReadAllFiles(Entry* entry, std::vector<uint8_t>& buffer) {
+  if (entry->attributes() & kFileAttributeDirectory) {
+    uint64_t bytes_read = 0;
+    for (auto& child : entry->children()) {
+      bytes_read += ReadAllFiles(child.get(), buffer);
+    }
+    return bytes_read;
+  }
+  File* file = nullptr;
+  REQUIRE(entry->Open(FileAccess::kFileReadData, &file) == X_STATUS_SUCCESS);
+  uint64_t bytes_read = 0;
+  for (size_t offset = 0; offset < entry->size(); offset += buffer.size()) {
+    size_t chunk_bytes_read = 0;
+    file->ReadSync(buffer.data(), buffer.size(), offset, &chunk_bytes_read);
+    bytes_read += chunk_bytes_read;
+  }
+  file->Destroy();
+  return bytes_read;
+}
+
+TEST_CASE("COMPRESSED_DISC_IMAGE_BENCHMARK", "[.benchmark]") {
+  // A real disc image can be given in XENIA_TEST_DISC_IMAGE, otherwise a
+  // synthetic 512 MB one is used.
+  testing::TempDirectory directory("xenia-vfs-compressed-benchmark");
+  std::unique_ptr<TestImage> test_image;
+  std::filesystem::path raw_path, compressed_path;
+  CompressedDiscImage::CreateStatistics statistics;
+  const char* image_path = std::getenv("XENIA_TEST_DISC_IMAGE");
+  if (image_path && *image_path) {
+    raw_path = xe::to_path(image_path);
+    compressed_path = directory.path() / "image.xcdi";
+    testing::BenchmarkTimer timer;
+    REQUIRE(CompressedDiscImage::Create(raw_path, compressed_path,
+                                        CompressedDiscImage::CreateOptions(),
+                                        &statistics));
+    WARN("Compression: " << timer.seconds() << " s");
+  } else {
+    test_image = std::make_unique<TestImage>(size_t(512) * 1024 * 1024);
+    raw_path = test_image->raw_path();
+    compressed_path = test_image->compressed_path();
+    statistics = test_image->statistics();
+  }
+  WARN("Raw image: " << statistics.image_size / (1024 * 1024)
+                     << " MB, compressed: "
+                     << statistics.container_size / (1024 * 1024) << " MB");
+
+  // Mounting and reading all the files once, in 1 MB reads, with the image
+  // in the host file cache and read from the disk.
+  std::vector<uint8_t> buffer(1024 * 1024);
+  for (uint32_t cold = 0; cold < 2; ++cold) {
+    for (uint32_t compressed = 0; compressed < 2; ++compressed) {
+      const std::filesystem::path& path =
+          compressed ? compressed_path : raw_path;
+      if (cold && !DropFromHostFileCache(path)) {
+        WARN("Cold reads can't be measured on this host");
+        break;
+      }
+      testing::BenchmarkTimer timer;
+      std::unique_ptr<Device> device;
+      if (compressed) {
+        device = std::make_unique<CompressedDiscImageDevice>(
+            "\\Device\\Cdrom0", path, 64 * 1024 * 1024, 8);
+      } else {
+        device =
+            std::make_unique<DiscImageDevice>("\\Device\\Cdrom0", path);
+      }
+      REQUIRE(device->Initialize());
+      Entry* root_entry = device->ResolvePath("");
+      REQUIRE(root_entry != nullptr);
+      uint64_t bytes_read = ReadAllFiles(root_entry, buffer);
+      WARN((compressed ? "Compressed" : "Raw")
+           << (cold ? " cold" : " warm") << " mount and read of "
+           << bytes_read / (1024 * 1024)
+           << " MB: " << timer.seconds() * 1000 << " ms");
+    }
+  }
+}
+
+}  // namespace test
+}  // namespace vfs
+}  // namespace xe
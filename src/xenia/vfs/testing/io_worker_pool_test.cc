@@ -0,0 +1,149 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/io_worker_pool.h"
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "xenia/base/filesystem.h"
+#include "xenia/base/testing/util.h"
+#include "xenia/vfs/devices/host_path_device.h"
+#include "xenia/vfs/file.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace vfs {
+namespace test {
+using xe::filesystem::FileAccess;
+
+constexpr size_t kFileSize = 4 * 1024 * 1024;
+
+// A host directory with a file in which every 32-bit word contains its own
+// offset divided by 4, mounted with a HostPathDevice.
+class TestDirectory {
+ public:
+  TestDirectory() : directory_("xenia-vfs-io-test") {
+    std::vector<uint32_t> data(kFileSize / sizeof(uint32_t));
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = uint32_t(i);
+    }
+    FILE* file =
+        xe::filesystem::OpenFile(directory_.path() / "Data.bin", "wb");
+    REQUIRE(file != nullptr);
+    REQUIRE(fwrite(data.data(), 1, kFileSize, file) == kFileSize);
+    fclose(file);
+
+    device_ = std::make_unique<HostPathDevice>("\\Device\\Test",
+                                               directory_.path(), false);
+    REQUIRE(device_->Initialize());
+  }
+
+  File* Open(uint32_t desired_access) {
+    Entry* entry = device_->ResolvePath("Data.bin");
+    REQUIRE(entry != nullptr);
+    File* file = nullptr;
+    REQUIRE(entry->Open(desired_access, &file) == X_STATUS_SUCCESS);
+    return file;
+  }
+
+ private:
+  testing::TempDirectory directory_;
+  // Unmounted before the directory is removed.
+  std::unique_ptr<HostPathDevice> device_;
+};
+
+TEST_CASE("IO_WORKER_POOL_OVERLAPPING_READS", "[vfs]") {
+  TestDirectory directory;
+  File* file = directory.Open(FileAccess::kFileReadData);
+
+  struct Request {
+    size_t offset;
+    std::vector<uint32_t> buffer;
+    size_t bytes_read = 0;
+    X_STATUS result = X_STATUS_UNSUCCESSFUL;
+  };
+  constexpr uint32_t kRequestCount = 256;
+  std::vector<Request> requests(kRequestCount);
+  std::mt19937 random(0);
+  for (Request& request : requests) {
+    // Up to 256 KB at anywhere in the first 3 MB.
+    request.offset = random() % (kFileSize * 3 / 16) * sizeof(uint32_t);
+    request.buffer.resize(random() % (kFileSize / 64) + 1);
+  }
+
+  // All queued requests are done once the pool is destroyed.
+  std::atomic<uint32_t> completed_count(0);
+  {
+    IoWorkerPool pool(4);
+    REQUIRE(pool.thread_count() == 4);
+    for (Request& request : requests) {
+      pool.Queue([file, &request, &completed_count]() {
+        request.result = file->ReadSync(
+            request.buffer.data(), request.buffer.size() * sizeof(uint32_t),
+            request.offset, &request.bytes_read);
+        ++completed_count;
+      });
+    }
+  }
+  REQUIRE(completed_count == kRequestCount);
+
+  for (const Request& request : requests) {
+    REQUIRE(request.result == X_STATUS_SUCCESS);
+    REQUIRE(request.bytes_read == request.buffer.size() * sizeof(uint32_t));
+    bool matches = true;
+    for (size_t i = 0; i < request.buffer.size(); ++i) {
+      matches &= request.buffer[i] == request.offset / sizeof(uint32_t) + i;
+    }
+    REQUIRE(matches);
+  }
+
+  file->Destroy();
+}
+
+TEST_CASE("IO_WORKER_POOL_WRITES", "[vfs]") {
+  TestDirectory directory;
+  File* file = directory.Open(FileAccess::kFileReadData |
+                              FileAccess::kFileWriteData);
+
+  // Concurrent writes to separate blocks.
+  constexpr size_t kBlockSize = 0x1000;
+  {
+    IoWorkerPool pool(4);
+    for (size_t offset = 0; offset < kFileSize; offset += kBlockSize) {
+      pool.Queue([file, offset]() {
+        std::vector<uint32_t> block(kBlockSize / sizeof(uint32_t),
+                                    ~uint32_t(offset / kBlockSize));
+        size_t bytes_written = 0;
+        file->WriteSync(block.data(), kBlockSize, offset, &bytes_written);
+      });
+    }
+  }
+
+  std::vector<uint32_t> data(kFileSize / sizeof(uint32_t));
+  size_t bytes_read = 0;
+  REQUIRE(file->ReadSync(data.data(), kFileSize, 0, &bytes_read) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(bytes_read == kFileSize);
+  bool matches = true;
+  for (size_t i = 0; i < data.size(); ++i) {
+    matches &= data[i] == ~uint32_t(i * sizeof(uint32_t) / kBlockSize);
+  }
+  REQUIRE(matches);
+
+  file->Destroy();
+}
+
+}  // namespace test
+}  // namespace vfs
+}  // namespace xe
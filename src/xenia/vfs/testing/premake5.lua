@@ -0,0 +1,12 @@
+project_root = "../../../.."
+include(project_root.."/tools/build")
+
+test_suite("xenia-vfs-tests", project_root, ".", {
+  links = {
+    "fmt",
+    "snappy",
+    "xenia-base",
+    "xenia-vfs",
+    "xxhash",
+  },
+})
@@ -0,0 +1,178 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/stfs_container_file.h"
+
+#include <random>
+#include <vector>
+
+#include "xenia/base/math.h"
+#include "xenia/base/testing/util.h"
+#include "xenia/vfs/devices/stfs_container_device.h"
+#include "xenia/vfs/devices/stfs_container_entry.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace vfs {
+namespace test {
+
+constexpr size_t kBlockSize = 0x1000;
+// Data blocks between two hash blocks in an STFS package.
+constexpr size_t kHashSpacing = 170;
+
+// A file laid out like in an STFS package, with every run of kHashSpacing
+// data blocks followed by a hash block. Every 32-bit word of the file data
+// contains its own offset in the file divided by 4.
+class TestPackage {
+ public:
+  explicit TestPackage(size_t size)
+      : device_("\\Device\\Test", "test.stfs"),
+        entry_(&device_, size, &mmap_) {
+    size_t block_count = xe::round_up(size, kBlockSize) / kBlockSize;
+    size_t package_block_count =
+        block_count + xe::round_up(block_count, kHashSpacing) / kHashSpacing;
+    data_.resize(package_block_count * kBlockSize / sizeof(uint32_t));
+    mmap_.emplace(0, std::make_unique<MappedMemory>(
+                         "test.stfs", MappedMemory::Mode::kRead, data_.data(),
+                         data_.size() * sizeof(uint32_t)));
+
+    size_t package_offset = 0;
+    for (size_t i = 0; i < block_count; ++i) {
+      if (!(i % kHashSpacing)) {
+        package_offset += kBlockSize;
+      }
+      size_t block_size = std::min(kBlockSize, size - i * kBlockSize);
+      entry_.AddBlock(0, package_offset, block_size);
+      for (size_t j = 0; j < kBlockSize / sizeof(uint32_t); ++j) {
+        data_[package_offset / sizeof(uint32_t) + j] =
+            uint32_t(i * kBlockSize / sizeof(uint32_t) + j);
+      }
+      package_offset += kBlockSize;
+    }
+  }
+
+  StfsContainerEntry* entry() { return &entry_; }
+
+ private:
+  class TestEntry : public StfsContainerEntry {
+   public:
+    TestEntry(Device* device, size_t size, MultifileMemoryMap* mmap)
+        : StfsContainerEntry(device, nullptr, "Data.bin", mmap) {
+      attributes_ = kFileAttributeNormal | kFileAttributeReadOnly;
+      size_ = size;
+    }
+  };
+
+  StfsContainerDevice device_;
+  MultifileMemoryMap mmap_;
+  std::vector<uint32_t> data_;
+  TestEntry entry_;
+};
+
+bool ReadMatches(StfsContainerFile& file, size_t offset, size_t length) {
+  std::vector<uint32_t> buffer(length / sizeof(uint32_t));
+  size_t bytes_read = 0;
+  if (file.ReadSync(buffer.data(), length, offset, &bytes_read) !=
+          X_STATUS_SUCCESS ||
+      bytes_read != length) {
+    return false;
+  }
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    if (buffer[i] != offset / sizeof(uint32_t) + i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST_CASE("STFS_CONTAINER_FILE_BLOCK_LIST", "[vfs]") {
+  TestPackage package(1000 * kBlockSize + 0x234);
+  auto entry = package.entry();
+
+  // 1001 blocks, split by a hash block every 170 blocks.
+  auto& block_list = entry->block_list();
+  REQUIRE(block_list.size() == 6);
+  REQUIRE(block_list[1].entry_offset == kHashSpacing * kBlockSize);
+  REQUIRE(block_list[1].length == kHashSpacing * kBlockSize);
+  REQUIRE(block_list[5].length == 150 * kBlockSize + 0x234);
+
+  REQUIRE(entry->FindBlock(0) == 0);
+  REQUIRE(entry->FindBlock(kHashSpacing * kBlockSize - 1) == 0);
+  REQUIRE(entry->FindBlock(kHashSpacing * kBlockSize) == 1);
+  REQUIRE(entry->FindBlock(entry->size() - 1) == 5);
+  REQUIRE(entry->FindBlock(entry->size()) == block_list.size());
+}
+
+TEST_CASE("STFS_CONTAINER_FILE_READ", "[vfs]") {
+  TestPackage package(1000 * kBlockSize + 0x234);
+  StfsContainerFile file(0, package.entry());
+  size_t size = package.entry()->size();
+
+  REQUIRE(ReadMatches(file, 0, 0x100));
+  // Spanning hash blocks.
+  REQUIRE(ReadMatches(file, kHashSpacing * kBlockSize - 0x10, 0x20));
+  REQUIRE(ReadMatches(file, 0x40, size - 0x40 - 4));
+  // The tail.
+  REQUIRE(ReadMatches(file, size - 0x34, 0x34));
+
+  std::mt19937 random(0);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    size_t offset = random() % (size / sizeof(uint32_t)) * sizeof(uint32_t);
+    size_t length = std::min(size_t(random() % 0x80000 + 1) * sizeof(uint32_t),
+                             (size - offset) & ~(sizeof(uint32_t) - 1));
+    REQUIRE(ReadMatches(file, offset, length));
+  }
+
+  // Reads are truncated at the end of the file.
+  uint8_t buffer[0x100];
+  size_t bytes_read = 0;
+  REQUIRE(file.ReadSync(buffer, sizeof(buffer), size - 0x10, &bytes_read) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(bytes_read == 0x10);
+  REQUIRE(file.ReadSync(buffer, sizeof(buffer), size, &bytes_read) ==
+          X_STATUS_END_OF_FILE);
+}
+
+TEST_CASE("STFS_CONTAINER_FILE_BENCHMARK", "[.benchmark]") {
+  constexpr size_t kPackageSize = 512 * 1024 * 1024;
+  TestPackage package(kPackageSize);
+  StfsContainerFile file(0, package.entry());
+  std::vector<uint8_t> buffer(1024 * 1024);
+  size_t bytes_read = 0;
+
+  // Small reads near the end of the file, like seeking in a large archive.
+  {
+    constexpr uint32_t kReadCount = 1000000;
+    std::mt19937 random(0);
+    testing::BenchmarkTimer timer;
+    for (uint32_t i = 0; i < kReadCount; ++i) {
+      size_t offset = kPackageSize - 0x1000000 + random() % 0xFF0000;
+      file.ReadSync(buffer.data(), 0x800, offset, &bytes_read);
+    }
+    WARN("Tail reads: " << kReadCount / timer.seconds() / 1e6
+                        << " million reads per second");
+  }
+
+  // Streaming the whole file in 1 MB reads.
+  {
+    testing::BenchmarkTimer timer;
+    for (uint32_t pass = 0; pass < 4; ++pass) {
+      for (size_t offset = 0; offset < kPackageSize; offset += buffer.size()) {
+        file.ReadSync(buffer.data(), buffer.size(), offset, &bytes_read);
+      }
+    }
+    WARN("Streaming: " << 4 * kPackageSize / timer.seconds() / (1024 * 1024)
+                       << " MB per second");
+  }
+}
+
+}  // namespace test
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,214 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/virtual_file_system.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "xenia/base/string.h"
+#include "xenia/base/testing/util.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace vfs {
+namespace test {
+
+constexpr char kMountPath[] = "\\Device\\Test";
+
+class TestEntry : public Entry {
+ public:
+  TestEntry(Device* device, Entry* parent, const std::string_view path,
+            uint32_t attributes)
+      : Entry(device, parent, path) {
+    attributes_ = attributes;
+  }
+
+  // Adds the child directly, like the devices do when reading their tree.
+  TestEntry* AddChild(const std::string_view name, uint32_t attributes) {
+    auto child = std::make_unique<TestEntry>(
+        device_, this, xe::utf8::join_guest_paths(path_, name), attributes);
+    TestEntry* child_ptr = child.get();
+    children_.push_back(std::move(child));
+    return child_ptr;
+  }
+
+  X_STATUS Open(uint32_t desired_access, File** out_file) override {
+    return X_STATUS_ACCESS_DENIED;
+  }
+
+ protected:
+  std::unique_ptr<Entry> CreateEntryInternal(const std::string_view name,
+                                             uint32_t attributes) override {
+    return std::make_unique<TestEntry>(
+        device_, this, xe::utf8::join_guest_paths(path_, name), attributes);
+  }
+  bool DeleteEntryInternal(Entry* entry) override { return true; }
+};
+
+// Synthetic tree of directory_count directories with file_count files each.
+class TestDevice : public Device {
+ public:
+  TestDevice(uint32_t directory_count, uint32_t file_count)
+      : Device(kMountPath),
+        directory_count_(directory_count),
+        file_count_(file_count) {}
+
+  bool Initialize() override {
+    root_entry_ =
+        std::make_unique<TestEntry>(this, nullptr, "", kFileAttributeDirectory);
+    for (uint32_t i = 0; i < directory_count_; ++i) {
+      auto directory = root_entry_->AddChild(fmt::format("Directory{}", i),
+                                             kFileAttributeDirectory);
+      for (uint32_t j = 0; j < file_count_; ++j) {
+        directory->AddChild(fmt::format("File{:05}.bin", j),
+                            kFileAttributeNormal);
+      }
+    }
+    root_entry_->IndexChildren(true);
+    return true;
+  }
+
+  bool is_read_only() const override { return false; }
+
+  void Dump(StringBuffer* string_buffer) override {
+    root_entry_->Dump(string_buffer, 0);
+  }
+  Entry* ResolvePath(const std::string_view path) override {
+    return root_entry_->ResolvePath(path);
+  }
+
+  const std::string& name() const override { return name_; }
+  uint32_t attributes() const override { return 0; }
+  uint32_t component_name_max_length() const override { return 40; }
+
+  uint32_t total_allocation_units() const override { return 0; }
+  uint32_t available_allocation_units() const override { return 0; }
+  uint32_t sectors_per_allocation_unit() const override { return 1; }
+  uint32_t bytes_per_sector() const override { return 0x200; }
+
+  TestEntry* root_entry() const { return root_entry_.get(); }
+
+ private:
+  std::string name_ = "Test";
+  uint32_t directory_count_;
+  uint32_t file_count_;
+  std::unique_ptr<TestEntry> root_entry_;
+};
+
+std::string FilePath(uint32_t directory, uint32_t file) {
+  return fmt::format("{}\\Directory{}\\File{:05}.bin", kMountPath, directory,
+                     file);
+}
+
+TEST_CASE("VFS_CHILD_LOOKUP", "[vfs]") {
+  auto device = std::make_unique<TestDevice>(4, 100);
+  REQUIRE(device->Initialize());
+  auto root_entry = device->root_entry();
+
+  // Small (not indexed) and large directories, case-insensitive.
+  REQUIRE(root_entry->GetChild("directory2") ==
+          root_entry->children()[2].get());
+  REQUIRE(root_entry->GetChild("Directory4") == nullptr);
+  auto directory = root_entry->GetChild("DIRECTORY3");
+  REQUIRE(directory != nullptr);
+  REQUIRE(directory->GetChild("file00042.BIN") ==
+          directory->children()[42].get());
+  REQUIRE(directory->GetChild("File00100.bin") == nullptr);
+  REQUIRE(directory->GetChild("File0004.bin") == nullptr);
+
+  // Entries added directly after indexing.
+  auto test_directory = static_cast<TestEntry*>(directory);
+  auto added = test_directory->AddChild("Added.bin", kFileAttributeNormal);
+  REQUIRE(directory->GetChild("ADDED.BIN") == added);
+
+  // Created and deleted entries.
+  auto created = directory->CreateEntry("Created.bin", kFileAttributeNormal);
+  REQUIRE(created != nullptr);
+  REQUIRE(directory->CreateEntry("created.bin", kFileAttributeNormal) ==
+          nullptr);
+  REQUIRE(directory->GetChild("CREATED.bin") == created);
+  REQUIRE(created->Delete());
+  REQUIRE(directory->GetChild("Created.bin") == nullptr);
+  REQUIRE(directory->GetChild("File00099.bin") ==
+          directory->children()[99].get());
+}
+
+TEST_CASE("VFS_RESOLVED_PATH_CACHE", "[vfs]") {
+  VirtualFileSystem file_system;
+  auto device = std::make_unique<TestDevice>(4, 100);
+  REQUIRE(device->Initialize());
+  REQUIRE(file_system.RegisterDevice(std::move(device)));
+  REQUIRE(file_system.RegisterSymbolicLink("test:", kMountPath));
+
+  auto entry = file_system.ResolvePath(FilePath(1, 10));
+  REQUIRE(entry != nullptr);
+  REQUIRE(entry->name() == "File00010.bin");
+  REQUIRE(file_system.ResolvePath(FilePath(1, 10)) == entry);
+  REQUIRE(file_system.ResolvePath("test:\\directory1\\file00010.bin") ==
+          entry);
+
+  // Deleting must not leave a dangling entry in the cache.
+  REQUIRE(file_system.DeletePath(FilePath(1, 10)));
+  REQUIRE(file_system.ResolvePath(FilePath(1, 10)) == nullptr);
+  REQUIRE(file_system.ResolvePath("test:\\directory1\\file00010.bin") ==
+          nullptr);
+
+  auto created = file_system.CreatePath("test:\\Directory1\\File00010.bin",
+                                        kFileAttributeNormal);
+  REQUIRE(created != nullptr);
+  REQUIRE(file_system.ResolvePath(FilePath(1, 10)) == created);
+
+  // And the symbolic link targets may change.
+  REQUIRE(file_system.UnregisterSymbolicLink("test:"));
+  REQUIRE(file_system.ResolvePath("test:\\directory1\\file00010.bin") ==
+          nullptr);
+}
+
+TEST_CASE("VFS_LOOKUP_BENCHMARK", "[.benchmark]") {
+  constexpr uint32_t kDirectoryCount = 64;
+  constexpr uint32_t kFileCount = 1024;
+  constexpr uint32_t kLookupCount = 1000000;
+  VirtualFileSystem file_system;
+  auto device = std::make_unique<TestDevice>(kDirectoryCount, kFileCount);
+  REQUIRE(device->Initialize());
+  auto root_entry = device->root_entry();
+  REQUIRE(file_system.RegisterDevice(std::move(device)));
+
+  // Loading screens open a limited set of files over and over.
+  std::mt19937 random(0);
+  std::vector<std::string> paths;
+  std::vector<std::string> relative_paths;
+  for (uint32_t i = 0; i < 1024; ++i) {
+    uint32_t directory = random() % kDirectoryCount;
+    uint32_t file = random() % kFileCount;
+    paths.push_back(FilePath(directory, file));
+    relative_paths.push_back(
+        fmt::format("Directory{}\\File{:05}.bin", directory, file));
+  }
+
+  for (uint32_t test = 0; test < 2; ++test) {
+    testing::BenchmarkTimer timer;
+    for (uint32_t i = 0; i < kLookupCount; ++i) {
+      size_t path_index = i % paths.size();
+      Entry* entry = test ? root_entry->ResolvePath(relative_paths[path_index])
+                          : file_system.ResolvePath(paths[path_index]);
+      REQUIRE(entry != nullptr);
+    }
+    WARN((test ? "Entry::ResolvePath: " : "VirtualFileSystem::ResolvePath: ")
+         << kLookupCount / timer.seconds() / 1e6
+         << " million lookups per second");
+  }
+}
+
+}  // namespace test
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,173 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+
+#include "xenia/vfs/compressed_disc_image.h"
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
+#include "xenia/vfs/devices/disc_image_device.h"
+#include "xenia/vfs/file.h"
+
+namespace xe {
+namespace vfs {
+
+DEFINE_transient_path(source, "", "Specifies the disc image to compress.",
+                      "General");
+
+DEFINE_transient_path(target, "",
+                      "Specifies the compressed disc image to create.",
+                      "General");
+
+DEFINE_int32(block_size, CompressedDiscImage::kDefaultBlockSize,
+             "Size of the compressed blocks, a power of two.", "General");
+DEFINE_bool(deduplicate, true, "Store blocks with identical contents once.",
+            "General");
+DEFINE_bool(verify, true,
+            "Read back the whole compressed image and compare it to the "
+            "source.",
+            "General");
+
+double SecondsSince(uint64_t start_ticks) {
+  return double(Clock::QueryHostTickCount() - start_ticks) /
+         double(Clock::QueryHostTickFrequency());
+}
+
+// Mounts the image and reads every file on it once, like a cold launch
+// touching the whole disc.
+bool MountAndReadAll(Device* device, double* out_mount_seconds,
+                     double* out_read_seconds) {
+  uint64_t start = Clock::QueryHostTickCount();
+  if (!device->Initialize()) {
+    return false;
+  }
+  *out_mount_seconds = SecondsSince(start);
+
+  start = Clock::QueryHostTickCount();
+  std::vector<uint8_t> buffer(1024 * 1024);
+  std::queue<Entry*> queue;
+  queue.push(device->ResolvePath(""));
+  while (!queue.empty()) {
+    auto entry = queue.front();
+    queue.pop();
+    for (auto& child : entry->children()) {
+      queue.push(child.get());
+    }
+    if (entry->attributes() & kFileAttributeDirectory) {
+      continue;
+    }
+    File* file = nullptr;
+    if (entry->Open(FileAccess::kFileReadData, &file) != X_STATUS_SUCCESS) {
+      return false;
+    }
+    for (size_t offset = 0; offset < entry->size(); offset += buffer.size()) {
+      size_t bytes_read = 0;
+      if (file->ReadSync(buffer.data(), buffer.size(), offset, &bytes_read) !=
+          X_STATUS_SUCCESS) {
+        file->Destroy();
+        return false;
+      }
+    }
+    file->Destroy();
+  }
+  *out_read_seconds = SecondsSince(start);
+  return true;
+}
+
+bool Verify(const std::filesystem::path& source_path,
+            CompressedDiscImage* image) {
+  FILE* source = xe::filesystem::OpenFile(source_path, "rb");
+  if (!source) {
+    return false;
+  }
+  std::vector<uint8_t> expected(1024 * 1024);
+  std::vector<uint8_t> actual(expected.size());
+  bool matches = true;
+  for (uint64_t offset = 0; matches && offset < image->size();
+       offset += expected.size()) {
+    size_t length =
+        size_t(std::min(uint64_t(expected.size()), image->size() - offset));
+    matches = fread(expected.data(), 1, length, source) == length &&
+              image->Read(offset, actual.data(), length) &&
+              !std::memcmp(expected.data(), actual.data(), length);
+  }
+  fclose(source);
+  return matches;
+}
+
+int vfs_compress_main(const std::vector<std::string>& args) {
+  if (cvars::source.empty() || cvars::target.empty()) {
+    XELOGE("Usage: {} [source] [target]", xe::path_to_utf8(args[0]));
+    return 1;
+  }
+
+  CompressedDiscImage::CreateOptions options;
+  options.block_size = uint32_t(cvars::block_size);
+  options.deduplicate = cvars::deduplicate;
+  CompressedDiscImage::CreateStatistics statistics;
+  uint64_t start = Clock::QueryHostTickCount();
+  if (!CompressedDiscImage::Create(cvars::source, cvars::target, options,
+                                   &statistics)) {
+    XELOGE("Failed to compress the disc image");
+    return 1;
+  }
+  XELOGI("Compressed {} blocks in {:.2f} s", statistics.block_count,
+         SecondsSince(start));
+  XELOGI("  {} zero, {} duplicate, {} stored uncompressed",
+         statistics.zero_block_count, statistics.duplicate_block_count,
+         statistics.uncompressed_block_count);
+  XELOGI("Disc image: {} bytes, compressed: {} bytes ({:.1f}%)",
+         statistics.image_size, statistics.container_size,
+         statistics.image_size ? 100.0 * double(statistics.container_size) /
+                                     double(statistics.image_size)
+                               : 0.0);
+
+  // Cold-load comparison. The host file cache is likely to still contain
+  // the source image, so it favors the raw image.
+  double mount_seconds = 0.0;
+  double read_seconds = 0.0;
+  auto compressed_device = std::make_unique<CompressedDiscImageDevice>(
+      "", cvars::target, 64 * 1024 * 1024, 8);
+  if (!MountAndReadAll(compressed_device.get(), &mount_seconds,
+                       &read_seconds)) {
+    XELOGE("Failed to read the compressed disc image");
+    return 1;
+  }
+  auto image_statistics = compressed_device->image()->statistics();
+  XELOGI("Compressed: mounted in {:.3f} s, read in {:.3f} s, {} host reads",
+         mount_seconds, read_seconds, image_statistics.host_reads);
+  auto device = std::make_unique<DiscImageDevice>("", cvars::source);
+  if (MountAndReadAll(device.get(), &mount_seconds, &read_seconds)) {
+    XELOGI("Raw: mounted in {:.3f} s, read in {:.3f} s", mount_seconds,
+           read_seconds);
+  }
+
+  if (cvars::verify) {
+    if (!Verify(cvars::source, compressed_device->image())) {
+      XELOGE("The compressed disc image doesn't match the source");
+      return 1;
+    }
+    XELOGI("Verified");
+  }
+
+  return 0;
+}
+
+}  // namespace vfs
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-vfs-compress", xe::vfs::vfs_compress_main,
+                   "[source] [target]", "source", "target");
@@ -28,6 +28,7 @@ VirtualFileSystem::~VirtualFileSystem() {
 bool VirtualFileSystem::RegisterDevice(std::unique_ptr<Device> device) {
   auto global_lock = global_critical_region_.Acquire();
   devices_.emplace_back(std::move(device));
+  resolved_path_cache_.clear();
   return true;
 }
 
@@ -37,6 +38,7 @@ bool VirtualFileSystem::UnregisterDevice(const std::string_view path) {
     if ((*it)->mount_path() == path) {
       XELOGD("Unregistered device: {}", (*it)->mount_path());
       devices_.erase(it);
+      resolved_path_cache_.clear();
       return true;
     }
   }
@@ -47,6 +49,7 @@ bool VirtualFileSystem::RegisterSymbolicLink(const std::string_view path,
                                              const std::string_view target) {
   auto global_lock = global_critical_region_.Acquire();
   symlinks_.insert({std::string(path), std::string(target)});
+  resolved_path_cache_.clear();
   XELOGD("Registered symbolic link: {} => {}", path, target);
 
   return true;
@@ -63,6 +66,7 @@ bool VirtualFileSystem::UnregisterSymbolicLink(const std::string_view path) {
   XELOGD("Unregistered symbolic link: {} => {}", it->first, it->second);
 
   symlinks_.erase(it);
+  resolved_path_cache_.clear();
   return true;
 }
 
@@ -102,6 +106,29 @@ bool VirtualFileSystem::ResolveSymbolicLink(const std::string_view path,
 Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
   auto global_lock = global_critical_region_.Acquire();
 
+  uint64_t tree_generation = Entry::tree_generation();
+  if (resolved_path_cache_generation_ != tree_generation) {
+    resolved_path_cache_.clear();
+    resolved_path_cache_generation_ = tree_generation;
+  }
+  std::string cache_key(path);
+  auto cached = resolved_path_cache_.find(cache_key);
+  if (cached != resolved_path_cache_.end()) {
+    return cached->second;
+  }
+
+  Entry* entry = ResolvePathUncached(path);
+  // Failures aren't cached, so creating entries doesn't need to invalidate.
+  if (entry) {
+    if (resolved_path_cache_.size() >= kResolvedPathCacheSize) {
+      resolved_path_cache_.clear();
+    }
+    resolved_path_cache_.emplace(std::move(cache_key), entry);
+  }
+  return entry;
+}
+
+Entry* VirtualFileSystem::ResolvePathUncached(const std::string_view path) {
   // Resolve relative paths
   auto normalized_path(xe::utf8::canonicalize_guest_path(path));
 
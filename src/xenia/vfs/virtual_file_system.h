@@ -51,7 +51,15 @@ class VirtualFileSystem {
   std::vector<std::unique_ptr<Device>> devices_;
   std::unordered_map<std::string, std::string> symlinks_;
 
+  // Guest path -> entry, for paths opened over and over again. Cleared when
+  // full and whenever entries, devices or symbolic links change, as the
+  // resolved entries may be gone.
+  static const size_t kResolvedPathCacheSize = 4096;
+  std::unordered_map<std::string, Entry*> resolved_path_cache_;
+  uint64_t resolved_path_cache_generation_ = 0;
+
   bool ResolveSymbolicLink(const std::string_view path, std::string& result);
+  Entry* ResolvePathUncached(const std::string_view path);
 };
 
 }  // namespace vfs